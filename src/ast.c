@@ -1,27 +1,610 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "ast.h"
 
+/* Nodes are carved from slabs instead of being malloc'ed one by one,
+ * each taking the bytes its type needs (see Node in ast.h). Freed nodes
+ * are kept on free lists by size for the next parse, and once no node is
+ * live the slabs are returned (unless retain_node_slabs() asks to keep
+ * them), so a process that parses over and over stays at the size of its
+ * largest tree.
+ *
+ * Nodes link to each other by offsets: the index of the slab in
+ * node_slabs and the word in the slab. Slabs are aligned to their size,
+ * so the slab of a node, and with it the node's offset, is found from its
+ * address.
+ *
+ * Identifier names are interned: each distinct name is stored once with
+ * a reference count, shared by the scanner's tokens and all nodes that
+ * use it. Nodes hold the name's number in name_chunks.
+ *
+ * Nodes come from the calling thread's arena (see NodeArena in ast.h), so
+ * threads can build trees side by side in arenas of their own. The name
+ * table is not thread-safe.
+ */
+
+typedef struct Name {
+    struct Name* next;      // hash chain
+    size_t refs;
+    unsigned hash;
+    uint32_t id;            // in name_chunks
+    char text[];
+} Name;
+
+#define NAME_CHUNK_SIZE (1u << NAME_CHUNK_SHIFT)
+#define NAME_MAX_CHUNKS 4096
+
+uint32_t* node_slabs[NODE_MAX_SLABS];
+const char** name_chunks[NAME_MAX_CHUNKS];
+
+static pthread_mutex_t slab_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t slab_count = 0;              // indices ever handed out
+static uint32_t* free_slab_indices = NULL;
+static size_t free_slab_count = 0;
+static size_t free_slab_capacity = 0;
+
+static uint32_t name_count = 0;              // past the highest id handed out
+static uint32_t* free_name_ids = NULL;
+static size_t free_name_count = 0;
+static size_t free_name_capacity = 0;
+
+static NodeArena shared_arena = NODE_ARENA_INIT;
+static _Thread_local NodeArena* thread_arena = NULL;  // NULL: shared_arena
+static Name** name_table = NULL;
+static size_t name_buckets = 0;
+static bool keep_slabs = false;              // see retain_node_slabs
+static AstMemStats mem_stats;                // names; nodes are counted per arena
+
+// A block's table of shared expressions, open addressing by expr_hash()
+typedef struct ExprScope {
+    struct ExprScope* parent;
+    Node** slots;
+    size_t count;
+    size_t capacity;                         // a power of two, or 0
+} ExprScope;
+
+static _Thread_local bool sharing = false;           // see share_expressions
+static _Thread_local bool spanning = false;          // see record_node_spans
+static _Thread_local ExprScope* expr_scope = NULL;   // innermost open block
+
+static NodeArena* current_arena(void) {
+    return thread_arena ? thread_arena : &shared_arena;
+}
+
+// Size of a node in words, header and span included
+static size_t node_words(const Node* node) {
+    return 1 + node_field_words(node->type) + (node->flags & NODE_SPANNED ? 2 : 0);
+}
+
+// Push an index or id on a stack of free ones
+static bool push_free(uint32_t** stack, size_t* count, size_t* capacity, uint32_t value) {
+    if (*count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 64;
+        uint32_t* values = realloc(*stack, grown * sizeof(uint32_t));
+        if (!values) return false;
+        *stack = values;
+        *capacity = grown;
+    }
+    (*stack)[(*count)++] = value;
+    return true;
+}
+
+// Allocate a slab and give it an index in node_slabs; any thread may
+static NodeSlab* new_slab(void) {
+    NodeSlab* slab = aligned_alloc(NODE_SLAB_BYTES, NODE_SLAB_BYTES);
+    if (!slab) return NULL;
+    pthread_mutex_lock(&slab_lock);
+    if (free_slab_count > 0) {
+        slab->index = free_slab_indices[--free_slab_count];
+    } else if (slab_count < NODE_MAX_SLABS) {
+        slab->index = slab_count++;
+    } else {
+        pthread_mutex_unlock(&slab_lock);
+        free(slab);
+        return NULL;
+    }
+    node_slabs[slab->index] = (uint32_t*)slab;
+    pthread_mutex_unlock(&slab_lock);
+    return slab;
+}
+
+// Free a list of slabs, the nodes in them with them
+static void free_slabs(NodeSlab* slab) {
+    while (slab) {
+        NodeSlab* next = slab->next;
+        pthread_mutex_lock(&slab_lock);
+        node_slabs[slab->index] = NULL;
+        // Without room to remember the index it is not used again
+        push_free(&free_slab_indices, &free_slab_count, &free_slab_capacity, slab->index);
+        if (free_slab_count == slab_count) {
+            slab_count = 0;                  // all free: start over
+            free_slab_count = 0;
+            free(free_slab_indices);
+            free_slab_indices = NULL;
+            free_slab_capacity = 0;
+        }
+        pthread_mutex_unlock(&slab_lock);
+        free(slab);
+        slab = next;
+    }
+}
+
 // Function to create a new AST node
 Node* new_node(NodeType type) {
-    Node* node = (Node*)malloc(sizeof(Node));
-    node->type = type;
-    node->left = node->right = node->next = NULL;
+    NodeArena* arena = current_arena();
+    bool spanned = spanning && type != NODE_CONDITION && type != NODE_BINARY_OP;
+    size_t words = 1 + node_field_words(type) + (spanned ? 2 : 0);
+    Node* node = node_at(arena->free_nodes[words]);
+    if (node) {
+        arena->free_nodes[words] = node->word[0];
+    } else {
+        if (arena->slab_used + words > NODE_SLAB_WORDS) {
+            NodeSlab* slab = new_slab();
+            if (!slab) return NULL;
+            slab->next = arena->slabs;
+            arena->slabs = slab;
+            arena->slab_used = NODE_SLAB_HEADER_WORDS;
+            arena->stats.slabs++;
+            arena->stats.slab_bytes += NODE_SLAB_BYTES;
+        }
+        node = (Node*)((uint32_t*)arena->slabs + arena->slab_used);
+        arena->slab_used += words;
+    }
+
+    memset(node, 0, words * 4);
+    node->type = (uint8_t)type;
+    if (spanned) {
+        node->flags = NODE_SPANNED;
+        set_node_span(node, -1, -1);
+    }
+
+    AstMemStats* stats = &arena->stats;
+    stats->nodes_by_type[type]++;
+    if (++stats->nodes > stats->peak_nodes) stats->peak_nodes = stats->nodes;
+    stats->node_bytes += words * 4;
+    if (stats->node_bytes > stats->peak_node_bytes) stats->peak_node_bytes = stats->node_bytes;
     return node;
 }
 
 // Function to create a new identifier node
 Node* new_ident(const char* name) {
     Node* node = new_node(NODE_IDENT);
-    node->name = strdup(name);
+    set_node_name(node, intern_name(name, strlen(name)));
     return node;
 }
 
 // Function to create a new number node
 Node* new_number(int value) {
     Node* node = new_node(NODE_NUMBER);
-    node->value = value;
+    set_node_value(node, value);
     return node;
 }
 
+// Return all slabs of the shared arena; only valid while no node is live
+static void release_slabs(void) {
+    free_slabs(shared_arena.slabs);
+    shared_arena.slabs = NULL;
+    shared_arena.slab_used = NODE_SLAB_WORDS;
+    memset(shared_arena.free_nodes, 0, sizeof(shared_arena.free_nodes));
+    shared_arena.stats.slabs = 0;
+    shared_arena.stats.slab_bytes = 0;
+}
+
+// Function to free a single node and its reference to its name, but
+// not the nodes it links to
+void free_node(Node* node) {
+    NodeType type = (NodeType)node->type;
+    if (type == NODE_IDENT) release_name(node_name(node));
+    NodeArena* arena = current_arena();
+    size_t words = node_words(node);
+    arena->stats.nodes_by_type[type]--;
+    arena->stats.node_bytes -= words * 4;
+    node->word[0] = arena->free_nodes[words];
+    arena->free_nodes[words] = node_offset(node);
+
+    if (--arena->stats.nodes == 0 && arena == &shared_arena && !keep_slabs) release_slabs();
+}
+
+// Set whether the slabs are kept when the last node is freed. A
+// long-running process parsing one program after another keeps them, so
+// later parses reuse the memory warmed up by earlier ones.
+void retain_node_slabs(bool retain) {
+    keep_slabs = retain;
+    if (!retain && shared_arena.stats.nodes == 0) release_slabs();
+}
+
+// Set whether the calling thread's new nodes get room for a span (see
+// set_node_span); returns the setting before. Parses of a token buffer
+// turn it on
+bool record_node_spans(bool record) {
+    bool previous = spanning;
+    spanning = record;
+    return previous;
+}
+
+// Allocate the calling thread's nodes from arena (the shared arena if
+// NULL) from now on; returns the arena used before
+NodeArena* use_node_arena(NodeArena* arena) {
+    NodeArena* previous = thread_arena;
+    thread_arena = arena;
+    return previous;
+}
+
+// Move the slabs and nodes of arena into the shared arena, leaving arena
+// empty. The words the arena has not handed out yet become free nodes of
+// the largest size that fits
+void adopt_node_arena(NodeArena* arena) {
+    if (!arena->slabs) return;
+    uint32_t* rest = (uint32_t*)arena->slabs + arena->slab_used;
+    for (size_t left = NODE_SLAB_WORDS - arena->slab_used; left >= 2;) {
+        size_t words = left < NODE_MAX_WORDS ? left : NODE_MAX_WORDS;
+        Node* node = (Node*)rest;
+        node->word[0] = arena->free_nodes[words];
+        arena->free_nodes[words] = node_offset(node);
+        rest += words;
+        left -= words;
+    }
+
+    // The shared arena keeps handing out nodes from its first slab
+    NodeSlab* last_slab = arena->slabs;
+    while (last_slab->next) last_slab = last_slab->next;
+    if (shared_arena.slabs) {
+        last_slab->next = shared_arena.slabs->next;
+        shared_arena.slabs->next = arena->slabs;
+    } else {
+        shared_arena.slabs = arena->slabs;
+        shared_arena.slab_used = NODE_SLAB_WORDS;
+    }
+    for (size_t words = 2; words <= NODE_MAX_WORDS; words++) {
+        if (!arena->free_nodes[words]) continue;
+        Node* last_free = node_at(arena->free_nodes[words]);
+        while (last_free->word[0]) last_free = node_at(last_free->word[0]);
+        last_free->word[0] = shared_arena.free_nodes[words];
+        shared_arena.free_nodes[words] = arena->free_nodes[words];
+    }
+
+    AstMemStats* stats = &shared_arena.stats;
+    stats->nodes += arena->stats.nodes;
+    if (stats->nodes > stats->peak_nodes) stats->peak_nodes = stats->nodes;
+    stats->node_bytes += arena->stats.node_bytes;
+    if (stats->node_bytes > stats->peak_node_bytes) stats->peak_node_bytes = stats->node_bytes;
+    for (int type = 0; type <= NODE_ERROR; type++) {
+        stats->nodes_by_type[type] += arena->stats.nodes_by_type[type];
+    }
+    stats->slabs += arena->stats.slabs;
+    stats->slab_bytes += arena->stats.slab_bytes;
+    *arena = (NodeArena)NODE_ARENA_INIT;
+}
+
+// Free the slabs of arena, and with them every node built in it, without
+// visiting the nodes; their names are not released. For trees whose
+// nodes borrow their names (see free_borrowed_ast)
+void free_node_arena(NodeArena* arena) {
+    free_slabs(arena->slabs);
+    *arena = (NodeArena)NODE_ARENA_INIT;
+}
+
+// Free nodes of a quiet parse (descent.h), which hold no references to
+// their names
+void free_borrowed_ast(Node* node) {
+    for (Node* next; node; node = next) {
+        next = node_next(node);
+        if (node->type == NODE_IDENT) {
+            retain_name(node_name(node));
+        } else {
+            free_borrowed_ast(node_left(node));
+            free_borrowed_ast(node_right(node));
+        }
+        free_node(node);
+    }
+}
+
+// Function to free an AST. A node owns its left and right subtrees, the
+// nodes following it in its list and, for identifiers, a reference to its
+// name; decl links point into the same tree and are not followed. A
+// shared expression goes with the last of its owners.
+void free_ast(Node* node) {
+    while (node) {
+        Node* next = node_next(node);
+        if (node_has_refs(node) && node->refs > 1) {
+            node->refs--;  // a shared expression with other owners
+        } else {
+            if (node_has_children(node)) {
+                free_ast(node_left(node));
+                free_ast(node_right(node));
+            }
+            free_node(node);
+        }
+        node = next;
+    }
+}
+
+// Turn hash-consing of expressions on or off for the calling thread;
+// either way, tables left open by an aborted parse are dropped
+void share_expressions(bool share) {
+    while (expr_scope) leave_expr_scope();
+    sharing = share;
+}
+
+void enter_expr_scope(void) {
+    if (!sharing) return;
+    ExprScope* scope = calloc(1, sizeof(ExprScope));
+    if (!scope) return;  // the block's expressions go into the outer table
+    scope->parent = expr_scope;
+    expr_scope = scope;
+}
+
+// Drop the innermost table and its references to the expressions
+void leave_expr_scope(void) {
+    ExprScope* scope = expr_scope;
+    if (!scope) return;
+    expr_scope = scope->parent;
+    for (size_t i = 0; i < scope->capacity; i++) free_ast(scope->slots[i]);
+    free(scope->slots);
+    free(scope);
+}
+
+// The value of a number, the name id of an identifier (names are
+// interned), the operator of an operation
+static uint32_t expr_key(const Node* node) {
+    return node->type == NODE_BINARY_OP ? (uint32_t)node_op(node) : node->word[0];
+}
+
+// Only operators have children to compare
+static size_t expr_hash(const Node* node) {
+    uint64_t hash = (uint64_t)node->type;
+    hash = hash * 31 + expr_key(node);
+    if (node->type == NODE_BINARY_OP) {
+        hash = hash * 31 + node->word[0];
+        hash = hash * 31 + node->word[1];
+    }
+    return (size_t)((hash * 0x9E3779B97F4A7C15u) >> 32);
+}
+
+static bool same_expr(const Node* a, const Node* b) {
+    return a->type == b->type && expr_key(a) == expr_key(b) &&
+           (a->type != NODE_BINARY_OP ||
+            (a->word[0] == b->word[0] && a->word[1] == b->word[1]));
+}
+
+static bool grow_expr_scope(ExprScope* scope) {
+    size_t capacity = scope->capacity ? scope->capacity * 2 : 64;
+    Node** slots = calloc(capacity, sizeof(Node*));
+    if (!slots) return false;
+    for (size_t i = 0; i < scope->capacity; i++) {
+        Node* node = scope->slots[i];
+        if (!node) continue;
+        size_t j = expr_hash(node) & (capacity - 1);
+        while (slots[j]) j = (j + 1) & (capacity - 1);
+        slots[j] = node;
+    }
+    free(scope->slots);
+    scope->slots = slots;
+    scope->capacity = capacity;
+    return true;
+}
+
+// Share a new expression node, whose children have been shared before:
+// returns the identical node of the current block if there is one (and
+// frees node), otherwise node, now in the table. The caller owns one
+// reference to the result
+Node* share_expr(Node* node) {
+    ExprScope* scope = expr_scope;
+    if (!scope || !node || !node_has_refs(node)) return node;
+    // Operands may be missing after a syntax error
+    if (node->type == NODE_BINARY_OP && (!node->word[0] || !node->word[1])) return node;
+    if (2 * (scope->count + 1) > scope->capacity && !grow_expr_scope(scope)) return node;
+
+    size_t mask = scope->capacity - 1;
+    for (size_t i = expr_hash(node) & mask;; i = (i + 1) & mask) {
+        Node* entry = scope->slots[i];
+        if (!entry) {
+            scope->slots[i] = node;
+            scope->count++;
+            node->refs = 2;  // the table's and the caller's
+            return node;
+        }
+        if (same_expr(entry, node)) {
+            if (entry->refs == NODE_MAX_REFS) return node;  // left unshared
+            entry->refs++;
+            free_ast(node);
+            mem_stats.shared_exprs++;
+            return entry;
+        }
+    }
+}
+
+static unsigned hash_name(const char* text, size_t len) {
+    unsigned hash = 2166136261u;   // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool grow_name_table(void) {
+    size_t buckets = name_buckets ? name_buckets * 2 : 256;
+    Name** table = calloc(buckets, sizeof(Name*));
+    if (!table) return false;
+
+    for (size_t i = 0; i < name_buckets; i++) {
+        Name* name = name_table[i];
+        while (name) {
+            Name* next = name->next;
+            name->next = table[name->hash & (buckets - 1)];
+            table[name->hash & (buckets - 1)] = name;
+            name = next;
+        }
+    }
+    free(name_table);
+    name_table = table;
+    name_buckets = buckets;
+    return true;
+}
+
+// Give a new name its number in name_chunks
+static bool new_name_id(Name* name) {
+    uint32_t id;
+    if (free_name_count > 0) {
+        id = free_name_ids[--free_name_count];
+    } else {
+        id = name_count ? name_count : 1;
+        if (id >> NAME_CHUNK_SHIFT >= NAME_MAX_CHUNKS) return false;
+        const char*** chunk = &name_chunks[id >> NAME_CHUNK_SHIFT];
+        if (!*chunk && !(*chunk = malloc(NAME_CHUNK_SIZE * sizeof(const char*)))) return false;
+        name_count = id + 1;
+    }
+    name_chunks[id >> NAME_CHUNK_SHIFT][id & (NAME_CHUNK_SIZE - 1)] = name->text;
+    name->id = id;
+    return true;
+}
+
+// Return the shared copy of the first len bytes of text, adding a
+// reference that release_name() drops again. NULL when out of memory.
+const char* intern_name(const char* text, size_t len) {
+    unsigned hash = hash_name(text, len);
+    if (name_buckets > 0) {
+        for (Name* name = name_table[hash & (name_buckets - 1)]; name; name = name->next) {
+            if (name->hash == hash && strncmp(name->text, text, len) == 0 &&
+                name->text[len] == '\0') {
+                name->refs++;
+                mem_stats.name_refs++;
+                return name->text;
+            }
+        }
+    }
+
+    if (mem_stats.names >= name_buckets && !grow_name_table()) return NULL;
+    Name* name = malloc(sizeof(Name) + len + 1);
+    if (!name) return NULL;
+    if (!new_name_id(name)) {
+        free(name);
+        return NULL;
+    }
+    memcpy(name->text, text, len);
+    name->text[len] = '\0';
+    name->hash = hash;
+    name->refs = 1;
+
+    Name** bucket = &name_table[hash & (name_buckets - 1)];
+    name->next = *bucket;
+    *bucket = name;
+    mem_stats.names++;
+    mem_stats.name_bytes += sizeof(Name) + len + 1;
+    mem_stats.name_refs++;
+    return name->text;
+}
+
+// Add a reference to an interned name
+const char* retain_name(const char* text) {
+    add_name_refs(text, 1);
+    return text;
+}
+
+// Add refs references at once, for nodes built without taking them
+void add_name_refs(const char* text, size_t refs) {
+    if (!text) return;
+    Name* name = (Name*)(text - offsetof(Name, text));
+    name->refs += refs;
+    mem_stats.name_refs += refs;
+}
+
+void release_name(const char* text) {
+    if (!text) return;
+    Name* name = (Name*)(text - offsetof(Name, text));
+    mem_stats.name_refs--;
+    if (--name->refs > 0) return;
+
+    Name** link = &name_table[name->hash & (name_buckets - 1)];
+    while (*link != name) link = &(*link)->next;
+    *link = name->next;
+    mem_stats.names--;
+    mem_stats.name_bytes -= sizeof(Name) + strlen(name->text) + 1;
+    // Without room to remember the id it is not used again
+    push_free(&free_name_ids, &free_name_count, &free_name_capacity, name->id);
+    free(name);
+
+    if (mem_stats.names == 0) {
+        free(name_table);
+        name_table = NULL;
+        name_buckets = 0;
+        for (uint32_t chunk = 0; chunk < NAME_MAX_CHUNKS && name_chunks[chunk]; chunk++) {
+            free(name_chunks[chunk]);
+            name_chunks[chunk] = NULL;
+        }
+        free(free_name_ids);
+        free_name_ids = NULL;
+        free_name_count = free_name_capacity = 0;
+        name_count = 0;
+    }
+}
+
+// Point an identifier node at an interned name, without adding a
+// reference
+void set_node_name(Node* node, const char* text) {
+    node->word[0] = text ? ((const Name*)(text - offsetof(Name, text)))->id : 0;
+}
+
+void get_ast_mem_stats(AstMemStats* stats) {
+    *stats = shared_arena.stats;
+    stats->names = mem_stats.names;
+    stats->name_bytes = mem_stats.name_bytes;
+    stats->name_refs = mem_stats.name_refs;
+    stats->shared_exprs = mem_stats.shared_exprs;
+}
+
+// Report the memory held by ASTs right now
+void print_ast_mem_stats(FILE* out) {
+    AstMemStats stats;
+    get_ast_mem_stats(&stats);
+    size_t table_bytes = name_buckets * sizeof(Name*);
+    for (uint32_t chunk = 0; chunk < NAME_MAX_CHUNKS && name_chunks[chunk]; chunk++) {
+        table_bytes += NAME_CHUNK_SIZE * sizeof(const char*);
+    }
+    fprintf(out, "AST memory:\n");
+    fprintf(out, "  nodes   %10zu live, %zu peak, %zu bytes (%zu peak)\n",
+            stats.nodes, stats.peak_nodes, stats.node_bytes, stats.peak_node_bytes);
+    for (int type = 0; type <= NODE_ERROR; type++) {
+        if (stats.nodes_by_type[type] == 0) continue;
+        fprintf(out, "    %-12s %10zu\n", node_type_name((NodeType)type),
+                stats.nodes_by_type[type]);
+    }
+    if (stats.shared_exprs > 0) {
+        fprintf(out, "  shared  %10zu expressions reused an identical node\n", stats.shared_exprs);
+    }
+    fprintf(out, "  slabs   %10zu bytes in %zu slabs\n", stats.slab_bytes, stats.slabs);
+    fprintf(out, "  names   %10zu bytes for %zu distinct names, %zu references\n",
+            stats.name_bytes + table_bytes, stats.names, stats.name_refs);
+    fprintf(out, "  total   %10zu bytes\n",
+            stats.slab_bytes + stats.name_bytes + table_bytes);
+}
+
+// Function to get the lower case name of a node type; the JSON and
+// S-expression formats use these, so they must stay stable
+const char* node_type_name(NodeType type) {
+    switch (type) {
+        case NODE_PROGRAM:    return "program";
+        case NODE_BLOCK:      return "block";
+        case NODE_CONST_DECL: return "const_decl";
+        case NODE_VAR_DECL:   return "var_decl";
+        case NODE_PROC:       return "proc";
+        case NODE_ASSIGN:     return "assign";
+        case NODE_CALL:       return "call";
+        case NODE_INPUT:      return "input";
+        case NODE_OUTPUT:     return "output";
+        case NODE_COMPOUND:   return "compound";
+        case NODE_IF:         return "if";
+        case NODE_WHILE:      return "while";
+        case NODE_CONDITION:  return "condition";
+        case NODE_BINARY_OP:  return "binary_op";
+        case NODE_NUMBER:     return "number";
+        case NODE_IDENT:      return "ident";
+        case NODE_ERROR:      return "error";
+        default:              return "unknown";
+    }
+}
+
 // Helper function to convert OpType into a string
 const char* to_string(OpType op) {
     switch (op) {
@@ -62,22 +645,23 @@ void fprint_ast(FILE* out, Node* node, int depth) {
             fprintf(out, "Block\n");
             break;
         case NODE_CONST_DECL:
-            fprintf(out, "Const Declaration: %s = %d\n", node->left->name, node->right->value);
+            fprintf(out, "Const Declaration: %s = %d\n", node_name(node_left(node)),
+                    node_value(node_right(node)));
             break;
         case NODE_VAR_DECL:
-            fprintf(out, "Var Declaration: %s\n", node->left->name);
+            fprintf(out, "Var Declaration: %s\n", node_name(node_left(node)));
             break;
         case NODE_PROC:
-            fprintf(out, "Procedure Declaration: %s\n", node->left->name);
+            fprintf(out, "Procedure Declaration: %s\n", node_name(node_left(node)));
             break;
         case NODE_ASSIGN:
-            fprintf(out, "Assignment: %s :=\n", node->left->name);
+            fprintf(out, "Assignment: %s :=\n", node_name(node_left(node)));
             break;
         case NODE_CALL:
-            fprintf(out, "Procedure Call: %s\n", node->left->name);
+            fprintf(out, "Procedure Call: %s\n", node_name(node_left(node)));
             break;
         case NODE_INPUT:
-            fprintf(out, "Input: %s\n", node->left->name);
+            fprintf(out, "Input: %s\n", node_name(node_left(node)));
             break;
         case NODE_OUTPUT:
             fprintf(out, "Output\n");
@@ -92,33 +676,38 @@ void fprint_ast(FILE* out, Node* node, int depth) {
             fprintf(out, "While Loop\n");
             break;
         case NODE_CONDITION:
-            fprintf(out, "Condition: %s\n", to_string(node->op));
+            fprintf(out, "Condition: %s\n", to_string(node_op(node)));
             break;
         case NODE_BINARY_OP:
-            fprintf(out, "Binary Operation: %s\n", to_string(node->op));
+            fprintf(out, "Binary Operation: %s\n", to_string(node_op(node)));
             break;
         case NODE_NUMBER:
-            fprintf(out, "Number: %d\n", node->value);
+            fprintf(out, "Number: %d\n", node_value(node));
             break;
         case NODE_IDENT:
-            fprintf(out, "Identifier: %s\n", node->name);
+            fprintf(out, "Identifier: %s\n", node_name(node));
+            break;
+        case NODE_ERROR:
+            fprintf(out, "Syntax Error: line %d\n", node_line(node));
             break;
     }
 
     // Recursively print child nodes
-    fprint_ast(out, node->left, depth + 1);
-    fprint_ast(out, node->right, depth + 1);
+    if (node_has_children(node)) {
+        fprint_ast(out, node_left(node), depth + 1);
+        fprint_ast(out, node_right(node), depth + 1);
+    }
 
     // Print next node in list (if any)
-    fprint_ast(out, node->next, depth);
+    fprint_ast(out, node_next(node), depth);
 }
 
 // Helper function to reverse a linked list of nodes
 Node* reverse_list(Node* head) {
     Node *prev = NULL, *current = head, *next = NULL;
     while (current != NULL) {
-        next = current->next;
-        current->next = prev;
+        next = node_next(current);
+        set_node_next(current, prev);
         prev = current;
         current = next;
     }
@@ -128,8 +717,19 @@ Node* reverse_list(Node* head) {
 // Helper function to find the last node in a list
 Node* find_last_node(Node* head) {
     if (head == NULL) return NULL;
-    while (head->next != NULL) {
-        head = head->next;
+    while (node_next(head) != NULL) {
+        head = node_next(head);
     }
     return head;
 }
+
+// Helper function to find the statement of a block, which follows its
+// variable and procedure declarations in the block's right list
+Node* find_block_statement(Node* block) {
+    Node* node = block ? node_right(block) : NULL;
+    while (node && (node->type == NODE_VAR_DECL || node->type == NODE_PROC ||
+                    (node->type == NODE_ERROR && node_next(node)))) {
+        node = node_next(node);
+    }
+    return node;
+}
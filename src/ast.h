@@ -1,6 +1,8 @@
 #ifndef AST_H
 #define AST_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,7 +24,8 @@ typedef enum {
     NODE_CONDITION,
     NODE_BINARY_OP,
     NODE_NUMBER,
-    NODE_IDENT
+    NODE_IDENT,
+    NODE_ERROR          // Placeholder for input that failed to parse
 } NodeType;
 
 // AST operator types
@@ -40,25 +43,310 @@ typedef enum {
     OP_GTE
 } OpType;
 
-// AST node structure
+/* AST nodes are records of a size that depends on their type, carved from
+ * slabs (see ast.c). A node links to other nodes by 32-bit offsets into
+ * the slabs rather than by pointers, and has only the fields of its type:
+ *
+ *   statements, declarations, blocks, programs and errors (24 bytes):
+ *       left, right, next, line, slot
+ *   NODE_CONDITION (16 bytes): op, left, right, line
+ *   NODE_BINARY_OP (12 bytes): op, left, right, refs
+ *   NODE_IDENT (20 bytes): name, decl, slot, level, refs
+ *   NODE_NUMBER (8 bytes): value, refs
+ *
+ * Nodes other than conditions and operations that are built while
+ * record_node_spans() is on for the thread end in two more words: the
+ * first and last token of the buffer being parsed (cst.h) they were
+ * parsed from. Other nodes have no span and cost nothing for it.
+ *
+ * Only the first four bytes are a C struct; everything else is read and
+ * written through the node_...() and set_node_...() functions below, which
+ * convert offsets to node pointers and back. Getters return NULL or 0 for
+ * fields a node's type does not have; setters must not be called for
+ * them.
+ */
 typedef struct Node {
-    NodeType type;
-    struct Node *left;
-    struct Node *right;
-    struct Node *next;  // For lists of nodes
-    union {
-        int value;         // For numbers
-        char *name;        // For identifiers
-        OpType op;         // For operators
-    };
+    uint8_t type;       // NodeType
+    uint8_t flags;      // NODE_CONDITION, NODE_BINARY_OP: the OpType;
+                        // NODE_SPANNED if the node ends in a span
+    uint16_t refs;      // NODE_NUMBER, NODE_IDENT, NODE_BINARY_OP: owners
+                        // of an expression shared by share_expr(), the
+                        // scope's table included; 0 if not shared
+    uint32_t word[];    // the fields of the type, see above
 } Node;
 
+#define NODE_SPANNED 0x80
+
+// Offset of a node in the slabs, 0 for none
+typedef uint32_t NodeOffset;
+
+#define NODE_SLAB_BYTES 65536                   // slabs are aligned to their size
+#define NODE_SLAB_WORDS (NODE_SLAB_BYTES / 4)
+#define NODE_SLAB_SHIFT 14                      // log2 of NODE_SLAB_WORDS
+#define NODE_MAX_SLABS (1u << (32 - NODE_SLAB_SHIFT))
+#define NODE_MAX_REFS UINT16_MAX
+
+// A slab starts with this header; an offset is the slab's index in
+// node_slabs and the word of the node in the slab
+typedef struct NodeSlab {
+    struct NodeSlab* next;          // in its arena
+    uint32_t index;
+} NodeSlab;
+
+#define NODE_SLAB_HEADER_WORDS (sizeof(NodeSlab) / 4)
+
+extern uint32_t* node_slabs[NODE_MAX_SLABS];
+extern const char** name_chunks[];
+#define NAME_CHUNK_SHIFT 12
+
+static inline Node* node_at(NodeOffset offset) {
+    if (!offset) return NULL;
+    return (Node*)(node_slabs[offset >> NODE_SLAB_SHIFT] + (offset & (NODE_SLAB_WORDS - 1)));
+}
+
+static inline NodeOffset node_offset(const Node* node) {
+    if (!node) return 0;
+    uintptr_t slab = (uintptr_t)node & ~(uintptr_t)(NODE_SLAB_BYTES - 1);
+    NodeOffset word = (NodeOffset)(((uintptr_t)node - slab) / 4);
+    return ((const NodeSlab*)slab)->index << NODE_SLAB_SHIFT | word;
+}
+
+// Words of the fields of the nodes of a type, header and span excluded
+static inline size_t node_field_words(int type) {
+    switch (type) {
+        case NODE_CONDITION: return 3;
+        case NODE_BINARY_OP: return 2;
+        case NODE_NUMBER:    return 1;
+        case NODE_IDENT:     return 4;
+        default:             return 5;
+    }
+}
+
+// Whether a node has left and right children: not identifiers and numbers
+static inline bool node_has_children(const Node* node) {
+    return node->type != NODE_IDENT && node->type != NODE_NUMBER;
+}
+
+// Whether a node can be in a list: all but conditions and expressions
+static inline bool node_has_next(const Node* node) {
+    return node_has_children(node) && node->type != NODE_CONDITION &&
+           node->type != NODE_BINARY_OP;
+}
+
+// Whether nodes of a type can be shared by share_expr() and have refs
+static inline bool node_has_refs(const Node* node) {
+    return node->type == NODE_NUMBER || node->type == NODE_IDENT ||
+           node->type == NODE_BINARY_OP;
+}
+
+static inline Node* node_left(const Node* node) {
+    return node_has_children(node) ? node_at(node->word[0]) : NULL;
+}
+
+static inline Node* node_right(const Node* node) {
+    return node_has_children(node) ? node_at(node->word[1]) : NULL;
+}
+
+static inline Node* node_next(const Node* node) {
+    return node_has_next(node) ? node_at(node->word[2]) : NULL;
+}
+
+// Source line of statements, procedures, conditions and syntax errors, 0
+// if unknown
+static inline int node_line(const Node* node) {
+    if (node_has_next(node)) return (int)node->word[3];
+    return node->type == NODE_CONDITION ? (int)node->word[2] : 0;
+}
+
+static inline OpType node_op(const Node* node) {
+    return (OpType)(node->flags & ~NODE_SPANNED);
+}
+
+// NODE_NUMBER
+static inline int node_value(const Node* node) {
+    return node->type == NODE_NUMBER ? (int)node->word[0] : 0;
+}
+
+// NODE_IDENT: the interned name (see intern_name)
+static inline const char* node_name(const Node* node) {
+    uint32_t id = node->type == NODE_IDENT ? node->word[0] : 0;
+    return id ? name_chunks[id >> NAME_CHUNK_SHIFT][id & ((1u << NAME_CHUNK_SHIFT) - 1)] : NULL;
+}
+
+// NODE_IDENT: the declaring CONST_DECL, VAR_DECL or PROC node, filled in
+// by semantic analysis
+static inline Node* node_decl(const Node* node) {
+    return node->type == NODE_IDENT ? node_at(node->word[1]) : NULL;
+}
+
+// Filled in by semantic analysis. NODE_IDENT: frame slot of a variable,
+// NODE_BLOCK: frame size, NODE_PROC: procedure number, NODE_CALL: call
+// site number
+static inline int node_slot(const Node* node) {
+    if (node_has_next(node)) return (int)node->word[4];
+    return node->type == NODE_IDENT ? (int)node->word[2] : 0;
+}
+
+// NODE_IDENT: static links from the use to the declaring block
+static inline int node_level(const Node* node) {
+    return node->type == NODE_IDENT ? (int)node->word[3] : 0;
+}
+
+static inline int node_refs(const Node* node) {
+    return node->refs;
+}
+
+// The first and last token of the span, -1 for nodes without one
+static inline int node_first_token(const Node* node) {
+    return node->flags & NODE_SPANNED ? (int)node->word[node_field_words(node->type)] : -1;
+}
+
+static inline int node_last_token(const Node* node) {
+    return node->flags & NODE_SPANNED ? (int)node->word[node_field_words(node->type) + 1] : -1;
+}
+
+// Where a node keeps its left, right and next links, for code that links
+// lists through the field to fill in
+static inline NodeOffset* node_left_link(Node* node) {
+    return &node->word[0];
+}
+
+static inline NodeOffset* node_right_link(Node* node) {
+    return &node->word[1];
+}
+
+static inline NodeOffset* node_next_link(Node* node) {
+    return &node->word[2];
+}
+
+static inline void set_node_left(Node* node, const Node* left) {
+    node->word[0] = node_offset(left);
+}
+
+static inline void set_node_right(Node* node, const Node* right) {
+    node->word[1] = node_offset(right);
+}
+
+static inline void set_node_next(Node* node, const Node* next) {
+    node->word[2] = node_offset(next);
+}
+
+static inline void set_node_line(Node* node, int line) {
+    node->word[node->type == NODE_CONDITION ? 2 : 3] = (uint32_t)line;
+}
+
+static inline void set_node_op(Node* node, OpType op) {
+    node->flags = (uint8_t)((node->flags & NODE_SPANNED) | op);
+}
+
+static inline void set_node_value(Node* node, int value) {
+    node->word[0] = (uint32_t)value;
+}
+
+static inline void set_node_decl(Node* node, const Node* decl) {
+    node->word[1] = node_offset(decl);
+}
+
+static inline void set_node_slot(Node* node, int slot) {
+    node->word[node->type == NODE_IDENT ? 2 : 4] = (uint32_t)slot;
+}
+
+static inline void set_node_level(Node* node, int level) {
+    node->word[3] = (uint32_t)level;
+}
+
+static inline void set_node_refs(Node* node, int refs) {
+    node->refs = (uint16_t)refs;
+}
+
+// Record that a node was parsed from tokens first..last; nothing for
+// nodes built without room for a span
+static inline void set_node_span(Node* node, int first, int last) {
+    if (!(node->flags & NODE_SPANNED)) return;
+    node->word[node_field_words(node->type)] = (uint32_t)first;
+    node->word[node_field_words(node->type) + 1] = (uint32_t)last;
+}
+
+void set_node_name(Node* node, const char* name);
+
+// Memory held by ASTs, for --mem-stats
+typedef struct {
+    size_t nodes;                   // live nodes
+    size_t peak_nodes;
+    size_t nodes_by_type[NODE_ERROR + 1];
+    size_t node_bytes;              // held by live nodes
+    size_t peak_node_bytes;
+    size_t slabs;                   // node slabs currently allocated
+    size_t slab_bytes;
+    size_t names;                   // distinct interned names
+    size_t name_bytes;              // including their headers
+    size_t name_refs;               // identifier nodes and tokens sharing them
+    size_t shared_exprs;            // expressions share_expr() replaced by
+                                    // an identical one
+} AstMemStats;
+
+// Largest node in words: a statement with its span
+#define NODE_MAX_WORDS 8
+
+// Where new_node() takes nodes from and free_node() returns them to: a
+// thread's own arena while use_node_arena() has installed one, the shared
+// arena otherwise. A worker thread builds a tree in its own arena, which
+// the thread that takes over the tree then merges with adopt_node_arena()
+typedef struct NodeArena {
+    NodeSlab* slabs;
+    size_t slab_used;               // words handed out from the first slab
+    NodeOffset free_nodes[NODE_MAX_WORDS + 1];  // by size, linked through
+                                                // their first field
+    AstMemStats stats;              // nodes and slabs, no names
+} NodeArena;
+
+#define NODE_ARENA_INIT { NULL, NODE_SLAB_WORDS, { 0 }, { 0 } }
+
+/* Hash-consing of expressions (--hash-cons). While share_expressions()
+ * is on for the calling thread, the parsers pass every NODE_NUMBER,
+ * NODE_IDENT and NODE_BINARY_OP of an expression through share_expr(),
+ * which returns an identical node built earlier in the same block if
+ * there is one, and frees the new node. The children of an expression
+ * are shared before it, so identical subtrees are found by comparing the
+ * node and its child offsets. Expressions have no side effects and the
+ * names of a block's statements all resolve in the block's scope, so a
+ * shared node stands for every place it is used; later phases see a DAG
+ * and may compute results per node.
+ *
+ * A shared node counts its owners in refs, and free_ast() only frees it
+ * with its last owner; one with NODE_MAX_REFS owners is not shared again.
+ * Each block has a table of its own, opened with enter_expr_scope() once
+ * its declarations are parsed and dropped with leave_expr_scope() at its
+ * end. Shared nodes keep the span of their first use, so pl0fmt does not
+ * share expressions.
+ */
+
 // Function prototypes
 Node* new_node(NodeType type);
 Node* new_ident(const char* name);
 Node* new_number(int value);
+void free_node(Node* node);
+void free_ast(Node* node);
+void free_borrowed_ast(Node* node);
+void retain_node_slabs(bool retain);
+bool record_node_spans(bool record);
+NodeArena* use_node_arena(NodeArena* arena);
+void adopt_node_arena(NodeArena* arena);
+void free_node_arena(NodeArena* arena);
+const char* intern_name(const char* text, size_t len);
+const char* retain_name(const char* name);
+void add_name_refs(const char* name, size_t refs);
+void release_name(const char* name);
+void share_expressions(bool share);
+void enter_expr_scope(void);
+void leave_expr_scope(void);
+Node* share_expr(Node* node);
+void get_ast_mem_stats(AstMemStats* stats);
+void print_ast_mem_stats(FILE* out);
 const char* to_string(OpType op);
+const char* node_type_name(NodeType type);
 void print_ast(Node* node, int depth);
 void fprint_ast(FILE* out, Node* node, int depth);
+Node* find_block_statement(Node* block);
 
 #endif // AST_H
@@ -0,0 +1,465 @@
+#include <stdint.h>
+#include "ast_emit.h"
+#include "bufio.h"
+
+/* All emitters walk the tree with an explicit stack instead of recursion.
+ * A list (a node and its `next` chain) occupies a single stack entry that
+ * is advanced in place, so the stack grows with the nesting depth of the
+ * program and not with the length of its declaration or statement lists.
+ */
+
+AstFormat ast_format_from_string(const char* name) {
+    if (strcmp(name, "json") == 0) return AST_FORMAT_JSON;
+    if (strcmp(name, "sexpr") == 0) return AST_FORMAT_SEXPR;
+    if (strcmp(name, "bin") == 0) return AST_FORMAT_BINARY;
+    return AST_FORMAT_NONE;
+}
+
+// Growable stack shared by the emitters and the binary reader
+typedef struct {
+    void** items;
+    unsigned char* stages;
+    size_t size;
+    size_t capacity;
+} WalkStack;
+
+static bool stack_push(WalkStack* s, void* item, unsigned char stage) {
+    if (s->size == s->capacity) {
+        size_t capacity = s->capacity ? s->capacity * 2 : 64;
+        void** items = realloc(s->items, capacity * sizeof(*items));
+        if (!items) return false;
+        s->items = items;
+        unsigned char* stages = realloc(s->stages, capacity);
+        if (!stages) return false;
+        s->stages = stages;
+        s->capacity = capacity;
+    }
+    s->items[s->size] = item;
+    s->stages[s->size] = stage;
+    s->size++;
+    return true;
+}
+
+static void stack_free(WalkStack* s) {
+    free(s->items);
+    free(s->stages);
+}
+
+// ---------------------------------------------------------------------------
+// Text formats (JSON and S-expressions)
+// ---------------------------------------------------------------------------
+
+enum {
+    STAGE_OPEN,        // node not written yet
+    STAGE_LEFT_DONE,   // left list written, close its slot
+    STAGE_RIGHT,       // continue with the right list
+    STAGE_RIGHT_DONE,  // right list written, close its slot
+    STAGE_CLOSE        // close the node and move along its list
+};
+
+typedef struct {
+    void (*open_node)(BufWriter* w, const Node* node);
+    void (*open_slot)(BufWriter* w, const char* slot);
+    void (*close_slot)(BufWriter* w);
+    void (*close_node)(BufWriter* w);
+    const char* separator;    // between elements of a list
+    const char* list_open;    // around a top level list of several nodes
+    const char* list_close;
+} TextFormat;
+
+static void json_put_string(BufWriter* w, const char* s) {
+    static const char hex[] = "0123456789abcdef";
+    bufwriter_putc(w, '"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            bufwriter_putc(w, '\\');
+            bufwriter_putc(w, (char)c);
+        } else if (c < 0x20) {
+            bufwriter_puts(w, "\\u00");
+            bufwriter_putc(w, hex[c >> 4]);
+            bufwriter_putc(w, hex[c & 0xf]);
+        } else {
+            bufwriter_putc(w, (char)c);
+        }
+    }
+    bufwriter_putc(w, '"');
+}
+
+static void json_open_node(BufWriter* w, const Node* node) {
+    bufwriter_puts(w, "{\"type\":\"");
+    bufwriter_puts(w, node_type_name(node->type));
+    bufwriter_putc(w, '"');
+    switch (node->type) {
+        case NODE_NUMBER:
+            bufwriter_puts(w, ",\"value\":");
+            bufwriter_put_int(w, node_value(node));
+            break;
+        case NODE_IDENT:
+            bufwriter_puts(w, ",\"name\":");
+            json_put_string(w, node_name(node));
+            break;
+        case NODE_CONDITION:
+        case NODE_BINARY_OP:
+            bufwriter_puts(w, ",\"op\":\"");
+            bufwriter_puts(w, to_string(node_op(node)));
+            bufwriter_putc(w, '"');
+            break;
+        case NODE_ERROR:
+            bufwriter_puts(w, ",\"line\":");
+            bufwriter_put_int(w, node_line(node));
+            break;
+        default:
+            break;
+    }
+}
+
+static void json_open_slot(BufWriter* w, const char* slot) {
+    bufwriter_puts(w, ",\"");
+    bufwriter_puts(w, slot);
+    bufwriter_puts(w, "\":[");
+}
+
+static void json_close_slot(BufWriter* w) {
+    bufwriter_putc(w, ']');
+}
+
+static void json_close_node(BufWriter* w) {
+    bufwriter_putc(w, '}');
+}
+
+static void sexpr_open_node(BufWriter* w, const Node* node) {
+    bufwriter_putc(w, '(');
+    bufwriter_puts(w, node_type_name(node->type));
+    switch (node->type) {
+        case NODE_NUMBER:
+            bufwriter_putc(w, ' ');
+            bufwriter_put_int(w, node_value(node));
+            break;
+        case NODE_IDENT:
+            bufwriter_putc(w, ' ');
+            json_put_string(w, node_name(node));
+            break;
+        case NODE_CONDITION:
+        case NODE_BINARY_OP:
+            bufwriter_putc(w, ' ');
+            bufwriter_puts(w, to_string(node_op(node)));
+            break;
+        case NODE_ERROR:
+            bufwriter_putc(w, ' ');
+            bufwriter_put_int(w, node_line(node));
+            break;
+        default:
+            break;
+    }
+}
+
+static void sexpr_open_slot(BufWriter* w, const char* slot) {
+    bufwriter_puts(w, " (:");
+    bufwriter_puts(w, slot);
+    bufwriter_putc(w, ' ');
+}
+
+static void sexpr_close(BufWriter* w) {
+    bufwriter_putc(w, ')');
+}
+
+static const TextFormat json_format = {
+    json_open_node, json_open_slot, json_close_slot, json_close_node,
+    ",", "[", "]"
+};
+
+static const TextFormat sexpr_format = {
+    sexpr_open_node, sexpr_open_slot, sexpr_close, sexpr_close,
+    " ", "", ""
+};
+
+static bool emit_text(BufWriter* w, Node* root, const TextFormat* fmt) {
+    WalkStack stack = {0};
+    bool wrap = node_next(root) != NULL;
+
+    if (wrap) bufwriter_puts(w, fmt->list_open);
+    if (!stack_push(&stack, root, STAGE_OPEN)) return false;
+
+    while (stack.size > 0) {
+        size_t top = stack.size - 1;
+        Node* node = stack.items[top];
+
+        switch (stack.stages[top]) {
+            case STAGE_OPEN:
+                fmt->open_node(w, node);
+                if (node_has_children(node) && node_left(node)) {
+                    fmt->open_slot(w, "left");
+                    stack.stages[top] = STAGE_LEFT_DONE;
+                    if (!stack_push(&stack, node_left(node), STAGE_OPEN)) goto oom;
+                } else {
+                    stack.stages[top] = STAGE_RIGHT;
+                }
+                break;
+
+            case STAGE_LEFT_DONE:
+                fmt->close_slot(w);
+                stack.stages[top] = STAGE_RIGHT;
+                break;
+
+            case STAGE_RIGHT:
+                if (node_has_children(node) && node_right(node)) {
+                    fmt->open_slot(w, "right");
+                    stack.stages[top] = STAGE_RIGHT_DONE;
+                    if (!stack_push(&stack, node_right(node), STAGE_OPEN)) goto oom;
+                } else {
+                    stack.stages[top] = STAGE_CLOSE;
+                }
+                break;
+
+            case STAGE_RIGHT_DONE:
+                fmt->close_slot(w);
+                stack.stages[top] = STAGE_CLOSE;
+                break;
+
+            case STAGE_CLOSE:
+                fmt->close_node(w);
+                if (node_next(node)) {
+                    // Reuse the entry for the next element of the list
+                    bufwriter_puts(w, fmt->separator);
+                    stack.items[top] = node_next(node);
+                    stack.stages[top] = STAGE_OPEN;
+                } else {
+                    stack.size--;
+                }
+                break;
+        }
+    }
+
+    if (wrap) bufwriter_puts(w, fmt->list_close);
+    bufwriter_putc(w, '\n');
+    stack_free(&stack);
+    return true;
+
+oom:
+    stack_free(&stack);
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// Binary format
+//
+//   header:  "PL0AST" followed by one version byte
+//   node:    u8 type, u8 flags, payload
+//            flags: 1 = has left, 2 = has right, 4 = has next
+//            payload: NODE_NUMBER             int32 value, little endian
+//                     NODE_ERROR              int32 line, little endian
+//                     NODE_IDENT              LEB128 length, name bytes
+//                     NODE_CONDITION/BINARY_OP u8 operator
+//
+// Nodes are written in pre-order: a node, its left list, its right list,
+// then the rest of its own list.
+// ---------------------------------------------------------------------------
+
+enum {
+    BIN_HAS_LEFT  = 1,
+    BIN_HAS_RIGHT = 2,
+    BIN_HAS_NEXT  = 4
+};
+
+static void bin_put_int32(BufWriter* w, int value) {
+    uint32_t v = (uint32_t)value;
+    unsigned char bytes[4] = {
+        (unsigned char)v, (unsigned char)(v >> 8),
+        (unsigned char)(v >> 16), (unsigned char)(v >> 24)
+    };
+    bufwriter_write(w, bytes, sizeof(bytes));
+}
+
+static int bin_get_int32(const unsigned char* p) {
+    return (int)((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                 (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+static void bin_put_node(BufWriter* w, const Node* node) {
+    unsigned char header[2];
+    bool children = node_has_children(node);
+    header[0] = (unsigned char)node->type;
+    header[1] = (unsigned char)((children && node_left(node) ? BIN_HAS_LEFT : 0) |
+                                (children && node_right(node) ? BIN_HAS_RIGHT : 0) |
+                                (node_next(node) ? BIN_HAS_NEXT : 0));
+    bufwriter_write(w, header, sizeof(header));
+
+    switch (node->type) {
+        case NODE_NUMBER:
+            bin_put_int32(w, node_value(node));
+            break;
+        case NODE_ERROR:
+            bin_put_int32(w, node_line(node));
+            break;
+        case NODE_IDENT: {
+            size_t len = strlen(node_name(node));
+            size_t n = len;
+            do {
+                unsigned char byte = n & 0x7f;
+                n >>= 7;
+                bufwriter_putc(w, (char)(n ? byte | 0x80 : byte));
+            } while (n);
+            bufwriter_write(w, node_name(node), len);
+            break;
+        }
+        case NODE_CONDITION:
+        case NODE_BINARY_OP:
+            bufwriter_putc(w, (char)node_op(node));
+            break;
+        default:
+            break;
+    }
+}
+
+static bool emit_binary(BufWriter* w, Node* root) {
+    WalkStack stack = {0};
+
+    bufwriter_puts(w, AST_BINARY_MAGIC);
+    bufwriter_putc(w, AST_BINARY_VERSION);
+
+    if (!stack_push(&stack, root, 0)) return false;
+    while (stack.size > 0) {
+        Node* node = stack.items[--stack.size];
+        bin_put_node(w, node);
+
+        // Pushed in reverse so that left is written first; `next` stays
+        // below the children and is picked up once they are done
+        bool children = node_has_children(node);
+        if ((node_next(node) && !stack_push(&stack, node_next(node), 0)) ||
+            (children && node_right(node) && !stack_push(&stack, node_right(node), 0)) ||
+            (children && node_left(node) && !stack_push(&stack, node_left(node), 0))) {
+            stack_free(&stack);
+            return false;
+        }
+    }
+
+    stack_free(&stack);
+    return true;
+}
+
+bool emit_ast(FILE* out, Node* root, AstFormat format) {
+    if (!root || format == AST_FORMAT_NONE) return true;
+
+    BufWriter* w = malloc(sizeof(BufWriter));
+    if (!w) return false;
+    bufwriter_init(w, out);
+
+    bool success;
+    switch (format) {
+        case AST_FORMAT_JSON:
+            success = emit_text(w, root, &json_format);
+            break;
+        case AST_FORMAT_SEXPR:
+            success = emit_text(w, root, &sexpr_format);
+            break;
+        case AST_FORMAT_BINARY:
+            success = emit_binary(w, root);
+            break;
+        default:
+            success = false;
+            break;
+    }
+
+    success = bufwriter_flush(w) && success;
+    free(w);
+    return success;
+}
+
+// Free a partially decoded tree
+static void free_decoded(WalkStack* stack, Node* root) {
+    stack->size = 0;
+    if (root && !stack_push(stack, root, 0)) return;
+    while (stack->size > 0) {
+        Node* node = stack->items[--stack->size];
+        bool children = node_has_children(node);
+        if ((node_next(node) && !stack_push(stack, node_next(node), 0)) ||
+            (children && node_right(node) && !stack_push(stack, node_right(node), 0)) ||
+            (children && node_left(node) && !stack_push(stack, node_left(node), 0))) {
+            return;
+        }
+        free_node(node);
+    }
+}
+
+// Decode a tree written by emit_ast(..., AST_FORMAT_BINARY)
+Node* read_ast_binary(const unsigned char* data, size_t size) {
+    size_t magic_len = strlen(AST_BINARY_MAGIC);
+    if (size < magic_len + 1 || memcmp(data, AST_BINARY_MAGIC, magic_len) != 0 ||
+        data[magic_len] != AST_BINARY_VERSION) {
+        return NULL;
+    }
+
+    const unsigned char* p = data + magic_len + 1;
+    const unsigned char* end = data + size;
+    WalkStack stack = {0};
+    NodeOffset root = 0;
+
+    // The stack holds the link fields still waiting for a node
+    if (!stack_push(&stack, &root, 0)) return NULL;
+    while (stack.size > 0) {
+        NodeOffset* slot = stack.items[--stack.size];
+        if (end - p < 2 || p[0] > NODE_ERROR) goto fail;
+
+        Node* node = new_node((NodeType)p[0]);
+        if (!node) goto fail;
+        unsigned char flags = p[1];
+        p += 2;
+        *slot = node_offset(node);
+
+        switch (node->type) {
+            case NODE_NUMBER:
+                if (end - p < 4) goto fail;
+                set_node_value(node, bin_get_int32(p));
+                p += 4;
+                break;
+            case NODE_ERROR:
+                if (end - p < 4) goto fail;
+                set_node_line(node, bin_get_int32(p));
+                p += 4;
+                break;
+            case NODE_IDENT: {
+                size_t len = 0;
+                int shift = 0;
+                set_node_name(node, NULL);
+                do {
+                    if (p == end || shift > 28) goto fail;
+                    len |= (size_t)(*p & 0x7f) << shift;
+                    shift += 7;
+                } while (*p++ & 0x80);
+                if ((size_t)(end - p) < len) goto fail;
+                set_node_name(node, intern_name((const char*)p, len));
+                if (!node_name(node)) goto fail;
+                p += len;
+                break;
+            }
+            case NODE_CONDITION:
+            case NODE_BINARY_OP:
+                if (p == end || *p > OP_GTE) goto fail;
+                set_node_op(node, (OpType)*p++);
+                break;
+            default:
+                break;
+        }
+
+        // Nodes only have room for the links of their type
+        if (((flags & BIN_HAS_NEXT) && !node_has_next(node)) ||
+            ((flags & (BIN_HAS_LEFT | BIN_HAS_RIGHT)) && !node_has_children(node))) {
+            goto fail;
+        }
+        if (((flags & BIN_HAS_NEXT) && !stack_push(&stack, node_next_link(node), 0)) ||
+            ((flags & BIN_HAS_RIGHT) && !stack_push(&stack, node_right_link(node), 0)) ||
+            ((flags & BIN_HAS_LEFT) && !stack_push(&stack, node_left_link(node), 0))) {
+            goto fail;
+        }
+    }
+
+    if (p != end) goto fail;
+    stack_free(&stack);
+    return node_at(root);
+
+fail:
+    free_decoded(&stack, node_at(root));
+    stack_free(&stack);
+    return NULL;
+}
@@ -0,0 +1,25 @@
+#ifndef AST_EMIT_H
+#define AST_EMIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "ast.h"
+
+// Machine-readable AST output formats (--emit-ast=...)
+typedef enum {
+    AST_FORMAT_NONE,
+    AST_FORMAT_JSON,     // nested objects, child lists as arrays
+    AST_FORMAT_SEXPR,    // (kind payload (:left ...) (:right ...))
+    AST_FORMAT_BINARY    // compact pre-order records, see ast_emit.c
+} AstFormat;
+
+// Header written at the start of every binary AST
+#define AST_BINARY_MAGIC   "PL0AST"
+#define AST_BINARY_VERSION 1
+
+// AST emitter function declarations
+AstFormat ast_format_from_string(const char* name);
+bool emit_ast(FILE* out, Node* root, AstFormat format);
+Node* read_ast_binary(const unsigned char* data, size_t size);
+
+#endif // AST_EMIT_H
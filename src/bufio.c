@@ -0,0 +1,131 @@
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include "bufio.h"
+
+void bufreader_init(BufReader* r, FILE* in) {
+    r->in = in;
+    r->pos = r->len = 0;
+    r->eof = false;
+}
+
+// Make at least one unread byte available, return false at end of input
+static bool bufreader_fill(BufReader* r) {
+    if (r->pos < r->len) return true;
+    if (r->eof) return false;
+    r->pos = 0;
+
+    // Read from the descriptor where there is one: a terminal or pipe then
+    // returns what is available instead of blocking until the buffer is full
+    int fd = fileno(r->in);
+    if (fd >= 0) {
+        ssize_t n;
+        do {
+            n = read(fd, r->buf, BUFREADER_SIZE);
+        } while (n < 0 && errno == EINTR);
+        r->len = n > 0 ? (size_t)n : 0;
+        if (n <= 0) r->eof = true;
+    } else {
+        r->len = fread(r->buf, 1, BUFREADER_SIZE, r->in);
+        if (r->len < BUFREADER_SIZE) r->eof = true;
+    }
+    return r->len > 0;
+}
+
+// Parse the next whitespace separated decimal integer without scanf
+ReadStatus bufreader_read_int(BufReader* r, long long* value) {
+    // Skip white space
+    for (;;) {
+        if (!bufreader_fill(r)) return READ_EOF;
+        char c = r->buf[r->pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') break;
+        r->pos++;
+    }
+
+    bool negative = false;
+    char sign = r->buf[r->pos];
+    if (sign == '-' || sign == '+') {
+        negative = sign == '-';
+        r->pos++;
+    }
+
+    // Accumulate as a negative number so that LLONG_MIN is representable
+    long long result = 0;
+    int digits = 0;
+    bool overflow = false;
+    while (bufreader_fill(r)) {
+        unsigned digit = (unsigned char)r->buf[r->pos] - '0';
+        if (digit > 9) break;
+        if (result < (LLONG_MIN + (long long)digit) / 10) overflow = true;
+        else result = result * 10 - (long long)digit;
+        digits++;
+        r->pos++;
+    }
+
+    if (digits == 0) return READ_INVALID;
+    if (bufreader_fill(r)) {
+        char c = r->buf[r->pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') return READ_INVALID;
+    }
+    if (overflow || (!negative && result == LLONG_MIN)) return READ_RANGE;
+
+    *value = negative ? result : -result;
+    return READ_OK;
+}
+
+void bufwriter_init(BufWriter* w, FILE* out) {
+    w->out = out;
+    w->len = 0;
+    w->error = false;
+}
+
+// Hand the buffered bytes to the underlying FILE
+bool bufwriter_flush(BufWriter* w) {
+    if (w->len > 0 && !w->error) {
+        if (fwrite(w->buf, 1, w->len, w->out) != w->len) {
+            w->error = true;
+        }
+    }
+    w->len = 0;
+    return !w->error;
+}
+
+void bufwriter_write(BufWriter* w, const void* data, size_t size) {
+    const char* p = data;
+
+    // Large blocks bypass the buffer once it has been drained
+    if (size >= BUFWRITER_SIZE) {
+        bufwriter_flush(w);
+        if (!w->error && fwrite(p, 1, size, w->out) != size) {
+            w->error = true;
+        }
+        return;
+    }
+
+    if (w->len + size > BUFWRITER_SIZE) bufwriter_flush(w);
+    memcpy(w->buf + w->len, p, size);
+    w->len += size;
+}
+
+void bufwriter_puts(BufWriter* w, const char* s) {
+    bufwriter_write(w, s, strlen(s));
+}
+
+// Format a decimal integer without going through printf
+void bufwriter_put_int(BufWriter* w, long long value) {
+    char digits[24];
+    int n = 0;
+    unsigned long long u = value < 0 ? 0ULL - (unsigned long long)value
+                                     : (unsigned long long)value;
+    do {
+        digits[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+    if (value < 0) digits[n++] = '-';
+
+    if (w->len + (size_t)n > BUFWRITER_SIZE) bufwriter_flush(w);
+    while (n > 0) {
+        w->buf[w->len++] = digits[--n];
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef BUFIO_H
+#define BUFIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Size of the buffer behind a BufWriter; output reaches the FILE in
+// chunks of this size, so no stdio call is made per item written
+#define BUFWRITER_SIZE (1024 * 1024)
+
+// Size of the buffer behind a BufReader, filled with one read at a time
+#define BUFREADER_SIZE (1024 * 1024)
+
+typedef struct {
+    FILE* out;
+    size_t len;
+    bool error;                 // set once a flush to `out` fails
+    char buf[BUFWRITER_SIZE];
+} BufWriter;
+
+typedef struct {
+    FILE* in;
+    size_t pos;
+    size_t len;
+    bool eof;                   // no more data after buf[len]
+    char buf[BUFREADER_SIZE];
+} BufReader;
+
+// Result of reading an integer from a BufReader
+typedef enum {
+    READ_OK,
+    READ_EOF,        // only whitespace left
+    READ_INVALID,    // next item is not an integer
+    READ_RANGE       // integer does not fit into a long long
+} ReadStatus;
+
+// Buffered reader function declarations
+void bufreader_init(BufReader* r, FILE* in);
+ReadStatus bufreader_read_int(BufReader* r, long long* value);
+
+static inline bool bufreader_available(const BufReader* r) {
+    return r->pos < r->len;
+}
+
+// Buffered writer function declarations
+void bufwriter_init(BufWriter* w, FILE* out);
+bool bufwriter_flush(BufWriter* w);
+void bufwriter_write(BufWriter* w, const void* data, size_t size);
+void bufwriter_puts(BufWriter* w, const char* s);
+void bufwriter_put_int(BufWriter* w, long long value);
+
+static inline void bufwriter_putc(BufWriter* w, char c) {
+    if (w->len == BUFWRITER_SIZE) bufwriter_flush(w);
+    w->buf[w->len++] = c;
+}
+
+#endif // BUFIO_H
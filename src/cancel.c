@@ -0,0 +1,66 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include "cancel.h"
+
+struct CancelToken {
+    atomic_int reason;       // CancelReason
+    uint64_t deadline_ns;    // CLOCK_MONOTONIC, 0 for none
+};
+
+CancelToken* analysis_cancel = NULL;
+
+// Polls of the calling thread since it last read the clock
+static _Thread_local unsigned polls = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// A token that expires timeout_ms milliseconds from now, or only when
+// cancelled if timeout_ms is 0; NULL when out of memory
+CancelToken* create_cancel_token(unsigned long long timeout_ms) {
+    CancelToken* token = malloc(sizeof(CancelToken));
+    if (!token) return NULL;
+    atomic_init(&token->reason, CANCEL_NONE);
+    token->deadline_ns = timeout_ms ? now_ns() + (uint64_t)timeout_ms * 1000000ULL : 0;
+    return token;
+}
+
+void free_cancel_token(CancelToken* token) {
+    free(token);
+}
+
+// Cancel from any thread, or from a signal handler
+void cancel_analysis(CancelToken* token) {
+    int none = CANCEL_NONE;
+    atomic_compare_exchange_strong_explicit(&token->reason, &none, CANCEL_REQUESTED,
+                                            memory_order_relaxed, memory_order_relaxed);
+}
+
+// Whether the phase calling it should give up; called once per statement
+// and procedure
+bool poll_cancel(CancelToken* token) {
+    if (!token) return false;
+    if (atomic_load_explicit(&token->reason, memory_order_relaxed) != CANCEL_NONE) return true;
+    if (token->deadline_ns == 0 || ++polls % CANCEL_CLOCK_POLLS != 0) return false;
+    if (now_ns() < token->deadline_ns) return false;
+    int none = CANCEL_NONE;
+    atomic_compare_exchange_strong_explicit(&token->reason, &none, CANCEL_TIMEOUT,
+                                            memory_order_relaxed, memory_order_relaxed);
+    return true;
+}
+
+// Whether a poll has found the token cancelled (or it was cancelled since),
+// without reading the clock
+bool cancel_requested(CancelToken* token) {
+    return token && atomic_load_explicit(&token->reason, memory_order_relaxed) != CANCEL_NONE;
+}
+
+CancelReason cancel_reason(CancelToken* token) {
+    return token ? (CancelReason)atomic_load_explicit(&token->reason, memory_order_relaxed)
+                 : CANCEL_NONE;
+}
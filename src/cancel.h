@@ -0,0 +1,44 @@
+#ifndef CANCEL_H
+#define CANCEL_H
+
+#include <stdbool.h>
+
+/* Cooperative cancellation of parsing and analysis (--timeout, the
+ * embedding API). A CancelToken carries a deadline and a flag that any
+ * thread may set with cancel_analysis(). The parsers poll it once per
+ * statement and procedure, and so do type checking, semantic analysis
+ * (on every thread of --jobs) and data-flow analysis; lexing a whole
+ * source (cst.h) polls it every LEX_POLL_TOKENS tokens. A poll that finds
+ * the token cancelled makes the phase give up, freeing what it built so
+ * far, and fail with the error message "Cancelled". cancel_requested()
+ * then tells the failure from an error in the program.
+ *
+ * A poll is a relaxed atomic load; only every CANCEL_CLOCK_POLLS-th poll
+ * of a thread also reads the clock, so a deadline is noticed that many
+ * statements late at most. Phases given no token (NULL) do not poll.
+ */
+
+#define CANCEL_CLOCK_POLLS 64
+
+typedef enum {
+    CANCEL_NONE,
+    CANCEL_REQUESTED,    // cancel_analysis()
+    CANCEL_TIMEOUT       // the deadline passed
+} CancelReason;
+
+typedef struct CancelToken CancelToken;
+
+// The token of the command line run, which the parsers (they have no
+// context) and the run_...() phases poll; set by run_pipeline() for
+// --timeout, NULL otherwise
+extern CancelToken* analysis_cancel;
+
+// Cancellation function declarations
+CancelToken* create_cancel_token(unsigned long long timeout_ms);
+void free_cancel_token(CancelToken* token);
+void cancel_analysis(CancelToken* token);
+bool poll_cancel(CancelToken* token);
+bool cancel_requested(CancelToken* token);
+CancelReason cancel_reason(CancelToken* token);
+
+#endif // CANCEL_H
@@ -0,0 +1,319 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+#include "cst.h"
+#include "parser.tab.h"
+
+_Static_assert(TOK_DOT - TOKEN_KIND_BASE <= UINT8_MAX, "token kinds must fit into Token.kind");
+
+extern Node* ast_root;
+extern int yylineno;
+extern int parse_error_count;
+
+// The buffer parse_tokens_with() is feeding to the parser, see replay_token()
+static TokenBuffer* replay = NULL;
+static TokenCursor replay_cursor;
+
+// Wrap source, which the buffer takes over
+static TokenBuffer* new_token_buffer(char* source, size_t size) {
+    TokenBuffer* tokens = size <= UINT32_MAX ? calloc(1, sizeof(TokenBuffer)) : NULL;
+    if (!tokens) {
+        free(source);
+        return NULL;
+    }
+    tokens->source = source;
+    tokens->source[size] = '\0';
+    tokens->source_size = size;
+    return tokens;
+}
+
+// Create an empty token buffer for source itself, which the caller keeps
+// unchanged until the buffer is freed; the scanner lexes a copy of its own
+TokenBuffer* borrow_token_buffer(const char* source, size_t size) {
+    TokenBuffer* tokens = size <= UINT32_MAX ? calloc(1, sizeof(TokenBuffer)) : NULL;
+    if (!tokens) return NULL;
+    tokens->source = (char*)source;
+    tokens->source_size = size;
+    tokens->borrowed = true;
+    return tokens;
+}
+
+// Create an empty token buffer for a copy of source
+TokenBuffer* create_token_buffer(const char* source, size_t size) {
+    char* copy = malloc(size + 1);
+    if (!copy) return NULL;
+    memcpy(copy, source, size);
+    return new_token_buffer(copy, size);
+}
+
+// Create an empty token buffer for the rest of in; NULL on read errors
+TokenBuffer* read_token_buffer(FILE* in) {
+    size_t capacity = 64 * 1024;
+    size_t size = 0;
+    char* source = malloc(capacity);
+    while (source) {
+        size += fread(source + size, 1, capacity - size, in);
+        if (size < capacity) break;
+        capacity *= 2;
+        char* grown = realloc(source, capacity);
+        if (!grown) free(source);
+        source = grown;
+    }
+    if (source && ferror(in)) {
+        free(source);
+        return NULL;
+    }
+    return source ? new_token_buffer(source, size) : NULL;
+}
+
+void free_token_buffer(TokenBuffer* tokens) {
+    if (!tokens) return;
+    for (int i = 0; i < tokens->name_count; i++) release_name(tokens->names[i]);
+    free(tokens->names);
+    free(tokens->name_slots);
+    if (!tokens->borrowed) free(tokens->source);
+    free(tokens->tokens);
+    free(tokens);
+}
+
+static size_t name_slot(const char* name, int slot_count) {
+    return (size_t)(((uintptr_t)name >> 4) * 2654435761u) & (size_t)(slot_count - 1);
+}
+
+static bool grow_name_slots(TokenBuffer* tokens) {
+    int count = tokens->name_slot_count ? tokens->name_slot_count * 2 : 256;
+    int* slots = malloc((size_t)count * sizeof(int));
+    if (!slots) return false;
+    memset(slots, -1, (size_t)count * sizeof(int));
+    for (int id = 0; id < tokens->name_count; id++) {
+        size_t slot = name_slot(tokens->names[id], count);
+        while (slots[slot] >= 0) slot = (slot + 1) & (size_t)(count - 1);
+        slots[slot] = id;
+    }
+    free(tokens->name_slots);
+    tokens->name_slots = slots;
+    tokens->name_slot_count = count;
+    return true;
+}
+
+// Index of name in tokens->names, taking over the caller's reference;
+// -1 for a NULL name or when out of memory
+static int name_id(TokenBuffer* tokens, const char* name) {
+    if (!name) return -1;
+    if (tokens->name_count >= tokens->name_slot_count / 2 && !grow_name_slots(tokens)) {
+        release_name(name);
+        return -1;
+    }
+    size_t mask = (size_t)(tokens->name_slot_count - 1);
+    size_t slot = name_slot(name, tokens->name_slot_count);
+    for (; tokens->name_slots[slot] >= 0; slot = (slot + 1) & mask) {
+        int id = tokens->name_slots[slot];
+        if (tokens->names[id] == name) {
+            release_name(name);
+            return id;
+        }
+    }
+    if (tokens->name_count == tokens->name_capacity) {
+        int capacity = tokens->name_capacity ? tokens->name_capacity * 2 : 128;
+        const char** grown = realloc(tokens->names, (size_t)capacity * sizeof(const char*));
+        if (!grown) {
+            release_name(name);
+            return -1;
+        }
+        tokens->names = grown;
+        tokens->name_capacity = capacity;
+    }
+    tokens->names[tokens->name_count] = name;
+    tokens->name_slots[slot] = tokens->name_count;
+    return tokens->name_count++;
+}
+
+// Append a token; an identifier's interned name is handed over with its
+// reference, which is dropped again if the buffer already holds the name
+bool append_token(TokenBuffer* tokens, int kind, size_t offset, int value, const char* name) {
+    if (tokens->count == tokens->capacity) {
+        int capacity = tokens->capacity ? tokens->capacity * 2 : 1024;
+        Token* grown = realloc(tokens->tokens, (size_t)capacity * sizeof(Token));
+        if (!grown) {
+            release_name(name);
+            return false;
+        }
+        tokens->tokens = grown;
+        tokens->capacity = capacity;
+    }
+    Token* token = &tokens->tokens[tokens->count++];
+    token->offset = (uint32_t)offset;
+    token->value = kind == TOK_IDENT ? name_id(tokens, name) : value;
+    token->kind = (uint8_t)(kind ? kind - TOKEN_KIND_BASE : 0);
+    return true;
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool is_ident_char(char c) {
+    return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// Length of a token's text, found again from the source: identifiers,
+// keywords and numbers run as far as the scanner's rules do
+size_t token_length(const TokenBuffer* tokens, int index) {
+    const Token* token = &tokens->tokens[index];
+    const char* text = tokens->source + token->offset;
+    size_t rest = tokens->source_size - token->offset;
+    size_t length = 0;
+    switch (token_kind(token)) {
+        case 0:
+            return 0;
+        case TOK_NUM:
+            while (length < rest && is_digit(text[length])) length++;
+            return length;
+        case TOK_ASSIGN:
+        case TOK_LTE:
+        case TOK_GTE:
+            return 2;
+        case TOK_EQ: case TOK_NEQ: case TOK_LT: case TOK_GT:
+        case TOK_PLUS: case TOK_MINUS: case TOK_MULT: case TOK_DIV:
+        case TOK_LPAREN: case TOK_RPAREN: case TOK_SEMICOLON: case TOK_COMMA: case TOK_DOT:
+            return 1;
+        default:  // identifiers and keywords
+            while (length < rest && is_ident_char(text[length])) length++;
+            return length;
+    }
+}
+
+static int count_lines(const char* text, size_t size) {
+    int lines = 0;
+    for (const char* end = text + size; (text = memchr(text, '\n', (size_t)(end - text))); text++) {
+        lines++;
+    }
+    return lines;
+}
+
+// Line of a token, counting the newlines before it
+int token_line(const TokenBuffer* tokens, int index) {
+    return 1 + count_lines(tokens->source, tokens->tokens[index].offset);
+}
+
+// Line of token index, counting on from token from, which is on line
+int token_line_from(const TokenBuffer* tokens, int from, int line, int index) {
+    size_t offset = tokens->tokens[from].offset;
+    return line + count_lines(tokens->source + offset, tokens->tokens[index].offset - offset);
+}
+
+// A cursor at token first, which is on line
+TokenCursor token_cursor(const TokenBuffer* tokens, int first, int line) {
+    TokenCursor cursor = { first, -1, -1, line, tokens->tokens[first].offset };
+    return cursor;
+}
+
+// Index of the next token, whose line is left in cursor->line. Reading
+// stays at the end of input once it is reached
+int cursor_next(const TokenBuffer* tokens, TokenCursor* cursor) {
+    if (cursor->next == cursor->skip_first) cursor->next = cursor->skip_last + 1;
+    int index = cursor->next < tokens->count - 1 ? cursor->next++ : tokens->count - 1;
+    size_t offset = tokens->tokens[index].offset;
+    cursor->line += count_lines(tokens->source + cursor->offset, offset - cursor->offset);
+    cursor->offset = offset;
+    return index;
+}
+
+bool replay_token(int* token) {
+    if (!replay) return false;
+    int index = cursor_next(replay, &replay_cursor);
+    const Token* next = &replay->tokens[index];
+    *token = token_kind(next);
+    if (*token == TOK_NUM) {
+        yylval.value = next->value;
+    } else if (*token == TOK_IDENT) {
+        // Every token hands a reference to the node built for it
+        yylval.name = next->value >= 0 ? retain_name(replay->names[next->value]) : NULL;
+    }
+    yylineno = replay_cursor.line;
+    yylloc.first_line = yylloc.last_line = replay_cursor.line;
+    yylloc.first_token = yylloc.last_token = index;
+    return true;
+}
+
+int parse_tokens_with(TokenBuffer* tokens, int (*parse)(void)) {
+    if (tokens->count == 0) lex_tokens(tokens);
+    if (tokens->lex_errors < 0) return 2;  // out of memory, like yyparse()
+    replay = tokens;
+    replay_cursor = token_cursor(tokens, 0, token_line(tokens, 0));
+    bool spans = record_node_spans(true);
+    int result = parse();
+    record_node_spans(spans);
+    replay = NULL;
+    parse_error_count += tokens->lex_errors;
+    return result;
+}
+
+int parse_tokens(TokenBuffer* tokens) {
+    return parse_tokens_with(tokens, yyparse);
+}
+
+// The text between token index and the next one (or the end of the source)
+static size_t gap_after(const TokenBuffer* tokens, int index, size_t* start) {
+    *start = tokens->tokens[index].offset + token_length(tokens, index);
+    size_t end = index + 1 < tokens->count ? tokens->tokens[index + 1].offset
+                                           : tokens->source_size;
+    return end - *start;
+}
+
+// Length of the comment at the start of text, 0 if there is none. An
+// unterminated comment runs to the end
+size_t comment_length(const char* text, size_t size) {
+    const char* end = NULL;
+    if (size >= 1 && text[0] == '{') {
+        end = memchr(text + 1, '}', size - 1);
+    } else if (size >= 2 && text[0] == '(' && text[1] == '*') {
+        for (const char* p = text + 2; (p = memchr(p, '*', size - (size_t)(p - text))); p++) {
+            if (p + 1 < text + size && p[1] == ')') {
+                end = p + 1;
+                break;
+            }
+        }
+    } else {
+        return 0;
+    }
+    return end ? (size_t)(end - text) + 1 : size;
+}
+
+// Trailing trivia of a token: the gap after it up to and including the
+// first newline outside comments, or all of it if it has none
+size_t token_trailing_trivia(const TokenBuffer* tokens, int index, size_t* start) {
+    size_t length = gap_after(tokens, index, start);
+    const char* gap = tokens->source + *start;
+    for (size_t i = 0; i < length; i++) {
+        if (gap[i] == '\n') return i + 1;
+        size_t comment = comment_length(gap + i, length - i);
+        if (comment > 0) i += comment - 1;
+    }
+    return length;
+}
+
+// Leading trivia of a token: what the previous token's trailing trivia
+// leaves of the gap before it
+size_t token_leading_trivia(const TokenBuffer* tokens, int index, size_t* start) {
+    if (index == 0) {
+        *start = 0;
+        return tokens->tokens[0].offset;
+    }
+    size_t gap_start;
+    size_t gap = gap_after(tokens, index - 1, &gap_start);
+    size_t trailing = token_trailing_trivia(tokens, index - 1, start);
+    *start = gap_start + trailing;
+    return gap - trailing;
+}
+
+// Write tokens first..last with their trivia; all tokens give back the
+// source exactly
+bool write_tokens(const TokenBuffer* tokens, int first, int last, FILE* out) {
+    if (first > last) return true;
+    size_t start, trailing_start;
+    token_leading_trivia(tokens, first, &start);
+    size_t end = token_trailing_trivia(tokens, last, &trailing_start);
+    end += trailing_start;
+    return fwrite(tokens->source + start, 1, end - start, out) == end - start;
+}
@@ -0,0 +1,115 @@
+#ifndef CST_H
+#define CST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "ast.h"
+#include "cancel.h"
+
+/* Concrete syntax: the tokens of a parsed source with their positions, for
+ * tools that need the source text back (pl0fmt, refactorings). Only the
+ * tokens are stored; the trivia (whitespace and comments) of a token is
+ * the text between it and its neighbours. Its trailing trivia runs up to
+ * and including the end of its line (a comment that starts on the line
+ * stays in it whole), the rest of the gap is the leading trivia of the
+ * next token. Together the tokens and their trivia cover the source
+ * without gaps, so it can be rewritten token by token.
+ *
+ * The tokens are lexed in a pass of their own, lex_tokens(), into a
+ * compact array; parse_tokens() then feeds the array to a parser through
+ * yylex() instead of running the scanner between parser steps, and the
+ * array can be parsed again without lexing the source again. Token
+ * lengths and lines are not stored but recomputed from the source.
+ *
+ * The nodes a parse of the buffer builds record which of its tokens they
+ * were parsed from (see set_node_span in ast.h); other parses build nodes
+ * without room for that.
+ */
+
+// Bison numbers the declared tokens from 258 on; Token.kind stores them
+// less this, so that they fit into a byte
+#define TOKEN_KIND_BASE 256
+
+typedef struct {
+    uint32_t offset;     // start of the token's text in the source
+    int32_t value;       // TOK_NUM: its value, TOK_IDENT: index into names
+    uint8_t kind;        // see token_kind()
+} Token;
+
+typedef struct {
+    char* source;        // a copy of the parsed text, or the caller's
+    size_t source_size;  // text for a borrow_token_buffer() (not NUL-terminated)
+    bool borrowed;       // source belongs to the caller
+    Token* tokens;       // in source order, ends with the end of input token
+    int count;
+    int capacity;
+    const char** names;  // distinct identifiers, each holding a reference
+    int name_count;
+    int name_capacity;
+    int* name_slots;     // open-addressing index of names, by pointer
+    int name_slot_count;
+    int lex_errors;      // errors lex_tokens() reported
+} TokenBuffer;
+
+// A reader of a token array that keeps track of lines; tokens
+// skip_first..skip_last are passed over
+typedef struct {
+    int next;            // index of the next token
+    int skip_first;
+    int skip_last;
+    int line;            // line of the source at offset
+    size_t offset;
+} TokenCursor;
+
+// Parser token (TOK_...) of a token, 0 for the end of input
+static inline int token_kind(const Token* token) {
+    return token->kind ? token->kind + TOKEN_KIND_BASE : 0;
+}
+
+// Token buffer function declarations
+TokenBuffer* create_token_buffer(const char* source, size_t size);
+TokenBuffer* borrow_token_buffer(const char* source, size_t size);
+TokenBuffer* read_token_buffer(FILE* in);
+void free_token_buffer(TokenBuffer* tokens);
+bool append_token(TokenBuffer* tokens, int kind, size_t offset, int value, const char* name);
+size_t token_length(const TokenBuffer* tokens, int index);
+int token_line(const TokenBuffer* tokens, int index);
+int token_line_from(const TokenBuffer* tokens, int from, int line, int index);
+TokenCursor token_cursor(const TokenBuffer* tokens, int first, int line);
+int cursor_next(const TokenBuffer* tokens, TokenCursor* cursor);
+size_t token_leading_trivia(const TokenBuffer* tokens, int index, size_t* start);
+size_t token_trailing_trivia(const TokenBuffer* tokens, int index, size_t* start);
+bool write_tokens(const TokenBuffer* tokens, int first, int last, FILE* out);
+size_t comment_length(const char* text, size_t size);
+
+// Tokens lexed between two polls of a cancellation token
+#define LEX_POLL_TOKENS 1024
+
+// Lex tokens->source into the empty buffer tokens, reporting lexical
+// errors through yyerror(); returns their number, -1 when out of memory
+// or when analysis_cancel was found cancelled, and keeps it in
+// tokens->lex_errors. Defined by the scanner
+int lex_tokens(TokenBuffer* tokens);
+
+// The same tokens, lexed by a scanner instance of its own: no global
+// state but the name table is touched, and cancel is polled instead of
+// analysis_cancel. The first error is described in error_msg instead of
+// being reported; returns the number of errors like lex_tokens(). Defined
+// by the scanner
+int lex_tokens_quiet(TokenBuffer* tokens, CancelToken* cancel, char* error_msg, size_t size);
+
+// Parse the tokens of tokens->source, lexing them first if the buffer is
+// still empty; returns the parser's result. The nodes record their spans.
+// Lexical errors are reported once, when lexing, and counted into
+// parse_error_count on every parse.
+// parse_tokens_with() takes the parser to use (yyparse or descent_parse)
+int parse_tokens(TokenBuffer* tokens);
+int parse_tokens_with(TokenBuffer* tokens, int (*parse)(void));
+
+// Called by yylex(): while parse_tokens_with() runs, sets *token to the
+// next token of the array, with its value and location, and returns true
+bool replay_token(int* token);
+
+#endif // CST_H
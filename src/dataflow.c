@@ -0,0 +1,1050 @@
+#include <limits.h>
+#include <stdint.h>
+#include "dataflow.h"
+
+/* Variables get program-wide ids: each block's variables are numbered
+ * consecutively from the block's base, in frame slot order. While one
+ * procedure is analyzed, the variables it touches (its own and the outer
+ * ones it or its callees use) are renumbered densely; its own variables
+ * come first. The sets are solved CHUNK_VARS variables at a time, so
+ * memory stays bounded for blocks with very many variables.
+ */
+
+#define CHUNK_VARS 2048
+
+typedef uint64_t Word;
+#define WORD_BITS 64
+
+typedef enum {
+    EV_USE,         // expression reads a variable
+    EV_CALL_USE,    // callee may read it before assigning it
+    EV_DEF,         // assignment or READ
+    EV_CALL_DEF     // callee assigns it on every path
+} EventKind;
+
+typedef struct {
+    EventKind kind;
+    int var;        // procedure variable
+    Node* stmt;
+} Event;
+
+typedef struct {
+    int first_event;
+    int end_event;
+    int succ[2];
+    int succ_count;
+} BasicBlock;
+
+typedef struct {
+    Node* block;
+    const char* name;   // NULL for the main program
+    int parent;         // enclosing procedure, -1 for the main program
+    int base;           // id of the first variable declared in the block
+    int local_count;
+    int* reads;         // summary: sorted ids of outer variables it may
+    int read_count;     // read before assigning them
+    int* writes;        // summary: sorted ids of outer variables it
+    int write_count;    // assigns on every path
+    bool writes_known;
+    int* may_writes;    // sorted ids of outer variables it or its callees
+    int may_write_count;// may assign
+    int analyzed_pass;  // last pass the summary was computed in
+    int used_pass;      // last pass a caller used it before that
+} ProcInfo;
+
+typedef struct {
+    DataflowContext* ctx;
+    ProcInfo* procs;
+    int proc_count;
+    int* order;         // nested procedures and callees declared earlier first
+    int order_count;
+    Node** var_decls;   // by id
+    int var_count;
+    int pass;
+    bool again;         // a summary changed after it was used
+    bool failed;        // out of memory, or cancelled
+    bool cancelled;
+
+    // Workspace of the procedure being analyzed
+    int proc;
+    Event* events;
+    int event_count, event_capacity;
+    BasicBlock* blocks;
+    int block_count, block_capacity;
+    int exit_block;
+    int* tracked;       // procedure variable -> id
+    int tracked_count;
+    int* local_of;      // id -> procedure variable, -1 if not tracked
+    bool* flags;        // per procedure variable: reported or exposed
+    int* pred_start;
+    int* preds;
+    int* queue;
+    bool* queued;
+    Word* sets;
+    size_t sets_capacity;
+
+    // Variables assigned by the statements collect_writes() walked
+    int* written;
+    int written_count;
+    bool* written_marks;    // by id
+} Analysis;
+
+static bool reserve(void** items, int* capacity, int needed, size_t size) {
+    if (needed <= *capacity) return true;
+    int new_capacity = *capacity ? *capacity * 2 : 64;
+    while (new_capacity < needed) new_capacity *= 2;
+    void* grown = realloc(*items, (size_t)new_capacity * size);
+    if (!grown) return false;
+    *items = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+static bool add_warning(DataflowContext* ctx, DataflowWarningKind kind, int line,
+                        const char* name, const char* callee) {
+    if (!reserve((void**)&ctx->warnings, &ctx->warning_capacity,
+                 ctx->warning_count + 1, sizeof(DataflowWarning))) {
+        return false;
+    }
+    DataflowWarning* w = &ctx->warnings[ctx->warning_count++];
+    w->kind = kind;
+    w->line = line;
+    w->name = name;
+    w->callee = callee;
+    w->count = 0;
+    if (kind == ERROR_ENDLESS_LOOP) ctx->error_count++;
+    return true;
+}
+
+DataflowContext* create_dataflow_context(void) {
+    DataflowContext* ctx = malloc(sizeof(DataflowContext));
+    if (!ctx) return NULL;
+    ctx->warnings = NULL;
+    ctx->warning_count = 0;
+    ctx->warning_capacity = 0;
+    ctx->error_count = 0;
+    ctx->cancel = NULL;
+    ctx->overflow = OVERFLOW_WRAP;
+    ctx->error_msg[0] = '\0';
+    return ctx;
+}
+
+void free_dataflow_context(DataflowContext* ctx) {
+    if (!ctx) return;
+    free(ctx->warnings);
+    free(ctx);
+}
+
+// Give up once the analysis is cancelled (cancel.h)
+static bool cancelled(Analysis* a) {
+    if (!poll_cancel(a->ctx->cancel)) return false;
+    a->cancelled = a->failed = true;
+    return true;
+}
+
+// Collect procedures and variables
+
+static void count_block(Analysis* a, Node* block) {
+    a->proc_count++;
+    a->var_count += node_slot(block);
+    for (Node* n = node_right(block); n; n = node_next(n)) {
+        if (n->type == NODE_PROC) count_block(a, node_right(n));
+    }
+}
+
+static void collect_block(Analysis* a, Node* block, int proc, int parent, const char* name) {
+    ProcInfo* p = &a->procs[proc];
+    p->block = block;
+    p->name = name;
+    p->parent = parent;
+    p->base = a->var_count;
+    p->local_count = node_slot(block);
+
+    for (Node* n = node_right(block); n && a->var_count < p->base + p->local_count;
+         n = node_next(n)) {
+        if (n->type == NODE_VAR_DECL) a->var_decls[a->var_count++] = n;
+    }
+    for (Node* n = node_right(block); n; n = node_next(n)) {
+        if (n->type == NODE_PROC) {
+            collect_block(a, node_right(n), node_slot(n) + 1, proc, node_name(node_left(n)));
+        }
+    }
+    a->order[a->order_count++] = proc;
+}
+
+// Build the control flow graph of one procedure
+
+static int new_block(Analysis* a) {
+    if (!reserve((void**)&a->blocks, &a->block_capacity, a->block_count + 1,
+                 sizeof(BasicBlock))) {
+        a->failed = true;
+        return 0;
+    }
+    BasicBlock* b = &a->blocks[a->block_count];
+    b->first_event = b->end_event = a->event_count;
+    b->succ_count = 0;
+    return a->block_count++;
+}
+
+static void add_edge(Analysis* a, int from, int to) {
+    BasicBlock* b = &a->blocks[from];
+    b->succ[b->succ_count++] = to;
+}
+
+// Procedure variable for an id, tracking it on first use
+static int track(Analysis* a, int id) {
+    if (a->local_of[id] < 0) {
+        a->local_of[id] = a->tracked_count;
+        a->tracked[a->tracked_count++] = id;
+    }
+    return a->local_of[id];
+}
+
+static void add_event(Analysis* a, int block, EventKind kind, int id, Node* stmt) {
+    if (id < 0) return;
+    if (!reserve((void**)&a->events, &a->event_capacity, a->event_count + 1,
+                 sizeof(Event))) {
+        a->failed = true;
+        return;
+    }
+    // A block's events are added while it is the current block, so they
+    // are contiguous, but blocks are created ahead of that
+    BasicBlock* b = &a->blocks[block];
+    if (b->first_event == b->end_event) b->first_event = a->event_count;
+    Event* ev = &a->events[a->event_count++];
+    ev->kind = kind;
+    ev->var = track(a, id);
+    ev->stmt = stmt;
+    b->end_event = a->event_count;
+}
+
+// Id of the variable an identifier refers to, -1 for constants
+static int variable_id(Analysis* a, Node* ident) {
+    if (!node_decl(ident) || node_decl(ident)->type != NODE_VAR_DECL) return -1;
+    int proc = a->proc;
+    for (int level = node_level(ident); level > 0; level--) proc = a->procs[proc].parent;
+    return a->procs[proc].base + node_slot(ident);
+}
+
+static void add_uses(Analysis* a, int block, Node* expr, Node* stmt) {
+    if (!expr) return;
+    if (expr->type == NODE_IDENT) {
+        int id = variable_id(a, expr);
+        if (id >= 0) add_event(a, block, EV_USE, id, stmt);
+        return;
+    }
+    if (expr->type == NODE_BINARY_OP || expr->type == NODE_CONDITION) {
+        add_uses(a, block, node_left(expr), stmt);
+        add_uses(a, block, node_right(expr), stmt);
+    }
+}
+
+static void add_call(Analysis* a, int block, Node* stmt) {
+    ProcInfo* callee = &a->procs[node_slot(node_decl(node_left(stmt))) + 1];
+    if (callee->analyzed_pass != a->pass) callee->used_pass = a->pass;
+    for (int i = 0; i < callee->read_count; i++) {
+        add_event(a, block, EV_CALL_USE, callee->reads[i], stmt);
+    }
+    for (int i = 0; i < callee->write_count; i++) {
+        add_event(a, block, EV_CALL_DEF, callee->writes[i], stmt);
+    }
+}
+
+// Add a statement to the graph; returns the block control reaches after it
+static int build_statement(Analysis* a, Node* stmt, int block) {
+    if (!stmt || a->failed || cancelled(a)) return block;
+
+    switch (stmt->type) {
+        case NODE_ASSIGN:
+            add_uses(a, block, node_right(stmt), stmt);
+            add_event(a, block, EV_DEF, variable_id(a, node_left(stmt)), stmt);
+            return block;
+
+        case NODE_INPUT:
+            add_event(a, block, EV_DEF, variable_id(a, node_left(stmt)), stmt);
+            return block;
+
+        case NODE_OUTPUT:
+            add_uses(a, block, node_left(stmt), stmt);
+            return block;
+
+        case NODE_CALL:
+            add_call(a, block, stmt);
+            return block;
+
+        case NODE_COMPOUND:
+            for (Node* s = node_left(stmt); s; s = node_next(s)) {
+                block = build_statement(a, s, block);
+            }
+            return block;
+
+        case NODE_IF: {
+            add_uses(a, block, node_left(stmt), stmt);
+            int then_block = new_block(a);
+            int join = new_block(a);
+            if (a->failed) return block;
+            add_edge(a, block, then_block);
+            add_edge(a, block, join);
+            int then_end = build_statement(a, node_right(stmt), then_block);
+            if (a->failed) return block;
+            add_edge(a, then_end, join);
+            return join;
+        }
+
+        case NODE_WHILE: {
+            int head = new_block(a);
+            int body = new_block(a);
+            if (a->failed) return block;
+            add_edge(a, block, head);
+            add_uses(a, head, node_left(stmt), stmt);
+            add_edge(a, head, body);
+            int body_end = build_statement(a, node_right(stmt), body);
+            int exit = new_block(a);
+            if (a->failed) return block;
+            add_edge(a, body_end, head);
+            add_edge(a, head, exit);
+            return exit;
+        }
+
+        default:
+            return block;
+    }
+}
+
+static bool build_graph(Analysis* a, int proc) {
+    ProcInfo* p = &a->procs[proc];
+    a->proc = proc;
+    a->event_count = 0;
+    a->block_count = 0;
+    a->tracked_count = 0;
+    for (int i = 0; i < p->local_count; i++) track(a, p->base + i);
+
+    int entry = new_block(a);
+    a->exit_block = build_statement(a, find_block_statement(p->block), entry);
+    if (a->failed) return false;
+
+    // Predecessor lists
+    int n = a->block_count;
+    free(a->pred_start);
+    free(a->preds);
+    free(a->queue);
+    free(a->queued);
+    a->pred_start = calloc((size_t)n + 1, sizeof(int));
+    a->preds = malloc((size_t)(2 * n) * sizeof(int));
+    a->queue = malloc((size_t)n * sizeof(int));
+    a->queued = malloc((size_t)n * sizeof(bool));
+    if (!a->pred_start || !a->preds || !a->queue || !a->queued) return false;
+    for (int b = 0; b < n; b++) {
+        for (int s = 0; s < a->blocks[b].succ_count; s++) a->pred_start[a->blocks[b].succ[s] + 1]++;
+    }
+    for (int b = 0; b < n; b++) a->pred_start[b + 1] += a->pred_start[b];
+    int* fill = a->queue;
+    for (int b = 0; b < n; b++) fill[b] = a->pred_start[b];
+    for (int b = 0; b < n; b++) {
+        for (int s = 0; s < a->blocks[b].succ_count; s++) {
+            int succ = a->blocks[b].succ[s];
+            a->preds[fill[succ]++] = b;
+        }
+    }
+    return true;
+}
+
+// Bit-vector sets of one chunk of procedure variables
+
+static inline bool set_has(const Word* set, int bit) {
+    return (set[bit / WORD_BITS] >> (bit % WORD_BITS)) & 1;
+}
+
+static inline void set_add(Word* set, int bit) {
+    set[bit / WORD_BITS] |= (Word)1 << (bit % WORD_BITS);
+}
+
+static inline void set_remove(Word* set, int bit) {
+    set[bit / WORD_BITS] &= ~((Word)1 << (bit % WORD_BITS));
+}
+
+// Worklist of blocks, each queued at most once
+static void push(Analysis* a, int* tail, int block) {
+    if (a->queued[block]) return;
+    a->queued[block] = true;
+    a->queue[*tail % a->block_count] = block;
+    (*tail)++;
+}
+
+typedef struct {
+    int lo, count, words;
+    Word* def;          // per block: variables assigned in it
+    Word* use;          // per block: variables read before assigned in it
+    Word* assigned;     // per block: definitely assigned at its end
+    Word* live;         // per block: live at its start
+    Word* cur;
+} Chunk;
+
+static Word* block_set(const Chunk* c, Word* sets, int block) {
+    return sets + (size_t)block * (size_t)c->words;
+}
+
+static bool in_chunk(const Chunk* c, int var) {
+    return var >= c->lo && var < c->lo + c->count;
+}
+
+// Intersection of the predecessors' definitely assigned sets
+static void assigned_on_entry(Analysis* a, Chunk* c, int block) {
+    if (block == 0) {
+        memset(c->cur, 0, (size_t)c->words * sizeof(Word));
+        return;
+    }
+    memset(c->cur, 0xff, (size_t)c->words * sizeof(Word));
+    for (int p = a->pred_start[block]; p < a->pred_start[block + 1]; p++) {
+        Word* out = block_set(c, c->assigned, a->preds[p]);
+        for (int w = 0; w < c->words; w++) c->cur[w] &= out[w];
+    }
+}
+
+// Union of the successors' live sets; outer variables are live at the end
+static void live_on_exit(Analysis* a, Chunk* c, int block) {
+    memset(c->cur, 0, (size_t)c->words * sizeof(Word));
+    for (int s = 0; s < a->blocks[block].succ_count; s++) {
+        Word* in = block_set(c, c->live, a->blocks[block].succ[s]);
+        for (int w = 0; w < c->words; w++) c->cur[w] |= in[w];
+    }
+    if (block == a->exit_block) {
+        int local_count = a->procs[a->proc].local_count;
+        for (int v = local_count > c->lo ? local_count - c->lo : 0; v < c->count; v++) {
+            set_add(c->cur, v);
+        }
+    }
+}
+
+static void solve_chunk(Analysis* a, Chunk* c) {
+    int n = a->block_count;
+    size_t words = (size_t)n * (size_t)c->words;
+    memset(c->def, 0, words * sizeof(Word));
+    memset(c->use, 0, words * sizeof(Word));
+    memset(c->assigned, 0xff, words * sizeof(Word));
+    memset(c->live, 0, words * sizeof(Word));
+
+    // Local sets of each block
+    for (int b = 0; b < n; b++) {
+        Word* def = block_set(c, c->def, b);
+        Word* use = block_set(c, c->use, b);
+        for (int e = a->blocks[b].first_event; e < a->blocks[b].end_event; e++) {
+            Event* ev = &a->events[e];
+            if (!in_chunk(c, ev->var)) continue;
+            int v = ev->var - c->lo;
+            if (ev->kind == EV_USE || ev->kind == EV_CALL_USE) {
+                if (!set_has(def, v)) set_add(use, v);
+            } else {
+                set_add(def, v);
+            }
+        }
+    }
+
+    // Definite assignment, forward: assigned = def | intersection of preds
+    int head = 0, tail = 0;
+    for (int b = 0; b < n; b++) {
+        a->queued[b] = false;
+        push(a, &tail, b);
+    }
+    while (head < tail) {
+        int b = a->queue[head++ % n];
+        a->queued[b] = false;
+        assigned_on_entry(a, c, b);
+        Word* def = block_set(c, c->def, b);
+        Word* out = block_set(c, c->assigned, b);
+        bool changed = false;
+        for (int w = 0; w < c->words; w++) {
+            Word value = c->cur[w] | def[w];
+            if (value != out[w]) {
+                out[w] = value;
+                changed = true;
+            }
+        }
+        if (!changed) continue;
+        for (int s = 0; s < a->blocks[b].succ_count; s++) push(a, &tail, a->blocks[b].succ[s]);
+    }
+
+    // Liveness, backward: live = use | (live after & ~def)
+    head = tail = 0;
+    for (int b = n - 1; b >= 0; b--) push(a, &tail, b);
+    while (head < tail) {
+        int b = a->queue[head++ % n];
+        a->queued[b] = false;
+        live_on_exit(a, c, b);
+        Word* def = block_set(c, c->def, b);
+        Word* use = block_set(c, c->use, b);
+        Word* in = block_set(c, c->live, b);
+        bool changed = false;
+        for (int w = 0; w < c->words; w++) {
+            Word value = use[w] | (c->cur[w] & ~def[w]);
+            if (value != in[w]) {
+                in[w] = value;
+                changed = true;
+            }
+        }
+        if (!changed) continue;
+        for (int p = a->pred_start[b]; p < a->pred_start[b + 1]; p++) push(a, &tail, a->preds[p]);
+    }
+}
+
+static const char* variable_name(Analysis* a, int var) {
+    return node_name(node_left(a->var_decls[a->tracked[var]]));
+}
+
+// Walk each block with the solved sets and report, or record summaries
+static void check_chunk(Analysis* a, Chunk* c, bool* exposed, Word* exit_assigned) {
+    ProcInfo* p = &a->procs[a->proc];
+    bool* reported = a->flags;
+
+    for (int b = 0; b < a->block_count && !a->failed; b++) {
+        // Reads of unassigned variables
+        assigned_on_entry(a, c, b);
+        for (int e = a->blocks[b].first_event; e < a->blocks[b].end_event; e++) {
+            Event* ev = &a->events[e];
+            if (!in_chunk(c, ev->var)) continue;
+            int v = ev->var - c->lo;
+            if (ev->kind == EV_DEF || ev->kind == EV_CALL_DEF) {
+                set_add(c->cur, v);
+            } else if (!set_has(c->cur, v)) {
+                if (ev->var >= p->local_count) {
+                    exposed[ev->var] = true;
+                } else if (!reported[ev->var]) {
+                    reported[ev->var] = true;
+                    const char* callee = ev->kind == EV_CALL_USE ?
+                                         node_name(node_left(ev->stmt)) : NULL;
+                    if (!add_warning(a->ctx, WARN_UNASSIGNED, node_line(ev->stmt),
+                                     variable_name(a, ev->var), callee)) {
+                        a->failed = true;
+                    }
+                }
+            }
+        }
+        if (b == a->exit_block) memcpy(exit_assigned, c->cur, (size_t)c->words * sizeof(Word));
+
+        // Assignments nobody reads
+        live_on_exit(a, c, b);
+        for (int e = a->blocks[b].end_event - 1; e >= a->blocks[b].first_event; e--) {
+            Event* ev = &a->events[e];
+            if (!in_chunk(c, ev->var)) continue;
+            int v = ev->var - c->lo;
+            if (ev->kind == EV_USE || ev->kind == EV_CALL_USE) {
+                set_add(c->cur, v);
+                continue;
+            }
+            if (ev->kind == EV_DEF && ev->stmt->type == NODE_ASSIGN &&
+                ev->var < p->local_count && !set_has(c->cur, v)) {
+                if (!add_warning(a->ctx, WARN_DEAD_STORE, node_line(ev->stmt),
+                                 variable_name(a, ev->var), NULL)) {
+                    a->failed = true;
+                }
+            }
+            set_remove(c->cur, v);
+        }
+    }
+}
+
+static int compare_ids(const void* x, const void* y) {
+    int a = *(const int*)x, b = *(const int*)y;
+    return (a > b) - (a < b);
+}
+
+// Replace a summary set by its union (grow) or intersection with ids.
+// Reads only grow and writes only shrink from pass to pass, so the passes
+// over recursive procedures terminate. Fails only when out of memory.
+static bool merge_summary(int** set, int* count, int* ids, int id_count, bool grow,
+                          bool* changed) {
+    qsort(ids, (size_t)id_count, sizeof(int), compare_ids);
+    int* merged = malloc((size_t)(*count + id_count + 1) * sizeof(int));
+    if (!merged) return false;
+    int i = 0, j = 0, n = 0;
+    while (i < *count || j < id_count) {
+        if (j == id_count || (i < *count && (*set)[i] < ids[j])) {
+            if (grow) merged[n++] = (*set)[i];
+            i++;
+        } else if (i == *count || ids[j] < (*set)[i]) {
+            if (grow) merged[n++] = ids[j];
+            j++;
+        } else {
+            merged[n++] = ids[j];
+            i++;
+            j++;
+        }
+    }
+    if (n != *count) *changed = true;
+    free(*set);
+    *set = merged;
+    *count = n;
+    return true;
+}
+
+static void analyze_procedure(Analysis* a, int proc) {
+    ProcInfo* p = &a->procs[proc];
+    if (cancelled(a)) return;
+    if (!build_graph(a, proc)) {
+        a->failed = true;
+        return;
+    }
+
+    int vars = a->tracked_count;
+    int words = (vars < CHUNK_VARS ? vars : CHUNK_VARS) / WORD_BITS + 1;
+    size_t needed = (size_t)(4 * a->block_count + 2) * (size_t)words;
+    if (needed > a->sets_capacity) {
+        free(a->sets);
+        a->sets = malloc(needed * sizeof(Word));
+        a->sets_capacity = a->sets ? needed : 0;
+    }
+    bool* exposed = calloc((size_t)vars + 1, sizeof(bool));
+    int* ids = malloc(((size_t)vars + 1) * sizeof(int));
+    if (!a->sets || !exposed || !ids) {
+        free(exposed);
+        free(ids);
+        a->failed = true;
+        return;
+    }
+    memset(a->flags, 0, (size_t)vars * sizeof(bool));
+
+    // Outer variables assigned on every path, in procedure numbering
+    int write_count = 0;
+    for (int lo = 0; lo < vars && !a->failed; lo += CHUNK_VARS) {
+        Chunk c;
+        c.lo = lo;
+        c.count = vars - lo < CHUNK_VARS ? vars - lo : CHUNK_VARS;
+        c.words = words;
+        size_t per_set = (size_t)a->block_count * (size_t)words;
+        c.def = a->sets;
+        c.use = c.def + per_set;
+        c.assigned = c.use + per_set;
+        c.live = c.assigned + per_set;
+        c.cur = c.live + per_set;
+        Word* exit_assigned = c.cur + words;
+
+        solve_chunk(a, &c);
+        check_chunk(a, &c, exposed, exit_assigned);
+        for (int v = 0; v < c.count; v++) {
+            if (lo + v >= p->local_count && set_has(exit_assigned, v)) {
+                ids[write_count++] = a->tracked[lo + v];
+            }
+        }
+    }
+
+    // Update the summaries used at calls to this procedure. Until the
+    // first analysis, callers saw no writes at all.
+    bool changed = false;
+    bool merged = merge_summary(&p->writes, &p->write_count, ids, write_count,
+                                !p->writes_known, &changed);
+    p->writes_known = true;
+    int read_count = 0;
+    for (int v = p->local_count; v < vars; v++) {
+        if (exposed[v]) ids[read_count++] = a->tracked[v];
+    }
+    if (!merged || !merge_summary(&p->reads, &p->read_count, ids, read_count, true, &changed)) {
+        a->failed = true;
+    }
+    if (changed && p->used_pass == a->pass) a->again = true;
+    p->analyzed_pass = a->pass;
+
+    for (int v = 0; v < vars; v++) a->local_of[a->tracked[v]] = -1;
+    free(exposed);
+    free(ids);
+}
+
+// Loops and reachability
+
+// Value of an expression of numbers and constants, computed as the
+// interpreter does; false if it reads a variable or divides by zero
+// Evaluate a constant expression as the interpreter does in the given
+// overflow mode. One that overflows with OVERFLOW_TRAP stops the program
+// when it runs, so it has no value.
+static bool constant_value(Node* expr, OverflowMode overflow, int* value) {
+    int left, right;
+    bool overflowed, negative;
+    switch (expr->type) {
+        case NODE_NUMBER:
+            *value = node_value(expr);
+            return true;
+
+        case NODE_IDENT:
+            if (!node_decl(expr) || node_decl(expr)->type != NODE_CONST_DECL) return false;
+            *value = node_value(node_right(node_decl(expr)));
+            return true;
+
+        case NODE_BINARY_OP:
+            if (!constant_value(node_left(expr), overflow, &left) ||
+                !constant_value(node_right(expr), overflow, &right)) {
+                return false;
+            }
+            switch (node_op(expr)) {
+                case OP_PLUS:
+                    overflowed = __builtin_add_overflow(left, right, value);
+                    negative = right < 0;
+                    break;
+                case OP_MINUS:
+                    overflowed = __builtin_sub_overflow(left, right, value);
+                    negative = right > 0;
+                    break;
+                case OP_MULT:
+                    overflowed = __builtin_mul_overflow(left, right, value);
+                    negative = (left < 0) != (right < 0);
+                    break;
+                case OP_DIV:
+                    if (right == 0) return false;
+                    overflowed = left == INT_MIN && right == -1;
+                    *value = overflowed ? INT_MIN : left / right;
+                    negative = false;
+                    break;
+                default:
+                    return false;
+            }
+            if (!overflowed || overflow == OVERFLOW_WRAP) return true;
+            if (overflow == OVERFLOW_TRAP) return false;
+            *value = negative ? INT_MIN : INT_MAX;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+static bool constant_condition(Node* cond, OverflowMode overflow, bool* value) {
+    int left, right = 0;
+    if (!constant_value(node_left(cond), overflow, &left)) return false;
+    if (node_op(cond) != OP_ODD && !constant_value(node_right(cond), overflow, &right)) {
+        return false;
+    }
+    switch (node_op(cond)) {
+        case OP_ODD: *value = (left & 1) != 0; return true;
+        case OP_EQ:  *value = left == right;   return true;
+        case OP_NEQ: *value = left != right;   return true;
+        case OP_LT:  *value = left < right;    return true;
+        case OP_LTE: *value = left <= right;   return true;
+        case OP_GT:  *value = left > right;    return true;
+        case OP_GTE: *value = left >= right;   return true;
+        default:     return false;
+    }
+}
+
+static void mark_written(Analysis* a, int id) {
+    if (id < 0 || a->written_marks[id]) return;
+    a->written_marks[id] = true;
+    a->written[a->written_count++] = id;
+}
+
+// Mark the variables a statement may assign, itself or in the procedures
+// it calls (whose may_writes must be complete)
+static void collect_writes(Analysis* a, Node* stmt) {
+    if (!stmt) return;
+    switch (stmt->type) {
+        case NODE_ASSIGN:
+        case NODE_INPUT:
+            mark_written(a, variable_id(a, node_left(stmt)));
+            break;
+        case NODE_CALL: {
+            ProcInfo* callee = &a->procs[node_slot(node_decl(node_left(stmt))) + 1];
+            for (int i = 0; i < callee->may_write_count; i++) {
+                mark_written(a, callee->may_writes[i]);
+            }
+            break;
+        }
+        case NODE_COMPOUND:
+            for (Node* s = node_left(stmt); s; s = node_next(s)) collect_writes(a, s);
+            break;
+        case NODE_IF:
+        case NODE_WHILE:
+            collect_writes(a, node_right(stmt));
+            break;
+        default:
+            break;
+    }
+}
+
+static void clear_writes(Analysis* a) {
+    for (int i = 0; i < a->written_count; i++) a->written_marks[a->written[i]] = false;
+    a->written_count = 0;
+}
+
+// Outer variables each procedure may assign, including through calls;
+// repeated until recursive procedures agree
+static bool compute_may_writes(Analysis* a) {
+    int* ids = malloc(((size_t)a->var_count + 1) * sizeof(int));
+    if (!ids) return false;
+
+    bool changed;
+    do {
+        changed = false;
+        for (int i = 0; i < a->order_count; i++) {
+            if (cancelled(a)) {
+                free(ids);
+                return false;
+            }
+            ProcInfo* p = &a->procs[a->order[i]];
+            a->proc = a->order[i];
+            collect_writes(a, find_block_statement(p->block));
+            int count = 0;
+            for (int w = 0; w < a->written_count; w++) {
+                int id = a->written[w];
+                if (id < p->base || id >= p->base + p->local_count) ids[count++] = id;
+            }
+            clear_writes(a);
+            if (!merge_summary(&p->may_writes, &p->may_write_count, ids, count, true,
+                               &changed)) {
+                free(ids);
+                return false;
+            }
+        }
+    } while (changed);
+
+    free(ids);
+    return true;
+}
+
+// Count the variables a condition reads; reports whether any of them is
+// marked as written, and the first one
+static void condition_variables(Analysis* a, Node* expr, int* count,
+                                const char** first, bool* written) {
+    if (!expr) return;
+    if (expr->type == NODE_IDENT) {
+        int id = variable_id(a, expr);
+        if (id < 0) return;
+        if ((*count)++ == 0) *first = node_name(expr);
+        if (a->written_marks[id]) *written = true;
+        return;
+    }
+    condition_variables(a, node_left(expr), count, first, written);
+    condition_variables(a, node_right(expr), count, first, written);
+}
+
+// A loop whose condition reads only variables the loop never assigns
+// keeps its condition forever once it is true
+static void check_loop_variables(Analysis* a, Node* loop) {
+    int count = 0;
+    const char* first = NULL;
+    bool written = false;
+    collect_writes(a, node_right(loop));
+    condition_variables(a, node_left(loop), &count, &first, &written);
+    clear_writes(a);
+
+    if (count > 0 && !written) {
+        if (!add_warning(a->ctx, ERROR_ENDLESS_LOOP, node_line(loop), first, NULL)) {
+            a->failed = true;
+            return;
+        }
+        a->ctx->warnings[a->ctx->warning_count - 1].count = count;
+    }
+}
+
+static void note(Analysis* a, DataflowWarningKind kind, Node* stmt) {
+    if (stmt && !add_warning(a->ctx, kind, node_line(stmt), NULL, NULL)) a->failed = true;
+}
+
+// Check loops and reachability in a statement; returns whether control
+// can get past it. Unreachable statements are reported, not checked.
+static bool check_statement(Analysis* a, Node* stmt) {
+    if (!stmt || cancelled(a)) return true;
+
+    bool value;
+    switch (stmt->type) {
+        case NODE_COMPOUND:
+            for (Node* s = node_left(stmt); s; s = node_next(s)) {
+                if (!check_statement(a, s)) {
+                    note(a, WARN_UNREACHABLE, node_next(s));
+                    return false;
+                }
+            }
+            return true;
+
+        case NODE_IF:
+            if (!constant_condition(node_left(stmt), a->ctx->overflow, &value)) {
+                check_statement(a, node_right(stmt));
+                return true;
+            }
+            if (!value) {
+                note(a, WARN_UNREACHABLE, node_right(stmt));
+                return true;
+            }
+            note(a, WARN_CONSTANT_CONDITION, stmt);
+            return check_statement(a, node_right(stmt));
+
+        case NODE_WHILE:
+            if (!constant_condition(node_left(stmt), a->ctx->overflow, &value)) {
+                check_loop_variables(a, stmt);
+                check_statement(a, node_right(stmt));
+                return true;
+            }
+            if (!value) {
+                note(a, WARN_UNREACHABLE, node_right(stmt));
+                return true;
+            }
+            if (!add_warning(a->ctx, ERROR_ENDLESS_LOOP, node_line(stmt), NULL, NULL)) {
+                a->failed = true;
+            }
+            check_statement(a, node_right(stmt));
+            return false;
+
+        default:
+            return true;
+    }
+}
+
+static int compare_warnings(const void* x, const void* y) {
+    const DataflowWarning* a = x;
+    const DataflowWarning* b = y;
+    if (a->line != b->line) return (a->line > b->line) - (a->line < b->line);
+    if (a->kind != b->kind) return (int)a->kind - (int)b->kind;
+    if (!a->name || !b->name) return (a->name != NULL) - (b->name != NULL);
+    return strcmp(a->name, b->name);
+}
+
+static void free_analysis(Analysis* a) {
+    if (a->procs) {
+        for (int i = 0; i < a->proc_count; i++) {
+            free(a->procs[i].reads);
+            free(a->procs[i].writes);
+            free(a->procs[i].may_writes);
+        }
+    }
+    free(a->procs);
+    free(a->order);
+    free(a->var_decls);
+    free(a->events);
+    free(a->blocks);
+    free(a->tracked);
+    free(a->local_of);
+    free(a->flags);
+    free(a->pred_start);
+    free(a->preds);
+    free(a->queue);
+    free(a->queued);
+    free(a->sets);
+    free(a->written);
+    free(a->written_marks);
+}
+
+// Analyze a program that passed semantic analysis and collect its
+// warnings and errors in ctx. Fails only when out of memory or
+// cancelled; endless loops are counted in ctx->error_count.
+bool analyze_dataflow(DataflowContext* ctx, Node* program) {
+    ctx->warning_count = 0;
+    ctx->error_count = 0;
+    if (!program || !node_left(program)) return true;
+
+    Analysis a = {0};
+    a.ctx = ctx;
+    count_block(&a, node_left(program));
+    a.procs = calloc((size_t)a.proc_count, sizeof(ProcInfo));
+    a.order = malloc((size_t)a.proc_count * sizeof(int));
+    a.var_decls = malloc(((size_t)a.var_count + 1) * sizeof(Node*));
+    a.tracked = malloc(((size_t)a.var_count + 1) * sizeof(int));
+    a.local_of = malloc(((size_t)a.var_count + 1) * sizeof(int));
+    a.flags = malloc(((size_t)a.var_count + 1) * sizeof(bool));
+    a.written = malloc(((size_t)a.var_count + 1) * sizeof(int));
+    a.written_marks = calloc((size_t)a.var_count + 1, sizeof(bool));
+    if (!a.procs || !a.order || !a.var_decls || !a.tracked || !a.local_of || !a.flags ||
+        !a.written || !a.written_marks) {
+        free_analysis(&a);
+        snprintf(ctx->error_msg, sizeof(ctx->error_msg), "Out of memory");
+        return false;
+    }
+    for (int i = 0; i < a.var_count; i++) a.local_of[i] = -1;
+    a.var_count = 0;
+    collect_block(&a, node_left(program), 0, -1, NULL);
+
+    // Callees come first in the order, so without recursion one pass
+    // suffices; recursion repeats the pass until the summaries settle.
+    // Only the warnings of the last pass are kept.
+    do {
+        a.pass++;
+        a.again = false;
+        ctx->warning_count = 0;
+        for (int i = 0; i < a.order_count && !a.failed; i++) {
+            analyze_procedure(&a, a.order[i]);
+        }
+    } while (a.again && !a.failed);
+
+    // Loops and reachability, on top of the warnings of the last pass
+    if (!a.failed && !compute_may_writes(&a)) a.failed = true;
+    for (int i = 0; i < a.order_count && !a.failed; i++) {
+        a.proc = a.order[i];
+        check_statement(&a, find_block_statement(a.procs[a.proc].block));
+    }
+
+    bool success = !a.failed;
+    if (!success) {
+        snprintf(ctx->error_msg, sizeof(ctx->error_msg), "%s",
+                 a.cancelled ? "Cancelled" : "Out of memory");
+    } else if (ctx->warning_count > 0) {
+        qsort(ctx->warnings, (size_t)ctx->warning_count, sizeof(DataflowWarning),
+              compare_warnings);
+    }
+    free_analysis(&a);
+    return success;
+}
+
+void print_dataflow_warnings(const DataflowContext* ctx, FILE* out) {
+    for (int i = 0; i < ctx->warning_count; i++) {
+        const DataflowWarning* w = &ctx->warnings[i];
+        switch (w->kind) {
+            case WARN_UNASSIGNED:
+                fprintf(out, "Warning line %d: Variable '%s' may be used before it is assigned",
+                        w->line, w->name);
+                if (w->callee) fprintf(out, " (read by procedure '%s')", w->callee);
+                fprintf(out, "\n");
+                break;
+            case WARN_DEAD_STORE:
+                fprintf(out, "Warning line %d: Value assigned to '%s' is never used\n",
+                        w->line, w->name);
+                break;
+            case WARN_CONSTANT_CONDITION:
+                fprintf(out, "Warning line %d: Condition is always true\n", w->line);
+                break;
+            case WARN_UNREACHABLE:
+                fprintf(out, "Warning line %d: Statement is never executed\n", w->line);
+                break;
+            case ERROR_ENDLESS_LOOP:
+                if (!w->name) {
+                    fprintf(out, "Loop Error line %d: Condition is always true, "
+                            "the loop never ends\n", w->line);
+                } else if (w->count == 1) {
+                    fprintf(out, "Loop Error line %d: The loop never ends once entered, "
+                            "'%s' in its condition is not assigned in the loop\n",
+                            w->line, w->name);
+                } else {
+                    fprintf(out, "Loop Error line %d: The loop never ends once entered, "
+                            "no variable in its condition is assigned in the loop\n",
+                            w->line);
+                }
+                break;
+        }
+    }
+}
+
+bool run_dataflow_analysis(Node* ast, const Options* opts) {
+    if (opts->verbose) {
+        fprintf(opts->output, "Phase 2b: Data-flow Analysis\n");
+    }
+
+    DataflowContext* ctx = create_dataflow_context();
+    if (!ctx) {
+        fprintf(stderr, "Error: Failed to create data-flow analysis context\n");
+        return false;
+    }
+    ctx->cancel = analysis_cancel;
+    ctx->overflow = opts->overflow;
+
+    // Warnings do not fail the run, endless loops do
+    bool success = analyze_dataflow(ctx, ast);
+
+    // A cancelled run is reported by the driver
+    if (!success && !cancel_requested(ctx->cancel)) {
+        fprintf(stderr, "Data-flow Error: %s\n", ctx->error_msg);
+    } else if (success) {
+        print_dataflow_warnings(ctx, stderr);
+        success = ctx->error_count == 0;
+        if (opts->verbose && success) {
+            fprintf(opts->output, "Data-flow analysis completed with %d warning%s\n",
+                    ctx->warning_count, ctx->warning_count == 1 ? "" : "s");
+        }
+    }
+
+    free_dataflow_context(ctx);
+    return success;
+}
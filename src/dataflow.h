@@ -0,0 +1,59 @@
+#ifndef DATAFLOW_H
+#define DATAFLOW_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "ast.h"
+#include "cancel.h"
+#include "options.h"
+
+/* Data-flow analysis of a program that passed semantic analysis. The
+ * main program and each procedure become a control flow graph of basic
+ * blocks, on which a worklist solver computes definite assignment
+ * (forward) and liveness (backward) with bit-vector sets. A call is
+ * replaced by a summary of the callee: the outer variables it may read
+ * before assigning them, and those it assigns on every path.
+ *
+ * The same pass looks for WHILE loops that cannot end once entered
+ * (condition always true, or none of its variables assigned in the loop
+ * body or the procedures it calls), for conditions that are always true
+ * or false, and for statements that can never run. Endless loops are
+ * errors, so such programs are rejected before they are executed.
+ */
+
+typedef enum {
+    WARN_UNASSIGNED,        // variable may be read before it is assigned
+    WARN_DEAD_STORE,        // assigned value is never read
+    WARN_CONSTANT_CONDITION,// IF condition is always true
+    WARN_UNREACHABLE,       // statement can never run
+    ERROR_ENDLESS_LOOP      // WHILE loop never ends once entered
+} DataflowWarningKind;
+
+typedef struct {
+    DataflowWarningKind kind;
+    int line;
+    const char* name;       // the variable; ERROR_ENDLESS_LOOP: first one of
+                            // the condition, NULL if it has none
+    const char* callee;     // WARN_UNASSIGNED: procedure whose call reads it, or NULL
+    int count;              // ERROR_ENDLESS_LOOP: variables in the condition
+} DataflowWarning;
+
+typedef struct {
+    DataflowWarning* warnings;  // sorted by line
+    int warning_count;
+    int warning_capacity;
+    int error_count;            // ERROR_ENDLESS_LOOP entries
+    CancelToken* cancel;        // polled per statement and procedure, or NULL
+    OverflowMode overflow;      // how constant conditions are folded, as
+                                // the interpreter would compute them
+    char error_msg[256];
+} DataflowContext;
+
+// Data-flow analysis function declarations
+DataflowContext* create_dataflow_context(void);
+void free_dataflow_context(DataflowContext* ctx);
+bool analyze_dataflow(DataflowContext* ctx, Node* program);
+void print_dataflow_warnings(const DataflowContext* ctx, FILE* out);
+bool run_dataflow_analysis(Node* ast, const Options* opts);
+
+#endif // DATAFLOW_H
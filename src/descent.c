@@ -0,0 +1,702 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "ast.h"
+#include "cancel.h"
+#include "cst.h"
+#include "descent.h"
+#include "parser.tab.h"
+#include "stream.h"
+
+extern Node* ast_root;
+extern int parse_error_count;
+extern int yylex(void);
+extern void yyerror(const char* s);
+
+// Statements and parentheses nest at most this deep; the parser recurses
+// on the C stack
+#define MAX_NESTING 10000
+
+// Sets of tokens, one bit per token kind (bit 0: end of input)
+typedef uint64_t TokenSet;
+#define TOKEN_BIT(kind) ((TokenSet)1 << ((kind) == TOK_YYEOF ? 0 : (kind) - TOK_YYerror))
+#define BIT_TOKEN(bit)  ((bit) == 0 ? TOK_YYEOF : (bit) + TOK_YYerror)
+_Static_assert(TOK_DOT - TOK_YYerror < 64, "token kinds must fit into a TokenSet");
+
+// Where statements and declaration items may end; after an error the
+// tokens before the next of these are skipped
+#define STATEMENT_END (TOKEN_BIT(TOK_SEMICOLON) | TOKEN_BIT(TOK_END) | TOKEN_BIT(TOK_DOT))
+#define ITEM_END      (TOKEN_BIT(TOK_COMMA) | TOKEN_BIT(TOK_SEMICOLON))
+#define FACTOR_START  (TOKEN_BIT(TOK_IDENT) | TOKEN_BIT(TOK_NUM) | TOKEN_BIT(TOK_LPAREN))
+#define EXPRESSION_START (FACTOR_START | TOKEN_BIT(TOK_PLUS) | TOKEN_BIT(TOK_MINUS))
+
+// After an expression an operator could always follow as well, so no
+// expected tokens are listed there (Bison lists at most four)
+#define AFTER_EXPRESSION 0
+
+// Like Bison, errors right after an error are not reported: the parser
+// must have accepted this many tokens since the last one, reported or not
+#define TOKENS_BETWEEN_ERRORS 3
+
+typedef struct {
+    int token;           // lookahead
+    YYSTYPE value;       // its semantic value
+    YYLTYPE loc;         // its location
+    YYLTYPE last;        // location of the last token accepted
+    int accepted;        // tokens accepted since the last error
+    int depth;           // nesting of statements and expressions
+    bool error;          // a syntax error the enclosing statement or item
+                         // has to recover from
+    bool aborted;        // give up: the input ended while recovering,
+                         // or the parse was cancelled
+    int result;          // of descent_parse()
+    CancelToken* cancel; // polled per statement and procedure, or NULL
+
+    // Quiet parses of a token array (descent_parse_procedures() and
+    // descent_parse_program()) give up at the first error without
+    // reporting it, and their nodes borrow names from the array
+    const TokenBuffer* tokens;
+    TokenCursor cursor;
+    Node* dropped;       // nodes recovery let go, freed by the caller
+    char* error_msg;     // descent_parse_tokens(): where the first error
+    size_t error_size;   // is described, NULL for other parses
+} Parser;
+
+static const char* token_name(int token) {
+    switch (token) {
+        case TOK_YYEOF:     return "end of file";
+        case TOK_NUM:       return "NUM";
+        case TOK_IDENT:     return "IDENT";
+        case TOK_CONST:     return "CONST";
+        case TOK_VAR:       return "VAR";
+        case TOK_PROC:      return "PROC";
+        case TOK_ASSIGN:    return "ASSIGN";
+        case TOK_CALL:      return "CALL";
+        case TOK_READ:      return "READ";
+        case TOK_WRITE:     return "WRITE";
+        case TOK_BEGIN:     return "BEGIN";
+        case TOK_END:       return "END";
+        case TOK_IF:        return "IF";
+        case TOK_THEN:      return "THEN";
+        case TOK_WHILE:     return "WHILE";
+        case TOK_DO:        return "DO";
+        case TOK_ODD:       return "ODD";
+        case TOK_EQ:        return "EQ";
+        case TOK_NEQ:       return "NEQ";
+        case TOK_LT:        return "LT";
+        case TOK_LTE:       return "LTE";
+        case TOK_GT:        return "GT";
+        case TOK_GTE:       return "GTE";
+        case TOK_PLUS:      return "PLUS";
+        case TOK_MINUS:     return "MINUS";
+        case TOK_MULT:      return "MULT";
+        case TOK_DIV:       return "DIV";
+        case TOK_LPAREN:    return "LPAREN";
+        case TOK_RPAREN:    return "RPAREN";
+        case TOK_SEMICOLON: return "SEMICOLON";
+        case TOK_COMMA:     return "COMMA";
+        case TOK_DOT:       return "DOT";
+        default:            return "invalid token";
+    }
+}
+
+static void read_token(Parser* p) {
+    if (!p->tokens) {
+        p->token = yylex();
+        p->value = yylval;
+        p->loc = yylloc;
+        return;
+    }
+    int index = cursor_next(p->tokens, &p->cursor);
+    const Token* token = &p->tokens->tokens[index];
+    p->token = token_kind(token);
+    if (p->token == TOK_IDENT) {
+        p->value.name = token->value >= 0 ? p->tokens->names[token->value] : NULL;
+    } else {
+        p->value.value = token->value;
+    }
+    p->loc.first_line = p->loc.last_line = p->cursor.line;
+    p->loc.first_token = p->loc.last_token = index;
+}
+
+// Free a subtree recovery let go of; a quiet parse leaves it to the caller
+static void drop(Parser* p, Node* node) {
+    if (!p->tokens) {
+        free_ast(node);
+    } else if (node) {
+        // Kept under an error node, as only statements and declarations
+        // have room for a list link
+        Node* holder = new_node(NODE_ERROR);
+        if (!holder) return;  // out of memory: left to its arena
+        set_node_left(holder, node);
+        set_node_next(holder, p->dropped);
+        p->dropped = holder;
+    }
+}
+
+// Accept the lookahead and read the next token
+static void next(Parser* p) {
+    p->last = p->loc;
+    p->accepted++;
+    read_token(p);
+}
+
+// Skip the lookahead; an identifier's name is released. Skipped tokens
+// still end up in the location of what is being recovered, as in Bison
+static void discard(Parser* p) {
+    if (p->token == TOK_IDENT && !p->tokens) release_name(p->value.name);
+    p->last = p->loc;
+    read_token(p);
+}
+
+// Describe the lookahead as unexpected, with up to four expected tokens
+// in the style of Bison's detailed messages
+static void describe_error(const Parser* p, TokenSet expected, char* message, size_t size) {
+    int length = snprintf(message, size, "syntax error, unexpected %s", token_name(p->token));
+    int count = 0;
+    for (TokenSet set = expected; set; set &= set - 1) count++;
+    if (count > 0 && count <= 4) {
+        const char* separator = ", expecting ";
+        for (int bit = 0; bit < 64 && (size_t)length < size; bit++) {
+            if (!(expected & ((TokenSet)1 << bit))) continue;
+            length += snprintf(message + length, size - (size_t)length, "%s%s",
+                               separator, token_name(BIT_TOKEN(bit)));
+            separator = " or ";
+        }
+    }
+}
+
+// Report the lookahead as unexpected and start recovering; a quiet parse
+// gives up instead
+static void syntax_error(Parser* p, TokenSet expected) {
+    p->error = true;
+    if (p->tokens) {
+        if (p->error_msg && !p->aborted) {
+            char message[256];
+            describe_error(p, expected, message, sizeof(message));
+            snprintf(p->error_msg, p->error_size, "line %d: %s", p->loc.first_line, message);
+        }
+        p->aborted = true;
+        return;
+    }
+    bool report = !p->aborted && p->accepted >= TOKENS_BETWEEN_ERRORS;
+    p->accepted = 0;
+    if (!report) return;
+
+    char message[256];
+    describe_error(p, expected, message, sizeof(message));
+    yyerror(message);
+}
+
+// Skip to the next token in stop; the parse is aborted if the input
+// ends first
+static void recover(Parser* p, TokenSet stop) {
+    p->error = false;
+    if (p->tokens) return;  // a quiet parse has given up already
+    while (!(TOKEN_BIT(p->token) & stop)) {
+        if (p->token == TOK_YYEOF) {
+            p->aborted = true;
+            return;
+        }
+        discard(p);
+    }
+}
+
+static bool expect(Parser* p, int token) {
+    if (p->token == token) {
+        next(p);
+        return true;
+    }
+    syntax_error(p, TOKEN_BIT(token));
+    return false;
+}
+
+// Location of an empty construct starting at the lookahead
+static YYLTYPE empty_location(const Parser* p) {
+    YYLTYPE loc = p->last;
+    loc.first_line = loc.last_line;
+    loc.first_token = loc.last_token + 1;
+    return loc;
+}
+
+// Record the tokens a node was parsed from, if there are any
+static Node* set_tokens(Node* node, YYLTYPE first, YYLTYPE last) {
+    if (last.last_token >= 0) set_node_span(node, first.first_token, last.last_token);
+    return node;
+}
+
+// Identifier node for the lookahead, which must be an IDENT; the node
+// takes over the token's reference to the name
+static Node* accept_ident(Parser* p) {
+    Node* node = new_node(NODE_IDENT);
+    set_node_name(node, p->value.name);
+    set_tokens(node, p->loc, p->loc);
+    next(p);
+    return node;
+}
+
+static Node* new_error(int line) {
+    Node* node = new_node(NODE_ERROR);
+    set_node_line(node, line);
+    return node;
+}
+
+static Node* new_binary(OpType op, Node* left, Node* right) {
+    Node* node = new_node(NODE_BINARY_OP);
+    set_node_left(node, left);
+    set_node_right(node, right);
+    set_node_op(node, op);
+    return node;
+}
+
+// Guard the C stack against deeply nested input
+static bool enter(Parser* p) {
+    if (++p->depth <= MAX_NESTING) return true;
+    if (!p->aborted && !p->tokens) yyerror("nesting too deep");
+    if (!p->aborted && p->error_msg) {
+        snprintf(p->error_msg, p->error_size, "line %d: nesting too deep", p->loc.first_line);
+    }
+    p->aborted = true;
+    p->result = 2;
+    return false;
+}
+
+// Give up once the parse is cancelled (cancel.h)
+static bool cancelled(Parser* p) {
+    if (!poll_cancel(p->cancel)) return false;
+    if (!p->aborted && p->error_msg) snprintf(p->error_msg, p->error_size, "Cancelled");
+    p->aborted = true;
+    p->result = 1;
+    return true;
+}
+
+static Node* parse_expression(Parser* p);
+
+// Share an expression node when hash-consing (ast.h); not in quiet
+// parses, whose nodes are freed one by one
+static Node* share(const Parser* p, Node* node) {
+    return p->tokens ? node : share_expr(node);
+}
+
+// factor = ident | number | "(" expression ")"
+static Node* parse_factor(Parser* p) {
+    Node* node = NULL;
+    switch (p->token) {
+        case TOK_IDENT:
+            return share(p, accept_ident(p));
+        case TOK_NUM:
+            node = set_tokens(new_number(p->value.value), p->loc, p->loc);
+            next(p);
+            return share(p, node);
+        case TOK_LPAREN:
+            next(p);
+            node = parse_expression(p);
+            if (!p->error && p->token != TOK_RPAREN) syntax_error(p, AFTER_EXPRESSION);
+            if (!p->error) next(p);
+            return node;
+        default:
+            syntax_error(p, FACTOR_START);
+            return NULL;
+    }
+}
+
+static int precedence(int token) {
+    switch (token) {
+        case TOK_PLUS:
+        case TOK_MINUS: return 1;
+        case TOK_MULT:
+        case TOK_DIV:   return 2;
+        default:        return 0;
+    }
+}
+
+static OpType binary_op(int token) {
+    switch (token) {
+        case TOK_PLUS:  return OP_PLUS;
+        case TOK_MINUS: return OP_MINUS;
+        case TOK_MULT:  return OP_MULT;
+        default:        return OP_DIV;
+    }
+}
+
+// Precedence climbing: extend left with the operators of at least
+// min_precedence that follow it; all operators are left-associative
+static Node* parse_operators(Parser* p, Node* left, int min_precedence) {
+    while (!p->error && precedence(p->token) >= min_precedence) {
+        int current = precedence(p->token);
+        OpType op = binary_op(p->token);
+        next(p);
+        Node* right = parse_factor(p);
+        while (!p->error && precedence(p->token) > current) {
+            right = parse_operators(p, right, current + 1);
+        }
+        left = share(p, new_binary(op, left, right));
+    }
+    return left;
+}
+
+// expression = [ "+" | "-" ] term { ("+" | "-") term }, term = factor
+// { ("*" | "/") factor }; a leading "-" multiplies the first term by -1
+static Node* parse_expression(Parser* p) {
+    if (!(TOKEN_BIT(p->token) & EXPRESSION_START)) {
+        syntax_error(p, EXPRESSION_START);
+        return NULL;
+    }
+    if (!enter(p)) return NULL;
+    Node* node;
+    if (p->token == TOK_PLUS || p->token == TOK_MINUS) {
+        bool negate = p->token == TOK_MINUS;
+        next(p);
+        node = parse_operators(p, parse_factor(p), 2);
+        if (negate) node = share(p, new_binary(OP_MULT, share(p, new_number(-1)), node));
+    } else {
+        node = parse_factor(p);
+    }
+    node = parse_operators(p, node, 1);
+    p->depth--;
+    return node;
+}
+
+static OpType relation_op(int token) {
+    switch (token) {
+        case TOK_EQ:  return OP_EQ;
+        case TOK_NEQ: return OP_NEQ;
+        case TOK_LT:  return OP_LT;
+        case TOK_LTE: return OP_LTE;
+        case TOK_GT:  return OP_GT;
+        case TOK_GTE: return OP_GTE;
+        default:      return OP_ODD;
+    }
+}
+
+// condition = "ODD" expression | expression relation expression
+static Node* parse_condition(Parser* p) {
+    Node* node = new_node(NODE_CONDITION);
+    if (!(TOKEN_BIT(p->token) & (EXPRESSION_START | TOKEN_BIT(TOK_ODD)))) {
+        syntax_error(p, EXPRESSION_START | TOKEN_BIT(TOK_ODD));
+        return node;
+    }
+    if (p->token == TOK_ODD) {
+        next(p);
+        set_node_op(node, OP_ODD);
+        set_node_left(node, parse_expression(p));
+        return node;
+    }
+    set_node_left(node, parse_expression(p));
+    if (p->error) return node;
+    set_node_op(node, relation_op(p->token));
+    if (node_op(node) == OP_ODD) {
+        syntax_error(p, AFTER_EXPRESSION);
+        return node;
+    }
+    next(p);
+    set_node_right(node, parse_expression(p));
+    return node;
+}
+
+static Node* parse_statement(Parser* p);
+
+// "BEGIN" statement { ";" statement } "END", without empty statements
+static void parse_compound(Parser* p, Node* compound) {
+    next(p);
+    NodeOffset* tail = node_left_link(compound);
+    for (;;) {
+        Node* stmt = parse_statement(p);
+        if (stmt) {
+            *tail = node_offset(stmt);
+            tail = node_next_link(stmt);
+        }
+        if (p->aborted || p->token != TOK_SEMICOLON) break;
+        next(p);
+    }
+    if (p->aborted) return;
+    if (p->token == TOK_END) {
+        next(p);
+    } else {
+        syntax_error(p, TOKEN_BIT(TOK_END) | TOKEN_BIT(TOK_SEMICOLON));
+    }
+}
+
+// A statement, NULL if it is empty. One that does not parse, or is not
+// followed by a token that can end it, becomes a NODE_ERROR
+static Node* parse_statement(Parser* p) {
+    YYLTYPE first = p->loc;
+    Node* stmt = NULL;
+    if (cancelled(p) || !enter(p)) return NULL;
+
+    switch (p->token) {
+        case TOK_IDENT:
+            stmt = new_node(NODE_ASSIGN);
+            set_node_left(stmt, accept_ident(p));
+            if (expect(p, TOK_ASSIGN)) set_node_right(stmt, parse_expression(p));
+            break;
+        case TOK_CALL:
+        case TOK_READ:
+            stmt = new_node(p->token == TOK_CALL ? NODE_CALL : NODE_INPUT);
+            next(p);
+            if (p->token == TOK_IDENT) {
+                set_node_left(stmt, accept_ident(p));
+            } else {
+                syntax_error(p, TOKEN_BIT(TOK_IDENT));
+            }
+            break;
+        case TOK_WRITE:
+            stmt = new_node(NODE_OUTPUT);
+            next(p);
+            set_node_left(stmt, parse_expression(p));
+            break;
+        case TOK_BEGIN:
+            stmt = new_node(NODE_COMPOUND);
+            parse_compound(p, stmt);
+            break;
+        case TOK_IF:
+        case TOK_WHILE: {
+            bool is_if = p->token == TOK_IF;
+            stmt = new_node(is_if ? NODE_IF : NODE_WHILE);
+            next(p);
+            set_node_left(stmt, parse_condition(p));
+            if (!p->error && p->token != (is_if ? TOK_THEN : TOK_DO)) {
+                syntax_error(p, AFTER_EXPRESSION);
+            }
+            if (!p->error) {
+                next(p);
+                set_node_right(stmt, parse_statement(p));
+            }
+            break;
+        }
+        default:
+            if (!(TOKEN_BIT(p->token) & STATEMENT_END)) syntax_error(p, 0);
+            break;
+    }
+
+    if (!p->error && !p->aborted && !(TOKEN_BIT(p->token) & STATEMENT_END)) {
+        bool expression_last = stmt && (stmt->type == NODE_ASSIGN || stmt->type == NODE_OUTPUT);
+        syntax_error(p, expression_last ? AFTER_EXPRESSION : STATEMENT_END);
+    }
+    if (p->error) {
+        drop(p, stmt);
+        stmt = new_error(first.first_line);
+        recover(p, STATEMENT_END);
+    } else if (stmt) {
+        set_tokens(stmt, first, p->last);
+        set_node_line(stmt, first.first_line);
+    }
+    p->depth--;
+    return stmt;
+}
+
+// One item of a CONST or VAR list: ident "=" number, or ident; an item
+// that does not parse becomes a NODE_ERROR
+static Node* parse_item(Parser* p, bool constant) {
+    YYLTYPE first = p->loc;
+    Node* item = new_node(constant ? NODE_CONST_DECL : NODE_VAR_DECL);
+    if (p->token != TOK_IDENT) {
+        syntax_error(p, TOKEN_BIT(TOK_IDENT));
+    } else {
+        set_node_left(item, accept_ident(p));
+        if (constant && expect(p, TOK_EQ)) {
+            if (p->token == TOK_NUM) {
+                set_node_right(item, set_tokens(new_number(p->value.value), p->loc, p->loc));
+                next(p);
+            } else {
+                syntax_error(p, TOKEN_BIT(TOK_NUM));
+            }
+        }
+        if (!p->error && !(TOKEN_BIT(p->token) & ITEM_END)) syntax_error(p, ITEM_END);
+    }
+    if (p->error) {
+        drop(p, item);
+        recover(p, ITEM_END);
+        return new_error(first.first_line);
+    }
+    return set_tokens(item, first, p->last);
+}
+
+// item { "," item } ";", appended to *tail; returns the new tail
+static NodeOffset* parse_items(Parser* p, NodeOffset* tail, bool constant) {
+    next(p);
+    for (;;) {
+        Node* item = parse_item(p, constant);
+        *tail = node_offset(item);
+        tail = node_next_link(item);
+        if (p->aborted || p->token != TOK_COMMA) break;
+        next(p);
+    }
+    if (!p->aborted) next(p);  // the ";"
+    return tail;
+}
+
+static Node* parse_block(Parser* p);
+
+// "PROCEDURE" ident ";" block ";". A malformed header or a missing ";"
+// after the block makes the procedure a NODE_ERROR that keeps its body
+static Node* parse_procedure(Parser* p) {
+    if (cancelled(p)) return NULL;
+    YYLTYPE first = p->loc;
+    next(p);
+    int error_line = p->loc.first_line;
+    Node* name = NULL;
+    if (p->token == TOK_IDENT) {
+        name = accept_ident(p);
+        if (p->token != TOK_SEMICOLON) syntax_error(p, TOKEN_BIT(TOK_SEMICOLON));
+    } else {
+        syntax_error(p, TOKEN_BIT(TOK_IDENT));
+    }
+    bool header_error = p->error;
+    if (header_error) recover(p, TOKEN_BIT(TOK_SEMICOLON));
+    if (p->aborted) {
+        drop(p, name);
+        return NULL;
+    }
+    next(p);
+    if (!header_error && !p->tokens) stream_procedure_header(node_name(name));
+
+    Node* body = parse_block(p);
+    if (!p->aborted && p->token != TOK_SEMICOLON) {
+        syntax_error(p, TOKEN_BIT(TOK_SEMICOLON) | TOKEN_BIT(TOK_DOT));
+        recover(p, TOKEN_BIT(TOK_SEMICOLON));
+        header_error = true;
+    }
+    if (!p->aborted) next(p);
+
+    if (header_error) {
+        drop(p, name);
+        Node* error = new_error(error_line);
+        set_node_right(error, body);
+        return error;
+    }
+    Node* proc = set_tokens(new_node(NODE_PROC), first, p->last);
+    set_node_line(proc, first.first_line);
+    set_node_left(proc, name);
+    set_node_right(proc, body);
+    if (!p->tokens) stream_procedure(proc);
+    return proc;
+}
+
+// block = [ "CONST" ... ";" ] [ "VAR" ... ";" ] { procedure } statement;
+// the constants are the block's left list, variables, procedures and the
+// statement its right list
+static Node* parse_block(Parser* p) {
+    YYLTYPE first = empty_location(p);
+    Node* block = new_node(NODE_BLOCK);
+    if (p->token == TOK_CONST) parse_items(p, node_left_link(block), true);
+
+    NodeOffset* tail = node_right_link(block);
+    if (!p->aborted && p->token == TOK_VAR) tail = parse_items(p, tail, false);
+    if (!p->aborted && !p->tokens) stream_block_declarations(node_left(block), node_right(block));
+    if (!p->tokens) enter_expr_scope();
+    while (!p->aborted && p->token == TOK_PROC) {
+        Node* proc = parse_procedure(p);
+        if (!proc) break;
+        *tail = node_offset(proc);
+        tail = node_next_link(proc);
+    }
+    if (!p->aborted) *tail = node_offset(parse_statement(p));
+    if (!p->tokens) leave_expr_scope();
+    return set_tokens(block, first, p->last);
+}
+
+// Start a parser at the first token, of tokens at cursor for a quiet parse
+static void start_parser(Parser* p, const TokenBuffer* tokens, const TokenCursor* cursor) {
+    p->tokens = tokens;
+    p->cancel = analysis_cancel;
+    if (tokens) p->cursor = *cursor;
+    p->last.first_line = p->last.last_line = tokens ? cursor->line : 1;
+    p->last.first_token = p->last.last_token = tokens ? cursor->next - 1 : -1;
+    p->accepted = TOKENS_BETWEEN_ERRORS;
+    p->result = 1;
+    read_token(p);
+}
+
+// program = block "." ; returns the NODE_PROGRAM, NULL if the input could
+// not be parsed
+static Node* parse_program(Parser* p) {
+    Node* block = parse_block(p);
+    if (!p->aborted && expect(p, TOK_DOT) && p->token != TOK_YYEOF) {
+        syntax_error(p, TOKEN_BIT(TOK_YYEOF));
+    }
+    if (p->aborted || p->error) {
+        if (p->token == TOK_IDENT && !p->tokens) release_name(p->value.name);
+        drop(p, block);
+        return NULL;
+    }
+    Node* program = new_node(NODE_PROGRAM);
+    set_node_left(program, block);
+    return program;
+}
+
+// Parse the scanner's input; sets ast_root and returns 0 like yyparse(),
+// or 1 if the input could not be parsed (2 if it nests too deeply)
+int descent_parse(void) {
+    Parser parser = { 0 };
+    ast_root = NULL;
+    parse_error_count = 0;
+    start_parser(&parser, NULL, NULL);
+    ast_root = parse_program(&parser);
+    return ast_root ? 0 : parser.result;
+}
+
+// Quietly parse the procedures in tokens first..last, which start on line
+bool descent_parse_procedures(const TokenBuffer* tokens, int first, int last, int line,
+                              Node** nodes) {
+    Parser parser = { 0 };
+    Parser* p = &parser;
+    bool spans = record_node_spans(true);
+    TokenCursor cursor = token_cursor(tokens, first, line);
+    start_parser(p, tokens, &cursor);
+    NodeOffset procs = 0;
+    NodeOffset* tail = &procs;
+    while (!p->aborted && p->token == TOK_PROC && p->loc.first_token <= last) {
+        Node* proc = parse_procedure(p);
+        if (!proc) break;
+        *tail = node_offset(proc);
+        tail = node_next_link(proc);
+    }
+    bool parsed = !p->aborted && !p->error && p->loc.first_token == last + 1;
+    if (!parsed) *tail = node_offset(p->dropped);
+    *nodes = node_at(procs);
+    record_node_spans(spans);
+    return parsed;
+}
+
+// Quietly parse the program in tokens, passing over tokens skip_first..
+// skip_last
+bool descent_parse_program(const TokenBuffer* tokens, int skip_first, int skip_last,
+                           Node** nodes) {
+    Parser parser = { 0 };
+    bool spans = record_node_spans(true);
+    TokenCursor cursor = token_cursor(tokens, 0, token_line(tokens, 0));
+    cursor.skip_first = skip_first;
+    cursor.skip_last = skip_last;
+    start_parser(&parser, tokens, &cursor);
+    *nodes = parse_program(&parser);
+    record_node_spans(spans);
+    if (*nodes) return true;
+    *nodes = parser.dropped;
+    return false;
+}
+
+// Quietly parse the whole program in tokens, polling cancel; NULL if it
+// does not parse, with the first syntax error described in error_msg
+Node* descent_parse_tokens(const TokenBuffer* tokens, CancelToken* cancel, char* error_msg,
+                           size_t size) {
+    Parser parser = { 0 };
+    parser.error_msg = error_msg;
+    parser.error_size = size;
+    if (size > 0) error_msg[0] = '\0';
+    TokenCursor cursor = token_cursor(tokens, 0, token_line(tokens, 0));
+    start_parser(&parser, tokens, &cursor);
+    parser.cancel = cancel;
+    Node* program = parse_program(&parser);
+    free_borrowed_ast(parser.dropped);
+    return program;
+}
+
+ParseFunction parser_function(ParserKind kind) {
+    return kind == PARSER_DESCENT ? descent_parse : yyparse;
+}
+
+// Parse the scanner's input with the chosen parser
+int run_parser(ParserKind kind) {
+    return parser_function(kind)();
+}
@@ -0,0 +1,59 @@
+#ifndef DESCENT_H
+#define DESCENT_H
+
+#include <stdbool.h>
+#include "ast.h"
+#include "cancel.h"
+#include "cst.h"
+
+/* Hand-written recursive-descent parser, an alternative to the Bison
+ * parser in parser.y. It reads the same tokens from yylex(), builds the
+ * same tree into ast_root (lists are built in order, statement and
+ * declaration nodes get the same lines and token spans) and reports
+ * through yyerror() and parse_error_count like yyparse(). Like yyparse(),
+ * it polls analysis_cancel (cancel.h) per statement and procedure.
+ *
+ * Syntax errors are recovered from as in the Bison grammar: a statement,
+ * constant, variable or procedure header that does not parse becomes a
+ * NODE_ERROR and the tokens up to the next one are skipped. Which tokens
+ * get skipped after an error may differ between the two parsers on some
+ * inputs; on programs without errors the trees are identical.
+ */
+
+typedef enum {
+    PARSER_BISON,        // yyparse()
+    PARSER_DESCENT       // descent_parse()
+} ParserKind;
+
+typedef int (*ParseFunction)(void);
+
+/* Quiet parses of part of a token array, for parsing one source on
+ * several threads (parallel_parse.h). They give up at the first syntax
+ * error without reporting it, and return false. Their nodes borrow the
+ * names of identifiers from tokens->names without taking references;
+ * before they are freed the caller has to add one for each identifier
+ * node. On failure *nodes lists everything that was built.
+ *
+ * descent_parse_procedures() parses the procedure declarations in tokens
+ * first..last, which start on line, into a list; descent_parse_program()
+ * the whole program except for tokens skip_first..skip_last, into a
+ * NODE_PROGRAM; both record the spans of their nodes (ast.h).
+ * descent_parse_tokens() parses the whole program, recording no spans, and
+ * frees what it built if that fails; it touches no global state (no
+ * ast_root, parse_error_count, analysis_cancel or scanner) and polls the
+ * token it is given instead, so the embedding API (pl0.hpp) is built on
+ * it.
+ */
+
+// Parser function declarations
+int descent_parse(void);
+bool descent_parse_procedures(const TokenBuffer* tokens, int first, int last, int line,
+                              Node** nodes);
+bool descent_parse_program(const TokenBuffer* tokens, int skip_first, int skip_last,
+                           Node** nodes);
+Node* descent_parse_tokens(const TokenBuffer* tokens, CancelToken* cancel, char* error_msg,
+                           size_t size);
+ParseFunction parser_function(ParserKind kind);
+int run_parser(ParserKind kind);
+
+#endif // DESCENT_H
@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "options.h"
+#include "ast.h"
+#include "cancel.h"
+#include "cst.h"
+#include "type_check.h"
+#include "semantic.h"
+#include "dataflow.h"
+#include "emit_c.h"
+#include "interp.h"
+#include "driver.h"
+#include "parallel_parse.h"
+#include "stream.h"
+#include "trace.h"
+
+extern FILE* yyin;
+extern void yyrestart(FILE* file);
+extern int yylineno;
+extern Node* ast_root;
+extern int parse_error_count;
+
+// --prelex: the tokens of the input, which the AST points into
+static TokenBuffer* input_tokens = NULL;
+
+static void print_phase_separator(const Options* opts) {
+    // Keep emitted ASTs, C and program output free of decoration
+    if (opts->emit_ast != AST_FORMAT_NONE || opts->emit_c || opts->interpret) return;
+    fprintf(opts->output, "\n------------------------------------------------\n");
+}
+
+// Release the AST and close the files
+static void cleanup(const Options* opts) {
+    trace_begin("cleanup", opts->input_file);
+    free_ast(ast_root);
+    ast_root = NULL;
+    share_expressions(false);
+    free_token_buffer(input_tokens);
+    input_tokens = NULL;
+    free_analysis_stream(analysis_stream);
+    analysis_stream = NULL;
+    free_cancel_token(analysis_cancel);
+    analysis_cancel = NULL;
+    fclose(yyin);
+    if (opts->output != stdout) fclose(opts->output);
+    trace_end();
+}
+
+// Exit status of a run a phase has failed: EXIT_CANCELLED if the phase
+// gave up because the --timeout budget was used up, which is reported
+// here instead of by the phase
+static int failure_status(const Options* opts) {
+    if (!cancel_requested(analysis_cancel)) return 1;
+    fprintf(stderr, "Timeout Error: Parsing and analysis took longer than %llu ms\n",
+            opts->timeout_ms);
+    return EXIT_CANCELLED;
+}
+
+static double elapsed_ms(const struct timespec* start, const struct timespec* end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e3 + (double)(end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// --prelex: lex the whole input into a token array first, then parse the
+// array; with -v both passes are timed. With --jobs the top-level
+// procedures of large inputs are parsed on several threads
+static int prelex_and_parse(const Options* opts) {
+    trace_begin("read input", opts->input_file);
+    input_tokens = read_token_buffer(yyin);
+    trace_end();
+    if (!input_tokens) {
+        perror(opts->input_file);
+        return 1;
+    }
+    struct timespec start, lexed, parsed;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    trace_begin("scan", opts->input_file);
+    lex_tokens(input_tokens);
+    trace_end();
+    clock_gettime(CLOCK_MONOTONIC, &lexed);
+    TaskPool* pool = opts->jobs > 1 ? create_task_pool(opts->jobs) : NULL;
+    ParseFunction parse = parser_function(opts->parser);
+    trace_begin("parse", opts->input_file);
+    int result = pool ? parse_tokens_parallel(input_tokens, parse, pool)
+                      : parse_tokens_with(input_tokens, parse);
+    trace_end();
+    free_task_pool(pool);
+    clock_gettime(CLOCK_MONOTONIC, &parsed);
+    if (opts->verbose && opts->prelex) {
+        fprintf(opts->output, "Lexed %d tokens in %.3f ms, parsed them in %.3f ms\n",
+                input_tokens->count, elapsed_ms(&start, &lexed), elapsed_ms(&lexed, &parsed));
+    }
+    return result;
+}
+
+// Run the requested phases on opts->input_file and return the process
+// exit status. Everything the run allocated is released again, and the
+// scanner keeps its buffer for the next run.
+int run_pipeline(const Options* opts) {
+    // Open input file
+    yyin = fopen(opts->input_file, "r");
+    if (!yyin) {
+        perror(opts->input_file);
+        if (opts->output != stdout) fclose(opts->output);
+        return 1;
+    }
+    yyrestart(yyin);
+
+    // --timeout: the parsers and phases poll the deadline, and give up
+    // once it has passed
+    if (opts->timeout_ms > 0) {
+        analysis_cancel = create_cancel_token(opts->timeout_ms);
+        if (!analysis_cancel) {
+            fprintf(stderr, "Error: Out of memory\n");
+            cleanup(opts);
+            return 1;
+        }
+    }
+
+    // Phase 0: Parsing
+    if (opts->verbose) {
+        print_phase_separator(opts);
+        fprintf(opts->output, "Phase 0: Parsing\n");
+    }
+    
+    // --stream: procedures are analyzed by the parser's hooks
+    if (opts->stream) {
+        analysis_stream = create_analysis_stream(opts);
+        if (!analysis_stream) {
+            fprintf(stderr, "Error: Failed to create streaming analysis context\n");
+            cleanup(opts);
+            return 1;
+        }
+    }
+
+    share_expressions(opts->hash_cons);
+    yylineno = 1;
+    bool prelex = opts->prelex || opts->jobs > 1;
+    int parse_result;
+    if (prelex) {
+        parse_result = prelex_and_parse(opts);
+    } else {
+        // The scanner reads and scans the input as the parser asks for tokens
+        trace_begin("parse", opts->input_file);
+        parse_result = run_parser(opts->parser);
+        trace_end();
+    }
+    
+    if (parse_result != 0) {
+        int status = failure_status(opts);
+        if (status == 1) fprintf(stderr, "Parse Error: Failed to parse input\n");
+        cleanup(opts);
+        return status;
+    }
+    
+    // Syntax errors the parser recovered from leave NODE_ERROR placeholders
+    // in the tree; later phases skip those, so their diagnostics are still
+    // reported, but the run fails
+    if (parse_error_count > 0) {
+        fprintf(stderr, "Parse Error: %d syntax error%s\n",
+                parse_error_count, parse_error_count == 1 ? "" : "s");
+    } else if (opts->verbose) {
+        fprintf(opts->output, "Parsing completed successfully\n");
+    }
+    
+    // Report memory held by the tree; on stderr, like the profile
+    if (opts->mem_stats) {
+        print_ast_mem_stats(stderr);
+    }
+
+    // Print AST if requested
+    if (opts->print_ast) {
+        print_phase_separator(opts);
+        fprintf(opts->output, "Abstract Syntax Tree:\n");
+        print_ast(ast_root, 0);
+    }
+
+    // Emit machine-readable AST if requested
+    if (opts->emit_ast != AST_FORMAT_NONE) {
+        trace_begin("emit_ast", opts->input_file);
+        bool emitted = emit_ast(opts->output, ast_root, opts->emit_ast);
+        trace_end();
+        if (!emitted) {
+            fprintf(stderr, "Error: Failed to write AST\n");
+            cleanup(opts);
+            return 1;
+        }
+    }
+    
+    // Phase 1-2 with --stream: the procedures were analyzed while parsing,
+    // the main statement is left
+    if (analysis_stream) {
+        print_phase_separator(opts);
+        trace_begin("finish_analysis_stream", opts->input_file);
+        bool finished = finish_analysis_stream(analysis_stream, ast_root, opts);
+        trace_end();
+        if (!finished) {
+            int status = failure_status(opts);
+            cleanup(opts);
+            return status;
+        }
+    }
+
+    // Phase 1: Type Checking
+    if (!opts->stream && !opts->skip_type_check) {
+        print_phase_separator(opts);
+        trace_begin("run_type_checking", opts->input_file);
+        bool checked = run_type_checking(ast_root, opts);
+        trace_end();
+        if (!checked) {
+            int status = failure_status(opts);
+            cleanup(opts);
+            return status;
+        }
+    }
+    
+    // Phase 2: Semantic Analysis
+    if (!opts->stream && !opts->skip_semantics) {
+        print_phase_separator(opts);
+        trace_begin("run_semantic_analysis", opts->input_file);
+        bool analyzed = run_semantic_analysis(ast_root, opts);
+        trace_end();
+        if (!analyzed) {
+            int status = failure_status(opts);
+            cleanup(opts);
+            return status;
+        }
+    }
+    
+    if (parse_error_count > 0) {
+        cleanup(opts);
+        return 1;
+    }
+    
+    // Data-flow warnings need the names resolved by semantic analysis, and
+    // the procedure bodies --stream has released
+    if (!opts->stream && !opts->skip_semantics && !opts->skip_dataflow) {
+        print_phase_separator(opts);
+        trace_begin("run_dataflow_analysis", opts->input_file);
+        bool analyzed = run_dataflow_analysis(ast_root, opts);
+        trace_end();
+        if (!analyzed) {
+            int status = failure_status(opts);
+            cleanup(opts);
+            return status;
+        }
+    }
+    
+    // Translation to C, of a program that passed all checks
+    if (opts->emit_c) {
+        trace_begin("emit_c", opts->input_file);
+        bool emitted = emit_c(opts->output, ast_root, opts->overflow);
+        trace_end();
+        if (!emitted) {
+            fprintf(stderr, "Error: Failed to write C\n");
+            cleanup(opts);
+            return 1;
+        }
+    }
+
+    // Phase 3: Execution
+    if (opts->interpret) {
+        trace_begin("run_interpreter", opts->input_file);
+        ExecStatus status = run_interpreter(ast_root, opts);
+        trace_end();
+        if (status != EXEC_OK) {
+            cleanup(opts);
+            if (status == EXEC_STEP_LIMIT) return EXIT_STEP_LIMIT;
+            if (status == EXEC_DEPTH_LIMIT) return EXIT_DEPTH_LIMIT;
+            return 1;
+        }
+    }
+    
+    // Success
+    if (opts->verbose) {
+        print_phase_separator(opts);
+        fprintf(opts->output, "All analysis phases completed successfully\n\n");
+    }
+    
+    cleanup(opts);
+    return 0;
+}
+
+
+// Parse a command line and run it; returns the process exit status
+int run_command(int argc, char** argv) {
+    Options opts;
+    int status = parse_command_line(argc, argv, &opts);
+    if (status >= 0) return status;
+    if (!opts.trace) return run_pipeline(&opts);
+
+    // The threads of --jobs have been joined when the pipeline returns
+    if (!start_trace()) {
+        fprintf(stderr, "Error: A trace is already being recorded\n");
+        if (opts.output != stdout) fclose(opts.output);
+        return 1;
+    }
+    trace_begin("run_pipeline", opts.input_file);
+    status = run_pipeline(&opts);
+    trace_end();
+    if (!finish_trace(opts.trace)) {
+        perror(opts.trace);
+        if (status == 0) status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,20 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include "options.h"
+
+/* The compiler pipeline behind the command line: parse, type check,
+ * analyze and optionally run one program. Used by main() and by the
+ * compile server, which calls it once per request in the same process.
+ */
+
+// Exit statuses besides 0 (success) and 1 (any other failure)
+#define EXIT_STEP_LIMIT 2   // --max-steps budget used up
+#define EXIT_DEPTH_LIMIT 3  // calls nested deeper than --max-depth
+#define EXIT_CANCELLED 4    // --timeout passed before parsing and analysis finished
+
+// Driver function declarations
+int run_pipeline(const Options* opts);
+int run_command(int argc, char** argv);
+
+#endif // DRIVER_H
@@ -0,0 +1,474 @@
+#include <limits.h>
+#include "emit_c.h"
+
+// ---------------------------------------------------------------------------
+// Runtime of the generated program
+// ---------------------------------------------------------------------------
+
+static const char* const runtime_head =
+    "#include <errno.h>\n"
+    "#include <stdarg.h>\n"
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#if defined(__unix__) || defined(__APPLE__)\n"
+    "#include <unistd.h>\n"
+    "#define PL0_POSIX 1\n"
+    "#endif\n"
+    "\n"
+    "#if defined(__GNUC__)\n"
+    "#define PL0_NORETURN __attribute__((noreturn))\n"
+    "#define PL0_UNUSED __attribute__((unused))\n"
+    "#else\n"
+    "#define PL0_NORETURN\n"
+    "#define PL0_UNUSED\n"
+    "#endif\n"
+    "\n"
+    "static char pl0_out[1 << 16];\n"
+    "static size_t pl0_out_len;\n"
+    "static int pl0_out_failed;\n"
+    "static char pl0_in[1 << 16];\n"
+    "static size_t pl0_in_pos, pl0_in_len;\n"
+    "static int pl0_in_eof;\n"
+    "\n"
+    "static void pl0_write_buffer(void) {\n"
+    "    if (fwrite(pl0_out, 1, pl0_out_len, stdout) != pl0_out_len) pl0_out_failed = 1;\n"
+    "    pl0_out_len = 0;\n"
+    "}\n"
+    "\n"
+    "static int pl0_flush(void) {\n"
+    "    pl0_write_buffer();\n"
+    "    return fflush(stdout) == 0 && !pl0_out_failed;\n"
+    "}\n"
+    "\n"
+    "static PL0_NORETURN void pl0_fail(int status, const char* format, ...) {\n"
+    "    va_list args;\n"
+    "    pl0_flush();\n"
+    "    fputs(\"Runtime Error: \", stderr);\n"
+    "    va_start(args, format);\n"
+    "    vfprintf(stderr, format, args);\n"
+    "    va_end(args);\n"
+    "    fputc('\\n', stderr);\n"
+    "    exit(status);\n"
+    "}\n"
+    "\n"
+    "static int pl0_finish(void) {\n"
+    "    if (!pl0_flush()) pl0_fail(1, \"Failed to write output\");\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "static inline void pl0_write(int32_t value) {\n"
+    "    char digits[10];\n"
+    "    int count = 0;\n"
+    "    uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;\n"
+    "    do {\n"
+    "        digits[count++] = (char)('0' + magnitude % 10);\n"
+    "        magnitude /= 10;\n"
+    "    } while (magnitude);\n"
+    "    if (pl0_out_len + 12 > sizeof pl0_out) pl0_write_buffer();\n"
+    "    if (value < 0) pl0_out[pl0_out_len++] = '-';\n"
+    "    while (count) pl0_out[pl0_out_len++] = digits[--count];\n"
+    "    pl0_out[pl0_out_len++] = '\\n';\n"
+    "}\n"
+    "\n"
+    "static inline int pl0_fill(void) {\n"
+    "    if (pl0_in_pos < pl0_in_len) return 1;\n"
+    "    if (pl0_in_eof) return 0;\n"
+    "    pl0_in_pos = 0;\n"
+    "#ifdef PL0_POSIX\n"
+    "    {\n"
+    "        ssize_t n;\n"
+    "        do {\n"
+    "            n = read(0, pl0_in, sizeof pl0_in);\n"
+    "        } while (n < 0 && errno == EINTR);\n"
+    "        pl0_in_len = n > 0 ? (size_t)n : 0;\n"
+    "    }\n"
+    "#else\n"
+    "    pl0_in_len = fread(pl0_in, 1, sizeof pl0_in, stdin);\n"
+    "#endif\n"
+    "    if (pl0_in_len == 0) pl0_in_eof = 1;\n"
+    "    return pl0_in_len > 0;\n"
+    "}\n"
+    "\n"
+    "static inline int pl0_space(char c) {\n"
+    "    return c == ' ' || c == '\\t' || c == '\\n' || c == '\\r';\n"
+    "}\n"
+    "\n"
+    "static inline void pl0_read(int32_t* variable, const char* name) {\n"
+    "    int negative = 0, digits = 0;\n"
+    "    int64_t magnitude = 0;\n"
+    "    if (pl0_in_pos == pl0_in_len) pl0_flush();\n"
+    "    for (;;) {\n"
+    "        if (!pl0_fill()) pl0_fail(1, \"Unexpected end of input reading '%s'\", name);\n"
+    "        if (!pl0_space(pl0_in[pl0_in_pos])) break;\n"
+    "        pl0_in_pos++;\n"
+    "    }\n"
+    "    if (pl0_in[pl0_in_pos] == '-' || pl0_in[pl0_in_pos] == '+') {\n"
+    "        negative = pl0_in[pl0_in_pos++] == '-';\n"
+    "    }\n"
+    "    while (pl0_fill()) {\n"
+    "        unsigned digit = (unsigned char)pl0_in[pl0_in_pos] - '0';\n"
+    "        if (digit > 9) break;\n"
+    "        if (magnitude <= 2147483648LL) magnitude = magnitude * 10 + digit;\n"
+    "        digits++;\n"
+    "        pl0_in_pos++;\n"
+    "    }\n"
+    "    if (digits == 0 || (pl0_fill() && !pl0_space(pl0_in[pl0_in_pos]))) {\n"
+    "        pl0_fail(1, \"Invalid input reading '%s', expected an integer\", name);\n"
+    "    }\n"
+    "    if (magnitude > (negative ? 2147483648LL : 2147483647LL)) {\n"
+    "        pl0_fail(1, \"Input value for '%s' out of range\", name);\n"
+    "    }\n"
+    "    *variable = (int32_t)(negative ? -magnitude : magnitude);\n"
+    "}\n"
+    "\n";
+
+// Only for programs with procedures
+static const char* const depth_limit =
+    "#ifndef PL0_MAX_DEPTH\n"
+    "#define PL0_MAX_DEPTH %d\n"
+    "#endif\n"
+    "\n"
+    "static int pl0_depth;\n"
+    "\n"
+    "static PL0_NORETURN void pl0_depth_exceeded(const char* name) {\n"
+    "    pl0_fail(3, \"Call depth limit of %%d exceeded calling '%%s'\", PL0_MAX_DEPTH, name);\n"
+    "}\n"
+    "\n";
+
+// Arithmetic of each overflow mode. With wrap the operations are done on
+// unsigned integers, whose wrap-around C defines
+static const char* const wrap_arithmetic =
+    "static inline int32_t pl0_int32(uint32_t value) {\n"
+    "    return value <= INT32_MAX ? (int32_t)value : (int32_t)(value - 2147483648u) + INT32_MIN;\n"
+    "}\n"
+    "\n"
+    "static inline int32_t pl0_add(int32_t left, int32_t right) {\n"
+    "    return pl0_int32((uint32_t)left + (uint32_t)right);\n"
+    "}\n"
+    "\n"
+    "static inline int32_t pl0_sub(int32_t left, int32_t right) {\n"
+    "    return pl0_int32((uint32_t)left - (uint32_t)right);\n"
+    "}\n"
+    "\n"
+    "static inline int32_t pl0_mul(int32_t left, int32_t right) {\n"
+    "    return pl0_int32((uint32_t)left * (uint32_t)right);\n"
+    "}\n"
+    "\n"
+    "static inline int32_t pl0_div(int32_t left, int32_t right) {\n"
+    "    if (right == 0) pl0_fail(1, \"Division by zero\");\n"
+    "    if (left == INT32_MIN && right == -1) return INT32_MIN;\n"
+    "    return left / right;\n"
+    "}\n";
+
+// The checked modes compute in 64 bits; pl0_overflow() gets the results
+// that do not fit
+static const char* const checked_arithmetic =
+    "static inline int32_t pl0_result(int64_t result, int32_t left, const char* op, int32_t right) {\n"
+    "    if (result >= INT32_MIN && result <= INT32_MAX) return (int32_t)result;\n"
+    "    return pl0_overflow(result, left, op, right);\n"
+    "}\n"
+    "\n"
+    "static inline int32_t pl0_add(int32_t left, int32_t right) {\n"
+    "    return pl0_result((int64_t)left + right, left, \"+\", right);\n"
+    "}\n"
+    "\n"
+    "static inline int32_t pl0_sub(int32_t left, int32_t right) {\n"
+    "    return pl0_result((int64_t)left - right, left, \"-\", right);\n"
+    "}\n"
+    "\n"
+    "static inline int32_t pl0_mul(int32_t left, int32_t right) {\n"
+    "    return pl0_result((int64_t)left * right, left, \"*\", right);\n"
+    "}\n"
+    "\n"
+    "static inline int32_t pl0_div(int32_t left, int32_t right) {\n"
+    "    if (right == 0) pl0_fail(1, \"Division by zero\");\n"
+    "    if (left == INT32_MIN && right == -1) return pl0_overflow(2147483648LL, left, \"/\", right);\n"
+    "    return left / right;\n"
+    "}\n";
+
+static const char* const trap_overflow =
+    "static inline int32_t pl0_overflow(int64_t result, int32_t left, const char* op, int32_t right) {\n"
+    "    (void)result;\n"
+    "    pl0_fail(1, \"Integer overflow in %ld %s %ld\", (long)left, op, (long)right);\n"
+    "    return 0;\n"
+    "}\n"
+    "\n";
+
+static const char* const saturate_overflow =
+    "static inline int32_t pl0_overflow(int64_t result, int32_t left, const char* op, int32_t right) {\n"
+    "    (void)left, (void)op, (void)right;\n"
+    "    return result < 0 ? INT32_MIN : INT32_MAX;\n"
+    "}\n"
+    "\n";
+
+// ---------------------------------------------------------------------------
+// Translation
+// ---------------------------------------------------------------------------
+
+static void indent(FILE* out, int depth) {
+    fprintf(out, "%*s", depth * 4, "");
+}
+
+// Whether a block needs a frame struct: for its variables, or as the
+// static link of the procedures declared in it
+static bool has_frame(Node* block) {
+    for (Node* decl = node_right(block); decl; decl = node_next(decl)) {
+        if (decl->type == NODE_VAR_DECL || decl->type == NODE_PROC) return true;
+    }
+    return false;
+}
+
+// The frame levels static links up from the current one, as a pointer
+static void emit_frame(FILE* out, int level) {
+    if (level == 0) {
+        fputs("&f", out);
+        return;
+    }
+    fputs("f.up", out);
+    for (int i = 1; i < level; i++) fputs("->up", out);
+}
+
+// A variable used in a block nesting levels deep (0: the main block)
+static void emit_variable(FILE* out, const Node* ident, int nesting) {
+    if (nesting == node_level(ident)) {
+        fprintf(out, "g_%s", node_name(ident));
+    } else if (node_level(ident) == 0) {
+        fprintf(out, "f.v_%s", node_name(ident));
+    } else {
+        emit_frame(out, node_level(ident));
+        fprintf(out, "->v_%s", node_name(ident));
+    }
+}
+
+static void emit_number(FILE* out, int value) {
+    if (value == INT_MIN) {
+        fputs("INT32_MIN", out);
+    } else if (value < 0) {
+        fprintf(out, "(%d)", value);
+    } else {
+        fprintf(out, "%d", value);
+    }
+}
+
+static void emit_expression(FILE* out, const Node* node, int nesting) {
+    switch (node->type) {
+        case NODE_NUMBER:
+            emit_number(out, node_value(node));
+            break;
+        case NODE_IDENT:
+            if (node_decl(node)->type == NODE_CONST_DECL) {
+                emit_number(out, node_value(node_right(node_decl(node))));
+            } else {
+                emit_variable(out, node, nesting);
+            }
+            break;
+        case NODE_BINARY_OP:
+            fputs(node_op(node) == OP_PLUS ? "pl0_add(" : node_op(node) == OP_MINUS ? "pl0_sub(" :
+                  node_op(node) == OP_MULT ? "pl0_mul(" : "pl0_div(", out);
+            emit_expression(out, node_left(node), nesting);
+            fputs(", ", out);
+            emit_expression(out, node_right(node), nesting);
+            fputc(')', out);
+            break;
+        default:
+            break;
+    }
+}
+
+static const char* c_operator(OpType op) {
+    switch (op) {
+        case OP_EQ:  return "==";
+        case OP_NEQ: return "!=";
+        case OP_LT:  return "<";
+        case OP_LTE: return "<=";
+        case OP_GT:  return ">";
+        default:     return ">=";
+    }
+}
+
+static void emit_condition(FILE* out, const Node* node, int nesting) {
+    fputc('(', out);
+    emit_expression(out, node_left(node), nesting);
+    if (node_op(node) == OP_ODD) {
+        fputs(" & 1", out);
+    } else {
+        fprintf(out, " %s ", c_operator(node_op(node)));
+        emit_expression(out, node_right(node), nesting);
+    }
+    fputc(')', out);
+}
+
+static void emit_statement(FILE* out, const Node* node, int nesting, int depth);
+
+// The statements of a body in braces, a compound statement unwrapped
+static void emit_body(FILE* out, const Node* node, int nesting, int depth) {
+    fputs(" {\n", out);
+    if (node && node->type == NODE_COMPOUND) {
+        for (const Node* stmt = node_left(node); stmt; stmt = node_next(stmt)) {
+            emit_statement(out, stmt, nesting, depth + 1);
+        }
+    } else if (node) {
+        emit_statement(out, node, nesting, depth + 1);
+    }
+    indent(out, depth);
+    fputs("}\n", out);
+}
+
+static void emit_statement(FILE* out, const Node* node, int nesting, int depth) {
+    if (!node) return;
+    switch (node->type) {
+        case NODE_ASSIGN:
+            indent(out, depth);
+            emit_variable(out, node_left(node), nesting);
+            fputs(" = ", out);
+            emit_expression(out, node_right(node), nesting);
+            fputs(";\n", out);
+            break;
+        case NODE_CALL: {
+            const Node* ident = node_left(node);
+            indent(out, depth);
+            fprintf(out, "p%d_%s(", node_slot(node_decl(ident)), node_name(ident));
+            if (nesting == node_level(ident)) {
+                fputs("NULL", out);
+            } else {
+                emit_frame(out, node_level(ident));
+            }
+            fputs(");\n", out);
+            break;
+        }
+        case NODE_INPUT:
+            indent(out, depth);
+            fputs("pl0_read(&", out);
+            emit_variable(out, node_left(node), nesting);
+            fprintf(out, ", \"%s\");\n", node_name(node_left(node)));
+            break;
+        case NODE_OUTPUT:
+            indent(out, depth);
+            fputs("pl0_write(", out);
+            emit_expression(out, node_left(node), nesting);
+            fputs(");\n", out);
+            break;
+        case NODE_COMPOUND:
+            indent(out, depth);
+            fputc('{', out);
+            emit_body(out, node, nesting, depth);
+            break;
+        case NODE_IF:
+            indent(out, depth);
+            fputs("if ", out);
+            emit_condition(out, node_left(node), nesting);
+            emit_body(out, node_right(node), nesting, depth);
+            break;
+        case NODE_WHILE:
+            indent(out, depth);
+            fputs("while ", out);
+            emit_condition(out, node_left(node), nesting);
+            emit_body(out, node_right(node), nesting, depth);
+            break;
+        default:
+            break;
+    }
+}
+
+// The C type of the static link of the procedures declared in a block:
+// the frame of the procedure numbered parent, or nothing for the main block
+static void emit_link_type(FILE* out, int parent) {
+    if (parent < 0) {
+        fputs("void*", out);
+    } else {
+        fprintf(out, "struct f%d*", parent);
+    }
+}
+
+// Frame structs and prototypes of the procedures declared in block and
+// in them, outermost first
+static void declare_procedures(FILE* out, Node* block, int parent) {
+    for (Node* proc = node_right(block); proc; proc = node_next(proc)) {
+        if (proc->type != NODE_PROC) continue;
+        if (has_frame(node_right(proc))) {
+            fprintf(out, "struct f%d {\n    ", node_slot(proc));
+            emit_link_type(out, parent);
+            fputs(" up;\n", out);
+            for (Node* var = node_right(node_right(proc)); var; var = node_next(var)) {
+                if (var->type == NODE_VAR_DECL) {
+                    fprintf(out, "    int32_t v_%s;\n", node_name(node_left(var)));
+                }
+            }
+            fputs("};\n", out);
+        }
+        fprintf(out, "static void p%d_%s(", node_slot(proc), node_name(node_left(proc)));
+        emit_link_type(out, parent);
+        fputs(" up);\n", out);
+        declare_procedures(out, node_right(proc), node_slot(proc));
+    }
+}
+
+static void define_procedures(FILE* out, Node* block, int parent, int nesting) {
+    for (Node* proc = node_right(block); proc; proc = node_next(proc)) {
+        if (proc->type != NODE_PROC) continue;
+        const char* name = node_name(node_left(proc));
+        fprintf(out, "\nstatic void p%d_%s(", node_slot(proc), name);
+        emit_link_type(out, parent);
+        fputs(" up) {\n", out);
+        if (has_frame(node_right(proc))) {
+            fprintf(out, "    PL0_UNUSED struct f%d f = { .up = up };\n", node_slot(proc));
+        } else {
+            // Only the link, for reaching the frames further out
+            fputs("    PL0_UNUSED struct { ", out);
+            emit_link_type(out, parent);
+            fputs(" up; } f = { .up = up };\n", out);
+        }
+        fprintf(out, "    if (pl0_depth == PL0_MAX_DEPTH) pl0_depth_exceeded(\"%s\");\n", name);
+        fputs("    pl0_depth++;\n", out);
+        const Node* stmt = find_block_statement(node_right(proc));
+        if (stmt && stmt->type == NODE_COMPOUND) {
+            for (stmt = node_left(stmt); stmt; stmt = node_next(stmt)) {
+                emit_statement(out, stmt, nesting + 1, 1);
+            }
+        } else if (stmt) {
+            emit_statement(out, stmt, nesting + 1, 1);
+        }
+        fputs("    pl0_depth--;\n}\n", out);
+        define_procedures(out, node_right(proc), node_slot(proc), nesting + 1);
+    }
+}
+
+// Translate an analyzed program to C; false if writing failed
+bool emit_c(FILE* out, Node* program, OverflowMode overflow) {
+    if (!program || program->type != NODE_PROGRAM) return false;
+    Node* block = node_left(program);
+
+    fputs("/* Generated from PL/0 by pl0_parser --emit-c */\n", out);
+    fputs(runtime_head, out);
+    bool has_procedures = false;
+    for (Node* decl = node_right(block); decl; decl = node_next(decl)) {
+        if (decl->type == NODE_PROC) has_procedures = true;
+    }
+    if (has_procedures) fprintf(out, depth_limit, DEFAULT_MAX_DEPTH);
+    if (overflow == OVERFLOW_WRAP) {
+        fputs(wrap_arithmetic, out);
+    } else {
+        fputs(overflow == OVERFLOW_TRAP ? trap_overflow : saturate_overflow, out);
+        fputs(checked_arithmetic, out);
+    }
+
+    fputc('\n', out);
+    for (Node* var = node_right(block); var; var = node_next(var)) {
+        if (var->type == NODE_VAR_DECL) {
+            fprintf(out, "static PL0_UNUSED int32_t g_%s;\n", node_name(node_left(var)));
+        }
+    }
+    declare_procedures(out, block, -1);
+    define_procedures(out, block, -1, 0);
+
+    fputs("\nint main(void) {\n", out);
+    const Node* stmt = find_block_statement(block);
+    if (stmt && stmt->type == NODE_COMPOUND) {
+        for (stmt = node_left(stmt); stmt; stmt = node_next(stmt)) emit_statement(out, stmt, 0, 1);
+    } else if (stmt) {
+        emit_statement(out, stmt, 0, 1);
+    }
+    fputs("    return pl0_finish();\n}\n", out);
+    return !ferror(out);
+}
@@ -0,0 +1,31 @@
+#ifndef EMIT_C_H
+#define EMIT_C_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "ast.h"
+#include "options.h"
+
+/* C backend (--emit-c): translates an analyzed program into one portable
+ * C99 source file that any C compiler turns into a native executable.
+ *
+ * The variables of the main block become globals. Every procedure, nested
+ * or not, becomes a C function of its own, named after its number and
+ * name; its variables live in a frame struct on the C stack that links
+ * to the frame of the enclosing procedure (the static link), which the
+ * caller passes in. A variable `level` blocks up is reached through as
+ * many links, as in the interpreter. Constants are inlined.
+ *
+ * The program behaves like --interpret with the same --overflow mode:
+ * READ and WRITE go through buffers, runtime errors print the same
+ * "Runtime Error: ..." message and exit with 1, and calls nested deeper
+ * than PL0_MAX_DEPTH (DEFAULT_MAX_DEPTH unless defined when compiling)
+ * exit with 3. There is no step limit. Operands are evaluated in the
+ * order the C compiler picks, so when both operands of an operation fail
+ * with --overflow=trap, which of the two errors is reported may differ.
+ */
+
+// C backend function declarations
+bool emit_c(FILE* out, Node* program, OverflowMode overflow);
+
+#endif // EMIT_C_H
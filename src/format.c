@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include "format.h"
+#include "bufio.h"
+#include "parser.tab.h"
+
+typedef struct {
+    const TokenBuffer* tokens;
+    BufWriter* out;
+    int next;            // first token not written yet
+    bool written;        // whether anything has been written
+} Formatter;
+
+// Whether a + or - is a sign rather than an operator, given the token before it
+static bool is_sign(int before) {
+    return before != TOK_IDENT && before != TOK_NUM && before != TOK_RPAREN;
+}
+
+// Punctuation that sticks to what comes before it
+static bool is_closing(int kind) {
+    return kind == TOK_SEMICOLON || kind == TOK_COMMA || kind == TOK_RPAREN || kind == TOK_DOT;
+}
+
+static bool space_between(const TokenBuffer* tokens, int index) {
+    int prev = token_kind(&tokens->tokens[index - 1]);
+    if (is_closing(token_kind(&tokens->tokens[index]))) return false;
+    if (prev == TOK_LPAREN) return false;
+    if ((prev == TOK_PLUS || prev == TOK_MINUS) &&
+        (index < 2 || is_sign(token_kind(&tokens->tokens[index - 2])))) {
+        return false;
+    }
+    return true;
+}
+
+// Line break (at most one blank line) and indentation, or a space
+static void write_separator(Formatter* f, int newlines, int depth, bool space) {
+    if (!f->written) return;
+    if (newlines > 0) {
+        bufwriter_putc(f->out, '\n');
+        if (newlines > 1) bufwriter_putc(f->out, '\n');
+        for (int i = 0; i < depth * FORMAT_INDENT; i++) bufwriter_putc(f->out, ' ');
+    } else if (space) {
+        bufwriter_putc(f->out, ' ');
+    }
+}
+
+// Write the gap before token index: its comments verbatim, each where the
+// source has it (own line or same line) and indented like the token
+static void write_gap(Formatter* f, int index, int depth) {
+    const TokenBuffer* tokens = f->tokens;
+    int kind = token_kind(&tokens->tokens[index]);
+    const char* p = tokens->source;
+    if (index > 0) p += tokens->tokens[index - 1].offset + token_length(tokens, index - 1);
+    const char* end = tokens->source + tokens->tokens[index].offset;
+    int newlines = 0;
+    bool after_comment = false;
+    while (p < end) {
+        size_t comment = comment_length(p, (size_t)(end - p));
+        if (comment == 0) {
+            if (*p++ == '\n') newlines++;
+            continue;
+        }
+        write_separator(f, newlines, depth, true);
+        bufwriter_write(f->out, p, comment);
+        f->written = true;
+        p += comment;
+        newlines = 0;
+        after_comment = true;
+    }
+    if (kind == 0) return;  // end of input
+    write_separator(f, newlines, depth,
+                    after_comment ? !is_closing(kind) : index > 0 && space_between(tokens, index));
+}
+
+// Write the tokens up to last; the first of them is indented by depth if it
+// starts a line, the others by continuation
+static void write_tokens_to(Formatter* f, int last, int depth, int continuation) {
+    for (; f->next <= last; f->next++, depth = continuation) {
+        write_gap(f, f->next, depth);
+        bufwriter_write(f->out, f->tokens->source + f->tokens->tokens[f->next].offset,
+                        token_length(f->tokens, f->next));
+        f->written = true;
+    }
+}
+
+static void format_statement(Formatter* f, const Node* stmt, int depth) {
+    if (!stmt) return;
+
+    switch (stmt->type) {
+        case NODE_COMPOUND:
+            write_tokens_to(f, node_first_token(stmt), depth, depth);
+            for (const Node* inner = node_left(stmt); inner; inner = node_next(inner)) {
+                write_tokens_to(f, node_first_token(inner) - 1, depth + 1, depth + 1);
+                format_statement(f, inner, depth + 1);
+            }
+            write_tokens_to(f, node_last_token(stmt) - 1, depth + 1, depth + 1);
+            write_tokens_to(f, node_last_token(stmt), depth, depth);
+            break;
+
+        case NODE_IF:
+        case NODE_WHILE: {
+            // Up to THEN or DO; a BEGIN ... END body lines up with the IF
+            const Node* body = node_right(stmt);
+            write_tokens_to(f, body ? node_first_token(body) - 1 : node_last_token(stmt),
+                            depth, depth + 1);
+            format_statement(f, body, body && body->type == NODE_COMPOUND ? depth : depth + 1);
+            break;
+        }
+
+        default:
+            write_tokens_to(f, node_last_token(stmt), depth, depth + 1);
+            break;
+    }
+}
+
+static const Node* last_in_list(const Node* node, NodeType type) {
+    const Node* last = NULL;
+    for (; node && node->type == type; node = node_next(node)) last = node;
+    return last;
+}
+
+// Procedures declared in a procedure are indented one level
+static void format_block(Formatter* f, const Node* block, int depth, bool in_procedure) {
+    const Node* consts = last_in_list(node_left(block), NODE_CONST_DECL);
+    if (consts) write_tokens_to(f, node_last_token(consts) + 1, depth, depth + 1);
+
+    const Node* vars = last_in_list(node_right(block), NODE_VAR_DECL);
+    if (vars) write_tokens_to(f, node_last_token(vars) + 1, depth, depth + 1);
+
+    int proc_depth = in_procedure ? depth + 1 : depth;
+    for (const Node* proc = vars ? node_next(vars) : node_right(block);
+         proc && proc->type == NODE_PROC; proc = node_next(proc)) {
+        write_tokens_to(f, node_last_token(node_left(proc)) + 1, proc_depth, proc_depth + 1);
+        format_block(f, node_right(proc), proc_depth, true);
+        write_tokens_to(f, node_last_token(proc), proc_depth, proc_depth);
+    }
+
+    format_statement(f, find_block_statement((Node*)block), depth);
+}
+
+// Write program, parsed from tokens without syntax errors, formatted
+bool format_program(const TokenBuffer* tokens, const Node* program, FILE* out) {
+    Formatter f = { tokens, malloc(sizeof(BufWriter)), 0, false };
+    if (!f.out) return false;
+    bufwriter_init(f.out, out);
+
+    format_block(&f, node_left(program), 0, false);
+    write_tokens_to(&f, tokens->count - 2, 0, 0);  // the final '.'
+    write_gap(&f, tokens->count - 1, 0);           // comments after it
+    bufwriter_putc(f.out, '\n');
+
+    bool success = bufwriter_flush(f.out);
+    free(f.out);
+    return success;
+}
@@ -0,0 +1,23 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "ast.h"
+#include "cst.h"
+
+/* Source formatter behind pl0fmt. It works on a program parsed with
+ * parse_tokens() and writes every token once, in a single pass: the AST
+ * gives the indentation of each line (three spaces per level, procedure
+ * bodies at the level of their header, statements inside BEGIN ... END and
+ * bodies of IF and WHILE one level deeper), the spacing between tokens on
+ * a line is canonical, and line breaks are kept where the source has them,
+ * with at most one blank line in a row. Comments are kept verbatim, on their
+ * own line or after a token as in the source.
+ */
+
+#define FORMAT_INDENT 3
+
+bool format_program(const TokenBuffer* tokens, const Node* program, FILE* out);
+
+#endif // FORMAT_H
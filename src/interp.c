@@ -0,0 +1,477 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // pthread_getattr_np
+#endif
+#include <limits.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "interp.h"
+
+// Stack kept free below the deepest interpreter frame for the library
+// calls READ and WRITE make
+#define STACK_RESERVE (256 * 1024)
+
+// Activation record of a block; its variables live in ctx->values
+typedef struct Frame {
+    struct Frame* static_link;  // frame of the lexically enclosing block
+    size_t base;                // index of slot 0 in ctx->values
+} Frame;
+
+InterpContext* create_interp_context(FILE* input, FILE* output) {
+    InterpContext* ctx = malloc(sizeof(InterpContext));
+    if (!ctx) return NULL;
+
+    ctx->runtime = create_runtime(input, output);
+    if (!ctx->runtime) {
+        free(ctx);
+        return NULL;
+    }
+    ctx->values = NULL;
+    ctx->values_size = 0;
+    ctx->values_capacity = 0;
+    ctx->error_msg[0] = '\0';
+    ctx->profile = NULL;
+    ctx->activation = NULL;
+    set_interp_limits(ctx, 0, DEFAULT_MAX_DEPTH);
+    ctx->depth = 0;
+    ctx->peak_depth = 0;
+    ctx->status = EXEC_OK;
+    ctx->overflow = OVERFLOW_WRAP;
+    ctx->stack_limit = NULL;
+    return ctx;
+}
+
+// Bound execution to max_steps loop iterations and calls (0: no limit)
+// and max_depth nested calls
+void set_interp_limits(InterpContext* ctx, unsigned long long max_steps, int max_depth) {
+    ctx->step_limit = max_steps ? max_steps : ULLONG_MAX;
+    ctx->steps_left = ctx->step_limit;
+    ctx->max_depth = max_depth;
+}
+
+// Loop iterations and calls executed so far
+unsigned long long interp_steps(const InterpContext* ctx) {
+    return ctx->step_limit - ctx->steps_left;
+}
+
+void free_interp_context(InterpContext* ctx) {
+    if (!ctx) return;
+    free_runtime(ctx->runtime);
+    free(ctx->values);
+    free(ctx);
+}
+
+// Find the storage of a resolved variable
+static int* variable_ref(InterpContext* ctx, Frame* frame, const Node* ident) {
+    for (int level = node_level(ident); level > 0; level--) {
+        frame = frame->static_link;
+    }
+    return &ctx->values[frame->base + node_slot(ident)];
+}
+
+// The result of left op right when it overflowed; *result holds it
+// wrapped around
+__attribute__((cold, noinline))
+static bool overflowed(InterpContext* ctx, OpType op, int left, int right, int* result) {
+    bool negative;
+    switch (ctx->overflow) {
+        case OVERFLOW_WRAP:
+            return true;
+        case OVERFLOW_TRAP: {
+            const char* symbol = op == OP_PLUS ? "+" : op == OP_MINUS ? "-"
+                               : op == OP_MULT ? "*" : "/";
+            snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                    "Integer overflow in %d %s %d", left, symbol, right);
+            return false;
+        }
+        case OVERFLOW_SATURATE:
+            switch (op) {
+                case OP_PLUS:  negative = right < 0; break;
+                case OP_MINUS: negative = right > 0; break;
+                case OP_MULT:  negative = (left < 0) != (right < 0); break;
+                default:       negative = false; break;  // INT_MIN / -1
+            }
+            *result = negative ? INT_MIN : INT_MAX;
+            return true;
+    }
+    return true;
+}
+
+// Whether the recursion may go one level deeper on the C stack. The stack
+// is assumed to grow down, as it does on every target we build for
+static inline bool stack_left(InterpContext* ctx) {
+    if ((char*)__builtin_frame_address(0) >= ctx->stack_limit) return true;
+    snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+            "Out of stack at call depth %d", ctx->depth);
+    ctx->status = EXEC_DEPTH_LIMIT;
+    return false;
+}
+
+static bool eval_expression(InterpContext* ctx, Node* node, Frame* frame, int* result) {
+    switch (node->type) {
+        case NODE_NUMBER:
+            *result = node_value(node);
+            return true;
+
+        case NODE_IDENT:
+            if (node_decl(node)->type == NODE_CONST_DECL) {
+                *result = node_value(node_right(node_decl(node)));
+            } else {
+                *result = *variable_ref(ctx, frame, node);
+            }
+            return true;
+
+        case NODE_BINARY_OP: {
+            int left, right;
+            if (!stack_left(ctx) ||
+                !eval_expression(ctx, node_left(node), frame, &left) ||
+                !eval_expression(ctx, node_right(node), frame, &right)) {
+                return false;
+            }
+            switch (node_op(node)) {
+                case OP_PLUS:
+                    if (__builtin_add_overflow(left, right, result)) break;
+                    return true;
+                case OP_MINUS:
+                    if (__builtin_sub_overflow(left, right, result)) break;
+                    return true;
+                case OP_MULT:
+                    if (__builtin_mul_overflow(left, right, result)) break;
+                    return true;
+                case OP_DIV:
+                    if (right == 0) {
+                        snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                                "Division by zero");
+                        return false;
+                    }
+                    if (left == INT_MIN && right == -1) {
+                        *result = INT_MIN;
+                        break;
+                    }
+                    *result = left / right;
+                    return true;
+                default:
+                    snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                            "Invalid operator in expression");
+                    return false;
+            }
+            return overflowed(ctx, node_op(node), left, right, result);
+        }
+
+        default:
+            break;
+    }
+
+    snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+            "Invalid node type in expression");
+    return false;
+}
+
+static bool eval_condition(InterpContext* ctx, Node* node, Frame* frame, bool* result) {
+    int left, right = 0;
+    if (!eval_expression(ctx, node_left(node), frame, &left)) return false;
+    if (node_op(node) != OP_ODD && !eval_expression(ctx, node_right(node), frame, &right)) {
+        return false;
+    }
+
+    switch (node_op(node)) {
+        case OP_ODD: *result = (left & 1) != 0; return true;
+        case OP_EQ:  *result = left == right;   return true;
+        case OP_NEQ: *result = left != right;   return true;
+        case OP_LT:  *result = left < right;    return true;
+        case OP_LTE: *result = left <= right;   return true;
+        case OP_GT:  *result = left > right;    return true;
+        case OP_GTE: *result = left >= right;   return true;
+        default:
+            snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                    "Invalid operator in condition");
+            return false;
+    }
+}
+
+static bool exec_block(InterpContext* ctx, Node* block, Frame* static_link);
+
+// Take one step from the budget; only loop iterations and calls take
+// steps, so a program without them runs in bounded time anyway
+static inline bool take_step(InterpContext* ctx) {
+    if (ctx->steps_left == 0) {
+        snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                "Step limit of %llu loop iterations and calls exceeded", ctx->step_limit);
+        ctx->status = EXEC_STEP_LIMIT;
+        return false;
+    }
+    ctx->steps_left--;
+    return true;
+}
+
+// Run a call site's procedure as its own profiled activation
+static bool exec_profiled_call(InterpContext* ctx, Node* call, Frame* declaring) {
+    Node* proc = node_decl(node_left(call));
+    ProfileActivation act;
+
+    profile_enter(ctx->profile, &act, ctx->activation, node_slot(proc) + 1, node_slot(call));
+    ctx->activation = &act;
+    bool success = exec_block(ctx, node_right(proc), declaring);
+    ctx->activation = act.parent;
+    profile_leave(ctx->profile, &act);
+    return success;
+}
+
+static bool exec_statement(InterpContext* ctx, Node* node, Frame* frame) {
+    if (!node) return true;
+    if (!stack_left(ctx)) return false;
+    if (ctx->profile && node->type != NODE_COMPOUND) profile_statement(ctx->profile, node);
+
+    switch (node->type) {
+        case NODE_ASSIGN: {
+            int value;
+            if (!eval_expression(ctx, node_right(node), frame, &value)) return false;
+            *variable_ref(ctx, frame, node_left(node)) = value;
+            return true;
+        }
+
+        case NODE_CALL: {
+            // The callee's static link is the frame of the block that
+            // declares it, `level` links up from here
+            Node* ident = node_left(node);
+            Frame* declaring = frame;
+            for (int level = node_level(ident); level > 0; level--) {
+                declaring = declaring->static_link;
+            }
+            if (!take_step(ctx)) return false;
+            if (ctx->depth == ctx->max_depth) {
+                snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                        "Call depth limit of %d exceeded calling '%s'",
+                        ctx->max_depth, node_name(ident));
+                ctx->status = EXEC_DEPTH_LIMIT;
+                return false;
+            }
+            if (++ctx->depth > ctx->peak_depth) ctx->peak_depth = ctx->depth;
+            bool success = ctx->profile ? exec_profiled_call(ctx, node, declaring)
+                                        : exec_block(ctx, node_right(node_decl(ident)), declaring);
+            ctx->depth--;
+            return success;
+        }
+
+        case NODE_INPUT: {
+            int value;
+            switch (runtime_read_int(ctx->runtime, &value)) {
+                case READ_OK:
+                    *variable_ref(ctx, frame, node_left(node)) = value;
+                    return true;
+                case READ_EOF:
+                    snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                            "Unexpected end of input reading '%s'", node_name(node_left(node)));
+                    return false;
+                case READ_INVALID:
+                    snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                            "Invalid input reading '%s', expected an integer",
+                            node_name(node_left(node)));
+                    return false;
+                case READ_RANGE:
+                    break;
+            }
+            snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                    "Input value for '%s' out of range", node_name(node_left(node)));
+            return false;
+        }
+
+        case NODE_OUTPUT: {
+            int value;
+            if (!eval_expression(ctx, node_left(node), frame, &value)) return false;
+            runtime_write_int(ctx->runtime, value);
+            return true;
+        }
+
+        case NODE_COMPOUND:
+            for (Node* stmt = node_left(node); stmt; stmt = node_next(stmt)) {
+                if (!exec_statement(ctx, stmt, frame)) return false;
+            }
+            return true;
+
+        case NODE_IF: {
+            bool cond;
+            if (!eval_condition(ctx, node_left(node), frame, &cond)) return false;
+            return cond ? exec_statement(ctx, node_right(node), frame) : true;
+        }
+
+        case NODE_WHILE:
+            for (;;) {
+                bool cond;
+                if (!eval_condition(ctx, node_left(node), frame, &cond)) return false;
+                if (!cond) return true;
+                if (!take_step(ctx)) return false;
+                if (ctx->profile) profile_iteration(ctx->profile, node);
+                if (!exec_statement(ctx, node_right(node), frame)) return false;
+            }
+
+        default:
+            snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                    "Cannot execute node of type %d", (int)node->type);
+            return false;
+    }
+}
+
+// Run a block in a fresh frame whose variables start out as zero
+static bool exec_block(InterpContext* ctx, Node* block, Frame* static_link) {
+    Frame frame = { static_link, ctx->values_size };
+    size_t needed = ctx->values_size + (size_t)node_slot(block);
+
+    if (needed > ctx->values_capacity) {
+        size_t capacity = ctx->values_capacity ? ctx->values_capacity * 2 : 256;
+        while (capacity < needed) capacity *= 2;
+        int* values = realloc(ctx->values, capacity * sizeof(int));
+        if (!values) {
+            snprintf(ctx->error_msg, sizeof(ctx->error_msg), "Out of memory");
+            return false;
+        }
+        ctx->values = values;
+        ctx->values_capacity = capacity;
+    }
+    // A block without variables may run before values is allocated
+    if (node_slot(block) > 0) {
+        memset(ctx->values + frame.base, 0, (size_t)node_slot(block) * sizeof(int));
+    }
+    ctx->values_size = needed;
+
+    bool success = exec_statement(ctx, find_block_statement(block), &frame);
+    ctx->values_size = frame.base;
+    return success;
+}
+
+// Lowest address the interpreter's frames may use on the calling thread
+static char* find_stack_limit(void) {
+    char* here = __builtin_frame_address(0);
+#ifdef __GLIBC__
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        void* low;
+        size_t size;
+        bool found = pthread_attr_getstack(&attr, &low, &size) == 0;
+        pthread_attr_destroy(&attr);
+        if (found && (char*)low + STACK_RESERVE < here) return (char*)low + STACK_RESERVE;
+    }
+#endif
+    // Otherwise assume a stack of RLIMIT_STACK, or 8 MB, starting here
+    size_t size = 8 * 1024 * 1024;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        size = (size_t)limit.rlim_cur;
+    }
+    if (size <= 2 * STACK_RESERVE) return here - size / 2;
+    return here - (size - STACK_RESERVE);
+}
+
+// Execute a program that passed semantic analysis. Its output is flushed
+// when it ends, also when it ends with a runtime error.
+bool interpret(InterpContext* ctx, Node* program) {
+    if (!program || program->type != NODE_PROGRAM) {
+        snprintf(ctx->error_msg, sizeof(ctx->error_msg), "Expected a program");
+        return false;
+    }
+
+    bool success;
+    ctx->status = EXEC_OK;
+    ctx->depth = 0;
+    ctx->stack_limit = find_stack_limit();
+    if (ctx->profile) {
+        ProfileActivation act;
+        profile_enter(ctx->profile, &act, NULL, 0, -1);
+        ctx->activation = &act;
+        success = exec_block(ctx, node_left(program), NULL);
+        ctx->activation = NULL;
+        profile_leave(ctx->profile, &act);
+    } else {
+        success = exec_block(ctx, node_left(program), NULL);
+    }
+
+    if (!runtime_flush(ctx->runtime) && success) {
+        snprintf(ctx->error_msg, sizeof(ctx->error_msg), "Failed to write output");
+        success = false;
+    }
+    if (!success && ctx->status == EXEC_OK) ctx->status = EXEC_ERROR;
+    return success;
+}
+
+static bool write_profile(const Profile* profile, const Options* opts) {
+    FILE* out = fopen(opts->profile, "w");
+    if (!out) {
+        perror(opts->profile);
+        return false;
+    }
+    bool written = write_callgrind(out, profile, opts->input_file);
+    if (fclose(out) != 0) written = false;
+    if (!written) {
+        fprintf(stderr, "Error: Failed to write profile to %s\n", opts->profile);
+    }
+    return written;
+}
+
+static const char* exec_status_name(ExecStatus status) {
+    switch (status) {
+        case EXEC_OK: return "ok";
+        case EXEC_ERROR: return "error";
+        case EXEC_STEP_LIMIT: return "step-limit";
+        case EXEC_DEPTH_LIMIT: return "depth-limit";
+    }
+    return "unknown";
+}
+
+ExecStatus run_interpreter(Node* ast, const Options* opts) {
+    if (opts->verbose) {
+        fprintf(opts->output, "Phase 3: Execution\n");
+    }
+
+    FILE* input = stdin;
+    if (opts->program_input) {
+        input = fopen(opts->program_input, "rb");
+        if (!input) {
+            perror(opts->program_input);
+            return EXEC_ERROR;
+        }
+    }
+
+    InterpContext* ctx = create_interp_context(input, opts->output);
+    if (!ctx) {
+        fprintf(stderr, "Error: Failed to create interpreter context\n");
+        if (input != stdin) fclose(input);
+        return EXEC_ERROR;
+    }
+
+    if (opts->profile) {
+        ctx->profile = create_profile(ast);
+        if (!ctx->profile) {
+            fprintf(stderr, "Error: Failed to create profile\n");
+            free_interp_context(ctx);
+            if (input != stdin) fclose(input);
+            return EXEC_ERROR;
+        }
+    }
+
+    set_interp_limits(ctx, opts->max_steps, opts->max_depth);
+    ctx->overflow = opts->overflow;
+    bool success = interpret(ctx, ast);
+
+    if (!success) {
+        fprintf(stderr, "Runtime Error: %s\n", ctx->error_msg);
+    } else if (opts->verbose) {
+        fprintf(opts->output, "Execution completed successfully\n");
+    }
+
+    // The profile is reported even when the program failed, it shows
+    // how far it got
+    if (ctx->profile) {
+        print_flat_profile(stderr, ctx->profile);
+        if (!write_profile(ctx->profile, opts) && success) ctx->status = EXEC_ERROR;
+        free_profile(ctx->profile);
+    }
+
+    if (opts->exec_stats) {
+        fprintf(stderr, "Stats: status=%s steps=%llu max_depth=%d\n",
+                exec_status_name(ctx->status), interp_steps(ctx), ctx->peak_depth);
+    }
+
+    ExecStatus status = ctx->status;
+    free_interp_context(ctx);
+    if (input != stdin) fclose(input);
+    return status;
+}
@@ -0,0 +1,62 @@
+#ifndef INTERP_H
+#define INTERP_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "ast.h"
+#include "options.h"
+#include "profile.h"
+#include "runtime.h"
+
+/* Tree-walking interpreter for an analyzed AST. Variables are addressed
+ * by the (level, slot) pairs that semantic analysis stored in NODE_IDENT
+ * nodes, so execution performs no name lookups.
+ *
+ * Execution can be bounded: every loop iteration and every call takes one
+ * step from a budget, and calls may only nest so deep. Procedures and
+ * statements run on the C stack, which the depth limit alone does not
+ * protect: statements nested inside each procedure take stack too. So
+ * execution also stops with EXEC_DEPTH_LIMIT once the calling thread's
+ * stack is nearly used up, however few calls are active.
+ *
+ * Integers are 32 bits; what happens when a result does not fit is
+ * chosen by ctx->overflow. All modes compute with the overflow-checking
+ * builtins and only differ once an overflow has happened, so checking
+ * costs the same in every mode.
+ */
+
+// How execution ended
+typedef enum {
+    EXEC_OK,
+    EXEC_ERROR,          // runtime error, see error_msg
+    EXEC_STEP_LIMIT,     // step budget used up
+    EXEC_DEPTH_LIMIT     // calls nested deeper than max_depth, or out of stack
+} ExecStatus;
+
+typedef struct {
+    Runtime* runtime;    // READ and WRITE
+    int* values;         // variable slots of all active frames
+    size_t values_size;
+    size_t values_capacity;
+    char error_msg[256];
+    Profile* profile;    // counters to update, NULL when not profiling
+    ProfileActivation* activation;  // innermost profiled activation
+    unsigned long long step_limit;  // see set_interp_limits(); ULLONG_MAX: no limit
+    unsigned long long steps_left;
+    int max_depth;
+    int depth;           // procedure calls active
+    int peak_depth;
+    ExecStatus status;   // set when interpret() returns
+    OverflowMode overflow;
+    char* stack_limit;   // frames below this address are out of stack
+} InterpContext;
+
+// Interpreter function declarations
+InterpContext* create_interp_context(FILE* input, FILE* output);
+void free_interp_context(InterpContext* ctx);
+void set_interp_limits(InterpContext* ctx, unsigned long long max_steps, int max_depth);
+bool interpret(InterpContext* ctx, Node* program);
+unsigned long long interp_steps(const InterpContext* ctx);
+ExecStatus run_interpreter(Node* ast, const Options* opts);
+
+#endif // INTERP_H
@@ -1,7 +1,11 @@
+#include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include "options.h"
 
+#define DEFAULT_PROFILE_FILE "callgrind.out.pl0"
+
 void print_usage(const char* program_name) {
     fprintf(stderr, "Usage: %s [options] input_file\n", program_name);
     fprintf(stderr, "Options:\n");
@@ -9,18 +13,81 @@ void print_usage(const char* program_name) {
     fprintf(stderr, "  -s, --symbols      Print symbol table\n");
     fprintf(stderr, "  -v, --verbose      Detailed output\n");
     fprintf(stderr, "  -o <file>          Write output to file\n");
+    fprintf(stderr, "  --parser=NAME      Parse with bison (default) or descent\n");
+    fprintf(stderr, "  --prelex           Lex the whole input before parsing (timed with -v)\n");
+    fprintf(stderr, "  --stream           Analyze and release each procedure as it is parsed\n");
+    fprintf(stderr, "  --hash-cons        Share identical expressions within a block\n");
     fprintf(stderr, "  --no-types         Skip type checking\n");
     fprintf(stderr, "  --no-semantics     Skip semantic analysis\n");
+    fprintf(stderr, "  --no-dataflow      Skip data-flow warnings\n");
+    fprintf(stderr, "  --jobs=N           Parse and analyze procedures on N threads (1)\n");
+    fprintf(stderr, "  --emit-ast=FORMAT  Write AST as json, sexpr or bin\n");
+    fprintf(stderr, "  --emit-c           Write the program translated to C\n");
+    fprintf(stderr, "  --interpret        Execute the program (READ from stdin)\n");
+    fprintf(stderr, "  --input-file FILE  READ from FILE instead of stdin\n");
+    fprintf(stderr, "  --profile[=FILE]   Execute with profiling, flat profile on stderr,\n");
+    fprintf(stderr, "                     callgrind file to FILE (%s)\n", DEFAULT_PROFILE_FILE);
+    fprintf(stderr, "  --max-steps=N      Stop after N loop iterations and calls\n");
+    fprintf(stderr, "  --max-depth=N      Stop when calls nest deeper than N (%d)\n",
+            DEFAULT_MAX_DEPTH);
+    fprintf(stderr, "  --overflow=MODE    Integer overflow: wrap, trap or saturate (wrap)\n");
+    fprintf(stderr, "  --timeout=MS       Give up parsing and analysis after MS milliseconds\n");
+    fprintf(stderr, "  --mem-stats        Report AST memory use after parsing\n");
+    fprintf(stderr, "  --trace=FILE       Write the time spent in each phase to FILE,\n");
+    fprintf(stderr, "                     in Chrome Trace Event format\n");
     fprintf(stderr, "  -h, --help         Print this help message\n");
+    fprintf(stderr, "Compile server (must be the first option):\n");
+    fprintf(stderr, "  --server=SOCKET    Serve requests on a Unix socket until SIGTERM\n");
+    fprintf(stderr, "  --connect=SOCKET   Run the rest of the command line on the server,\n");
+    fprintf(stderr, "                     or here if no server is running\n");
 }
 
-Options parse_options(int argc, char** argv) {
+// Parse the N of a --max-..., --jobs or --timeout option: a positive
+// integer up to max
+static bool parse_limit(const char* text, unsigned long long max, unsigned long long* value) {
+    char* end;
+    errno = 0;
+    if (*text < '0' || *text > '9') return false;
+    *value = strtoull(text, &end, 10);
+    return errno == 0 && *end == '\0' && *value > 0 && *value <= max;
+}
+
+// Give up on the command line; returns the exit status to use
+static int reject_options(Options* opts, int status) {
+    if (opts->output != stdout) fclose(opts->output);
+    opts->output = stdout;
+    return status;
+}
+
+// Parse the command line into opts. Returns -1 if the program should go
+// on, otherwise the exit status to stop with (after --help or an error,
+// which has been reported on stderr). Never exits, so the server can
+// parse its clients' command lines.
+int parse_command_line(int argc, char** argv, Options* out) {
     Options opts = {
         .print_ast = false,
         .print_symbols = false,
         .verbose = false,
+        .parser = PARSER_BISON,
+        .prelex = false,
+        .stream = false,
+        .hash_cons = false,
         .skip_type_check = false,
         .skip_semantics = false,
+        .skip_dataflow = false,
+        .jobs = 1,
+        .emit_ast = AST_FORMAT_NONE,
+        .emit_c = false,
+        .interpret = false,
+        .program_input = NULL,
+        .profile = NULL,
+        .mem_stats = false,
+        .trace = NULL,
+        .max_steps = 0,
+        .max_depth = DEFAULT_MAX_DEPTH,
+        .timeout_ms = 0,
+        .overflow = OVERFLOW_WRAP,
+        .exec_stats = false,
         .input_file = NULL,
         .output = stdout
     };
@@ -33,48 +100,206 @@ Options parse_options(int argc, char** argv) {
             } else {
                 fprintf(stderr, "Error: Multiple input files specified\n");
                 print_usage(argv[0]);
-                exit(1);
+                return reject_options(&opts, 1);
             }
             continue;
         }
 
         if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
             print_usage(argv[0]);
-            exit(0);
+            return reject_options(&opts, 0);
         } else if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--debug") == 0) {
             opts.print_ast = true;
         } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--symbols") == 0) {
             opts.print_symbols = true;
         } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) {
             opts.verbose = true;
+        } else if (strncmp(argv[i], "--parser=", 9) == 0) {
+            if (strcmp(argv[i] + 9, "bison") == 0) {
+                opts.parser = PARSER_BISON;
+            } else if (strcmp(argv[i] + 9, "descent") == 0) {
+                opts.parser = PARSER_DESCENT;
+            } else {
+                fprintf(stderr, "Error: Unknown parser: %s\n", argv[i] + 9);
+                print_usage(argv[0]);
+                return reject_options(&opts, 1);
+            }
+        } else if (strcmp(argv[i], "--prelex") == 0) {
+            opts.prelex = true;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            opts.stream = true;
+        } else if (strcmp(argv[i], "--hash-cons") == 0) {
+            opts.hash_cons = true;
         } else if (strcmp(argv[i], "--no-types") == 0) {
             opts.skip_type_check = true;
         } else if (strcmp(argv[i], "--no-semantics") == 0) {
             opts.skip_semantics = true;
+        } else if (strcmp(argv[i], "--no-dataflow") == 0) {
+            opts.skip_dataflow = true;
+        } else if (strncmp(argv[i], "--emit-ast=", 11) == 0) {
+            opts.emit_ast = ast_format_from_string(argv[i] + 11);
+            if (opts.emit_ast == AST_FORMAT_NONE) {
+                fprintf(stderr, "Error: Unknown AST format: %s\n", argv[i] + 11);
+                print_usage(argv[0]);
+                return reject_options(&opts, 1);
+            }
+        } else if (strcmp(argv[i], "--emit-c") == 0) {
+            opts.emit_c = true;
+        } else if (strcmp(argv[i], "--interpret") == 0) {
+            opts.interpret = true;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            opts.interpret = true;
+            opts.profile = DEFAULT_PROFILE_FILE;
+        } else if (strncmp(argv[i], "--profile=", 10) == 0) {
+            opts.interpret = true;
+            opts.profile = argv[i] + 10;
+        } else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            unsigned long long jobs;
+            if (!parse_limit(argv[i] + 7, MAX_JOBS, &jobs)) {
+                fprintf(stderr, "Error: Invalid number of jobs: %s\n", argv[i] + 7);
+                print_usage(argv[0]);
+                return reject_options(&opts, 1);
+            }
+            opts.jobs = (int)jobs;
+        } else if (strncmp(argv[i], "--max-steps=", 12) == 0) {
+            if (!parse_limit(argv[i] + 12, ULLONG_MAX - 1, &opts.max_steps)) {
+                fprintf(stderr, "Error: Invalid step limit: %s\n", argv[i] + 12);
+                print_usage(argv[0]);
+                return reject_options(&opts, 1);
+            }
+            opts.exec_stats = true;
+        } else if (strncmp(argv[i], "--max-depth=", 12) == 0) {
+            unsigned long long depth;
+            if (!parse_limit(argv[i] + 12, INT_MAX, &depth)) {
+                fprintf(stderr, "Error: Invalid depth limit: %s\n", argv[i] + 12);
+                print_usage(argv[0]);
+                return reject_options(&opts, 1);
+            }
+            opts.max_depth = (int)depth;
+            opts.exec_stats = true;
+        } else if (strncmp(argv[i], "--timeout=", 10) == 0) {
+            // In nanoseconds the deadline must fit into 64 bits
+            if (!parse_limit(argv[i] + 10, ULLONG_MAX / 2000000, &opts.timeout_ms)) {
+                fprintf(stderr, "Error: Invalid timeout: %s\n", argv[i] + 10);
+                print_usage(argv[0]);
+                return reject_options(&opts, 1);
+            }
+        } else if (strncmp(argv[i], "--overflow=", 11) == 0) {
+            const char* mode = argv[i] + 11;
+            if (strcmp(mode, "wrap") == 0) {
+                opts.overflow = OVERFLOW_WRAP;
+            } else if (strcmp(mode, "trap") == 0) {
+                opts.overflow = OVERFLOW_TRAP;
+            } else if (strcmp(mode, "saturate") == 0) {
+                opts.overflow = OVERFLOW_SATURATE;
+            } else {
+                fprintf(stderr, "Error: Unknown overflow mode: %s\n", mode);
+                print_usage(argv[0]);
+                return reject_options(&opts, 1);
+            }
+        } else if (strcmp(argv[i], "--mem-stats") == 0) {
+            opts.mem_stats = true;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            if (argv[i][8] == '\0') {
+                fprintf(stderr, "Error: --trace requires a filename\n");
+                print_usage(argv[0]);
+                return reject_options(&opts, 1);
+            }
+            opts.trace = argv[i] + 8;
+        } else if (strcmp(argv[i], "--input-file") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: --input-file requires a filename\n");
+                print_usage(argv[0]);
+                return reject_options(&opts, 1);
+            }
+            opts.program_input = argv[i];
         } else if (strcmp(argv[i], "-o") == 0) {
             if (++i >= argc) {
                 fprintf(stderr, "Error: -o requires a filename\n");
                 print_usage(argv[0]);
-                exit(1);
+                return reject_options(&opts, 1);
             }
             opts.output = fopen(argv[i], "w");
             if (!opts.output) {
                 perror("Error opening output file");
-                exit(1);
+                opts.output = stdout;
+                return reject_options(&opts, 1);
             }
         } else {
             fprintf(stderr, "Error: Unknown option: %s\n", argv[i]);
             print_usage(argv[0]);
-            exit(1);
+            return reject_options(&opts, 1);
         }
     }
 
+    if (opts.program_input && !opts.interpret) {
+        fprintf(stderr, "Error: --input-file requires --interpret\n");
+        print_usage(argv[0]);
+        return reject_options(&opts, 1);
+    }
+
+    if (opts.exec_stats && !opts.interpret) {
+        fprintf(stderr, "Error: --max-steps and --max-depth require --interpret\n");
+        print_usage(argv[0]);
+        return reject_options(&opts, 1);
+    }
+
+    if (opts.interpret && opts.skip_semantics) {
+        fprintf(stderr, "Error: --interpret requires semantic analysis\n");
+        print_usage(argv[0]);
+        return reject_options(&opts, 1);
+    }
+
+    // The translation goes to the output, and needs resolved names
+    if (opts.emit_c && (opts.emit_ast != AST_FORMAT_NONE || opts.interpret)) {
+        fprintf(stderr, "Error: --emit-c cannot be combined with --emit-ast or --interpret\n");
+        print_usage(argv[0]);
+        return reject_options(&opts, 1);
+    }
+
+    if (opts.emit_c && opts.skip_semantics) {
+        fprintf(stderr, "Error: --emit-c requires semantic analysis\n");
+        print_usage(argv[0]);
+        return reject_options(&opts, 1);
+    }
+
+    // Procedures are gone by the end of a streaming parse, and the
+    // parallel parser has no streaming hooks
+    if (opts.stream && (opts.print_ast || opts.emit_ast != AST_FORMAT_NONE || opts.interpret ||
+                        opts.emit_c)) {
+        fprintf(stderr, "Error: --stream cannot be combined with -d, --emit-ast, --emit-c or --interpret\n");
+        print_usage(argv[0]);
+        return reject_options(&opts, 1);
+    }
+
+    if (opts.stream && opts.jobs > 1) {
+        fprintf(stderr, "Error: --stream parses on one thread, --jobs must be 1\n");
+        print_usage(argv[0]);
+        return reject_options(&opts, 1);
+    }
+
+    // Chunks parsed on other threads borrow their names from the token
+    // array and are freed node by node, so they cannot share expressions
+    if (opts.hash_cons && opts.jobs > 1) {
+        fprintf(stderr, "Error: --hash-cons parses on one thread, --jobs must be 1\n");
+        print_usage(argv[0]);
+        return reject_options(&opts, 1);
+    }
+
     if (opts.input_file == NULL) {
         fprintf(stderr, "Error: No input file specified\n");
         print_usage(argv[0]);
-        exit(1);
+        return reject_options(&opts, 1);
     }
 
+    *out = opts;
+    return -1;
+}
+
+Options parse_options(int argc, char** argv) {
+    Options opts;
+    int status = parse_command_line(argc, argv, &opts);
+    if (status >= 0) exit(status);
     return opts;
 }
 
@@ -3,20 +3,51 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include "ast_emit.h"
+#include "descent.h"
+
+#define DEFAULT_MAX_DEPTH 10000
+#define MAX_JOBS 256
+
+// What integer arithmetic does when the result does not fit into 32 bits
+typedef enum {
+    OVERFLOW_WRAP,           // two's complement wrap-around
+    OVERFLOW_TRAP,           // runtime error
+    OVERFLOW_SATURATE        // clamp to INT_MIN or INT_MAX
+} OverflowMode;
 
 /* Command line options structure */
 typedef struct {
     bool print_ast;           // -d, --debug: print AST
     bool print_symbols;       // -s, --symbols: print symbol table
     bool verbose;            // -v, --verbose: detailed output
+    ParserKind parser;       // --parser=NAME: bison or descent
+    bool prelex;             // --prelex: lex the whole input before parsing
+    bool stream;             // --stream: analyze and release procedures while parsing
+    bool hash_cons;          // --hash-cons: share identical expressions of a block
     bool skip_type_check;    // --no-types: skip type checking
     bool skip_semantics;     // --no-semantics: skip semantic analysis
+    bool skip_dataflow;      // --no-dataflow: skip data-flow warnings
+    int jobs;                // --jobs=N: threads for parsing and semantic analysis
+    AstFormat emit_ast;      // --emit-ast=FORMAT: write AST as json, sexpr or bin
+    bool emit_c;             // --emit-c: write the program translated to C
+    bool interpret;          // --interpret: execute the program
+    const char* program_input; // --input-file: READ source instead of stdin
+    const char* profile;     // --profile[=FILE]: callgrind file, NULL if not profiling
+    bool mem_stats;          // --mem-stats: report AST memory after parsing
+    const char* trace;       // --trace=FILE: Chrome trace of the phases, NULL if none
+    unsigned long long max_steps; // --max-steps=N: loop iterations and calls, 0 = no limit
+    int max_depth;           // --max-depth=N: nesting of procedure calls
+    unsigned long long timeout_ms; // --timeout=MS: budget for parsing and analysis, 0 = none
+    OverflowMode overflow;   // --overflow=MODE: wrap, trap or saturate
+    bool exec_stats;         // stats line after execution, set by the limits
     const char* input_file;  // Input file path
     FILE* output;            // Output file (stdout or specified file)
 } Options;
 
 /* Function declarations */
 void print_usage(const char* program_name);
+int parse_command_line(int argc, char** argv, Options* out);
 Options parse_options(int argc, char** argv);
 
 #endif // OPTIONS_H
@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include "ast.h"
+#include "parallel_parse.h"
+#include "parser.tab.h"
+#include "trace.h"
+
+extern Node* ast_root;
+extern int parse_error_count;
+
+typedef struct {
+    const TokenBuffer* tokens;
+    int first;           // first token of the chunk's procedures
+    int last;            // the ";" ending the last one
+    int line;            // line of token first
+    NodeArena arena;
+    Node* procs;         // the procedures, or what was built if not parsed
+    bool parsed;
+} ChunkTask;
+
+static int kind_at(const TokenBuffer* tokens, int index) {
+    return token_kind(&tokens->tokens[index]);
+}
+
+// Skip a CONST or VAR section if the block has one; -1 if it holds tokens
+// a declaration cannot have
+static int skip_section(const TokenBuffer* tokens, int index, int keyword) {
+    if (kind_at(tokens, index) != keyword) return index;
+    for (index++; kind_at(tokens, index) != TOK_SEMICOLON; index++) {
+        int kind = kind_at(tokens, index);
+        if (kind != TOK_IDENT && kind != TOK_NUM && kind != TOK_EQ && kind != TOK_COMMA) return -1;
+    }
+    return index + 1;
+}
+
+static int skip_declarations(const TokenBuffer* tokens, int index) {
+    index = skip_section(tokens, index, TOK_CONST);
+    return index < 0 ? -1 : skip_section(tokens, index, TOK_VAR);
+}
+
+// The ";" or "." ending the statement at index, outside BEGIN..END; -1 if
+// a token on the way cannot be part of a statement
+static int statement_end(const TokenBuffer* tokens, int index) {
+    int depth = 0;
+    for (;; index++) {
+        switch (kind_at(tokens, index)) {
+            case TOK_BEGIN:
+                depth++;
+                break;
+            case TOK_END:
+                if (--depth < 0) return -1;
+                break;
+            case TOK_SEMICOLON:
+            case TOK_DOT:
+                if (depth == 0) return index;
+                break;
+            case TOK_CONST:
+            case TOK_VAR:
+            case TOK_PROC:
+            case TOK_YYEOF:
+                return -1;
+            default:
+                break;
+        }
+    }
+}
+
+// The ";" ending the procedure declaration at index, -1 if the tokens do
+// not follow the grammar. Nested procedures are counted, not recursed into
+static int procedure_end(const TokenBuffer* tokens, int index) {
+    int open = 0;  // procedures whose statement has not been reached yet
+    for (;;) {
+        if (kind_at(tokens, index) == TOK_PROC) {
+            if (kind_at(tokens, index + 1) != TOK_IDENT ||
+                kind_at(tokens, index + 2) != TOK_SEMICOLON) {
+                return -1;
+            }
+            open++;
+            index = skip_declarations(tokens, index + 3);
+            if (index < 0) return -1;
+            continue;
+        }
+        index = statement_end(tokens, index);
+        if (index < 0 || kind_at(tokens, index) != TOK_SEMICOLON) return -1;
+        if (--open == 0) return index;
+        index++;
+    }
+}
+
+// Split the top-level procedures into chunks of at least
+// PARSE_CHUNK_TOKENS tokens; returns their number, 0 if the pre-scan
+// fails or there are too few tokens for two chunks
+static int find_chunks(const TokenBuffer* tokens, ChunkTask** chunks) {
+    int count = 0;
+    int capacity = 0;
+    *chunks = NULL;
+    int index = skip_declarations(tokens, 0);
+    while (index >= 0 && kind_at(tokens, index) == TOK_PROC) {
+        int end = procedure_end(tokens, index);
+        if (end < 0) {
+            count = 0;
+            break;
+        }
+        if (count > 0 && (*chunks)[count - 1].last - (*chunks)[count - 1].first < PARSE_CHUNK_TOKENS) {
+            (*chunks)[count - 1].last = end;
+        } else {
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                ChunkTask* grown = realloc(*chunks, (size_t)capacity * sizeof(ChunkTask));
+                if (!grown) return 0;
+                *chunks = grown;
+            }
+            ChunkTask* chunk = &(*chunks)[count++];
+            *chunk = (ChunkTask){ tokens, index, end, 0, NODE_ARENA_INIT, NULL, false };
+        }
+        index = end + 1;
+    }
+    // A short last chunk joins the one before
+    if (count >= 2 && (*chunks)[count - 1].last - (*chunks)[count - 1].first < PARSE_CHUNK_TOKENS) {
+        (*chunks)[count - 2].last = (*chunks)[count - 1].last;
+        count--;
+    }
+    return count >= 2 ? count : 0;
+}
+
+static void parse_chunk_task(void* arg) {
+    ChunkTask* chunk = arg;
+    NodeArena* previous = use_node_arena(&chunk->arena);
+    trace_begin("parse chunk", NULL);
+    chunk->parsed = descent_parse_procedures(chunk->tokens, chunk->first, chunk->last,
+                                             chunk->line, &chunk->procs);
+    trace_end();
+    use_node_arena(previous);
+}
+
+// Give the identifier nodes their references: after a parse without
+// errors, there is one identifier node per identifier token
+static void take_name_refs(const TokenBuffer* tokens) {
+    size_t* refs = calloc((size_t)tokens->name_count + 1, sizeof(size_t));
+    for (int i = 0; i < tokens->count; i++) {
+        const Token* token = &tokens->tokens[i];
+        if (token_kind(token) != TOK_IDENT || token->value < 0) continue;
+        if (refs) {
+            refs[token->value]++;
+        } else {
+            retain_name(tokens->names[token->value]);
+        }
+    }
+    for (int id = 0; refs && id < tokens->name_count; id++) {
+        add_name_refs(tokens->names[id], refs[id]);
+    }
+    free(refs);
+}
+
+// Link the procedures between the variables and the statement of the
+// program's block, which then spans them as in a sequential parse
+static void link_procedures(Node* block, Node* procs, int first, int last) {
+    NodeOffset* link = node_right_link(block);
+    while (*link && node_at(*link)->type == NODE_VAR_DECL) link = node_next_link(node_at(*link));
+    Node* tail = procs;
+    while (node_next(tail)) tail = node_next(tail);
+    set_node_next(tail, node_at(*link));
+    *link = node_offset(procs);
+    int block_first = node_first_token(block);
+    int block_last = node_last_token(block);
+    if (block_first < 0) block_first = first;
+    if (!node_next(tail)) block_last = last;  // the statement is empty
+    set_node_span(block, block_first, block_last);
+}
+
+int parse_tokens_parallel(TokenBuffer* tokens, ParseFunction parse, TaskPool* pool) {
+    if (tokens->count == 0) lex_tokens(tokens);
+    ChunkTask* chunks = NULL;
+    int count = tokens->lex_errors == 0 ? find_chunks(tokens, &chunks) : 0;
+    if (count == 0) {
+        free(chunks);
+        return parse_tokens_with(tokens, parse);
+    }
+
+    TaskGroup group = TASK_GROUP_INIT;
+    int line = token_line(tokens, 0);
+    for (int i = 0; i < count; i++) {
+        line = token_line_from(tokens, i > 0 ? chunks[i - 1].first : 0, line, chunks[i].first);
+        chunks[i].line = line;
+        if (!submit_task(pool, &group, parse_chunk_task, &chunks[i])) parse_chunk_task(&chunks[i]);
+    }
+    int first = chunks[0].first;
+    int last = chunks[count - 1].last;
+    Node* program;
+    bool parsed = descent_parse_program(tokens, first, last, &program);
+    wait_task_group(pool, &group);
+
+    for (int i = 0; i < count; i++) {
+        adopt_node_arena(&chunks[i].arena);
+        parsed = parsed && chunks[i].parsed;
+    }
+    if (!parsed) {
+        free_borrowed_ast(program);
+        for (int i = 0; i < count; i++) free_borrowed_ast(chunks[i].procs);
+        free(chunks);
+        return parse_tokens_with(tokens, parse);
+    }
+
+    for (int i = count - 1; i > 0; i--) {
+        Node* tail = chunks[i - 1].procs;
+        while (node_next(tail)) tail = node_next(tail);
+        set_node_next(tail, chunks[i].procs);
+    }
+    link_procedures(node_left(program), chunks[0].procs, first, last);
+    take_name_refs(tokens);
+    free(chunks);
+    parse_error_count = 0;
+    ast_root = program;
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef PARALLEL_PARSE_H
+#define PARALLEL_PARSE_H
+
+#include "cst.h"
+#include "descent.h"
+#include "task_pool.h"
+
+/* Parallel parsing of large sources. A pre-scan of the token array finds
+ * the top-level procedure declarations by following the nesting of
+ * PROCEDURE headers, declarations and BEGIN/END. Runs of consecutive
+ * procedures with at least PARSE_CHUNK_TOKENS tokens are parsed as chunks
+ * on the pool's threads, each into a node arena of its own, while the
+ * calling thread parses the rest of the program; the procedure lists are
+ * then linked into the program's block.
+ *
+ * The tree is the one a sequential parse builds, down to lines and token
+ * spans. Chunks are parsed quietly by the descent parser; if any part does
+ * not parse, or lexing reported errors, the source is parsed again with
+ * parse_tokens_with(tokens, parse), so the error messages are the same as
+ * well.
+ */
+
+#define PARSE_CHUNK_TOKENS 16384
+
+// Parallel parse function declarations
+int parse_tokens_parallel(TokenBuffer* tokens, ParseFunction parse, TaskPool* pool);
+
+#endif // PARALLEL_PARSE_H
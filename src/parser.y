@@ -3,8 +3,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "ast.h"
+#include "cancel.h"
+#include "cst.h"
+#include "stream.h"
 
 Node* ast_root = NULL;
+int parse_error_count = 0;
 extern Node* reverse_list(Node* head);
 extern Node* find_last_node(Node* head);
 
@@ -14,13 +18,77 @@ extern int yylineno;
 void yyerror(const char *s);
 %}
 
+/* Locations are lines and, when parsing with parse_tokens() (cst.h),
+ * indices into the token buffer, -1 otherwise */
+%code requires {
+    typedef struct YYLTYPE {
+        int first_line;
+        int last_line;
+        int first_token;
+        int last_token;
+    } YYLTYPE;
+    #define YYLTYPE_IS_DECLARED 1
+    #define YYLTYPE_IS_TRIVIAL 1
+
+    // An empty rule starts after the symbol before it
+    #define YYLLOC_DEFAULT(Current, Rhs, N)                                \
+        do {                                                               \
+            if (N) {                                                       \
+                (Current).first_line = YYRHSLOC(Rhs, 1).first_line;        \
+                (Current).first_token = YYRHSLOC(Rhs, 1).first_token;      \
+                (Current).last_line = YYRHSLOC(Rhs, N).last_line;          \
+                (Current).last_token = YYRHSLOC(Rhs, N).last_token;        \
+            } else {                                                       \
+                (Current).first_line = (Current).last_line =               \
+                    YYRHSLOC(Rhs, 0).last_line;                            \
+                (Current).last_token = YYRHSLOC(Rhs, 0).last_token;        \
+                (Current).first_token = (Current).last_token + 1;          \
+            }                                                              \
+        } while (0)
+
+    // Lines only, for the --debug trace
+    #define YYLOCATION_PRINT(File, Loc) \
+        fprintf(File, "%d-%d", (Loc)->first_line, (Loc)->last_line)
+}
+
+%code {
+    static Node* ident_node(const char* name, YYLTYPE loc);
+    static Node* new_error(int line);
+    static Node* set_tokens(Node* node, YYLTYPE first, YYLTYPE last);
+    static Node* link_statements(Node* first, Node* rest);
+
+    // Give up once the run is cancelled (cancel.h). YYABORT frees the
+    // stack but not the symbols of the rule being reduced, so node,
+    // which holds them, is freed here
+    #define CANCEL_POINT(node)                                             \
+        do {                                                               \
+            if (poll_cancel(analysis_cancel)) {                            \
+                free_ast(node);                                            \
+                YYABORT;                                                   \
+            }                                                              \
+        } while (0)
+}
+
 /* Bison declarations */
 %define api.token.prefix {TOK_}
 %define parse.error detailed
+%locations
+
+/* Without default reductions a state left by an `error` production keeps
+ * discarding bad tokens until one it can use, instead of reducing first
+ * and then popping (and losing) the surrounding list on the next bad one */
+%define lr.default-reduction accepting
+
+%initial-action {
+    ast_root = NULL;
+    parse_error_count = 0;
+    @$.first_line = @$.last_line = 1;
+    @$.first_token = @$.last_token = -1;
+}
 
 %union {
     int     value;
-    char*   name;
+    const char* name;    // interned, the token holds a reference
     struct Node* node;
 }
 
@@ -36,11 +104,16 @@ void yyerror(const char *s);
 %token  LPAREN  RPAREN
 %token  SEMICOLON  COMMA   DOT
 
-/* non-terminals */
-%type <node>  program block constants variables procedures
+/* non-terminals; program has no value, its action sets ast_root */
+%type <node>  block constants variables procedures
 %type <node>  const_decl var_decl statement statement_list
 %type <node>  expression condition term factor
 
+/* Values that never make it into ast_root: symbols discarded by error
+ * recovery and whatever is left on the stack when a parse is aborted */
+%destructor { release_name($$); } <name>
+%destructor { free_ast($$); } <node>
+
 /* Precence rules are implicit via grammar rules
 %right ASSIGN
 %left  LT GT EQ NEQ LTE GTE
@@ -54,33 +127,42 @@ void yyerror(const char *s);
 program
     : block DOT
         {
-            $$ = new_node(NODE_PROGRAM);
-            $$->left = $1;
-            ast_root = $$;
+            ast_root = new_node(NODE_PROGRAM);
+            set_node_left(ast_root, $1);
         }
     ;
 
 block
-    : constants variables procedures statement
+    : constants variables
         {
-            $$ = new_node(NODE_BLOCK);
+            // Reverse the declaration lists before the procedures, which
+            // --stream analyzes as they are reduced
+            $1 = reverse_list($1);
+            $2 = reverse_list($2);
+            stream_block_declarations($1, $2);
+            enter_expr_scope();
+        }
+      procedures statement
+        {
+            $$ = set_tokens(new_node(NODE_BLOCK), @$, @$);
+            leave_expr_scope();
             
-            // Reverse the lists before linking
-            Node* const_list = reverse_list($1);
-            Node* var_list = reverse_list($2);
-            Node* proc_list = reverse_list($3);
+            // Reverse the procedures before linking
+            Node* const_list = $1;
+            Node* var_list = $2;
+            Node* proc_list = reverse_list($4);
             
-            $$->left = const_list;
-            $$->right = var_list ? var_list : (proc_list ? proc_list : $4);
+            set_node_left($$, const_list);
+            set_node_right($$, var_list ? var_list : (proc_list ? proc_list : $5));
             
             if (var_list) {
                 Node* last_var = find_last_node(var_list);
-                last_var->next = proc_list ? proc_list : $4;
+                set_node_next(last_var, proc_list ? proc_list : $5);
             }
             
             if (proc_list) {
                 Node* last_proc = find_last_node(proc_list);
-                last_proc->next = $4;
+                set_node_next(last_proc, $5);
             }
         }
     ;
@@ -93,16 +175,25 @@ constants
 const_decl
     : IDENT EQ NUM
         {
-            $$ = new_node(NODE_CONST_DECL);
-            $$->left = new_ident($1);    // identifier
-            $$->right = new_number($3);   // value
+            $$ = set_tokens(new_node(NODE_CONST_DECL), @1, @3);
+            set_node_left($$, ident_node($1, @1));    // identifier
+            set_node_right($$, set_tokens(new_number($3), @3, @3));   // value
+        }
+    | error
+        {
+            $$ = new_error(@1.first_line);
         }
     | const_decl COMMA IDENT EQ NUM
         {
-            $$ = new_node(NODE_CONST_DECL);
-            $$->left = new_ident($3);
-            $$->right = new_number($5);
-            $$->next = $1;               // link to previous declarations
+            $$ = set_tokens(new_node(NODE_CONST_DECL), @3, @5);
+            set_node_left($$, ident_node($3, @3));
+            set_node_right($$, set_tokens(new_number($5), @5, @5));
+            set_node_next($$, $1);               // link to previous declarations
+        }
+    | const_decl COMMA error
+        {
+            $$ = new_error(@3.first_line);
+            set_node_next($$, $1);
         }
     ;
 
@@ -114,25 +205,49 @@ variables
 var_decl
     : IDENT
         {
-            $$ = new_node(NODE_VAR_DECL);
-            $$->left = new_ident($1);
+            $$ = set_tokens(new_node(NODE_VAR_DECL), @1, @1);
+            set_node_left($$, ident_node($1, @1));
+        }
+    | error
+        {
+            $$ = new_error(@1.first_line);
         }
     | var_decl COMMA IDENT
         {
-            $$ = new_node(NODE_VAR_DECL);
-            $$->left = new_ident($3);
-            $$->next = $1;
+            $$ = set_tokens(new_node(NODE_VAR_DECL), @3, @3);
+            set_node_left($$, ident_node($3, @3));
+            set_node_next($$, $1);
+        }
+    | var_decl COMMA error
+        {
+            $$ = new_error(@3.first_line);
+            set_node_next($$, $1);
         }
     ;
 
 procedures
     : %empty                                    { $$ = NULL; }
-    | procedures PROC IDENT SEMICOLON block SEMICOLON
+    | procedures PROC IDENT SEMICOLON
+        {
+            stream_procedure_header($3);
+        }
+      block SEMICOLON
         {
-            $$ = new_node(NODE_PROC);
-            $$->left = new_ident($3);
-            $$->right = $5;
-            $$->next = $1;
+            $$ = set_tokens(new_node(NODE_PROC), @2, @7);
+            set_node_line($$, @2.first_line);
+            set_node_left($$, ident_node($3, @3));
+            set_node_right($$, $6);
+            set_node_next($$, $1);
+            CANCEL_POINT($$);
+            stream_procedure($$);
+        }
+    | procedures PROC error SEMICOLON block SEMICOLON
+        {
+            // Malformed header: keep the body so it is still parsed, but
+            // poison the whole procedure for later phases
+            $$ = new_error(@3.first_line);
+            set_node_right($$, $5);
+            set_node_next($$, $1);
         }
     ;
 
@@ -140,42 +255,59 @@ statement
     : %empty                              { $$ = NULL; }
     | IDENT ASSIGN expression
         {
-            $$ = new_node(NODE_ASSIGN);
-            $$->left = new_ident($1);
-            $$->right = $3;
+            $$ = set_tokens(new_node(NODE_ASSIGN), @$, @$);
+            set_node_line($$, @1.first_line);
+            set_node_left($$, ident_node($1, @1));
+            set_node_right($$, $3);
+            CANCEL_POINT($$);
         }
     | CALL IDENT
         {
-            $$ = new_node(NODE_CALL);
-            $$->left = new_ident($2);
+            $$ = set_tokens(new_node(NODE_CALL), @$, @$);
+            set_node_line($$, @1.first_line);
+            set_node_left($$, ident_node($2, @2));
+            CANCEL_POINT($$);
         }
     | READ IDENT
         {
-            $$ = new_node(NODE_INPUT);
-            $$->left = new_ident($2);
+            $$ = set_tokens(new_node(NODE_INPUT), @$, @$);
+            set_node_line($$, @1.first_line);
+            set_node_left($$, ident_node($2, @2));
+            CANCEL_POINT($$);
         }
     | WRITE expression
         {
-            $$ = new_node(NODE_OUTPUT);
-            $$->left = $2;
+            $$ = set_tokens(new_node(NODE_OUTPUT), @$, @$);
+            set_node_line($$, @1.first_line);
+            set_node_left($$, $2);
+            CANCEL_POINT($$);
         }
     | BEGIN statement statement_list END
         {
-            $$ = new_node(NODE_COMPOUND);
-            $$->left = $2;
-            $$->right = $3;
+            $$ = set_tokens(new_node(NODE_COMPOUND), @$, @$);
+            set_node_line($$, @1.first_line);
+            set_node_left($$, link_statements($2, $3));
+            CANCEL_POINT($$);
         }
     | IF condition THEN statement
         {
-            $$ = new_node(NODE_IF);
-            $$->left = $2;
-            $$->right = $4;
+            $$ = set_tokens(new_node(NODE_IF), @$, @$);
+            set_node_line($$, @1.first_line);
+            set_node_left($$, $2);
+            set_node_right($$, $4);
+            CANCEL_POINT($$);
         }
     | WHILE condition DO statement
         {
-            $$ = new_node(NODE_WHILE);
-            $$->left = $2;
-            $$->right = $4;
+            $$ = set_tokens(new_node(NODE_WHILE), @$, @$);
+            set_node_line($$, @1.first_line);
+            set_node_left($$, $2);
+            set_node_right($$, $4);
+            CANCEL_POINT($$);
+        }
+    | error
+        {
+            $$ = new_error(@1.first_line);
         }
     ;
 
@@ -183,8 +315,7 @@ statement_list
     : %empty                            { $$ = NULL; }
     | SEMICOLON statement statement_list
         {
-            $$ = $2;
-            $$->next = $3;
+            $$ = link_statements($2, $3);
         }
     ;
 
@@ -192,50 +323,50 @@ condition
     : ODD expression
         {
             $$ = new_node(NODE_CONDITION);
-            $$->left = $2;
-            $$->op = OP_ODD;
+            set_node_left($$, $2);
+            set_node_op($$, OP_ODD);
         }
     | expression EQ expression
         {
             $$ = new_node(NODE_CONDITION);
-            $$->left = $1;
-            $$->right = $3;
-            $$->op = OP_EQ;
+            set_node_left($$, $1);
+            set_node_right($$, $3);
+            set_node_op($$, OP_EQ);
         }
     | expression NEQ expression
         {
             $$ = new_node(NODE_CONDITION);
-            $$->left = $1;
-            $$->right = $3;
-            $$->op = OP_NEQ;
+            set_node_left($$, $1);
+            set_node_right($$, $3);
+            set_node_op($$, OP_NEQ);
         }
     | expression LT expression
         {
             $$ = new_node(NODE_CONDITION);
-            $$->left = $1;
-            $$->right = $3;
-            $$->op = OP_LT;
+            set_node_left($$, $1);
+            set_node_right($$, $3);
+            set_node_op($$, OP_LT);
         }
     | expression LTE expression
         {
             $$ = new_node(NODE_CONDITION);
-            $$->left = $1;
-            $$->right = $3;
-            $$->op = OP_LTE;
+            set_node_left($$, $1);
+            set_node_right($$, $3);
+            set_node_op($$, OP_LTE);
         }
     | expression GT expression
         {
             $$ = new_node(NODE_CONDITION);
-            $$->left = $1;
-            $$->right = $3;
-            $$->op = OP_GT;
+            set_node_left($$, $1);
+            set_node_right($$, $3);
+            set_node_op($$, OP_GT);
         }
     | expression GTE expression
         {
             $$ = new_node(NODE_CONDITION);
-            $$->left = $1;
-            $$->right = $3;
-            $$->op = OP_GTE;
+            set_node_left($$, $1);
+            set_node_right($$, $3);
+            set_node_op($$, OP_GTE);
         }
     ;
 
@@ -245,23 +376,26 @@ expression
     | MINUS term
         {
             $$ = new_node(NODE_BINARY_OP);
-            $$->left = new_number(-1);
-            $$->right = $2;
-            $$->op = OP_MULT;  // not the most efficient
+            set_node_left($$, share_expr(new_number(-1)));
+            set_node_right($$, $2);
+            set_node_op($$, OP_MULT);  // not the most efficient
+            $$ = share_expr($$);
         }
     | expression PLUS term
         {
             $$ = new_node(NODE_BINARY_OP);
-            $$->left = $1;
-            $$->right = $3;
-            $$->op = OP_PLUS;
+            set_node_left($$, $1);
+            set_node_right($$, $3);
+            set_node_op($$, OP_PLUS);
+            $$ = share_expr($$);
         }
     | expression MINUS term
         {
             $$ = new_node(NODE_BINARY_OP);
-            $$->left = $1;
-            $$->right = $3;
-            $$->op = OP_MINUS;
+            set_node_left($$, $1);
+            set_node_right($$, $3);
+            set_node_op($$, OP_MINUS);
+            $$ = share_expr($$);
         }
     ;
 
@@ -270,22 +404,25 @@ term
     | term MULT factor
         {
             $$ = new_node(NODE_BINARY_OP);
-            $$->left = $1;
-            $$->right = $3;
-            $$->op = OP_MULT;
+            set_node_left($$, $1);
+            set_node_right($$, $3);
+            set_node_op($$, OP_MULT);
+            $$ = share_expr($$);
         }
     | term DIV factor
         {
             $$ = new_node(NODE_BINARY_OP);
-            $$->left = $1;
-            $$->right = $3;
-            $$->op = OP_DIV;
+            set_node_left($$, $1);
+            set_node_right($$, $3);
+            set_node_op($$, OP_DIV);
+            $$ = share_expr($$);
         }
     ;
 
+/* With --hash-cons, expressions are shared (share_expr() in ast.h) */
 factor
-    : IDENT                     { $$ = new_ident($1); }
-    | NUM                       { $$ = new_number($1); }
+    : IDENT                     { $$ = share_expr(ident_node($1, @1)); }
+    | NUM                       { $$ = share_expr(set_tokens(new_number($1), @1, @1)); }
     | LPAREN expression RPAREN  { $$ = $2; }
     ;
 
@@ -293,5 +430,34 @@ factor
 /* Epilogue */
 
 void yyerror(const char *s) {
+    parse_error_count++;
     fprintf(stderr, "ERROR line %d: %s\n", yylineno, s);
 }
+
+// Identifier node for a name interned by the scanner; the node takes
+// over the token's reference
+static Node* ident_node(const char* name, YYLTYPE loc) {
+    Node* node = new_node(NODE_IDENT);
+    set_node_name(node, name);
+    return set_tokens(node, loc, loc);
+}
+
+// Placeholder for a construct that failed to parse
+static Node* new_error(int line) {
+    Node* node = new_node(NODE_ERROR);
+    set_node_line(node, line);
+    return node;
+}
+
+// Record the tokens a node was parsed from, if there are any
+static Node* set_tokens(Node* node, YYLTYPE first, YYLTYPE last) {
+    if (last.last_token >= 0) set_node_span(node, first.first_token, last.last_token);
+    return node;
+}
+
+// Prepend a statement to a statement list, dropping empty statements
+static Node* link_statements(Node* first, Node* rest) {
+    if (!first) return rest;
+    set_node_next(first, rest);
+    return first;
+}
@@ -0,0 +1,376 @@
+#ifndef PL0_HPP
+#define PL0_HPP
+
+/* A C++17 interface to the library for programs that embed the analyzer,
+ * header-only over the C functions. pl0::parse() lexes and parses a
+ * source into a Program and describes the first error in Diagnostics;
+ * Program::check() runs type checking, semantic analysis and data-flow
+ * analysis on it. Nothing is printed, and none of the driver's globals
+ * (ast_root, parse_error_count, the scanner, the analysis stream) is
+ * touched; the source is lexed by a scanner instance of its own:
+ *
+ *     auto [program, diagnostics] = pl0::parse(text);
+ *     if (diagnostics) diagnostics = program.check();
+ *     if (!diagnostics) std::cerr << diagnostics.message() << '\n';
+ *
+ * The source is borrowed, not copied (the scanner reads it a buffer's
+ * worth at a time): it must outlive the Program, which keeps the tokens
+ * and the nodes (in an arena of its own, freed at once without walking
+ * the tree). Nodes are read through NodeRef, which holds a pointer and
+ * nothing else. Program and Diagnostics are move-only.
+ *
+ * Both take an optional Budget, a deadline and a cancellation flag that
+ * other threads may set; the parser and the passes poll it per statement
+ * and procedure (cancel.h). A parse that runs out of budget frees what it
+ * built at once and, like a check, fails with Phase::cancelled.
+ *
+ * Identifier names still go through the process-wide name table
+ * (intern_name()), which takes no lock, so programs are parsed on one
+ * thread at a time. The data-flow findings in Diagnostics name variables
+ * of the Program they came from, and are valid while it is.
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <iterator>
+#include <string_view>
+#include <utility>
+
+extern "C" {
+#include "ast.h"
+#include "cancel.h"
+#include "cst.h"
+#include "dataflow.h"
+#include "descent.h"
+#include "semantic.h"
+#include "type_check.h"
+}
+
+namespace pl0 {
+
+// The phase an error came from
+enum class Phase {
+    none,
+    memory,     // out of memory in any phase
+    lex,
+    syntax,
+    types,
+    semantics,
+    dataflow,
+    cancelled   // the budget ran out, or was cancelled
+};
+
+// A time budget for parse() and Program::check(), and a flag to give up
+// early: cancel() may be called from any thread while they run. Without
+// memory for it, a budget never runs out.
+class Budget {
+public:
+    // No deadline, only cancel()
+    Budget() : token_(create_cancel_token(0)) {}
+    // A deadline timeout from now, none if it is not positive
+    explicit Budget(std::chrono::milliseconds timeout)
+        : token_(create_cancel_token(timeout.count() > 0
+                                     ? static_cast<unsigned long long>(timeout.count())
+                                     : 0)) {}
+    Budget(const Budget&) = delete;
+    Budget& operator=(const Budget&) = delete;
+    ~Budget() { free_cancel_token(token_); }
+
+    void cancel() {
+        if (token_) cancel_analysis(token_);
+    }
+    // CANCEL_NONE until a poll has found the deadline passed, or cancel()
+    CancelReason reason() const { return cancel_reason(token_); }
+    CancelToken* get() const { return token_; }
+
+private:
+    CancelToken* token_;
+};
+
+class NodeList;
+
+// A node of a Program; false if there is none
+class NodeRef {
+public:
+    NodeRef() = default;
+    explicit NodeRef(const Node* node) : node_(node) {}
+
+    explicit operator bool() const { return node_ != nullptr; }
+    bool operator==(NodeRef other) const { return node_ == other.node_; }
+    bool operator!=(NodeRef other) const { return node_ != other.node_; }
+
+    NodeType type() const { return static_cast<NodeType>(node_->type); }
+    OpType op() const { return node_op(node_); }
+    int value() const { return node_value(node_); }
+    // NODE_IDENT
+    std::string_view name() const {
+        const char* name = node_name(node_);
+        return name ? std::string_view(name) : std::string_view();
+    }
+    // Source line of statements, procedures and conditions, 0 if unknown
+    int line() const { return node_line(node_); }
+
+    // Null for identifiers and numbers, which have no children
+    NodeRef left() const { return NodeRef(node_left(node_)); }
+    NodeRef right() const { return NodeRef(node_right(node_)); }
+    NodeRef next() const { return NodeRef(node_next(node_)); }
+    // NODE_IDENT, once checked: the declaring node
+    NodeRef decl() const { return NodeRef(node_decl(node_)); }
+    // NODE_BLOCK: the statement after the declarations
+    NodeRef statement() const { return NodeRef(find_block_statement(const_cast<Node*>(node_))); }
+    // This node and the ones after it in its list
+    NodeList list() const;
+
+    const Node* get() const { return node_; }
+
+private:
+    const Node* node_ = nullptr;
+};
+
+// The nodes of a list, linked through next
+class NodeList {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = NodeRef;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const NodeRef*;
+        using reference = NodeRef;
+
+        iterator() = default;
+        explicit iterator(NodeRef node) : node_(node) {}
+        NodeRef operator*() const { return node_; }
+        iterator& operator++() {
+            node_ = node_.next();
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator before = *this;
+            node_ = node_.next();
+            return before;
+        }
+        bool operator==(const iterator& other) const { return node_ == other.node_; }
+        bool operator!=(const iterator& other) const { return node_ != other.node_; }
+
+    private:
+        NodeRef node_;
+    };
+
+    explicit NodeList(NodeRef first) : first_(first) {}
+    iterator begin() const { return iterator(first_); }
+    iterator end() const { return iterator(); }
+    bool empty() const { return !first_; }
+
+private:
+    NodeRef first_;
+};
+
+inline NodeList NodeRef::list() const {
+    return NodeList(*this);
+}
+
+// The first error of a parse or check, if any, and the data-flow warnings
+// of a check; true if there was no error
+class Diagnostics {
+public:
+    Diagnostics() = default;
+    Diagnostics(const Diagnostics&) = delete;
+    Diagnostics& operator=(const Diagnostics&) = delete;
+    Diagnostics(Diagnostics&& other) noexcept { *this = std::move(other); }
+    Diagnostics& operator=(Diagnostics&& other) noexcept {
+        if (this == &other) return *this;
+        free_dataflow_context(dataflow_);
+        phase_ = other.phase_;
+        std::char_traits<char>::copy(message_, other.message_, sizeof(message_));
+        dataflow_ = other.dataflow_;
+        other.phase_ = Phase::none;
+        other.message_[0] = '\0';
+        other.dataflow_ = nullptr;
+        return *this;
+    }
+    ~Diagnostics() { free_dataflow_context(dataflow_); }
+
+    bool ok() const { return phase_ == Phase::none; }
+    explicit operator bool() const { return ok(); }
+    Phase phase() const { return phase_; }
+    // "line N: ..." for errors that have a line, empty if there is none
+    std::string_view message() const { return message_; }
+
+    // Data-flow warnings and endless loop errors, sorted by line
+    const DataflowWarning* begin() const { return dataflow_ ? dataflow_->warnings : nullptr; }
+    const DataflowWarning* end() const { return begin() + warning_count(); }
+    int warning_count() const { return dataflow_ ? dataflow_->warning_count : 0; }
+
+    // Print the findings the way the command line tool does
+    void print_warnings(FILE* out) const {
+        if (dataflow_) print_dataflow_warnings(dataflow_, out);
+    }
+
+private:
+    friend class Program;
+    friend struct ParseResult parse(std::string_view source, Budget* budget);
+
+    void fail(Phase phase, const char* message) {
+        phase_ = phase;
+        std::snprintf(message_, sizeof(message_), "%s", message);
+    }
+
+    // A phase gave up because of token: the findings so far go too
+    void cancel(CancelToken* token) {
+        fail(Phase::cancelled,
+             cancel_reason(token) == CANCEL_TIMEOUT ? "time budget used up" : "cancelled");
+        free_dataflow_context(dataflow_);
+        dataflow_ = nullptr;
+    }
+
+    Phase phase_ = Phase::none;
+    char message_[256] = "";
+    DataflowContext* dataflow_ = nullptr;
+};
+
+// A parsed program: the tokens of its source and its AST; false if it did
+// not parse
+class Program {
+public:
+    Program() = default;
+    Program(const Program&) = delete;
+    Program& operator=(const Program&) = delete;
+    Program(Program&& other) noexcept { *this = std::move(other); }
+    Program& operator=(Program&& other) noexcept {
+        if (this == &other) return *this;
+        release();
+        tokens_ = std::exchange(other.tokens_, nullptr);
+        arena_ = std::exchange(other.arena_, empty_arena());
+        root_ = std::exchange(other.root_, nullptr);
+        return *this;
+    }
+    ~Program() { release(); }
+
+    explicit operator bool() const { return root_ != nullptr; }
+    // The caller's text
+    std::string_view source() const {
+        return tokens_ ? std::string_view(tokens_->source, tokens_->source_size)
+                       : std::string_view();
+    }
+    // The NODE_PROGRAM
+    NodeRef root() const { return NodeRef(root_); }
+
+    // Type check, analyze and look for data-flow problems, stopping at
+    // the first phase that fails. The analysis fills in the nodes'
+    // declarations, levels and slots.
+    Diagnostics check(Budget* budget = nullptr) {
+        Diagnostics diagnostics;
+        if (!root_) {
+            diagnostics.fail(Phase::syntax, "the program did not parse");
+            return diagnostics;
+        }
+        CancelToken* cancel = budget ? budget->get() : nullptr;
+        NodeArena* previous = use_node_arena(&arena_);
+        check(diagnostics, cancel);
+        use_node_arena(previous);
+        if (!diagnostics.ok() && cancel_requested(cancel)) diagnostics.cancel(cancel);
+        return diagnostics;
+    }
+
+private:
+    friend struct ParseResult parse(std::string_view source, Budget* budget);
+
+    void check(Diagnostics& diagnostics, CancelToken* cancel) {
+        TypeContext* types = create_type_context();
+        if (!types) return diagnostics.fail(Phase::memory, "Out of memory");
+        types->cancel = cancel;
+        bool typed = check_type(types, root_) != TYPE_ERROR;
+        if (!typed) diagnostics.fail(Phase::types, types->error_msg);
+        free_type_context(types);
+        if (!typed) return;
+
+        SemanticContext* semantics = create_semantic_context();
+        if (!semantics) return diagnostics.fail(Phase::memory, "Out of memory");
+        semantics->cancel = cancel;
+        bool analyzed = analyze_semantics(semantics, root_);
+        if (!analyzed) diagnostics.fail(Phase::semantics, semantics->error_msg);
+        free_semantic_context(semantics);
+        if (!analyzed) return;
+
+        DataflowContext* dataflow = create_dataflow_context();
+        if (!dataflow) return diagnostics.fail(Phase::memory, "Out of memory");
+        diagnostics.dataflow_ = dataflow;
+        dataflow->cancel = cancel;
+        if (!analyze_dataflow(dataflow, root_)) {
+            return diagnostics.fail(Phase::memory, dataflow->error_msg);
+        }
+        for (const DataflowWarning& finding : diagnostics) {
+            if (finding.kind != ERROR_ENDLESS_LOOP) continue;
+            std::snprintf(diagnostics.message_, sizeof(diagnostics.message_),
+                          "line %d: the loop never ends once entered", finding.line);
+            diagnostics.phase_ = Phase::dataflow;
+            break;
+        }
+    }
+
+    // NODE_ARENA_INIT, spelled out for C++
+    static NodeArena empty_arena() {
+        NodeArena arena{};
+        arena.slab_used = NODE_SLAB_WORDS;
+        return arena;
+    }
+
+    // Nodes borrow their names from the tokens, so neither is walked
+    void release() {
+        free_node_arena(&arena_);
+        free_token_buffer(tokens_);
+        tokens_ = nullptr;
+        root_ = nullptr;
+    }
+
+    TokenBuffer* tokens_ = nullptr;
+    NodeArena arena_ = empty_arena();
+    Node* root_ = nullptr;
+};
+
+struct ParseResult {
+    Program program;
+    Diagnostics diagnostics;
+};
+
+// Lex and parse source, which must outlive the program, within budget
+inline ParseResult parse(std::string_view source, Budget* budget = nullptr) {
+    ParseResult result;
+    Program& program = result.program;
+    Diagnostics& diagnostics = result.diagnostics;
+    program.tokens_ = borrow_token_buffer(source.data(), source.size());
+    if (!program.tokens_) {
+        diagnostics.fail(Phase::memory, "Out of memory");
+        return result;
+    }
+    CancelToken* cancel = budget ? budget->get() : nullptr;
+    int errors = lex_tokens_quiet(program.tokens_, cancel, diagnostics.message_,
+                                  sizeof(diagnostics.message_));
+    if (errors < 0 && cancel_requested(cancel)) {
+        diagnostics.cancel(cancel);
+        program.release();
+    } else if (errors < 0) {
+        diagnostics.fail(Phase::memory, "Out of memory");
+    }
+    if (errors > 0) diagnostics.phase_ = Phase::lex;
+    if (errors != 0) return result;
+
+    NodeArena* previous = use_node_arena(&program.arena_);
+    program.root_ = descent_parse_tokens(program.tokens_, cancel, diagnostics.message_,
+                                         sizeof(diagnostics.message_));
+    use_node_arena(previous);
+    if (!program.root_ && cancel_requested(cancel)) {
+        diagnostics.cancel(cancel);
+        program.release();
+    } else if (!program.root_) {
+        diagnostics.phase_ = Phase::syntax;
+        if (!diagnostics.message_[0]) diagnostics.fail(Phase::syntax, "syntax error");
+    }
+    return result;
+}
+
+} // namespace pl0
+
+#endif // PL0_HPP
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "ast.h"
+#include "cst.h"
+#include "semantic.h"
+#include "trace.h"
+#include "xref.h"
+
+/* pl0_index: keep a cross-reference index of PL/0 sources up to date and
+ * query it (see xref.h for the index) */
+
+extern Node* ast_root;
+extern int parse_error_count;
+extern int yylex_destroy(void);
+
+// Roles a query prints, as bits 1 << XrefRole
+#define ALL_ROLES 0xf
+
+static void print_index_usage(const char* program_name) {
+    fprintf(stderr, "Usage: %s [options] INDEX file...\n", program_name);
+    fprintf(stderr, "       %s --query=NAME [role...] INDEX\n", program_name);
+    fprintf(stderr, "Makes INDEX cover the given files, parsing only those that changed\n");
+    fprintf(stderr, "since it was last written, or lists the definitions and uses of NAME.\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -q, --query=NAME   Print where NAME is defined and used, exit 1 if nowhere\n");
+    fprintf(stderr, "  --defs             Only definitions\n");
+    fprintf(stderr, "  --reads            Only uses in expressions\n");
+    fprintf(stderr, "  --writes           Only assignments and READ\n");
+    fprintf(stderr, "  --calls            Only CALLs\n");
+    fprintf(stderr, "  -v, --verbose      Report how many files were parsed and reused\n");
+    fprintf(stderr, "  --trace=FILE       Write the time spent on each file to FILE,\n");
+    fprintf(stderr, "                     in Chrome Trace Event format\n");
+    fprintf(stderr, "  -h, --help         Print this help message\n");
+}
+
+static int query_index(const char* path, const char* name, unsigned roles) {
+    char error_msg[256];
+    XrefIndex* index = open_xref_index(path, error_msg, sizeof(error_msg));
+    if (!index) {
+        fprintf(stderr, "Error: %s\n", error_msg);
+        return 2;
+    }
+    static const char* const kinds[] = { "constant", "variable", "procedure" };
+    int found = 0;
+    const XrefName* entries = xref_find_name(index, name);
+    for (uint32_t i = 0; entries && i < entries->entry_count; i++) {
+        const XrefEntry* entry = &index->entries[entries->first_entry + i];
+        if (!(roles & 1u << entry->role) || entry->file >= index->header->file_count) continue;
+        printf("%s:%u:%u: %s %s %s\n", xref_string(index, index->files[entry->file].path),
+               entry->line, entry->column, xref_role_name((XrefRole)entry->role),
+               entry->kind <= SYM_PROCEDURE ? kinds[entry->kind] : "?", name);
+        found++;
+    }
+    close_xref_index(index);
+    return found > 0 ? 0 : 1;
+}
+
+// Parse and analyze one file into the builder; returns the exit status
+static int index_file(XrefBuilder* builder, const char* path, const struct stat* st) {
+    FILE* in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return 1;
+    }
+    trace_begin("read input", path);
+    TokenBuffer* tokens = read_token_buffer(in);
+    fclose(in);
+    trace_end();
+    if (!tokens) {
+        fprintf(stderr, "%s: cannot read source\n", path);
+        return 1;
+    }
+
+    // A file with syntax errors is left out, so that it is parsed again
+    // next time
+    int status = 0;
+    trace_begin("parse", path);
+    bool parsed = parse_tokens(tokens) == 0 && parse_error_count == 0 && ast_root;
+    trace_end();
+    if (!parsed) {
+        fprintf(stderr, "%s: not indexed, it has syntax errors\n", path);
+        status = 1;
+    } else {
+        SemanticContext* ctx = create_semantic_context();
+        int64_t mtime = (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+        int source = ctx ? xref_add_source(builder, path, mtime, (uint64_t)st->st_size) : -1;
+        trace_begin("analyze_semantics", path);
+        bool analyzed = source < 0 || analyze_semantics(ctx, ast_root);
+        trace_end();
+        if (!analyzed) {
+            fprintf(stderr, "%s: indexed up to a semantic error: %s\n", path, ctx->error_msg);
+            status = 1;
+        }
+        trace_begin("xref_add_tree", path);
+        bool added = source >= 0 && xref_add_tree(builder, source, tokens, ast_root);
+        trace_end();
+        if (!added) {
+            if (!ctx) snprintf(builder->error_msg, sizeof(builder->error_msg), "Out of memory");
+            status = 2;
+        }
+        free_semantic_context(ctx);
+    }
+    trace_begin("cleanup", path);
+    free_ast(ast_root);
+    ast_root = NULL;
+    free_token_buffer(tokens);
+    trace_end();
+    return status;
+}
+
+static int update_index(const char* path, char** files, int file_count, bool verbose) {
+    char error_msg[256];
+    XrefIndex* old = NULL;
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        old = open_xref_index(path, error_msg, sizeof(error_msg));
+        if (!old) fprintf(stderr, "Warning: %s, building it again\n", error_msg);
+    }
+    XrefBuilder* builder = create_xref_builder();
+    int* reuse = old ? malloc((old->header->file_count + 1) * sizeof(int)) : NULL;
+    if (!builder || (old && !reuse)) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(reuse);
+        free_xref_builder(builder);
+        close_xref_index(old);
+        return 2;
+    }
+    for (uint32_t i = 0; old && i < old->header->file_count; i++) reuse[i] = -1;
+
+    int status = 0;
+    int parsed = 0;
+    int reused = 0;
+    for (int i = 0; i < file_count && status < 2; i++) {
+        bool duplicate = false;
+        for (int j = 0; j < builder->source_count && !duplicate; j++) {
+            duplicate = strcmp(builder->sources[j].path, files[i]) == 0;
+        }
+        if (duplicate) continue;
+        if (stat(files[i], &st) != 0) {
+            perror(files[i]);
+            status = 1;
+            continue;
+        }
+        // A file is unchanged if it has the size and modification time
+        // the index recorded
+        int file = old ? xref_find_file(old, files[i]) : -1;
+        int64_t mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+        if (file >= 0 && old->files[file].mtime == mtime &&
+            old->files[file].size == (uint64_t)st.st_size) {
+            reuse[file] = xref_add_source(builder, files[i], mtime, (uint64_t)st.st_size);
+            if (reuse[file] < 0) status = 2;
+            reused++;
+            continue;
+        }
+        int file_status = index_file(builder, files[i], &st);
+        if (file_status > status) status = file_status;
+        parsed++;
+    }
+
+    trace_begin("xref_reuse", path);
+    if (status < 2 && old && !xref_reuse(builder, old, reuse)) status = 2;
+    trace_end();
+    // The old index stays mapped until the new one has replaced it
+    trace_begin("write_xref_index", path);
+    if (status < 2 && !write_xref_index(builder, path)) status = 2;
+    trace_end();
+    if (status == 2) fprintf(stderr, "Error: %s\n", builder->error_msg);
+    if (verbose && status < 2) {
+        fprintf(stderr, "%s: %d files parsed, %d unchanged, %zu entries\n",
+                path, parsed, reused, builder->ref_count);
+    }
+    free(reuse);
+    close_xref_index(old);
+    free_xref_builder(builder);
+    return status;
+}
+
+int main(int argc, char** argv) {
+    const char* query = NULL;
+    const char* trace = NULL;
+    unsigned roles = 0;
+    bool verbose = false;
+    int first_arg = argc;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--query=", 8) == 0) {
+            query = argv[i] + 8;
+        } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            query = argv[++i];
+        } else if (strcmp(argv[i], "--defs") == 0) {
+            roles |= 1u << XREF_DEFINE;
+        } else if (strcmp(argv[i], "--reads") == 0) {
+            roles |= 1u << XREF_READ;
+        } else if (strcmp(argv[i], "--writes") == 0) {
+            roles |= 1u << XREF_WRITE;
+        } else if (strcmp(argv[i], "--calls") == 0) {
+            roles |= 1u << XREF_CALL;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0 && argv[i][8] != '\0') {
+            trace = argv[i] + 8;
+        } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_index_usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Error: Unknown option: %s\n", argv[i]);
+            print_index_usage(argv[0]);
+            return 2;
+        } else {
+            first_arg = i;
+            break;
+        }
+    }
+
+    if (first_arg == argc) {
+        fprintf(stderr, "Error: No index given\n");
+        print_index_usage(argv[0]);
+        return 2;
+    }
+    if (query) {
+        if (first_arg + 1 != argc) {
+            fprintf(stderr, "Error: --query takes the index only, not files\n");
+            return 2;
+        }
+        if (trace) {
+            fprintf(stderr, "Error: --trace is for updating an index, not --query\n");
+            return 2;
+        }
+        return query_index(argv[first_arg], query, roles ? roles : ALL_ROLES);
+    }
+    if (roles) {
+        fprintf(stderr, "Error: --defs, --reads, --writes and --calls require --query\n");
+        return 2;
+    }
+    if (first_arg + 1 == argc) {
+        fprintf(stderr, "Error: No files to index\n");
+        return 2;
+    }
+    if (trace) start_trace();
+    int status = update_index(argv[first_arg], argv + first_arg + 1, argc - first_arg - 1, verbose);
+    yylex_destroy();
+    if (trace && !finish_trace(trace)) {
+        perror(trace);
+        if (status == 0) status = 2;
+    }
+    return status;
+}
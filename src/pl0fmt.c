@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+#include "cst.h"
+#include "format.h"
+
+/* pl0fmt: reformat PL/0 source files (see format.h for the layout) */
+
+extern Node* ast_root;
+extern int parse_error_count;
+extern int yylex_destroy(void);
+
+typedef enum {
+    MODE_PRINT,          // formatted source to stdout
+    MODE_IN_PLACE,       // -i: rewrite files that change
+    MODE_CHECK           // --check: list files that would change
+} FormatMode;
+
+static void print_usage(const char* program_name) {
+    fprintf(stderr, "Usage: %s [options] [file...]\n", program_name);
+    fprintf(stderr, "Formats PL/0 source, stdin if no file is given.\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -i                 Rewrite the files in place\n");
+    fprintf(stderr, "  --check            List files that are not formatted, exit 1 if any\n");
+    fprintf(stderr, "  -h, --help         Print this help message\n");
+}
+
+static bool write_file(const char* path, const char* text, size_t size) {
+    size_t length = strlen(path);
+    char* temp = malloc(length + 8);
+    if (!temp) return false;
+    memcpy(temp, path, length);
+    memcpy(temp + length, ".fmttmp", 8);
+
+    FILE* out = fopen(temp, "wb");
+    bool success = out && fwrite(text, 1, size, out) == size;
+    if (out && fclose(out) != 0) success = false;
+    if (success && rename(temp, path) != 0) success = false;
+    if (!success) {
+        perror(path);
+        remove(temp);
+    }
+    free(temp);
+    return success;
+}
+
+// Format one file (stdin if path is NULL); returns the exit status
+static int format_file(const char* path, FormatMode mode) {
+    const char* name = path ? path : "<stdin>";
+    FILE* in = path ? fopen(path, "rb") : stdin;
+    if (!in) {
+        perror(path);
+        return 1;
+    }
+    TokenBuffer* tokens = read_token_buffer(in);
+    if (path) fclose(in);
+    if (!tokens) {
+        fprintf(stderr, "%s: cannot read source\n", name);
+        return 1;
+    }
+
+    int status = 0;
+    if (parse_tokens(tokens) != 0 || parse_error_count > 0 || !ast_root) {
+        fprintf(stderr, "%s: not formatted, it has syntax errors\n", name);
+        status = 1;
+    } else if (mode == MODE_PRINT) {
+        if (!format_program(tokens, ast_root, stdout)) status = 1;
+    } else {
+        char* text = NULL;
+        size_t length = 0;
+        FILE* out = open_memstream(&text, &length);
+        bool formatted = out && format_program(tokens, ast_root, out);
+        if (out && fclose(out) != 0) formatted = false;
+        bool changed = length != tokens->source_size ||
+                       memcmp(text, tokens->source, length) != 0;
+        if (!formatted) {
+            fprintf(stderr, "%s: out of memory\n", name);
+            status = 1;
+        } else if (changed && mode == MODE_CHECK) {
+            printf("%s\n", name);
+            status = 1;
+        } else if (changed && !write_file(path, text, length)) {
+            status = 1;
+        }
+        free(text);
+    }
+
+    free_ast(ast_root);
+    ast_root = NULL;
+    free_token_buffer(tokens);
+    return status;
+}
+
+int main(int argc, char** argv) {
+    FormatMode mode = MODE_PRINT;
+    int first_file = argc;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0) {
+            mode = MODE_IN_PLACE;
+        } else if (strcmp(argv[i], "--check") == 0) {
+            mode = MODE_CHECK;
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            fprintf(stderr, "Error: Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            first_file = i;
+            break;
+        }
+    }
+    if (mode == MODE_IN_PLACE && first_file == argc) {
+        fprintf(stderr, "Error: -i requires files\n");
+        return 1;
+    }
+
+    int status = 0;
+    if (first_file == argc) {
+        status = format_file(NULL, mode);
+    }
+    for (int i = first_file; i < argc; i++) {
+        if (mode == MODE_IN_PLACE && strcmp(argv[i], "-") == 0) {
+            fprintf(stderr, "Error: -i cannot rewrite stdin\n");
+            status = 1;
+            continue;
+        }
+        if (format_file(strcmp(argv[i], "-") == 0 ? NULL : argv[i], mode) != 0) status = 1;
+    }
+
+    yylex_destroy();
+    return status;
+}
@@ -0,0 +1,216 @@
+#include <time.h>
+#include "profile.h"
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+// First pass: find the largest procedure number, call site number and line
+static void measure(Profile* profile, Node* node) {
+    for (; node; node = node_next(node)) {
+        if (node_line(node) >= profile->line_count) {
+            profile->line_count = node_line(node) + 1;
+        }
+        if (node->type == NODE_PROC && node_slot(node) + 2 > profile->proc_count) {
+            profile->proc_count = node_slot(node) + 2;
+        }
+        if (node->type == NODE_CALL && node_slot(node) + 1 > profile->call_count) {
+            profile->call_count = node_slot(node) + 1;
+        }
+        if (node_has_children(node)) {
+            measure(profile, node_left(node));
+            measure(profile, node_right(node));
+        }
+    }
+}
+
+static void scan_statement(Profile* profile, Node* stmt, int proc) {
+    if (!stmt) return;
+    if (profile->line_owner[node_line(stmt)] < 0) profile->line_owner[node_line(stmt)] = proc;
+
+    switch (stmt->type) {
+        case NODE_CALL: {
+            CallProfile* call = &profile->calls[node_slot(stmt)];
+            call->caller = proc;
+            call->callee = node_slot(node_decl(node_left(stmt))) + 1;
+            call->line = node_line(stmt);
+            break;
+        }
+        case NODE_COMPOUND:
+            for (Node* s = node_left(stmt); s; s = node_next(s)) scan_statement(profile, s, proc);
+            break;
+        case NODE_IF:
+        case NODE_WHILE:
+            scan_statement(profile, node_right(stmt), proc);
+            break;
+        default:
+            break;
+    }
+}
+
+// Second pass: name procedures and attribute lines and call sites to them
+static void scan_block(Profile* profile, Node* block, int proc, const char* prefix) {
+    for (Node* n = node_right(block); n; n = node_next(n)) {
+        if (n->type != NODE_PROC) continue;
+
+        ProcProfile* p = &profile->procs[node_slot(n) + 1];
+        const char* name = node_name(node_left(n));
+        p->name = malloc(strlen(prefix) + strlen(name) + 2);
+        if (p->name) sprintf(p->name, "%s%s%s", prefix, *prefix ? "." : "", name);
+        p->line = node_line(n);
+        scan_block(profile, node_right(n), node_slot(n) + 1, p->name ? p->name : name);
+    }
+    scan_statement(profile, find_block_statement(block), proc);
+}
+
+// Set up counters for an analyzed program
+Profile* create_profile(Node* program) {
+    Profile* profile = calloc(1, sizeof(Profile));
+    if (!profile) return NULL;
+
+    profile->proc_count = 1;
+    profile->line_count = 1;
+    measure(profile, program);
+
+    profile->procs = calloc((size_t)profile->proc_count, sizeof(ProcProfile));
+    profile->calls = calloc((size_t)profile->call_count + 1, sizeof(CallProfile));
+    profile->line_counts = calloc((size_t)profile->line_count, sizeof(unsigned long long));
+    profile->line_iterations = calloc((size_t)profile->line_count, sizeof(unsigned long long));
+    profile->line_owner = malloc((size_t)profile->line_count * sizeof(int));
+    if (!profile->procs || !profile->calls || !profile->line_counts ||
+        !profile->line_iterations || !profile->line_owner) {
+        free_profile(profile);
+        return NULL;
+    }
+    for (int i = 0; i < profile->line_count; i++) profile->line_owner[i] = -1;
+
+    Node* block = node_left(program);
+    Node* main_stmt = find_block_statement(block);
+    profile->procs[0].name = strdup("main");
+    profile->procs[0].line = main_stmt && node_line(main_stmt) ? node_line(main_stmt) : 1;
+    scan_block(profile, block, 0, "");
+    return profile;
+}
+
+void free_profile(Profile* profile) {
+    if (!profile) return;
+    if (profile->procs) {
+        for (int i = 0; i < profile->proc_count; i++) free(profile->procs[i].name);
+    }
+    free(profile->procs);
+    free(profile->calls);
+    free(profile->line_counts);
+    free(profile->line_iterations);
+    free(profile->line_owner);
+    free(profile);
+}
+
+void profile_enter(Profile* profile, ProfileActivation* act,
+                   ProfileActivation* parent, int proc, int call) {
+    act->parent = parent;
+    act->proc = proc;
+    act->call = call;
+    act->child_ns = 0;
+    act->statements = profile->statements;
+    profile->procs[proc].calls++;
+    profile->procs[proc].active++;
+    act->start_ns = now_ns();
+}
+
+void profile_leave(Profile* profile, ProfileActivation* act) {
+    unsigned long long elapsed = now_ns() - act->start_ns;
+    ProcProfile* proc = &profile->procs[act->proc];
+
+    proc->self_ns += elapsed - act->child_ns;
+    // Recursive activations are already inside the outermost one's time
+    if (--proc->active == 0) proc->total_ns += elapsed;
+
+    if (act->parent) {
+        act->parent->child_ns += elapsed;
+    } else {
+        profile->total_ns = elapsed;
+    }
+
+    if (act->call >= 0) {
+        CallProfile* call = &profile->calls[act->call];
+        call->count++;
+        call->total_ns += elapsed;
+        call->statements += profile->statements - act->statements;
+    }
+}
+
+static int compare_self_time(const void* a, const void* b) {
+    const ProcProfile* pa = *(const ProcProfile* const*)a;
+    const ProcProfile* pb = *(const ProcProfile* const*)b;
+    if (pa->self_ns != pb->self_ns) return pa->self_ns < pb->self_ns ? 1 : -1;
+    return pa < pb ? -1 : pa > pb;
+}
+
+// gprof style flat profile, procedures by self time, then line counts
+void print_flat_profile(FILE* out, const Profile* profile) {
+    const ProcProfile** order = malloc((size_t)profile->proc_count * sizeof(ProcProfile*));
+    if (!order) return;
+    for (int i = 0; i < profile->proc_count; i++) order[i] = &profile->procs[i];
+    qsort(order, (size_t)profile->proc_count, sizeof(ProcProfile*), compare_self_time);
+
+    double total_ms = profile->total_ns / 1e6;
+    fprintf(out, "Flat profile: %llu statements in %.3f ms\n\n",
+            profile->statements, total_ms);
+    fprintf(out, "  %%time     self ms    total ms       calls  procedure\n");
+    for (int i = 0; i < profile->proc_count; i++) {
+        const ProcProfile* p = order[i];
+        if (p->calls == 0) continue;
+        fprintf(out, "%7.2f %11.3f %11.3f %11llu  %s (line %d)\n",
+                profile->total_ns ? 100.0 * p->self_ns / profile->total_ns : 0.0,
+                p->self_ns / 1e6, p->total_ns / 1e6, p->calls, p->name, p->line);
+    }
+    free((void*)order);
+
+    fprintf(out, "\n   line  statements  iterations\n");
+    for (int line = 0; line < profile->line_count; line++) {
+        if (profile->line_counts[line] == 0) continue;
+        fprintf(out, "%7d %11llu", line, profile->line_counts[line]);
+        if (profile->line_iterations[line] > 0) {
+            fprintf(out, " %11llu", profile->line_iterations[line]);
+        }
+        fputc('\n', out);
+    }
+}
+
+// Write the profile in callgrind format for callgrind_annotate/KCachegrind.
+// Costs are statements executed and nanoseconds; time is only measured
+// per activation, so it is attributed to the procedure's header line.
+bool write_callgrind(FILE* out, const Profile* profile, const char* source) {
+    fprintf(out, "# callgrind format\n");
+    fprintf(out, "version: 1\n");
+    fprintf(out, "creator: pl0_parser --profile\n");
+    fprintf(out, "cmd: %s\n", source);
+    fprintf(out, "positions: line\n");
+    fprintf(out, "events: Statements Nanoseconds\n");
+    fprintf(out, "summary: %llu %llu\n\n", profile->statements, profile->total_ns);
+    fprintf(out, "fl=%s\n", source);
+
+    for (int proc = 0; proc < profile->proc_count; proc++) {
+        const ProcProfile* p = &profile->procs[proc];
+        if (p->calls == 0) continue;
+
+        fprintf(out, "\nfn=%s\n", p->name);
+        fprintf(out, "%d 0 %llu\n", p->line, p->self_ns);
+        for (int line = 0; line < profile->line_count; line++) {
+            if (profile->line_owner[line] == proc && profile->line_counts[line] > 0) {
+                fprintf(out, "%d %llu\n", line, profile->line_counts[line]);
+            }
+        }
+
+        for (int i = 0; i < profile->call_count; i++) {
+            const CallProfile* call = &profile->calls[i];
+            if (call->caller != proc || call->count == 0) continue;
+            fprintf(out, "cfn=%s\n", profile->procs[call->callee].name);
+            fprintf(out, "calls=%llu %d\n", call->count, profile->procs[call->callee].line);
+            fprintf(out, "%d %llu %llu\n", call->line, call->statements, call->total_ns);
+        }
+    }
+    return !ferror(out);
+}
@@ -0,0 +1,75 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "ast.h"
+
+/* Execution profile of an interpreted program. Statement and loop counts
+ * are kept per source line; calls and time per procedure and per call
+ * site. Procedures are indexed by NODE_PROC->slot + 1, index 0 being the
+ * main program, and call sites by NODE_CALL->slot, both numbers assigned
+ * by semantic analysis.
+ */
+
+typedef struct {
+    char* name;                     // dotted path, e.g. "outer.inner"
+    int line;                       // line of the PROCEDURE keyword
+    unsigned long long calls;
+    unsigned long long self_ns;     // time not spent in callees
+    unsigned long long total_ns;    // time of outermost activations
+    int active;                     // activations currently running
+} ProcProfile;
+
+typedef struct {
+    int caller;                     // procedure index of the call site
+    int callee;
+    int line;
+    unsigned long long count;
+    unsigned long long total_ns;
+    unsigned long long statements;  // executed inside the callee, inclusive
+} CallProfile;
+
+typedef struct {
+    ProcProfile* procs;
+    int proc_count;
+    CallProfile* calls;
+    int call_count;
+    unsigned long long* line_counts;      // statements executed per line
+    unsigned long long* line_iterations;  // loop bodies entered per WHILE line
+    int* line_owner;                      // procedure index of a line
+    int line_count;
+    unsigned long long statements;
+    unsigned long long total_ns;
+} Profile;
+
+// Timing state of one running activation, kept on the interpreter's stack
+typedef struct ProfileActivation {
+    struct ProfileActivation* parent;
+    int proc;
+    int call;                       // call site, -1 for the main program
+    unsigned long long start_ns;
+    unsigned long long child_ns;
+    unsigned long long statements;  // Profile::statements on entry
+} ProfileActivation;
+
+// Profile function declarations
+Profile* create_profile(Node* program);
+void free_profile(Profile* profile);
+void profile_enter(Profile* profile, ProfileActivation* act,
+                   ProfileActivation* parent, int proc, int call);
+void profile_leave(Profile* profile, ProfileActivation* act);
+void print_flat_profile(FILE* out, const Profile* profile);
+bool write_callgrind(FILE* out, const Profile* profile, const char* source);
+
+// Count an executed statement; called once per statement, so kept inline
+static inline void profile_statement(Profile* profile, const Node* stmt) {
+    profile->line_counts[node_line(stmt)]++;
+    profile->statements++;
+}
+
+static inline void profile_iteration(Profile* profile, const Node* loop) {
+    profile->line_iterations[node_line(loop)]++;
+}
+
+#endif // PROFILE_H
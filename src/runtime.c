@@ -0,0 +1,40 @@
+#include <limits.h>
+#include <stdlib.h>
+#include "runtime.h"
+
+Runtime* create_runtime(FILE* input, FILE* output) {
+    Runtime* rt = malloc(sizeof(Runtime));
+    if (!rt) return NULL;
+
+    bufreader_init(&rt->in, input);
+    bufwriter_init(&rt->out, output);
+    return rt;
+}
+
+// Free the runtime; output not flushed before is lost
+void free_runtime(Runtime* rt) {
+    free(rt);
+}
+
+ReadStatus runtime_read_int(Runtime* rt, int* value) {
+    // Show pending output before possibly waiting for input, so that
+    // interactive programs see their prompts
+    if (!bufreader_available(&rt->in)) bufwriter_flush(&rt->out);
+
+    long long v;
+    ReadStatus status = bufreader_read_int(&rt->in, &v);
+    if (status != READ_OK) return status;
+    if (v < INT_MIN || v > INT_MAX) return READ_RANGE;
+
+    *value = (int)v;
+    return READ_OK;
+}
+
+void runtime_write_int(Runtime* rt, int value) {
+    bufwriter_put_int(&rt->out, value);
+    bufwriter_putc(&rt->out, '\n');
+}
+
+bool runtime_flush(Runtime* rt) {
+    return bufwriter_flush(&rt->out) && fflush(rt->out.out) == 0;
+}
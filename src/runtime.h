@@ -0,0 +1,25 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "bufio.h"
+
+/* I/O runtime behind READ and WRITE. Input is read and parsed in bulk,
+ * output is formatted into a buffer that reaches the stream only when it
+ * is full, before blocking for more input, and at runtime_flush().
+ */
+
+typedef struct {
+    BufReader in;
+    BufWriter out;
+} Runtime;
+
+// Runtime function declarations
+Runtime* create_runtime(FILE* input, FILE* output);
+void free_runtime(Runtime* rt);
+ReadStatus runtime_read_int(Runtime* rt, int* value);
+void runtime_write_int(Runtime* rt, int value);
+bool runtime_flush(Runtime* rt);
+
+#endif // RUNTIME_H
@@ -1,4 +1,5 @@
 #include "semantic.h"
+#include "trace.h"
 
 // Create semantic context
 SemanticContext* create_semantic_context() {
@@ -13,9 +14,16 @@ SemanticContext* create_semantic_context() {
     }
     ctx->global_scope->symbols = NULL;
     ctx->global_scope->parent = NULL;
+    ctx->global_scope->level = 0;
+    ctx->global_scope->frame_size = 0;
 
     // Set current scope to global scope
     ctx->current_scope = ctx->global_scope;
+    ctx->proc_count = 0;
+    ctx->call_count = 0;
+    ctx->pool = NULL;
+    ctx->release_scopes = false;
+    ctx->cancel = NULL;
     ctx->error_msg[0] = '\0';
     return ctx;
 }
@@ -65,6 +73,8 @@ static bool enter_scope(SemanticContext* ctx) {
     
     new_scope->symbols = NULL;
     new_scope->parent = ctx->current_scope;
+    new_scope->level = ctx->current_scope->level + 1;
+    new_scope->frame_size = 0;
     ctx->current_scope = new_scope;
     return true;
 }
@@ -75,8 +85,14 @@ static bool leave_scope(SemanticContext* ctx) {
     
     Scope* old_scope = ctx->current_scope;
     ctx->current_scope = old_scope->parent;
+    if (ctx->release_scopes) {
+        free_scope(old_scope);
+        return true;
+    }
     
-    // Copy symbols from old scope to current scope if they're not already there
+    // Copy symbols from old scope to current scope if they're not already there.
+    // They keep their own level, so lookups in the parent scope ignore them;
+    // they are only kept for dump_symbol_table().
     Symbol* sym = old_scope->symbols;
     while (sym) {
         Symbol* next = sym->next;
@@ -95,7 +111,9 @@ static Symbol* lookup_symbol_current_scope(SemanticContext* ctx, const char* nam
     if (!ctx->current_scope) return NULL;
     
     for (Symbol* s = ctx->current_scope->symbols; s; s = s->next) {
-        if (strcmp(s->name, name) == 0) return s;
+        if (s->level == ctx->current_scope->level && strcmp(s->name, name) == 0) {
+            return s;
+        }
     }
     return NULL;
 }
@@ -104,15 +122,27 @@ static Symbol* lookup_symbol_current_scope(SemanticContext* ctx, const char* nam
 static Symbol* lookup_symbol(SemanticContext* ctx, const char* name) {
     for (Scope* scope = ctx->current_scope; scope; scope = scope->parent) {
         for (Symbol* s = scope->symbols; s; s = s->next) {
-            if (strcmp(s->name, name) == 0) return s;
+            if (s->level == scope->level && strcmp(s->name, name) == 0) return s;
         }
     }
     return NULL;
 }
 
+// Look up an identifier and record where it lives in the AST node, so that
+// later phases need no name lookups
+static Symbol* resolve_ident(SemanticContext* ctx, Node* ident) {
+    Symbol* sym = lookup_symbol(ctx, node_name(ident));
+    if (sym) {
+        set_node_level(ident, ctx->current_scope->level - sym->level);
+        set_node_slot(ident, sym->slot);
+        set_node_decl(ident, sym->decl);
+    }
+    return sym;
+}
+
 // Add new symbol to current scope
 static bool declare_symbol(SemanticContext* ctx, const char* name, 
-                         SymbolKind kind, Type type, int value) {
+                         SymbolKind kind, Type type, int value, Node* decl) {
     if (!ctx->current_scope || lookup_symbol_current_scope(ctx, name)) {
         snprintf(ctx->error_msg, sizeof(ctx->error_msg),
                 "Symbol '%s' already declared in current scope", name);
@@ -131,60 +161,233 @@ static bool declare_symbol(SemanticContext* ctx, const char* name,
     symbol->kind = kind;
     symbol->type = type;     // Set the type
     symbol->value = value;
+    symbol->level = ctx->current_scope->level;
+    symbol->slot = kind == SYM_VARIABLE ? ctx->current_scope->frame_size++ : 0;
+    symbol->decl = decl;
     symbol->next = ctx->current_scope->symbols;
     ctx->current_scope->symbols = symbol;
     return true;
 }
 
-static bool analyze_block(SemanticContext* ctx, Node* node) {
-    if (!node) return true;
+static bool analyze_block(SemanticContext* ctx, Node* node);
+
+/* Parallel analysis of sibling procedures. Once all procedures of a block
+ * are declared the block's scope no longer changes, so each procedure body
+ * is analyzed by a task of its own: the task sees the enclosing scope
+ * through a view that ends at the procedure's own symbol, which hides the
+ * siblings declared after it just like the sequential pass does. The
+ * procedure and call site numbers of each task are known in advance from
+ * the size of the procedures before it, and afterwards the symbols of the
+ * tasks are linked into the block's scope in declaration order. So the
+ * AST, the symbol table and the reported error (the first one in program
+ * order) are the same as without parallelism.
+ */
+
+// Procedures smaller than this are analyzed right away instead of in a task
+#define PARALLEL_MIN_NODES 256
+
+typedef struct {
+    int procs;
+    int calls;
+    int nodes;
+} SubtreeCount;
+
+static void count_subtree(const Node* node, SubtreeCount* count) {
+    for (; node; node = node_next(node)) {
+        count->nodes++;
+        if (node->type == NODE_PROC) count->procs++;
+        if (node->type == NODE_CALL) count->calls++;
+        if (node_has_children(node)) {
+            count_subtree(node_left(node), count);
+            count_subtree(node_right(node), count);
+        }
+    }
+}
+
+typedef struct {
+    SemanticContext ctx;  // the task's own counters and error message
+    Scope view;           // the enclosing scope as the procedure sees it
+    Symbol* symbol;       // the procedure's symbol, end of the view's own symbols
+    Node* proc;
+    bool small;
+    bool success;
+} ProcTask;
+
+static void analyze_proc_task(void* arg) {
+    ProcTask* task = arg;
+    // Small procedures are analyzed inline, within the span of their block
+    if (!task->small) trace_begin("analyze procedure", NULL);
+    task->success = analyze_block(&task->ctx, node_right(task->proc));
+    if (!task->small) trace_end();
+}
 
+// Free what a failed task left behind: its open scopes and the symbols it
+// added to the view
+static void discard_task_symbols(ProcTask* task) {
+    Scope* scope = task->ctx.current_scope;
+    while (scope != &task->view) {
+        Scope* parent = scope->parent;
+        free_scope(scope);
+        scope = parent;
+    }
+    while (task->view.symbols != task->symbol) {
+        Symbol* next = task->view.symbols->next;
+        free(task->view.symbols->name);
+        free(task->view.symbols);
+        task->view.symbols = next;
+    }
+}
+
+// Analyze the procedures starting at procs and then the block's statement
+static bool analyze_procs_parallel(SemanticContext* ctx, Node* procs, Node* stmt) {
+    int count = 0;
+    for (Node* proc = procs; proc; proc = node_next(proc)) {
+        if (proc->type == NODE_PROC) count++;
+    }
+    ProcTask* tasks = calloc((size_t)count, sizeof(ProcTask));
+    if (!tasks) {
+        snprintf(ctx->error_msg, sizeof(ctx->error_msg), "Out of memory");
+        return false;
+    }
+
+    // Declare all procedures, stopping at a duplicate like the sequential
+    // pass, whose error is only reported if no earlier procedure fails
+    Scope* scope = ctx->current_scope;
+    Symbol* outer = scope->symbols;
+    int declared = 0;
+    bool declared_all = true;
+    for (Node* proc = procs; proc; proc = node_next(proc)) {
+        if (proc->type != NODE_PROC) continue;
+        if (!declare_symbol(ctx, node_name(node_left(proc)), SYM_PROCEDURE, TYPE_VOID, 0, proc)) {
+            declared_all = false;
+            break;
+        }
+        SubtreeCount size = { 1, 0, 1 };
+        count_subtree(node_left(proc), &size);
+        count_subtree(node_right(proc), &size);
+
+        ProcTask* task = &tasks[declared++];
+        task->symbol = scope->symbols;
+        task->proc = proc;
+        task->small = size.nodes < PARALLEL_MIN_NODES;
+        task->view = *scope;
+        task->ctx.current_scope = &task->view;
+        task->ctx.global_scope = &task->view;
+        task->ctx.pool = ctx->pool;
+        task->ctx.cancel = ctx->cancel;
+        set_node_slot(proc, ctx->proc_count);
+        task->ctx.proc_count = ctx->proc_count + 1;
+        task->ctx.call_count = ctx->call_count;
+        ctx->proc_count += size.procs;
+        ctx->call_count += size.calls;
+    }
+
+    TaskGroup group = TASK_GROUP_INIT;
+    for (int i = 0; i < declared; i++) {
+        if (!tasks[i].small && !submit_task(ctx->pool, &group, analyze_proc_task, &tasks[i])) {
+            tasks[i].small = true;
+        }
+    }
+    for (int i = 0; i < declared; i++) {
+        if (tasks[i].small) analyze_proc_task(&tasks[i]);
+    }
+    bool success = declared_all && (!stmt || analyze_semantics(ctx, stmt));
+    wait_task_group(ctx->pool, &group);
+
+    // Report the first failure in program order, then link the symbols
+    // of all tasks into the scope in declaration order
+    bool reported = false;
+    for (int i = 0; i < declared; i++) {
+        if (tasks[i].success) continue;
+        if (!reported) {
+            memcpy(ctx->error_msg, tasks[i].ctx.error_msg, sizeof(ctx->error_msg));
+            reported = true;
+        }
+        discard_task_symbols(&tasks[i]);
+        success = false;
+    }
+    Symbol* symbols = outer;
+    for (int i = 0; i < declared; i++) {
+        tasks[i].symbol->next = symbols;
+        symbols = tasks[i].view.symbols;
+    }
+    if (declared > 0) scope->symbols = symbols;
+
+    free(tasks);
+    return success;
+}
+
+// Enter the scope of a block and declare its constants and variables;
+// *rest is set to what follows the variables
+static bool open_block(SemanticContext* ctx, Node* constants, Node* variables, Node** rest) {
     if (!enter_scope(ctx)) return false;
     
     // Analyze constant declarations
-    for (Node* const_decl = node->left; const_decl; const_decl = const_decl->next) {
+    for (Node* const_decl = constants; const_decl; const_decl = node_next(const_decl)) {
         if (const_decl->type == NODE_CONST_DECL) {
-            if (!declare_symbol(ctx, const_decl->left->name, 
+            if (!declare_symbol(ctx, node_name(node_left(const_decl)), 
                               SYM_CONSTANT, TYPE_INTEGER, 
-                              const_decl->right->value)) {
+                              node_value(node_right(const_decl)), const_decl)) {
                 return false;
             }
         }
     }
     
-    // Analyze variable declarations
-    Node* var_decl = node->right;
-    while (var_decl && var_decl->type == NODE_VAR_DECL) {
-        if (!declare_symbol(ctx, var_decl->left->name, 
-                          SYM_VARIABLE, TYPE_INTEGER, 0)) {
+    // Analyze variable declarations (skipping ones that failed to parse)
+    Node* var_decl = variables;
+    while (var_decl && (var_decl->type == NODE_VAR_DECL ||
+                        var_decl->type == NODE_ERROR)) {
+        if (var_decl->type == NODE_VAR_DECL &&
+            !declare_symbol(ctx, node_name(node_left(var_decl)), 
+                          SYM_VARIABLE, TYPE_INTEGER, 0, var_decl)) {
             return false;
         }
-        var_decl = var_decl->next;
+        var_decl = node_next(var_decl);
     }
+    *rest = var_decl;
+    return true;
+}
+
+// Fail once the analysis is cancelled (cancel.h)
+static bool cancelled(SemanticContext* ctx) {
+    if (!poll_cancel(ctx->cancel)) return false;
+    snprintf(ctx->error_msg, sizeof(ctx->error_msg), "Cancelled");
+    return true;
+}
+
+static bool analyze_block(SemanticContext* ctx, Node* node) {
+    if (!node) return true;
+    if (cancelled(ctx)) return false;
+
+    Node* proc;  // Continue from where the variables left off
+    if (!open_block(ctx, node_left(node), node_right(node), &proc)) return false;
+    set_node_slot(node, ctx->current_scope->frame_size);
     
     // Analyze procedure declarations
-    Node* proc = var_decl;  // Continue from where var_decl left off
+    if (ctx->pool && proc && proc->type == NODE_PROC &&
+        node_next(proc) && node_next(proc)->type == NODE_PROC) {
+        if (!analyze_procs_parallel(ctx, proc, find_block_statement(node))) {
+            return false;
+        }
+        leave_scope(ctx);
+        return true;
+    }
     while (proc) {
         if (proc->type == NODE_PROC) {
-            if (!declare_symbol(ctx, proc->left->name, 
-                              SYM_PROCEDURE, TYPE_VOID, 0)) {
+            if (!declare_symbol(ctx, node_name(node_left(proc)), 
+                              SYM_PROCEDURE, TYPE_VOID, 0, proc)) {
                 return false;
             }
-            if (!analyze_block(ctx, proc->right)) {
+            set_node_slot(proc, ctx->proc_count++);
+            if (!analyze_block(ctx, node_right(proc))) {
                 return false;
             }
         }
-        proc = proc->next;
-    }
-    
-    // Find and analyze the main statement
-    Node* stmt = node->right;
-    while (stmt && stmt->type != NODE_COMPOUND && stmt->type != NODE_IF && 
-           stmt->type != NODE_WHILE && stmt->type != NODE_ASSIGN &&
-           stmt->type != NODE_CALL && stmt->type != NODE_INPUT) {
-        stmt = stmt->next;
+        proc = node_next(proc);
     }
     
+    // Analyze the main statement
+    Node* stmt = find_block_statement(node);
     if (stmt) {
         if (!analyze_semantics(ctx, stmt)) {
             return false;
@@ -195,6 +398,56 @@ static bool analyze_block(SemanticContext* ctx, Node* node) {
     return true;
 }
 
+bool open_block_scope(SemanticContext* ctx, Node* constants, Node* variables) {
+    Node* rest;
+    return open_block(ctx, constants, variables, &rest);
+}
+
+Symbol* declare_procedure(SemanticContext* ctx, const char* name, int* number) {
+    if (!declare_symbol(ctx, name, SYM_PROCEDURE, TYPE_VOID, 0, NULL)) return NULL;
+    *number = ctx->proc_count++;
+    return ctx->current_scope->symbols;
+}
+
+bool close_block_scope(SemanticContext* ctx, Node* block) {
+    set_node_slot(block, ctx->current_scope->frame_size);
+    Node* stmt = find_block_statement(block);
+    if (stmt && !analyze_semantics(ctx, stmt)) return false;
+    leave_scope(ctx);
+    return true;
+}
+
+// Check that every identifier in an expression or condition names a
+// constant or variable, and resolve it
+static bool analyze_expression(SemanticContext* ctx, Node* node) {
+    if (!node) return true;
+
+    switch (node->type) {
+        case NODE_IDENT: {
+            Symbol* sym = resolve_ident(ctx, node);
+            if (!sym) {
+                snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                        "Undefined identifier '%s'", node_name(node));
+                return false;
+            }
+            if (sym->kind == SYM_PROCEDURE) {
+                snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                        "Cannot use procedure '%s' in an expression", node_name(node));
+                return false;
+            }
+            return true;
+        }
+
+        case NODE_BINARY_OP:
+        case NODE_CONDITION:
+            return analyze_expression(ctx, node_left(node)) &&
+                   analyze_expression(ctx, node_right(node));
+
+        default:
+            return true;
+    }
+}
+
 // Modified dump_symbol_table to include type information
 void dump_symbol_table(SemanticContext* ctx, FILE* out) {
     fprintf(out, "\nSymbol Table:\n");
@@ -228,69 +481,73 @@ void dump_symbol_table(SemanticContext* ctx, FILE* out) {
 
 bool analyze_semantics(SemanticContext* ctx, Node* node) {
     if (!node) return true;
+    if (cancelled(ctx)) return false;
     
     switch (node->type) {
         case NODE_PROGRAM:
-            return analyze_block(ctx, node->left);
+            return analyze_block(ctx, node_left(node));
             
         case NODE_ASSIGN: {
-            Symbol* sym = lookup_symbol(ctx, node->left->name);
+            Symbol* sym = resolve_ident(ctx, node_left(node));
             if (!sym) {
                 snprintf(ctx->error_msg, sizeof(ctx->error_msg),
-                        "Undefined identifier '%s'", node->left->name);
+                        "Undefined identifier '%s'", node_name(node_left(node)));
                 return false;
             }
             if (sym->kind == SYM_CONSTANT) {
                 snprintf(ctx->error_msg, sizeof(ctx->error_msg),
-                        "Cannot assign to constant '%s'", node->left->name);
+                        "Cannot assign to constant '%s'", node_name(node_left(node)));
                 return false;
             }
             if (sym->kind == SYM_PROCEDURE) {
                 snprintf(ctx->error_msg, sizeof(ctx->error_msg),
-                        "Cannot assign to procedure '%s'", node->left->name);
+                        "Cannot assign to procedure '%s'", node_name(node_left(node)));
                 return false;
             }
-            return true;
+            return analyze_expression(ctx, node_right(node));
         }
             
         case NODE_CALL: {
-            Symbol* sym = lookup_symbol(ctx, node->left->name);
+            Symbol* sym = resolve_ident(ctx, node_left(node));
             if (!sym) {
                 snprintf(ctx->error_msg, sizeof(ctx->error_msg),
-                        "Undefined procedure '%s'", node->left->name);
+                        "Undefined procedure '%s'", node_name(node_left(node)));
                 return false;
             }
             if (sym->kind != SYM_PROCEDURE) {
                 snprintf(ctx->error_msg, sizeof(ctx->error_msg),
-                        "'%s' is not a procedure", node->left->name);
+                        "'%s' is not a procedure", node_name(node_left(node)));
                 return false;
             }
+            set_node_slot(node, ctx->call_count++);
             return true;
         }
             
         case NODE_INPUT: {
-            Symbol* sym = lookup_symbol(ctx, node->left->name);
+            Symbol* sym = resolve_ident(ctx, node_left(node));
             if (!sym) {
                 snprintf(ctx->error_msg, sizeof(ctx->error_msg),
-                        "Undefined identifier '%s'", node->left->name);
+                        "Undefined identifier '%s'", node_name(node_left(node)));
                 return false;
             }
             if (sym->kind != SYM_VARIABLE) {
                 snprintf(ctx->error_msg, sizeof(ctx->error_msg),
-                        "Cannot read into '%s' - must be a variable", node->left->name);
+                        "Cannot read into '%s' - must be a variable", node_name(node_left(node)));
                 return false;
             }
             return true;
         }
             
-        case NODE_IF:
-            return analyze_semantics(ctx, node->right);
+        case NODE_OUTPUT:
+            return analyze_expression(ctx, node_left(node));
             
+        case NODE_IF:
         case NODE_WHILE:
-            return analyze_semantics(ctx, node->right);
+            return analyze_expression(ctx, node_left(node)) &&
+                   analyze_semantics(ctx, node_right(node));
             
         case NODE_COMPOUND:
-            for (Node* stmt = node->left; stmt; stmt = stmt->next) {
+            for (Node* stmt = node_left(node); stmt; stmt = node_next(stmt)) {
                 if (!analyze_semantics(ctx, stmt)) {
                     return false;
                 }
@@ -313,15 +570,20 @@ bool run_semantic_analysis(Node* ast, const Options* opts) {
         return false;
     }
     
+    if (opts->jobs > 1) sem_ctx->pool = create_task_pool(opts->jobs);
+    sem_ctx->cancel = analysis_cancel;
     bool success = analyze_semantics(sem_ctx, ast);
+    free_task_pool(sem_ctx->pool);
+    sem_ctx->pool = NULL;
     
-    if (!success) {
+    // A cancelled run is reported by the driver
+    if (!success && !cancel_requested(sem_ctx->cancel)) {
         fprintf(stderr, "Semantic Error: %s\n", sem_ctx->error_msg);
     } else if (opts->verbose) {
         fprintf(opts->output, "Semantic analysis completed successfully\n");
     }
     
-    if (opts->print_symbols) {
+    if (opts->print_symbols && !cancel_requested(sem_ctx->cancel)) {
         //fprintf(opts->output, "\n----------------------------------------\n");
         dump_symbol_table(sem_ctx, opts->output);
     }
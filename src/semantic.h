@@ -5,7 +5,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include "ast.h"
+#include "cancel.h"
 #include "options.h"
+#include "task_pool.h"
 #include "type_check.h"
 
 typedef enum {
@@ -19,17 +21,27 @@ typedef struct Symbol {
     SymbolKind kind;
     Type type;          // TYPE_INTEGER for vars/consts, TYPE_VOID for procedures
     int value;          // Used for constants
+    int level;          // Nesting level of the declaring block
+    int slot;           // Frame slot, used for variables
+    Node* decl;         // Declaring AST node
     struct Symbol* next;
 } Symbol;
 
 typedef struct Scope {
     Symbol* symbols;
     struct Scope* parent;
+    int level;          // 0 for the global scope, +1 per nested block
+    int frame_size;     // Number of variables declared in this scope
 } Scope;
 
 typedef struct {
     Scope* current_scope;
     Scope* global_scope; // keep track of global scope across analysis phases
+    int proc_count;      // Procedures numbered so far
+    int call_count;      // Call sites numbered so far
+    TaskPool* pool;      // analyze sibling procedures in parallel, or NULL
+    bool release_scopes; // free the symbols of a block when leaving it
+    CancelToken* cancel; // polled per statement and procedure, or NULL
     char error_msg[256];
 } SemanticContext;
 
@@ -40,4 +52,17 @@ bool analyze_semantics(SemanticContext* ctx, Node* node);
 bool run_semantic_analysis(Node* ast, const Options* opt);
 void dump_symbol_table(SemanticContext* ctx, FILE* out);
 
+/* The same analysis one block at a time, for analyzing procedures while
+ * they are parsed (stream.h). open_block_scope() enters the scope of a
+ * block once its constants and variables (lists in declaration order) are
+ * known, declare_procedure() declares a procedure of the current block
+ * before its body, and close_block_scope() analyzes the statement of the
+ * block whose scope is current and leaves the scope. The procedure's
+ * symbol has no declaring node until the caller sets decl, and its number
+ * is stored to *number for the caller to put into the NODE_PROC.
+ */
+bool open_block_scope(SemanticContext* ctx, Node* constants, Node* variables);
+Symbol* declare_procedure(SemanticContext* ctx, const char* name, int* number);
+bool close_block_scope(SemanticContext* ctx, Node* block);
+
 #endif // SEMANTIC_H
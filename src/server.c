@@ -0,0 +1,438 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ast.h"
+#include "driver.h"
+#include "server.h"
+
+#define REQUEST_MAGIC 0x53304c50u        // "PL0S"
+#define MAX_REQUEST_SIZE (1024 * 1024)
+#define MAX_REQUEST_ARGS 4096
+
+/* A request is this header, sent together with the client's stdin,
+ * stdout and stderr as SCM_RIGHTS, followed by `size` bytes holding the
+ * working directory and `argc` arguments, each NUL terminated. The reply
+ * is the exit status as a uint32_t.
+ *
+ * The server process only relays: it receives a request, passes it on
+ * in the same format to a worker process it forked, and passes back the
+ * worker's reply. The worker runs the requests one after the other, so
+ * its node slabs stay warm between them. A request that crashes the
+ * worker takes only the worker down: the server reports the signal on
+ * the client's stderr, replies 128 + the signal number as a shell would,
+ * and forks a new worker for the next request.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t argc;
+    uint32_t size;
+} RequestHeader;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static bool write_all(int fd, const void* data, size_t size) {
+    const char* p = data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void* data, size_t size) {
+    char* p = data;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static bool fill_address(struct sockaddr_un* addr, const char* path) {
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", path);
+        return false;
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+// Working directory in a malloc'ed buffer
+static char* current_directory(void) {
+    size_t size = 256;
+    for (;;) {
+        char* dir = malloc(size);
+        if (!dir) return NULL;
+        if (getcwd(dir, size)) return dir;
+        free(dir);
+        if (errno != ERANGE) return NULL;
+        size *= 2;
+    }
+}
+
+// Send a request: the header together with fds, then the payload
+static bool send_request(int fd, const RequestHeader* header, const int fds[3],
+                         const char* payload) {
+    union {
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { (void*)header, sizeof(*header) };
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, 3 * sizeof(int));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    return sent >= 0 &&
+           write_all(fd, (const char*)header + sent, sizeof(*header) - (size_t)sent) &&
+           write_all(fd, payload, header->size);
+}
+
+int run_client(const char* socket_path, int argc, char** argv) {
+    struct sockaddr_un addr;
+    if (!fill_address(&addr, socket_path)) return 1;
+
+    // Without a server the request runs here, as the server would run it.
+    // A socket nobody listens on is left by a server that died: say so
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        if (fd >= 0 && errno == ECONNREFUSED) {
+            fprintf(stderr, "Warning: No server is listening at %s, running the request here\n",
+                    socket_path);
+        }
+        if (fd >= 0) close(fd);
+        return run_command(argc, argv);
+    }
+
+    char* cwd = current_directory();
+    if (!cwd) {
+        perror("Error: Cannot determine working directory");
+        close(fd);
+        return 1;
+    }
+
+    size_t size = strlen(cwd) + 1;
+    for (int i = 0; i < argc; i++) size += strlen(argv[i]) + 1;
+    char* payload = malloc(size);
+    if (!payload) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(cwd);
+        close(fd);
+        return 1;
+    }
+    char* p = payload;
+    p = stpcpy(p, cwd) + 1;
+    for (int i = 0; i < argc; i++) p = stpcpy(p, argv[i]) + 1;
+    free(cwd);
+
+    RequestHeader header = { REQUEST_MAGIC, (uint32_t)argc, (uint32_t)size };
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    uint32_t status;
+    bool ok = send_request(fd, &header, fds, payload) && read_all(fd, &status, sizeof(status));
+    free(payload);
+    close(fd);
+
+    if (!ok) {
+        fprintf(stderr, "Error: Lost connection to server at %s\n", socket_path);
+        return 1;
+    }
+    return (int)status;
+}
+
+// Receive a request; on success the caller owns fds and the payload
+static bool receive_request(int conn, RequestHeader* header, int fds[3], char** payload) {
+    union {
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { header, sizeof(*header) };
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t n;
+    do {
+        n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return false;
+
+    int received = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            received = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            memcpy(fds, CMSG_DATA(cmsg), (size_t)received * sizeof(int));
+        }
+    }
+
+    *payload = NULL;
+    bool valid = received == 3 && !(msg.msg_flags & MSG_CTRUNC) &&
+                 read_all(conn, (char*)header + n, sizeof(*header) - (size_t)n) &&
+                 header->magic == REQUEST_MAGIC &&
+                 header->argc > 0 && header->argc <= MAX_REQUEST_ARGS &&
+                 header->size > 0 && header->size <= MAX_REQUEST_SIZE &&
+                 (*payload = malloc(header->size)) != NULL &&
+                 read_all(conn, *payload, header->size) &&
+                 (*payload)[header->size - 1] == '\0';
+    if (!valid) {
+        for (int i = 0; i < received; i++) close(fds[i]);
+        free(*payload);
+    }
+    return valid;
+}
+
+// Run one request with the client's streams in place of our own; false
+// once the server has closed the connection
+static bool serve_request(int conn, const int saved_fds[3], int home) {
+    RequestHeader header;
+    int fds[3];
+    char* payload;
+    if (!receive_request(conn, &header, fds, &payload)) return false;
+
+    // The payload is the directory followed by the arguments
+    char** argv = malloc((header.argc + 1) * sizeof(char*));
+    const char* end = payload + header.size;
+    const char* cwd = payload;
+    char* p = payload + strlen(payload) + 1;
+    uint32_t argc = 0;
+    while (argv && argc < header.argc && p < end) {
+        argv[argc++] = p;
+        p += strlen(p) + 1;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; i++) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+    clearerr(stdin);
+
+    uint32_t status = 1;
+    if (!argv || argc != header.argc) {
+        fprintf(stderr, "Error: Malformed request\n");
+    } else if (chdir(cwd) != 0) {
+        perror(cwd);
+    } else {
+        argv[argc] = NULL;
+        status = (uint32_t)run_command((int)argc, argv);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; i++) dup2(saved_fds[i], i);
+    if (fchdir(home) != 0) perror("Error: Cannot return to server directory");
+
+    free(argv);
+    free(payload);
+    return write_all(conn, &status, sizeof(status));
+}
+
+typedef struct {
+    pid_t pid;      // -1 while there is none
+    int fd;         // the server's end of the worker's connection
+} Worker;
+
+// Fork a worker that serves the requests relayed over its connection
+// until the server closes it
+static bool start_worker(Worker* worker, int listen_fd, const int saved_fds[3], int home) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) < 0) {
+        perror("Error: Cannot start worker");
+        return false;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Error: Cannot start worker");
+        close(pair[0]);
+        close(pair[1]);
+        return false;
+    }
+    if (pid == 0) {
+        // Shutting down waits for the running request instead
+        signal(SIGINT, SIG_IGN);
+        signal(SIGTERM, SIG_IGN);
+        close(listen_fd);
+        close(pair[0]);
+        // Keep node slabs between requests instead of returning them
+        retain_node_slabs(true);
+        while (serve_request(pair[1], saved_fds, home)) {
+        }
+        _exit(0);
+    }
+    close(pair[1]);
+    worker->pid = pid;
+    worker->fd = pair[0];
+    return true;
+}
+
+// Close the worker's connection and wait for it; returns its wait status
+static int stop_worker(Worker* worker) {
+    int status = 0;
+    close(worker->fd);
+    while (waitpid(worker->pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    worker->pid = -1;
+    worker->fd = -1;
+    return status;
+}
+
+// Pass a request from conn on to the worker, starting one if there is
+// none, and its reply back
+static void relay_request(Worker* worker, int conn, int listen_fd, const int saved_fds[3],
+                          int home) {
+    RequestHeader header;
+    int fds[3];
+    char* payload;
+    if (!receive_request(conn, &header, fds, &payload)) return;
+
+    // A worker that died between requests is replaced first
+    if (worker->pid > 0 && waitpid(worker->pid, NULL, WNOHANG) != 0) {
+        close(worker->fd);
+        worker->pid = -1;
+    }
+    uint32_t status = 1;
+    if (worker->pid < 0 && !start_worker(worker, listen_fd, saved_fds, home)) {
+        dprintf(fds[2], "Error: The server cannot run requests\n");
+    } else if (!send_request(worker->fd, &header, fds, payload) ||
+               !read_all(worker->fd, &status, sizeof(status))) {
+        int wait_status = stop_worker(worker);
+        if (WIFSIGNALED(wait_status)) {
+            int sig = WTERMSIG(wait_status);
+            dprintf(fds[2], "Error: Request terminated by signal %d (%s)\n", sig, strsignal(sig));
+            status = 128 + (uint32_t)sig;
+        } else {
+            dprintf(fds[2], "Error: Request ended the server's worker with status %d\n",
+                    WIFEXITED(wait_status) ? WEXITSTATUS(wait_status) : -1);
+            status = 1;
+        }
+    }
+
+    for (int i = 0; i < 3; i++) close(fds[i]);
+    free(payload);
+    write_all(conn, &status, sizeof(status));
+}
+
+static bool server_alive(const struct sockaddr_un* addr) {
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) return false;
+    bool alive = connect(probe, (const struct sockaddr*)addr, sizeof(*addr)) == 0;
+    close(probe);
+    return alive;
+}
+
+// Bind the socket, taking over the path if it belongs to a dead server
+static int bind_socket(const char* socket_path) {
+    struct sockaddr_un addr;
+    if (!fill_address(&addr, socket_path)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Error: Cannot create socket");
+        return -1;
+    }
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        if (errno != EADDRINUSE) {
+            perror(socket_path);
+            close(fd);
+            return -1;
+        }
+        if (server_alive(&addr)) {
+            fprintf(stderr, "Error: A server is already running at %s\n", socket_path);
+            close(fd);
+            return -1;
+        }
+        unlink(socket_path);
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror(socket_path);
+            close(fd);
+            return -1;
+        }
+    }
+
+    if (listen(fd, SOMAXCONN) < 0) {
+        perror("Error: Cannot listen on socket");
+        close(fd);
+        unlink(socket_path);
+        return -1;
+    }
+    return fd;
+}
+
+// Serve requests until SIGINT or SIGTERM
+int run_server(const char* socket_path) {
+    int listen_fd = bind_socket(socket_path);
+    if (listen_fd < 0) return 1;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = request_stop;   // no SA_RESTART: accept() returns
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int saved_fds[3] = { dup(STDIN_FILENO), dup(STDOUT_FILENO), dup(STDERR_FILENO) };
+    int home = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (saved_fds[0] < 0 || saved_fds[1] < 0 || saved_fds[2] < 0 || home < 0) {
+        perror("Error: Cannot set up server");
+        close(listen_fd);
+        unlink(socket_path);
+        return 1;
+    }
+
+    Worker worker = { -1, -1 };
+    while (!stop_requested) {
+        int conn = accept(listen_fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("Error: accept failed");
+            break;
+        }
+        relay_request(&worker, conn, listen_fd, saved_fds, home);
+        close(conn);
+    }
+    if (worker.pid > 0) stop_worker(&worker);
+
+    close(listen_fd);
+    unlink(socket_path);
+    for (int i = 0; i < 3; i++) close(saved_fds[i]);
+    close(home);
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+/* Compile server. `pl0_parser --server=SOCKET` keeps one warm process
+ * listening on a Unix domain socket; `pl0_parser --connect=SOCKET ...`
+ * hands it the rest of its command line together with its working
+ * directory and standard streams, and exits with the status the server
+ * reports. Requests run one at a time through the same pipeline as a
+ * single-shot invocation, so output and exit status are the same. They
+ * run in a worker process, so a request that crashes ends only itself.
+ */
+
+// Server function declarations
+int run_server(const char* socket_path);
+int run_client(const char* socket_path, int argc, char** argv);
+
+#endif // SERVER_H
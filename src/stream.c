@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include "stream.h"
+
+extern int parse_error_count;
+
+AnalysisStream* analysis_stream = NULL;
+
+AnalysisStream* create_analysis_stream(const Options* opts) {
+    AnalysisStream* stream = calloc(1, sizeof(AnalysisStream));
+    if (!stream) return NULL;
+    if (!opts->skip_type_check) stream->types = create_type_context();
+    if (!opts->skip_semantics) {
+        stream->semantics = create_semantic_context();
+        // Keep the symbols of finished blocks only for printing them
+        if (stream->semantics) stream->semantics->release_scopes = !opts->print_symbols;
+    }
+    if ((!opts->skip_type_check && !stream->types) ||
+        (!opts->skip_semantics && !stream->semantics)) {
+        free_analysis_stream(stream);
+        return NULL;
+    }
+    if (stream->types) stream->types->cancel = analysis_cancel;
+    if (stream->semantics) stream->semantics->cancel = analysis_cancel;
+    return stream;
+}
+
+void free_analysis_stream(AnalysisStream* stream) {
+    if (!stream) return;
+    if (stream->types) free_type_context(stream->types);
+    free_semantic_context(stream->semantics);
+    free(stream->open);
+    free(stream);
+}
+
+// The stream to feed, NULL if there is none or the parse has hit a
+// syntax error, after which the parser's recovery no longer matches the
+// scopes opened so far
+static AnalysisStream* active_stream(void) {
+    return parse_error_count == 0 ? analysis_stream : NULL;
+}
+
+void stream_block_declarations(Node* constants, Node* variables) {
+    AnalysisStream* stream = active_stream();
+    if (!stream || !stream->semantics || stream->semantic_failed) return;
+    if (!open_block_scope(stream->semantics, constants, variables)) {
+        stream->semantic_failed = true;
+    }
+}
+
+void stream_procedure_header(const char* name) {
+    AnalysisStream* stream = active_stream();
+    if (!stream || !stream->semantics) return;
+    OpenProcedure proc = { NULL, 0 };
+    if (!stream->semantic_failed) {
+        proc.symbol = declare_procedure(stream->semantics, name, &proc.number);
+        stream->semantic_failed = !proc.symbol;
+    }
+    // After a failure the symbols are no longer looked at, only counted
+    if (stream->open_count >= stream->open_capacity && !stream->semantic_failed) {
+        int capacity = stream->open_capacity ? stream->open_capacity * 2 : 16;
+        OpenProcedure* grown = realloc(stream->open, (size_t)capacity * sizeof(OpenProcedure));
+        if (!grown) {
+            snprintf(stream->semantics->error_msg, sizeof(stream->semantics->error_msg),
+                     "Out of memory");
+            stream->semantic_failed = true;
+        } else {
+            stream->open = grown;
+            stream->open_capacity = capacity;
+        }
+    }
+    if (!stream->semantic_failed) stream->open[stream->open_count] = proc;
+    stream->open_count++;
+}
+
+void stream_procedure(Node* proc) {
+    AnalysisStream* stream = active_stream();
+    if (!stream) return;
+    if (stream->types && !stream->type_failed) {
+        stream->type_failed = check_type(stream->types, proc) == TYPE_ERROR;
+    }
+    if (stream->semantics) {
+        stream->open_count--;
+        if (!stream->semantic_failed) {
+            const OpenProcedure* open = &stream->open[stream->open_count];
+            open->symbol->decl = proc;
+            set_node_slot(proc, open->number);
+            stream->semantic_failed = !close_block_scope(stream->semantics, node_right(proc));
+        }
+    }
+    free_ast(node_right(proc));
+    set_node_right(proc, NULL);
+    stream->released++;
+}
+
+// Analyze what is left of the program after the parse, its main
+// statement, and report the outcome like run_type_checking() and
+// run_semantic_analysis(); false if the program has errors
+bool finish_analysis_stream(AnalysisStream* stream, Node* program, const Options* opts) {
+    if (opts->verbose) {
+        fprintf(opts->output, "Phase 1-2: Type Checking and Semantic Analysis (streamed)\n");
+        fprintf(opts->output, "Analyzed and released %d procedure%s while parsing\n",
+                stream->released, stream->released == 1 ? "" : "s");
+    }
+    bool complete = parse_error_count == 0 && program;
+    // A cancelled run is reported by the driver
+    if (cancel_requested(analysis_cancel)) return false;
+
+    if (stream->types) {
+        if (complete && !stream->type_failed) {
+            stream->type_failed = check_type(stream->types, program) == TYPE_ERROR;
+        }
+        if (cancel_requested(analysis_cancel)) return false;
+        if (stream->type_failed) {
+            fprintf(stderr, "Type Error: %s\n", stream->types->error_msg);
+            return false;
+        } else if (opts->verbose && complete) {
+            fprintf(opts->output, "Type checking completed successfully\n");
+        }
+    }
+
+    if (stream->semantics) {
+        if (complete && !stream->semantic_failed) {
+            stream->semantic_failed = !close_block_scope(stream->semantics, node_left(program));
+        }
+        if (cancel_requested(analysis_cancel)) return false;
+        if (stream->semantic_failed) {
+            fprintf(stderr, "Semantic Error: %s\n", stream->semantics->error_msg);
+        } else if (opts->verbose && complete) {
+            fprintf(opts->output, "Semantic analysis completed successfully\n");
+        }
+        if (opts->print_symbols) {
+            dump_symbol_table(stream->semantics, opts->output);
+        }
+    }
+    return complete && !stream->semantic_failed;
+}
@@ -0,0 +1,61 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include "ast.h"
+#include "options.h"
+#include "semantic.h"
+#include "type_check.h"
+
+/* Streaming analysis (--stream): each procedure is type-checked and
+ * analyzed as soon as the parser has reduced it, and its body is freed
+ * right after. Instead of the whole program, the tree in memory is then
+ * the blocks still being parsed, which grow with the nesting of
+ * procedures, with two nodes for each finished procedure declared in
+ * them. Both parsers call the stream_...() hooks below, which do nothing
+ * unless analysis_stream is set.
+ *
+ * A block's scope is opened once its constants and variables are parsed,
+ * a procedure is declared when its header is, and when the procedure is
+ * reduced the statement of its body is analyzed. The NODE_PROC stays in
+ * its block's list without its body (right is NULL), so later calls
+ * still resolve to it. finish_analysis_stream() analyzes the main
+ * statement after the parse. Blocks are analyzed in the order of the
+ * whole-tree pass, so procedure and call site numbers and the first
+ * error reported are the same.
+ *
+ * The stream stops at the first syntax error: then only the syntax
+ * errors and an error found before them are reported. Phases that need
+ * the whole tree (data-flow analysis, execution, printing the AST) do not
+ * run with --stream.
+ */
+
+// A procedure whose body is being parsed
+typedef struct {
+    Symbol* symbol;              // declared, without its node yet
+    int number;                  // for the NODE_PROC's slot
+} OpenProcedure;
+
+typedef struct {
+    TypeContext* types;          // NULL with --no-types
+    SemanticContext* semantics;  // NULL with --no-semantics
+    OpenProcedure* open;         // innermost last
+    int open_count;
+    int open_capacity;
+    int released;                // procedure bodies analyzed and freed
+    bool type_failed;            // an error is in types->error_msg
+    bool semantic_failed;        // an error is in semantics->error_msg
+} AnalysisStream;
+
+// The stream the parser hooks feed, NULL when not streaming
+extern AnalysisStream* analysis_stream;
+
+// Streaming analysis function declarations
+AnalysisStream* create_analysis_stream(const Options* opts);
+void free_analysis_stream(AnalysisStream* stream);
+void stream_block_declarations(Node* constants, Node* variables);
+void stream_procedure_header(const char* name);
+void stream_procedure(Node* proc);
+bool finish_analysis_stream(AnalysisStream* stream, Node* program, const Options* opts);
+
+#endif // STREAM_H
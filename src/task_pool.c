@@ -0,0 +1,216 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "task_pool.h"
+
+typedef struct {
+    TaskFunc func;
+    void* arg;
+    TaskGroup* group;
+} Task;
+
+// Ring buffer of tasks; its thread pushes and pops at the bottom, thieves
+// take from the top
+typedef struct {
+    pthread_mutex_t lock;
+    Task* tasks;
+    size_t capacity;     // power of two
+    size_t top;          // oldest task
+    size_t bottom;       // one past the newest task
+} TaskDeque;
+
+struct TaskPool {
+    TaskDeque* deques;   // one per thread, [0] for threads outside the pool
+    int deque_count;
+    pthread_t* threads;
+    int thread_count;    // workers plus the thread that created the pool
+    atomic_int queued;   // tasks in all deques
+    pthread_mutex_t lock;
+    pthread_cond_t work; // signaled when a task is queued or on shutdown
+    bool shutdown;
+};
+
+#define INITIAL_DEQUE_CAPACITY 64
+
+// The pool the current thread works for and its deque
+static _Thread_local TaskPool* current_pool;
+static _Thread_local int current_deque;
+
+static int own_deque(TaskPool* pool) {
+    return current_pool == pool ? current_deque : 0;
+}
+
+static bool push_task(TaskDeque* deque, Task task) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom - deque->top == deque->capacity) {
+        size_t capacity = deque->capacity * 2;
+        Task* tasks = malloc(capacity * sizeof(Task));
+        if (!tasks) {
+            pthread_mutex_unlock(&deque->lock);
+            return false;
+        }
+        for (size_t i = deque->top; i != deque->bottom; i++) {
+            tasks[i & (capacity - 1)] = deque->tasks[i & (deque->capacity - 1)];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->capacity = capacity;
+    }
+    deque->tasks[deque->bottom++ & (deque->capacity - 1)] = task;
+    pthread_mutex_unlock(&deque->lock);
+    return true;
+}
+
+// Take the newest task (own deque) or the oldest one (stealing)
+static bool take_task(TaskDeque* deque, bool newest, Task* task) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->bottom != deque->top;
+    if (found && newest) {
+        *task = deque->tasks[--deque->bottom & (deque->capacity - 1)];
+    } else if (found) {
+        *task = deque->tasks[deque->top++ & (deque->capacity - 1)];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static bool find_task(TaskPool* pool, int own, Task* task) {
+    if (atomic_load(&pool->queued) == 0) return false;
+    bool found = take_task(&pool->deques[own], true, task);
+    for (int i = 1; !found && i < pool->thread_count; i++) {
+        found = take_task(&pool->deques[(own + i) % pool->thread_count], false, task);
+    }
+    if (found) atomic_fetch_sub(&pool->queued, 1);
+    return found;
+}
+
+static void run_task(Task* task) {
+    task->func(task->arg);
+    __atomic_fetch_sub(&task->group->pending, 1, __ATOMIC_RELEASE);
+}
+
+typedef struct {
+    TaskPool* pool;
+    int deque;
+} WorkerStart;
+
+static void* worker_main(void* arg) {
+    WorkerStart* start = arg;
+    TaskPool* pool = start->pool;
+    current_pool = pool;
+    current_deque = start->deque;
+    free(start);
+
+    for (;;) {
+        Task task;
+        if (find_task(pool, current_deque, &task)) {
+            run_task(&task);
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        while (atomic_load(&pool->queued) == 0 && !pool->shutdown) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        bool done = pool->shutdown && atomic_load(&pool->queued) == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (done) return NULL;
+    }
+}
+
+// Create a pool of the calling thread and threads - 1 workers
+TaskPool* create_task_pool(int threads) {
+    if (threads < 1) threads = 1;
+    TaskPool* pool = calloc(1, sizeof(TaskPool));
+    if (!pool) return NULL;
+    pool->deques = calloc((size_t)threads, sizeof(TaskDeque));
+    pool->threads = calloc((size_t)threads, sizeof(pthread_t));
+    if (!pool->deques || !pool->threads) {
+        free(pool->deques);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    atomic_init(&pool->queued, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pool->thread_count = 1;
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deque_count++;
+        pool->deques[i].capacity = INITIAL_DEQUE_CAPACITY;
+        pool->deques[i].tasks = malloc(INITIAL_DEQUE_CAPACITY * sizeof(Task));
+        if (!pool->deques[i].tasks) {
+            free_task_pool(pool);
+            return NULL;
+        }
+    }
+    current_pool = pool;
+    current_deque = 0;
+
+    // Run with fewer workers if some cannot be started
+    for (int i = 1; i < threads; i++) {
+        WorkerStart* start = malloc(sizeof(WorkerStart));
+        if (!start) break;
+        start->pool = pool;
+        start->deque = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, start) != 0) {
+            free(start);
+            break;
+        }
+        pool->thread_count++;
+    }
+    return pool;
+}
+
+// Stop the workers once the queued tasks are done and free the pool
+void free_task_pool(TaskPool* pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 1; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (int i = 0; i < pool->deque_count; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    if (current_pool == pool) current_pool = NULL;
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+}
+
+// Queue func(arg) as part of group. Returns false if out of memory, the
+// caller should then run the task itself
+bool submit_task(TaskPool* pool, TaskGroup* group, TaskFunc func, void* arg) {
+    Task task = { func, arg, group };
+    __atomic_fetch_add(&group->pending, 1, __ATOMIC_RELAXED);
+    if (!push_task(&pool->deques[own_deque(pool)], task)) {
+        __atomic_fetch_sub(&group->pending, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    atomic_fetch_add(&pool->queued, 1);
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+
+// Wait until all tasks of group have run, running queued tasks meanwhile
+void wait_task_group(TaskPool* pool, TaskGroup* group) {
+    int own = own_deque(pool);
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+        Task task;
+        if (find_task(pool, own, &task)) {
+            run_task(&task);
+        } else {
+            sched_yield();
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <stdbool.h>
+
+/* Work-stealing thread pool for fork/join parallelism. Each thread has
+ * its own deque of tasks: it pushes and pops tasks at the bottom, idle
+ * threads steal the oldest task from the top of another deque. A thread
+ * waiting for a group of tasks runs queued tasks meanwhile, so tasks may
+ * submit and wait for subtasks without starving the pool.
+ */
+
+typedef void (*TaskFunc)(void* arg);
+
+// Tasks to wait for together; initialize with TASK_GROUP_INIT
+typedef struct {
+    int pending;         // tasks not done yet, only accessed atomically
+} TaskGroup;
+
+#define TASK_GROUP_INIT { 0 }
+
+typedef struct TaskPool TaskPool;
+
+// Task pool function declarations
+TaskPool* create_task_pool(int threads);
+void free_task_pool(TaskPool* pool);
+bool submit_task(TaskPool* pool, TaskGroup* group, TaskFunc func, void* arg);
+void wait_task_group(TaskPool* pool, TaskGroup* group);
+
+#endif // TASK_POOL_H
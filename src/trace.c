@@ -0,0 +1,217 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "bufio.h"
+#include "trace.h"
+
+// Events per chunk of a thread's buffer; a full chunk is never moved, a
+// new one is linked after it
+#define TRACE_CHUNK_EVENTS 4096
+
+typedef struct {
+    const char* name;     // NULL for an end event
+    const char* file;
+    uint64_t ns;          // CLOCK_MONOTONIC
+} TraceEvent;
+
+typedef struct TraceChunk {
+    struct TraceChunk* next;
+    int count;
+    TraceEvent events[TRACE_CHUNK_EVENTS];
+} TraceChunk;
+
+typedef struct TraceBuffer {
+    struct TraceBuffer* next;   // in the list of all buffers
+    int tid;
+    TraceChunk* first;
+    TraceChunk* last;
+} TraceBuffer;
+
+// The buffers of the open trace, pushed by the threads that own them
+static _Atomic(TraceBuffer*) buffers = NULL;
+static atomic_int buffer_count = 0;
+// Number of the open trace, 0 while none is open; a thread's buffer
+// belongs to the trace it was made for
+static atomic_uint open_trace = 0;
+static unsigned last_trace = 0;
+static uint64_t start_ns;
+
+static _Thread_local TraceBuffer* thread_buffer = NULL;
+static _Thread_local unsigned thread_trace = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Start recording events; false if a trace is open already
+bool start_trace(void) {
+    if (atomic_load_explicit(&open_trace, memory_order_relaxed) != 0) return false;
+    start_ns = now_ns();
+    if (++last_trace == 0) last_trace = 1;
+    atomic_store_explicit(&open_trace, last_trace, memory_order_release);
+    return true;
+}
+
+// The calling thread's buffer for trace, made and registered on first use
+static TraceBuffer* own_buffer(unsigned trace) {
+    if (thread_trace == trace) return thread_buffer;
+    TraceBuffer* buffer = calloc(1, sizeof(TraceBuffer));
+    if (!buffer) return NULL;
+    buffer->tid = atomic_fetch_add_explicit(&buffer_count, 1, memory_order_relaxed) + 1;
+    buffer->next = atomic_load_explicit(&buffers, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&buffers, &buffer->next, buffer,
+                                                  memory_order_release, memory_order_relaxed)) {
+    }
+    thread_buffer = buffer;
+    thread_trace = trace;
+    return buffer;
+}
+
+static void record(const char* name, const char* file) {
+    unsigned trace = atomic_load_explicit(&open_trace, memory_order_acquire);
+    if (trace == 0) return;
+    TraceBuffer* buffer = own_buffer(trace);
+    if (!buffer) return;
+    TraceChunk* chunk = buffer->last;
+    if (!chunk || chunk->count == TRACE_CHUNK_EVENTS) {
+        // Out of memory: the events are dropped
+        chunk = malloc(sizeof(TraceChunk));
+        if (!chunk) return;
+        chunk->next = NULL;
+        chunk->count = 0;
+        if (buffer->last) {
+            buffer->last->next = chunk;
+        } else {
+            buffer->first = chunk;
+        }
+        buffer->last = chunk;
+    }
+    chunk->events[chunk->count++] = (TraceEvent){ name, file, now_ns() };
+}
+
+// Begin a span on the calling thread; file, if not NULL, goes into the
+// span's arguments
+void trace_begin(const char* name, const char* file) {
+    record(name, file);
+}
+
+// End the calling thread's innermost span
+void trace_end(void) {
+    record(NULL, NULL);
+}
+
+static void put_json_string(BufWriter* w, const char* s) {
+    static const char hex[] = "0123456789abcdef";
+    bufwriter_putc(w, '"');
+    // Names and paths rarely need escaping: copy up to the first character
+    // that does in one go
+    size_t plain = 0;
+    while ((unsigned char)s[plain] >= 0x20 && s[plain] != '"' && s[plain] != '\\') plain++;
+    bufwriter_write(w, s, plain);
+    for (s += plain; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            bufwriter_putc(w, '\\');
+            bufwriter_putc(w, (char)c);
+        } else if (c < 0x20) {
+            bufwriter_puts(w, "\\u00");
+            bufwriter_putc(w, hex[c >> 4]);
+            bufwriter_putc(w, hex[c & 0xf]);
+        } else {
+            bufwriter_putc(w, (char)c);
+        }
+    }
+    bufwriter_putc(w, '"');
+}
+
+// Timestamps are microseconds since start_trace(), to the nanosecond
+static void put_timestamp(BufWriter* w, uint64_t ns) {
+    uint64_t since = ns > start_ns ? ns - start_ns : 0;
+    unsigned fraction = (unsigned)(since % 1000);
+    bufwriter_put_int(w, (long long)(since / 1000));
+    bufwriter_putc(w, '.');
+    bufwriter_putc(w, (char)('0' + fraction / 100));
+    bufwriter_putc(w, (char)('0' + fraction / 10 % 10));
+    bufwriter_putc(w, (char)('0' + fraction % 10));
+}
+
+static void write_events(BufWriter* w, const TraceBuffer* buffer, long long pid, bool* first) {
+    for (const TraceChunk* chunk = buffer->first; chunk; chunk = chunk->next) {
+        for (int i = 0; i < chunk->count; i++) {
+            const TraceEvent* event = &chunk->events[i];
+            bufwriter_puts(w, *first ? "\n" : ",\n");
+            *first = false;
+            if (event->name) {
+                bufwriter_puts(w, "{\"name\":");
+                put_json_string(w, event->name);
+                bufwriter_puts(w, ",\"cat\":\"pl0\",\"ph\":\"B\",\"ts\":");
+            } else {
+                bufwriter_puts(w, "{\"ph\":\"E\",\"ts\":");
+            }
+            put_timestamp(w, event->ns);
+            bufwriter_puts(w, ",\"pid\":");
+            bufwriter_put_int(w, pid);
+            bufwriter_puts(w, ",\"tid\":");
+            bufwriter_put_int(w, buffer->tid);
+            if (event->file) {
+                bufwriter_puts(w, ",\"args\":{\"file\":");
+                put_json_string(w, event->file);
+                bufwriter_putc(w, '}');
+            }
+            bufwriter_putc(w, '}');
+        }
+    }
+}
+
+// Stop recording, write the events of all threads to path, unless it is
+// NULL, and free the buffers. Only call it once the threads that
+// recorded events have finished or been joined. False if writing failed.
+bool finish_trace(const char* path) {
+    atomic_store_explicit(&open_trace, 0, memory_order_relaxed);
+    TraceBuffer* list = atomic_exchange_explicit(&buffers, NULL, memory_order_acquire);
+    atomic_store_explicit(&buffer_count, 0, memory_order_relaxed);
+
+    bool success = true;
+    FILE* out = path ? fopen(path, "w") : NULL;
+    if (path && !out) success = false;
+    BufWriter* w = out ? malloc(sizeof(BufWriter)) : NULL;
+    if (out && !w) success = false;
+    if (w) {
+        bufwriter_init(w, out);
+        bufwriter_puts(w, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        // The threads in the order they started recording
+        TraceBuffer* reversed = NULL;
+        while (list) {
+            TraceBuffer* next = list->next;
+            list->next = reversed;
+            reversed = list;
+            list = next;
+        }
+        list = reversed;
+        bool first = true;
+        for (TraceBuffer* buffer = list; buffer; buffer = buffer->next) {
+            write_events(w, buffer, (long long)getpid(), &first);
+        }
+        bufwriter_puts(w, "\n]}\n");
+        success = bufwriter_flush(w);
+        free(w);
+    }
+    if (out && fclose(out) != 0) success = false;
+
+    while (list) {
+        TraceBuffer* next = list->next;
+        for (TraceChunk* chunk = list->first; chunk;) {
+            TraceChunk* next_chunk = chunk->next;
+            free(chunk);
+            chunk = next_chunk;
+        }
+        free(list);
+        list = next;
+    }
+    return success;
+}
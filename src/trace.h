@@ -0,0 +1,24 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+
+/* Span tracing in the Chrome Trace Event format (--trace=FILE), for
+ * chrome://tracing, Perfetto or speedscope. trace_begin() and trace_end()
+ * record a begin and an end event with a timestamp in a buffer of the
+ * calling thread; threads never share a buffer, and each one registers
+ * its buffer on first use with a lock-free push, so recording takes no
+ * lock. finish_trace() writes all buffers as one JSON file.
+ *
+ * While no trace is open, trace_begin() and trace_end() return at once.
+ * Span names must be string literals, and the file names given to
+ * trace_begin() must stay valid until finish_trace().
+ */
+
+// Trace function declarations
+bool start_trace(void);
+bool finish_trace(const char* path);
+void trace_begin(const char* name, const char* file);
+void trace_end(void);
+
+#endif // TRACE_H
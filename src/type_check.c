@@ -4,6 +4,8 @@
 
 TypeContext* create_type_context() {
     TypeContext* ctx = malloc(sizeof(TypeContext));
+    if (!ctx) return NULL;
+    ctx->cancel = NULL;
     ctx->error_msg[0] = '\0';
     return ctx;
 }
@@ -26,8 +28,8 @@ static Type check_expression_type(TypeContext* ctx, Node* node);
 static Type check_condition_type(TypeContext* ctx, Node* node);
 
 static Type check_binary_op_type(TypeContext* ctx, Node* node) {
-    Type left = check_expression_type(ctx, node->left);
-    Type right = check_expression_type(ctx, node->right);
+    Type left = check_expression_type(ctx, node_left(node));
+    Type right = check_expression_type(ctx, node_right(node));
     
     if (left == TYPE_ERROR || right == TYPE_ERROR) {
         return TYPE_ERROR;
@@ -80,8 +82,8 @@ static Type check_condition_type(TypeContext* ctx, Node* node) {
         return TYPE_ERROR;
     }
     
-    if (node->op == OP_ODD) {
-        Type operand = check_expression_type(ctx, node->left);
+    if (node_op(node) == OP_ODD) {
+        Type operand = check_expression_type(ctx, node_left(node));
         if (operand != TYPE_INTEGER) {
             snprintf(ctx->error_msg, sizeof(ctx->error_msg),
                     "ODD operator requires integer operand, got %s",
@@ -89,8 +91,8 @@ static Type check_condition_type(TypeContext* ctx, Node* node) {
             return TYPE_ERROR;
         }
     } else {
-        Type left = check_expression_type(ctx, node->left);
-        Type right = check_expression_type(ctx, node->right);
+        Type left = check_expression_type(ctx, node_left(node));
+        Type right = check_expression_type(ctx, node_right(node));
         
         if (left != TYPE_INTEGER || right != TYPE_INTEGER) {
             snprintf(ctx->error_msg, sizeof(ctx->error_msg),
@@ -105,6 +107,10 @@ static Type check_condition_type(TypeContext* ctx, Node* node) {
 
 Type check_type(TypeContext* ctx, Node* node) {
     if (!node) return TYPE_VOID;
+    if (poll_cancel(ctx->cancel)) {
+        snprintf(ctx->error_msg, sizeof(ctx->error_msg), "Cancelled");
+        return TYPE_ERROR;
+    }
     
     switch (node->type) {
         case NODE_PROGRAM:
@@ -113,7 +119,7 @@ Type check_type(TypeContext* ctx, Node* node) {
             return TYPE_VOID;
             
         case NODE_CONST_DECL:
-            if (node->right->type != NODE_NUMBER) {
+            if (node_right(node)->type != NODE_NUMBER) {
                 snprintf(ctx->error_msg, sizeof(ctx->error_msg),
                         "Constant must be initialized with a number");
                 return TYPE_ERROR;
@@ -127,7 +133,7 @@ Type check_type(TypeContext* ctx, Node* node) {
             return TYPE_VOID;
             
         case NODE_ASSIGN: {
-            Type expr_type = check_expression_type(ctx, node->right);
+            Type expr_type = check_expression_type(ctx, node_right(node));
             if (expr_type != TYPE_INTEGER) {
                 snprintf(ctx->error_msg, sizeof(ctx->error_msg),
                         "Assignment requires integer expression");
@@ -138,7 +144,7 @@ Type check_type(TypeContext* ctx, Node* node) {
             
         case NODE_IF:
         case NODE_WHILE: {
-            Type cond_type = check_condition_type(ctx, node->left);
+            Type cond_type = check_condition_type(ctx, node_left(node));
             if (cond_type != TYPE_BOOLEAN) {
                 snprintf(ctx->error_msg, sizeof(ctx->error_msg),
                         "Control structure requires boolean condition");
@@ -170,11 +176,13 @@ bool run_type_checking(Node* ast, const Options *opts) {
         fprintf(stderr, "Error: Failed to create type checking context\n");
         return false;
     }
+    type_ctx->cancel = analysis_cancel;
     
     Type program_type = check_type(type_ctx, ast);
     bool success = (program_type != TYPE_ERROR);
     
-    if (!success) {
+    // A cancelled run is reported by the driver
+    if (!success && !cancel_requested(type_ctx->cancel)) {
         fprintf(stderr, "Type Error: %s\n", type_ctx->error_msg);
     } else if (opts->verbose) {
         fprintf(opts->output, "Type checking completed successfully\n");
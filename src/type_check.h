@@ -5,6 +5,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include "ast.h"
+#include "cancel.h"
 #include "options.h"
 
 typedef enum {
@@ -15,6 +16,7 @@ typedef enum {
 } Type;
 
 typedef struct {
+    CancelToken* cancel;  // polled per statement and procedure, or NULL
     char error_msg[256];
 } TypeContext;
 
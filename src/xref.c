@@ -0,0 +1,459 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "xref.h"
+
+// ---------------------------------------------------------------------------
+// Building an index
+// ---------------------------------------------------------------------------
+
+XrefBuilder* create_xref_builder(void) {
+    return calloc(1, sizeof(XrefBuilder));
+}
+
+void free_xref_builder(XrefBuilder* builder) {
+    if (!builder) return;
+    for (int i = 0; i < builder->source_count; i++) free(builder->sources[i].path);
+    for (size_t i = 0; i < builder->ref_count; i++) release_name(builder->refs[i].name);
+    free(builder->sources);
+    free(builder->refs);
+    free(builder);
+}
+
+static bool out_of_memory(XrefBuilder* builder) {
+    snprintf(builder->error_msg, sizeof(builder->error_msg), "Out of memory");
+    return false;
+}
+
+// Add a source; returns its number, -1 when out of memory
+int xref_add_source(XrefBuilder* builder, const char* path, int64_t mtime, uint64_t size) {
+    if (builder->source_count == builder->source_capacity) {
+        int capacity = builder->source_capacity ? builder->source_capacity * 2 : 16;
+        XrefSource* grown = realloc(builder->sources, (size_t)capacity * sizeof(XrefSource));
+        if (!grown) {
+            out_of_memory(builder);
+            return -1;
+        }
+        builder->sources = grown;
+        builder->source_capacity = capacity;
+    }
+    char* copy = strdup(path);
+    if (!copy) {
+        out_of_memory(builder);
+        return -1;
+    }
+    builder->sources[builder->source_count] = (XrefSource){ copy, mtime, size };
+    return builder->source_count++;
+}
+
+// Append an entry, taking over the reference to name
+static bool add_ref(XrefBuilder* builder, const char* name, const XrefEntry* entry) {
+    if (!name) return out_of_memory(builder);
+    if (builder->ref_count == builder->ref_capacity) {
+        size_t capacity = builder->ref_capacity ? builder->ref_capacity * 2 : 1024;
+        XrefRef* grown = realloc(builder->refs, capacity * sizeof(XrefRef));
+        if (!grown) {
+            release_name(name);
+            return out_of_memory(builder);
+        }
+        builder->refs = grown;
+        builder->ref_capacity = capacity;
+    }
+    builder->refs[builder->ref_count++] = (XrefRef){ name, *entry };
+    return true;
+}
+
+typedef struct {
+    XrefBuilder* builder;
+    const TokenBuffer* tokens;
+    uint32_t source;
+} Collector;
+
+static SymbolKind symbol_kind(const Node* decl) {
+    return decl->type == NODE_CONST_DECL ? SYM_CONSTANT :
+           decl->type == NODE_VAR_DECL ? SYM_VARIABLE : SYM_PROCEDURE;
+}
+
+static bool token_offset(const Collector* c, const Node* ident, uint32_t* offset) {
+    int index = ident ? node_first_token(ident) : -1;
+    if (index < 0 || index >= c->tokens->count) return false;
+    *offset = c->tokens->tokens[index].offset;
+    return true;
+}
+
+// Record an identifier of the tree; uses that semantic analysis did not
+// resolve (it stops at the first error) are left out
+static bool collect_ident(Collector* c, const Node* ident, const Node* decl, XrefRole role) {
+    XrefEntry entry = { c->source, 0, 0, 0, 0, (uint8_t)role, 0, 0 };
+    if (!decl || !token_offset(c, ident, &entry.offset) ||
+        !token_offset(c, node_left(decl), &entry.definition)) {
+        return true;
+    }
+    entry.kind = (uint8_t)symbol_kind(decl);
+    return add_ref(c->builder, retain_name(node_name(ident)), &entry);
+}
+
+static bool collect(Collector* c, const Node* node, XrefRole role) {
+    for (; node; node = node_next(node)) {
+        bool collected = true;
+        switch (node->type) {
+            case NODE_CONST_DECL:
+            case NODE_VAR_DECL:
+                collected = collect_ident(c, node_left(node), node, XREF_DEFINE);
+                break;
+            case NODE_PROC:
+                collected = collect_ident(c, node_left(node), node, XREF_DEFINE) &&
+                            collect(c, node_right(node), XREF_READ);
+                break;
+            case NODE_ASSIGN:
+                collected = collect_ident(c, node_left(node), node_decl(node_left(node)),
+                                          XREF_WRITE) &&
+                            collect(c, node_right(node), XREF_READ);
+                break;
+            case NODE_INPUT:
+                collected = collect_ident(c, node_left(node), node_decl(node_left(node)),
+                                          XREF_WRITE);
+                break;
+            case NODE_CALL:
+                collected = collect_ident(c, node_left(node), node_decl(node_left(node)),
+                                          XREF_CALL);
+                break;
+            case NODE_IDENT:
+                collected = collect_ident(c, node, node_decl(node), role);
+                break;
+            default:
+                collected = collect(c, node_left(node), role) && collect(c, node_right(node), role);
+                break;
+        }
+        if (!collected) return false;
+    }
+    return true;
+}
+
+static int compare_offsets(const void* a, const void* b) {
+    uint32_t x = ((const XrefRef*)a)->entry.offset;
+    uint32_t y = ((const XrefRef*)b)->entry.offset;
+    return (x > y) - (x < y);
+}
+
+// Record the definitions and uses in program, parsed by parse_tokens()
+// from tokens and analyzed by analyze_semantics(), for source
+bool xref_add_tree(XrefBuilder* builder, int source, const TokenBuffer* tokens, Node* program) {
+    size_t first = builder->ref_count;
+    Collector c = { builder, tokens, (uint32_t)source };
+    if (!collect(&c, program, XREF_READ)) return false;
+
+    // Lines and columns in one pass over the source, in offset order
+    size_t count = builder->ref_count - first;
+    if (count == 0) return true;
+    XrefRef* refs = builder->refs + first;
+    qsort(refs, count, sizeof(XrefRef), compare_offsets);
+    uint32_t line = 1;
+    size_t line_start = 0;
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (; offset < refs[i].entry.offset; offset++) {
+            if (tokens->source[offset] == '\n') {
+                line++;
+                line_start = offset + 1;
+            }
+        }
+        refs[i].entry.line = line;
+        refs[i].entry.column = (uint32_t)(offset - line_start) + 1;
+    }
+    return true;
+}
+
+// Copy the entries of index for the files it had that are still to be
+// indexed unchanged: sources[file] is the builder's number for the old
+// file, -1 to drop it
+bool xref_reuse(XrefBuilder* builder, const XrefIndex* index, const int* sources) {
+    for (uint32_t n = 0; n < index->header->name_count; n++) {
+        const XrefName* name = &index->names[n];
+        if (name->first_entry > index->header->entry_count ||
+            name->entry_count > index->header->entry_count - name->first_entry) {
+            continue;
+        }
+        const char* interned = NULL;
+        for (uint32_t i = 0; i < name->entry_count; i++) {
+            XrefEntry entry = index->entries[name->first_entry + i];
+            if (entry.file >= index->header->file_count || sources[entry.file] < 0) continue;
+            entry.file = (uint32_t)sources[entry.file];
+            if (!interned) {
+                const char* text = xref_string(index, name->name);
+                interned = intern_name(text, strlen(text));
+            } else {
+                retain_name(interned);
+            }
+            if (!add_ref(builder, interned, &entry)) return false;
+        }
+    }
+    return true;
+}
+
+// Order of the entries in an index: by name, then where they are
+static int compare_refs(const void* a, const void* b) {
+    const XrefRef* x = a;
+    const XrefRef* y = b;
+    if (x->name != y->name) return strcmp(x->name, y->name);
+    if (x->entry.file != y->entry.file) return (x->entry.file > y->entry.file) - (x->entry.file < y->entry.file);
+    return (x->entry.offset > y->entry.offset) - (x->entry.offset < y->entry.offset);
+}
+
+static int compare_sources(const void* a, const void* b) {
+    return strcmp((*(const XrefSource* const*)a)->path, (*(const XrefSource* const*)b)->path);
+}
+
+typedef struct {
+    XrefFile* files;
+    XrefName* names;
+    XrefEntry* entries;
+    char* strings;
+    uint32_t strings_size;
+} IndexTables;
+
+static void free_tables(IndexTables* t) {
+    free(t->files);
+    free(t->names);
+    free(t->entries);
+    free(t->strings);
+}
+
+// Lay out the tables of the index in memory; false if out of memory or
+// too large for the 32-bit offsets
+static bool build_tables(XrefBuilder* builder, XrefHeader* header, IndexTables* t) {
+    int count = builder->source_count;
+    const XrefSource** order = malloc((size_t)(count ? count : 1) * sizeof(XrefSource*));
+    int* file_of = malloc((size_t)(count ? count : 1) * sizeof(int));
+    if (!order || !file_of) {
+        free(order);
+        free(file_of);
+        return out_of_memory(builder);
+    }
+    for (int i = 0; i < count; i++) order[i] = &builder->sources[i];
+    qsort(order, (size_t)count, sizeof(XrefSource*), compare_sources);
+    for (int i = 0; i < count; i++) file_of[order[i] - builder->sources] = i;
+
+    for (size_t i = 0; i < builder->ref_count; i++) {
+        XrefEntry* entry = &builder->refs[i].entry;
+        entry->file = (uint32_t)file_of[entry->file];
+    }
+    // refs is NULL until the first reference
+    if (builder->ref_count > 0) qsort(builder->refs, builder->ref_count, sizeof(XrefRef), compare_refs);
+
+    // Sizes first: the names are the runs of equal (interned) pointers
+    uint64_t strings_size = 1;  // offset 0 is the empty string
+    uint32_t name_count = 0;
+    for (int i = 0; i < count; i++) strings_size += strlen(builder->sources[i].path) + 1;
+    for (size_t i = 0; i < builder->ref_count; i++) {
+        if (i == 0 || builder->refs[i].name != builder->refs[i - 1].name) {
+            name_count++;
+            strings_size += strlen(builder->refs[i].name) + 1;
+        }
+    }
+    if (strings_size > UINT32_MAX || builder->ref_count > UINT32_MAX) {
+        free(order);
+        free(file_of);
+        snprintf(builder->error_msg, sizeof(builder->error_msg), "Index too large");
+        return false;
+    }
+
+    t->files = calloc((size_t)(count ? count : 1), sizeof(XrefFile));
+    t->names = calloc(name_count ? name_count : 1, sizeof(XrefName));
+    t->entries = calloc(builder->ref_count ? builder->ref_count : 1, sizeof(XrefEntry));
+    t->strings = calloc((size_t)strings_size, 1);
+    if (!t->files || !t->names || !t->entries || !t->strings) {
+        free(order);
+        free(file_of);
+        return out_of_memory(builder);
+    }
+
+    uint32_t used = 1;
+    for (int i = 0; i < count; i++) {
+        const XrefSource* source = order[i];
+        size_t length = strlen(source->path) + 1;
+        t->files[i] = (XrefFile){ source->mtime, source->size, used, 0 };
+        memcpy(t->strings + used, source->path, length);
+        used += (uint32_t)length;
+    }
+    XrefName* name = t->names - 1;
+    for (size_t i = 0; i < builder->ref_count; i++) {
+        const XrefRef* ref = &builder->refs[i];
+        if (i == 0 || ref->name != builder->refs[i - 1].name) {
+            name++;
+            size_t length = strlen(ref->name) + 1;
+            *name = (XrefName){ used, (uint32_t)i, 0 };
+            memcpy(t->strings + used, ref->name, length);
+            used += (uint32_t)length;
+        }
+        name->entry_count++;
+        t->entries[i] = ref->entry;
+        t->files[ref->entry.file].entry_count++;
+    }
+    t->strings_size = (uint32_t)strings_size;
+
+    memset(header, 0, sizeof(XrefHeader));
+    memcpy(header->magic, XREF_MAGIC, sizeof(header->magic));
+    header->version = XREF_VERSION;
+    header->byte_order = XREF_BYTE_ORDER;
+    header->file_count = (uint32_t)count;
+    header->name_count = name_count;
+    header->entry_count = (uint32_t)builder->ref_count;
+    header->strings_size = t->strings_size;
+    free(order);
+    free(file_of);
+    return true;
+}
+
+// Write the index to path, replacing the file only once it is complete
+bool write_xref_index(XrefBuilder* builder, const char* path) {
+    XrefHeader header;
+    IndexTables t = { NULL, NULL, NULL, NULL, 0 };
+    if (!build_tables(builder, &header, &t)) {
+        free_tables(&t);
+        return false;
+    }
+
+    size_t length = strlen(path);
+    char* temp = malloc(length + 8);
+    if (!temp) {
+        free_tables(&t);
+        return out_of_memory(builder);
+    }
+    memcpy(temp, path, length);
+    memcpy(temp + length, ".idxtmp", 8);
+
+    FILE* out = fopen(temp, "wb");
+    bool success = out &&
+        fwrite(&header, sizeof(header), 1, out) == 1 &&
+        fwrite(t.files, sizeof(XrefFile), header.file_count, out) == header.file_count &&
+        fwrite(t.names, sizeof(XrefName), header.name_count, out) == header.name_count &&
+        fwrite(t.entries, sizeof(XrefEntry), header.entry_count, out) == header.entry_count &&
+        fwrite(t.strings, 1, t.strings_size, out) == t.strings_size;
+    if (out && fclose(out) != 0) success = false;
+    if (success && rename(temp, path) != 0) success = false;
+    if (!success) {
+        snprintf(builder->error_msg, sizeof(builder->error_msg), "Cannot write %s: %s",
+                 path, strerror(errno));
+        remove(temp);
+    }
+    free(temp);
+    free_tables(&t);
+    return success;
+}
+
+// ---------------------------------------------------------------------------
+// Reading an index
+// ---------------------------------------------------------------------------
+
+// Map an index; only the header and the bounds of the tables are checked,
+// so opening takes the same time however large the index is
+XrefIndex* open_xref_index(const char* path, char* error_msg, size_t size) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        snprintf(error_msg, size, "Cannot open %s: %s", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    XrefIndex* index = calloc(1, sizeof(XrefIndex));
+    if (!index) {
+        snprintf(error_msg, size, "Out of memory");
+        close(fd);
+        return NULL;
+    }
+    index->size = (size_t)st.st_size;
+    if (index->size >= sizeof(XrefHeader)) {
+        index->data = mmap(NULL, index->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (index->data == MAP_FAILED) index->data = NULL;
+    }
+    close(fd);
+
+    const XrefHeader* header = index->data;
+    bool valid = header &&
+        memcmp(header->magic, XREF_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == XREF_VERSION && header->byte_order == XREF_BYTE_ORDER;
+    if (valid) {
+        uint64_t expected = sizeof(XrefHeader) +
+            (uint64_t)header->file_count * sizeof(XrefFile) +
+            (uint64_t)header->name_count * sizeof(XrefName) +
+            (uint64_t)header->entry_count * sizeof(XrefEntry) + header->strings_size;
+        valid = expected == index->size && header->strings_size > 0;
+    }
+    if (!valid) {
+        snprintf(error_msg, size, "%s is not a PL/0 index of this version", path);
+        close_xref_index(index);
+        return NULL;
+    }
+
+    const char* data = index->data;
+    index->header = header;
+    index->files = (const XrefFile*)(data + sizeof(XrefHeader));
+    index->names = (const XrefName*)(index->files + header->file_count);
+    index->entries = (const XrefEntry*)(index->names + header->name_count);
+    index->strings = (const char*)(index->entries + header->entry_count);
+    if (index->strings[header->strings_size - 1] != '\0') {
+        snprintf(error_msg, size, "%s is not a PL/0 index of this version", path);
+        close_xref_index(index);
+        return NULL;
+    }
+    return index;
+}
+
+void close_xref_index(XrefIndex* index) {
+    if (!index) return;
+    if (index->data) munmap(index->data, index->size);
+    free(index);
+}
+
+// A string of the index; offsets out of range give the empty string
+const char* xref_string(const XrefIndex* index, uint32_t offset) {
+    return offset < index->header->strings_size ? index->strings + offset : "";
+}
+
+// The number of the file with path, -1 if the index has none
+int xref_find_file(const XrefIndex* index, const char* path) {
+    uint32_t low = 0;
+    uint32_t high = index->header->file_count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        int order = strcmp(xref_string(index, index->files[mid].path), path);
+        if (order == 0) return (int)mid;
+        if (order < 0) low = mid + 1; else high = mid;
+    }
+    return -1;
+}
+
+// The entries of name, NULL if it occurs nowhere; the run of entries it
+// points to is within the index
+const XrefName* xref_find_name(const XrefIndex* index, const char* name) {
+    uint32_t low = 0;
+    uint32_t high = index->header->name_count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        const XrefName* found = &index->names[mid];
+        int order = strcmp(xref_string(index, found->name), name);
+        if (order == 0) {
+            bool in_range = found->first_entry <= index->header->entry_count &&
+                            found->entry_count <= index->header->entry_count - found->first_entry;
+            return in_range ? found : NULL;
+        }
+        if (order < 0) low = mid + 1; else high = mid;
+    }
+    return NULL;
+}
+
+const char* xref_role_name(XrefRole role) {
+    switch (role) {
+        case XREF_DEFINE: return "define";
+        case XREF_READ:   return "read";
+        case XREF_WRITE:  return "write";
+        case XREF_CALL:   return "call";
+    }
+    return "?";
+}
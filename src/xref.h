@@ -0,0 +1,129 @@
+#ifndef XREF_H
+#define XREF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+#include "cst.h"
+#include "semantic.h"
+
+/* Cross-reference index of PL/0 sources, behind pl0_index. For every
+ * file it records where each constant, variable and procedure is defined
+ * and where the analyzed tree reads, writes (assignment, READ) or calls
+ * it. A reference names its symbol by the offset of the definition in
+ * the same file, so symbols of the same name in different scopes stay
+ * apart.
+ *
+ * An index file is used in place with mmap(): a header, then the files
+ * sorted by path, the distinct names sorted by their text, the entries
+ * sorted by name, file and offset, and the strings the tables point
+ * into. Looking up a name is a binary search over the names, which gives
+ * the run of its entries. The tables are in the byte order of the host
+ * that wrote them; an index written elsewhere (or by another version) is
+ * rejected and has to be built again.
+ *
+ * An XrefBuilder collects the entries for a new index: xref_add_tree()
+ * those of an analyzed source, xref_reuse() those an older index has for
+ * files that did not change, so an update only parses what changed.
+ */
+
+#define XREF_MAGIC      "PL0IDX"
+#define XREF_VERSION    1
+
+typedef enum {
+    XREF_DEFINE,
+    XREF_READ,
+    XREF_WRITE,
+    XREF_CALL
+} XrefRole;
+
+typedef struct {
+    char magic[7];           // XREF_MAGIC and its terminator
+    uint8_t version;
+    uint32_t byte_order;     // XREF_BYTE_ORDER as written
+    uint32_t file_count;
+    uint32_t name_count;
+    uint32_t entry_count;
+    uint32_t strings_size;   // the string table ends with a terminator
+    uint32_t reserved;
+} XrefHeader;
+
+#define XREF_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    int64_t mtime;           // modification time in nanoseconds
+    uint64_t size;
+    uint32_t path;           // offset into the strings
+    uint32_t entry_count;
+} XrefFile;
+
+typedef struct {
+    uint32_t name;           // offset into the strings
+    uint32_t first_entry;
+    uint32_t entry_count;
+} XrefName;
+
+typedef struct {
+    uint32_t file;
+    uint32_t offset;         // of the identifier in the source
+    uint32_t line;
+    uint32_t column;         // 1-based, in bytes
+    uint32_t definition;     // offset of the defining identifier
+    uint8_t role;            // XrefRole
+    uint8_t kind;            // SymbolKind
+    uint16_t reserved;
+} XrefEntry;
+
+// An index file mapped into memory
+typedef struct {
+    void* data;
+    size_t size;
+    const XrefHeader* header;
+    const XrefFile* files;
+    const XrefName* names;
+    const XrefEntry* entries;
+    const char* strings;
+} XrefIndex;
+
+// A source of the index being built
+typedef struct {
+    char* path;
+    int64_t mtime;
+    uint64_t size;
+} XrefSource;
+
+// An entry of the index being built, holding a reference to its name
+typedef struct {
+    const char* name;        // interned (see intern_name)
+    XrefEntry entry;
+} XrefRef;
+
+typedef struct {
+    XrefSource* sources;
+    int source_count;
+    int source_capacity;
+    XrefRef* refs;
+    size_t ref_count;
+    size_t ref_capacity;
+    char error_msg[256];
+} XrefBuilder;
+
+// Index building function declarations
+XrefBuilder* create_xref_builder(void);
+void free_xref_builder(XrefBuilder* builder);
+int xref_add_source(XrefBuilder* builder, const char* path, int64_t mtime, uint64_t size);
+bool xref_add_tree(XrefBuilder* builder, int source, const TokenBuffer* tokens, Node* program);
+bool xref_reuse(XrefBuilder* builder, const XrefIndex* index, const int* sources);
+bool write_xref_index(XrefBuilder* builder, const char* path);
+
+// Index reading function declarations; open_xref_index() returns NULL
+// and describes the problem in error_msg if the file cannot be used
+XrefIndex* open_xref_index(const char* path, char* error_msg, size_t size);
+void close_xref_index(XrefIndex* index);
+int xref_find_file(const XrefIndex* index, const char* path);
+const XrefName* xref_find_name(const XrefIndex* index, const char* name);
+const char* xref_string(const XrefIndex* index, uint32_t offset);
+const char* xref_role_name(XrefRole role);
+
+#endif // XREF_H
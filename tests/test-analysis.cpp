@@ -5,9 +5,13 @@
 extern "C" {
 #include "ast.h"
 #include "semantic.h"
+#include "stream.h"
 extern int yyparse(void);
 extern struct yy_buffer_state* yy_scan_string(const char*);
+extern void yy_delete_buffer(struct yy_buffer_state*);
 extern Node* ast_root;
+extern int parse_error_count;
+extern int yylineno;
 }
 
 class SemanticAnalysisTest : public ::testing::Test {
@@ -21,11 +25,16 @@ protected:
         if (sem_ctx) {
             free_semantic_context(sem_ctx);
         }
+        free_ast(ast_root);
+        ast_root = nullptr;
     }
 
     bool parse_and_analyze(const std::string& input) {
-        yy_scan_string(input.c_str());
-        if (yyparse() != 0) return false;
+        free_ast(ast_root);
+        struct yy_buffer_state* buffer = yy_scan_string(input.c_str());
+        int result = yyparse();
+        yy_delete_buffer(buffer);
+        if (result != 0) return false;
         return analyze_semantics(sem_ctx, ast_root);
     }
 
@@ -132,6 +141,56 @@ TEST_F(SemanticAnalysisTest, VariableScoping) {
     EXPECT_GE(count, 2);
 }
 
+// Identifier Resolution Tests
+TEST_F(SemanticAnalysisTest, ResolvesLevelsAndSlots) {
+    ASSERT_TRUE(parse_and_analyze(
+        "CONST k = 5;"
+        "VAR a, b;"
+        "PROCEDURE p;"
+        "  VAR c;"
+        "  c := b + k;"
+        "a := 1."));
+    Node* block = node_left(ast_root);
+    EXPECT_EQ(node_slot(block), 2);                    // frame size
+
+    Node* proc = node_next(node_next(node_right(block)));
+    ASSERT_EQ(proc->type, NODE_PROC);
+    EXPECT_EQ(node_slot(proc), 0);                     // procedure number
+    EXPECT_EQ(node_slot(node_right(proc)), 1);
+
+    Node* assign = node_next(node_right(node_right(proc)));      // c := b + k
+    ASSERT_EQ(assign->type, NODE_ASSIGN);
+    EXPECT_EQ(node_level(node_left(assign)), 0);
+    EXPECT_EQ(node_slot(node_left(assign)), 0);
+    Node* b = node_left(node_right(assign));
+    EXPECT_EQ(node_level(b), 1);
+    EXPECT_EQ(node_slot(b), 1);
+    EXPECT_EQ(node_decl(b)->type, NODE_VAR_DECL);
+    EXPECT_EQ(node_decl(node_right(node_right(assign)))->type, NODE_CONST_DECL);
+}
+
+TEST_F(SemanticAnalysisTest, SiblingLocalsNotVisible) {
+    ASSERT_FALSE(parse_and_analyze(
+        "PROCEDURE p; VAR t; t := 1;"
+        "PROCEDURE q; t := 2;"
+        "."));
+    EXPECT_TRUE(std::string(sem_ctx->error_msg).find("Undefined identifier 't'") != std::string::npos);
+}
+
+TEST_F(SemanticAnalysisTest, UndefinedInExpression) {
+    ASSERT_FALSE(parse_and_analyze(
+        "VAR x;"
+        "BEGIN x := 1; WHILE x < y DO x := x + 1 END."));
+    EXPECT_TRUE(std::string(sem_ctx->error_msg).find("Undefined identifier 'y'") != std::string::npos);
+}
+
+TEST_F(SemanticAnalysisTest, ProcedureInExpression) {
+    ASSERT_FALSE(parse_and_analyze(
+        "PROCEDURE p; ;"
+        "WRITE p + 1."));
+    EXPECT_TRUE(std::string(sem_ctx->error_msg).find("Cannot use procedure 'p'") != std::string::npos);
+}
+
 // Error Cases
 TEST_F(SemanticAnalysisTest, DuplicateConstant) {
     ASSERT_FALSE(parse_and_analyze(
@@ -158,6 +217,21 @@ TEST_F(SemanticAnalysisTest, UndefinedVariable) {
     EXPECT_TRUE(std::string(sem_ctx->error_msg).find("Undefined identifier") != std::string::npos);
 }
 
+TEST_F(SemanticAnalysisTest, UndefinedVariableLaterInCompound) {
+    ASSERT_FALSE(parse_and_analyze(
+        "VAR x;"
+        "BEGIN x := 1; y := 2 END."));
+    EXPECT_TRUE(std::string(sem_ctx->error_msg).find("Undefined identifier 'y'") != std::string::npos);
+}
+
+TEST_F(SemanticAnalysisTest, SkipsPoisonedDeclarations) {
+    // The malformed declaration is skipped, the ones around it survive
+    ASSERT_TRUE(parse_and_analyze(
+        "VAR x, 1, y;"
+        "BEGIN x := 1; y := 2 END."));
+    EXPECT_EQ(parse_error_count, 1);
+}
+
 TEST_F(SemanticAnalysisTest, AssignToConstant) {
     ASSERT_FALSE(parse_and_analyze(
         "CONST x = 1;"
@@ -255,3 +329,215 @@ TEST_F(SemanticAnalysisTest, ComplexProgram) {
     EXPECT_TRUE(symbols.find("temp") != std::string::npos);
 }
 
+
+// Parallel analysis of sibling procedures (SemanticContext.pool)
+
+// A procedure large enough to be analyzed in a task of its own, with a
+// nested procedure and calls
+static std::string large_procedure(int i, const std::string& extra = "") {
+    std::string name = "p" + std::to_string(i);
+    std::string text = "PROCEDURE " + name + ";\n"
+                       "  VAR a, b;\n"
+                       "  PROCEDURE inner; b := a + g;\n"
+                       "  BEGIN\n"
+                       "    a := " + std::to_string(i) + ";\n";
+    for (int k = 0; k < 60; k++) text += "    a := a * 2 + g; CALL inner;\n";
+    if (i > 0) text += "    CALL p" + std::to_string(i - 1) + ";\n";
+    return text + extra + "    g := b\n  END;\n";
+}
+
+// Node kinds and everything semantic analysis stores in the AST
+static void describe(const Node* node, std::string& out) {
+    for (; node; node = node_next(node)) {
+        out += std::to_string(node->type) + ":" + std::to_string(node_slot(node)) + ":" +
+               std::to_string(node_level(node)) + " ";
+        if (!node_has_children(node)) {
+            out += std::to_string(node_decl(node) ? node_line(node_decl(node)) : -1) + " ";
+            continue;
+        }
+        describe(node_left(node), out);
+        describe(node_right(node), out);
+    }
+}
+
+class ParallelAnalysisTest : public SemanticAnalysisTest {
+protected:
+    void TearDown() override {
+        free_task_pool(sem_ctx->pool);
+        SemanticAnalysisTest::TearDown();
+    }
+
+    // Analyze a program with and without a pool, expecting the same result
+    void expect_same_analysis(const std::string& program) {
+        yylineno = 1;
+        bool sequential = parse_and_analyze(program);
+        std::string sequential_error = sem_ctx->error_msg;
+        std::string sequential_ast, sequential_symbols = get_symbol_table();
+        describe(ast_root, sequential_ast);
+
+        free_semantic_context(sem_ctx);
+        sem_ctx = create_semantic_context();
+        sem_ctx->pool = create_task_pool(4);
+        ASSERT_NE(sem_ctx->pool, nullptr);
+        yylineno = 1;
+        EXPECT_EQ(parse_and_analyze(program), sequential);
+        EXPECT_EQ(sem_ctx->error_msg, sequential_error);
+        if (sequential) {
+            std::string parallel_ast;
+            describe(ast_root, parallel_ast);
+            EXPECT_EQ(parallel_ast, sequential_ast);
+            EXPECT_EQ(get_symbol_table(), sequential_symbols);
+        }
+    }
+};
+
+TEST_F(ParallelAnalysisTest, SameResultAsSequential) {
+    std::string program = "VAR g;\n";
+    for (int i = 0; i < 12; i++) {
+        program += i % 3 == 1 ? "PROCEDURE s" + std::to_string(i) + "; g := 1;\n" : "";
+        program += large_procedure(i);
+    }
+    program += "BEGIN g := 0; CALL p11; CALL s10 END.";
+    expect_same_analysis(program);
+}
+
+TEST_F(ParallelAnalysisTest, ReportsFirstErrorInProgramOrder) {
+    std::string program = "VAR g;\n";
+    for (int i = 0; i < 8; i++) {
+        program += large_procedure(i, i == 3 ? "    x3 := 1;\n" : i == 6 ? "    x6 := 1;\n" : "");
+    }
+    program += "BEGIN x := 0 END.";
+    expect_same_analysis(program);
+    EXPECT_STREQ(sem_ctx->error_msg, "Undefined identifier 'x3'");
+}
+
+TEST_F(ParallelAnalysisTest, DuplicateAfterFailingProcedure) {
+    std::string program = "VAR g;\n" + large_procedure(0) +
+                          large_procedure(1, "    y := 1;\n") + large_procedure(1) +
+                          "BEGIN g := 0 END.";
+    expect_same_analysis(program);
+    EXPECT_STREQ(sem_ctx->error_msg, "Undefined identifier 'y'");
+
+    program = "VAR g;\n" + large_procedure(0) + large_procedure(1) + large_procedure(0) + ".";
+    expect_same_analysis(program);
+    EXPECT_STREQ(sem_ctx->error_msg, "Symbol 'p0' already declared in current scope");
+}
+
+TEST_F(ParallelAnalysisTest, LaterSiblingsNotVisible) {
+    // p0 calls p1, which is only declared after it
+    std::string program = "VAR g;\n" + large_procedure(0, "    CALL p1;\n") +
+                          large_procedure(1) + ".";
+    expect_same_analysis(program);
+    EXPECT_STREQ(sem_ctx->error_msg, "Undefined procedure 'p1'");
+}
+
+// Streaming analysis (stream.h): procedures analyzed while they are parsed
+
+class StreamingAnalysisTest : public SemanticAnalysisTest {
+protected:
+    void TearDown() override {
+        free_analysis_stream(analysis_stream);
+        analysis_stream = nullptr;
+        SemanticAnalysisTest::TearDown();
+    }
+
+    // Parse with a stream, returning what finish_analysis_stream() does
+    bool parse_streaming(const std::string& input, ParseFunction parse = yyparse) {
+        free_ast(ast_root);
+        ast_root = nullptr;
+        free_analysis_stream(analysis_stream);
+        Options opts = {};
+        opts.output = stdout;
+        analysis_stream = create_analysis_stream(&opts);
+        EXPECT_NE(analysis_stream, nullptr);
+        yylineno = 1;
+        struct yy_buffer_state* buffer = yy_scan_string(input.c_str());
+        int result = parse();
+        yy_delete_buffer(buffer);
+        return result == 0 && finish_analysis_stream(analysis_stream, ast_root, &opts);
+    }
+
+    // Analyze a program as a whole and streaming with both parsers,
+    // expecting the same result; the whole tree is compared without the
+    // bodies of its procedures
+    void expect_same_as_whole_tree(const std::string& program) {
+        free_analysis_stream(analysis_stream);
+        analysis_stream = nullptr;
+        free_semantic_context(sem_ctx);
+        sem_ctx = create_semantic_context();
+        yylineno = 1;
+        bool whole = parse_and_analyze(program);
+        ASSERT_NE(ast_root, nullptr);
+        std::string whole_error = sem_ctx->error_msg;
+        for (Node* node = node_right(node_left(ast_root)); node; node = node_next(node)) {
+            if (node->type != NODE_PROC) continue;
+            free_ast(node_right(node));
+            set_node_right(node, nullptr);
+        }
+        std::string whole_ast;
+        describe(ast_root, whole_ast);
+
+        for (ParseFunction parse : { yyparse, descent_parse }) {
+            EXPECT_EQ(parse_streaming(program, parse), whole);
+            EXPECT_EQ(analysis_stream->semantics->error_msg, whole_error);
+            if (whole) {
+                std::string streamed_ast;
+                describe(ast_root, streamed_ast);
+                EXPECT_EQ(streamed_ast, whole_ast);
+            }
+        }
+    }
+};
+
+TEST_F(StreamingAnalysisTest, SameResultAsWholeTree) {
+    std::string program = "VAR g;\n";
+    for (int i = 0; i < 6; i++) program += large_procedure(i);
+    program += "BEGIN g := 0; CALL p5 END.";
+    expect_same_as_whole_tree(program);
+    EXPECT_EQ(analysis_stream->released, 12);
+}
+
+TEST_F(StreamingAnalysisTest, ReportsSameFirstError) {
+    expect_same_as_whole_tree("VAR g;\n" + large_procedure(0) +
+                              large_procedure(1, "    x := 1;\n") + "BEGIN y := 0 END.");
+    EXPECT_STREQ(analysis_stream->semantics->error_msg, "Undefined identifier 'x'");
+
+    expect_same_as_whole_tree("VAR g;\n" + large_procedure(0, "    CALL p1;\n") +
+                              large_procedure(1) + ".");
+    EXPECT_STREQ(analysis_stream->semantics->error_msg, "Undefined procedure 'p1'");
+
+    expect_same_as_whole_tree("VAR g;\n" + large_procedure(0) + large_procedure(0) + ".");
+    EXPECT_STREQ(analysis_stream->semantics->error_msg,
+                 "Symbol 'p0' already declared in current scope");
+
+    expect_same_as_whole_tree("VAR g;\n" + large_procedure(0) + "BEGIN CALL g END.");
+    EXPECT_STREQ(analysis_stream->semantics->error_msg, "'g' is not a procedure");
+}
+
+TEST_F(StreamingAnalysisTest, ReleasesProcedureBodies) {
+    std::string program = "VAR g;\n";
+    for (int i = 0; i < 20; i++) program += large_procedure(i);
+    program += "CALL p19.";
+    ASSERT_TRUE(parse_and_analyze(program));
+    AstMemStats whole;
+    get_ast_mem_stats(&whole);
+
+    ASSERT_TRUE(parse_streaming(program));
+    AstMemStats streamed;
+    get_ast_mem_stats(&streamed);
+    EXPECT_LT(streamed.nodes * 20, whole.nodes);
+    for (Node* node = node_right(node_left(ast_root)); node; node = node_next(node)) {
+        if (node->type == NODE_PROC) {
+            EXPECT_EQ(node_right(node), nullptr);
+        }
+    }
+}
+
+TEST_F(StreamingAnalysisTest, StopsAtSyntaxError) {
+    // The undefined procedure follows the syntax error, so it is not reported
+    EXPECT_FALSE(parse_streaming("VAR a;\nPROCEDURE p; a := 1 +;\n"
+                                 "PROCEDURE q; CALL zz;\nBEGIN CALL p END."));
+    EXPECT_GT(parse_error_count, 0);
+    EXPECT_FALSE(analysis_stream->semantic_failed);
+    EXPECT_EQ(analysis_stream->released, 0);
+}
@@ -0,0 +1,214 @@
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "pl0.hpp"
+
+extern "C" {
+extern int yyparse(void);
+extern struct yy_buffer_state* yy_scan_string(const char*);
+extern void yy_delete_buffer(struct yy_buffer_state*);
+extern int yylineno;
+extern int parse_error_count;
+extern Node* ast_root;
+}
+
+#ifndef PL0_EXAMPLES_DIR
+#define PL0_EXAMPLES_DIR "examples"
+#endif
+
+static_assert(!std::is_copy_constructible<pl0::Program>::value, "programs are moved");
+static_assert(std::is_nothrow_move_constructible<pl0::Program>::value, "programs are moved");
+static_assert(!std::is_copy_constructible<pl0::Diagnostics>::value, "diagnostics are moved");
+static_assert(std::is_nothrow_move_assignable<pl0::Diagnostics>::value, "diagnostics are moved");
+
+class APITest : public ::testing::Test {
+protected:
+    static std::string print(const Node* node) {
+        char* buffer = nullptr;
+        size_t size = 0;
+        FILE* out = open_memstream(&buffer, &size);
+        fprint_ast(out, const_cast<Node*>(node), 0);
+        fclose(out);
+        std::string text(buffer, size);
+        free(buffer);
+        return text;
+    }
+
+    static std::string read_file(const std::string& path) {
+        std::ifstream in(path);
+        std::stringstream text;
+        text << in.rdbuf();
+        return text.str();
+    }
+};
+
+TEST_F(APITest, ParsesWithoutGlobalState) {
+    std::string text = "VAR x; BEGIN x := 1; WRITE x END.";
+    ast_root = nullptr;
+    parse_error_count = 3;
+    auto [program, diagnostics] = pl0::parse(text);
+    EXPECT_TRUE(diagnostics.ok());
+    EXPECT_EQ(diagnostics.phase(), pl0::Phase::none);
+    ASSERT_TRUE(program);
+    EXPECT_EQ(ast_root, nullptr);
+    EXPECT_EQ(parse_error_count, 3);
+    parse_error_count = 0;
+
+    // The source is borrowed
+    EXPECT_EQ(program.source().data(), text.data());
+    EXPECT_EQ(program.source().size(), text.size());
+    EXPECT_TRUE(program.check().ok());
+}
+
+TEST_F(APITest, WalksTheTree) {
+    auto [program, diagnostics] = pl0::parse("CONST k = 3; VAR x, y;\n"
+                                             "PROCEDURE p; x := k;\n"
+                                             "BEGIN CALL p; y := x + k END.");
+    ASSERT_TRUE(diagnostics);
+    pl0::NodeRef root = program.root();
+    ASSERT_EQ(root.type(), NODE_PROGRAM);
+    pl0::NodeRef block = root.left();
+    ASSERT_EQ(block.type(), NODE_BLOCK);
+
+    std::vector<std::string> constants;
+    for (pl0::NodeRef item : block.left().list()) {
+        constants.push_back(std::string(item.left().name()) + "=" +
+                            std::to_string(item.right().value()));
+    }
+    EXPECT_EQ(constants, std::vector<std::string>({ "k=3" }));
+
+    std::vector<NodeType> declarations;
+    for (pl0::NodeRef item : block.right().list()) {
+        if (item == block.statement()) break;
+        declarations.push_back(item.type());
+    }
+    EXPECT_EQ(declarations, std::vector<NodeType>({ NODE_VAR_DECL, NODE_VAR_DECL, NODE_PROC }));
+
+    pl0::NodeRef statement = block.statement();
+    ASSERT_EQ(statement.type(), NODE_COMPOUND);
+    EXPECT_EQ(statement.line(), 3);
+    pl0::NodeRef assign = statement.left().next();
+    ASSERT_EQ(assign.type(), NODE_ASSIGN);
+    EXPECT_EQ(assign.right().op(), OP_PLUS);
+    EXPECT_EQ(assign.right().line(), 0);
+
+    // Checking links identifiers to their declarations
+    EXPECT_FALSE(assign.right().right().decl());
+    ASSERT_TRUE(program.check());
+    pl0::NodeRef k = assign.right().right().decl();
+    ASSERT_TRUE(k);
+    EXPECT_EQ(k.type(), NODE_CONST_DECL);
+    EXPECT_EQ(k, block.left());
+}
+
+// The parse is the one the command line tool gets from the scanner and
+// Bison's parser
+TEST_F(APITest, MatchesTheParser) {
+    DIR* examples = opendir(PL0_EXAMPLES_DIR);
+    ASSERT_NE(examples, nullptr) << PL0_EXAMPLES_DIR;
+    int compared = 0;
+    while (struct dirent* entry = readdir(examples)) {
+        std::string name = entry->d_name;
+        if (name.size() <= 4 || name.compare(name.size() - 4, 4, ".pl0") != 0) continue;
+        SCOPED_TRACE(name);
+        std::string text = read_file(std::string(PL0_EXAMPLES_DIR) + "/" + name);
+
+        struct yy_buffer_state* scan_buffer = yy_scan_string(text.c_str());
+        yylineno = 1;
+        int parsed = yyparse();
+        yy_delete_buffer(scan_buffer);
+        std::string expected = parsed == 0 ? print(ast_root) : "";
+        free_ast(ast_root);
+        ast_root = nullptr;
+        parse_error_count = 0;
+
+        auto [program, diagnostics] = pl0::parse(text);
+        EXPECT_EQ(diagnostics.ok(), parsed == 0) << diagnostics.message();
+        if (program) {
+            EXPECT_EQ(print(program.root().get()), expected);
+        }
+        compared++;
+    }
+    closedir(examples);
+    EXPECT_GT(compared, 0);
+}
+
+TEST_F(APITest, ReportsTheFirstError) {
+    {
+        auto [program, diagnostics] = pl0::parse("VAR x;\nBEGIN x := 1 $ 2 END.");
+        EXPECT_EQ(diagnostics.phase(), pl0::Phase::lex);
+        EXPECT_EQ(diagnostics.message().substr(0, 7), "line 2:");
+        EXPECT_FALSE(program);
+    }
+    {
+        auto [program, diagnostics] = pl0::parse("VAR x;\n\nx := ;.");
+        EXPECT_EQ(diagnostics.phase(), pl0::Phase::syntax);
+        EXPECT_EQ(diagnostics.message(), "line 3: syntax error, unexpected SEMICOLON");
+        EXPECT_FALSE(program);
+        EXPECT_EQ(program.check().phase(), pl0::Phase::syntax);
+    }
+    {
+        auto [program, diagnostics] = pl0::parse("VAR x BEGIN x := 1 END.");
+        EXPECT_EQ(diagnostics.message(), "line 1: syntax error, unexpected BEGIN, "
+                                         "expecting SEMICOLON or COMMA");
+    }
+    {
+        auto [program, diagnostics] = pl0::parse("VAR x; y := 1.");
+        ASSERT_TRUE(diagnostics);
+        pl0::Diagnostics checked = program.check();
+        EXPECT_EQ(checked.phase(), pl0::Phase::semantics);
+        EXPECT_NE(checked.message().find("'y'"), std::string_view::npos) << checked.message();
+    }
+    {
+        std::string deep = "VAR x; x := " + std::string(100000, '(') + "1" +
+                           std::string(100000, ')') + ".";
+        auto [program, diagnostics] = pl0::parse(deep);
+        EXPECT_EQ(diagnostics.phase(), pl0::Phase::syntax);
+        EXPECT_EQ(diagnostics.message(), "line 1: nesting too deep");
+    }
+    EXPECT_EQ(ast_root, nullptr);
+    EXPECT_EQ(parse_error_count, 0);
+}
+
+TEST_F(APITest, CollectsDataflowFindings) {
+    auto [program, diagnostics] = pl0::parse("VAR x, y;\nBEGIN y := x;\nx := 1 END.");
+    ASSERT_TRUE(diagnostics);
+    diagnostics = program.check();
+    EXPECT_TRUE(diagnostics.ok());
+    std::vector<std::string> findings;
+    for (const DataflowWarning& finding : diagnostics) {
+        findings.push_back(std::to_string(finding.kind) + ":" + std::to_string(finding.line) +
+                           ":" + finding.name);
+    }
+    EXPECT_EQ(findings, std::vector<std::string>({ "0:2:x", "1:2:y", "1:3:x" }));
+
+    auto [loop, loop_diagnostics] = pl0::parse("VAR x;\nBEGIN x := 1;\nWHILE x > 0 DO WRITE x END.");
+    ASSERT_TRUE(loop_diagnostics);
+    pl0::Diagnostics checked = loop.check();
+    EXPECT_EQ(checked.phase(), pl0::Phase::dataflow);
+    EXPECT_EQ(checked.message(), "line 3: the loop never ends once entered");
+    EXPECT_EQ(checked.warning_count(), 1);
+}
+
+TEST_F(APITest, MovesOwnership) {
+    std::string text = "VAR x; BEGIN READ x; WRITE x END.";
+    pl0::Program program;
+    EXPECT_FALSE(program);
+    EXPECT_TRUE(program.source().empty());
+    {
+        pl0::ParseResult result = pl0::parse(text);
+        program = std::move(result.program);
+        EXPECT_FALSE(result.program);
+    }
+    ASSERT_TRUE(program);
+    pl0::Program moved(std::move(program));
+    EXPECT_EQ(moved.root().left().right().left().name(), "x");
+    EXPECT_EQ(moved.source().data(), text.data());
+    program = std::move(moved);
+    EXPECT_TRUE(program.check());
+}
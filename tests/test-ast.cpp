@@ -4,6 +4,7 @@
 
 extern "C" {
 #include "ast.h"
+#include "ast_emit.h"
 }
 
 class ASTTest : public ::testing::Test {
@@ -30,6 +31,20 @@ protected:
         return result;
     }
 
+    // Helper function to capture machine-readable AST output
+    std::string capture_emitted(Node* node, AstFormat format) {
+        char* buffer = nullptr;
+        size_t size = 0;
+        FILE* memstream = open_memstream(&buffer, &size);
+
+        EXPECT_TRUE(emit_ast(memstream, node, format));
+        fclose(memstream);
+
+        std::string result(buffer, size);
+        free(buffer);
+        return result;
+    }
+
     // Helper to create a simple program AST
     Node* create_sample_program() {
         // Program: CONST x = 42; VAR y; BEGIN y := x END.
@@ -40,28 +55,28 @@ protected:
         Node* const_decl = new_node(NODE_CONST_DECL);
         Node* const_ident = new_ident("x");
         Node* const_value = new_number(42);
-        const_decl->left = const_ident;
-        const_decl->right = const_value;
+        set_node_left(const_decl, const_ident);
+        set_node_right(const_decl, const_value);
         
         // VAR y
         Node* var_decl = new_node(NODE_VAR_DECL);
         Node* var_ident = new_ident("y");
-        var_decl->left = var_ident;
+        set_node_left(var_decl, var_ident);
         
         // BEGIN y := x END
         Node* compound = new_node(NODE_COMPOUND);
         Node* assign = new_node(NODE_ASSIGN);
         Node* y_ident = new_ident("y");
         Node* x_ident = new_ident("x");
-        assign->left = y_ident;
-        assign->right = x_ident;
-        compound->left = assign;
+        set_node_left(assign, y_ident);
+        set_node_right(assign, x_ident);
+        set_node_left(compound, assign);
         
         // Link everything together
-        block->left = const_decl;
-        block->right = var_decl;
-        var_decl->next = compound;
-        program->left = block;
+        set_node_left(block, const_decl);
+        set_node_right(block, var_decl);
+        set_node_next(var_decl, compound);
+        set_node_left(program, block);
         
         return program;
     }
@@ -72,10 +87,10 @@ TEST_F(ASTTest, CreateNode) {
     Node* node = new_node(NODE_PROGRAM);
     ASSERT_NE(node, nullptr);
     EXPECT_EQ(node->type, NODE_PROGRAM);
-    EXPECT_EQ(node->left, nullptr);
-    EXPECT_EQ(node->right, nullptr);
-    EXPECT_EQ(node->next, nullptr);
-    free(node);
+    EXPECT_EQ(node_left(node), nullptr);
+    EXPECT_EQ(node_right(node), nullptr);
+    EXPECT_EQ(node_next(node), nullptr);
+    free_ast(node);
 }
 
 TEST_F(ASTTest, CreateIdentifier) {
@@ -84,13 +99,12 @@ TEST_F(ASTTest, CreateIdentifier) {
     
     ASSERT_NE(node, nullptr);
     EXPECT_EQ(node->type, NODE_IDENT);
-    ASSERT_NE(node->name, nullptr);
-    EXPECT_STREQ(node->name, test_name);
-    EXPECT_EQ(node->left, nullptr);
-    EXPECT_EQ(node->right, nullptr);
+    ASSERT_NE(node_name(node), nullptr);
+    EXPECT_STREQ(node_name(node), test_name);
+    EXPECT_FALSE(node_has_children(node));
+    EXPECT_EQ(node_decl(node), nullptr);
     
-    free(node->name);
-    free(node);
+    free_ast(node);
 }
 
 TEST_F(ASTTest, CreateNumber) {
@@ -99,39 +113,39 @@ TEST_F(ASTTest, CreateNumber) {
     
     ASSERT_NE(node, nullptr);
     EXPECT_EQ(node->type, NODE_NUMBER);
-    EXPECT_EQ(node->value, test_value);
-    EXPECT_EQ(node->left, nullptr);
-    EXPECT_EQ(node->right, nullptr);
+    EXPECT_EQ(node_value(node), test_value);
+    EXPECT_EQ(node_left(node), nullptr);
+    EXPECT_EQ(node_right(node), nullptr);
     
-    free(node);
+    free_ast(node);
 }
 
 // Test operator string conversion
 TEST_F(ASTTest, OperatorToString) {
     Node* node = new_node(NODE_BINARY_OP);
-    node->op = OP_PLUS;
-    EXPECT_EQ(to_string(node->op), "PLUS");
-    node->op = OP_MINUS;
-    EXPECT_EQ(to_string(node->op), "MINUS");
-    node->op = OP_MULT;
-    EXPECT_EQ(to_string(node->op), "MULT");
-    node->op = OP_DIV;
-    EXPECT_EQ(to_string(node->op), "DIV");
-    node->op = OP_ODD;
-    EXPECT_EQ(to_string(node->op), "ODD");
-    node->op = OP_EQ;
-    EXPECT_EQ(to_string(node->op), "EQ");
-    node->op = OP_NEQ;
-    EXPECT_EQ(to_string(node->op), "NEQ");
-    node->op = OP_LT;
-    EXPECT_EQ(to_string(node->op), "LT");
-    node->op = OP_LTE;
-    EXPECT_EQ(to_string(node->op), "LTE");
-    node->op = OP_GT;
-    EXPECT_EQ(to_string(node->op), "GT");
-    node->op = OP_GTE;
-    EXPECT_EQ(to_string(node->op), "GTE");
-    free(node);
+    set_node_op(node, OP_PLUS);
+    EXPECT_STREQ(to_string(node_op(node)), "PLUS");
+    set_node_op(node, OP_MINUS);
+    EXPECT_STREQ(to_string(node_op(node)), "MINUS");
+    set_node_op(node, OP_MULT);
+    EXPECT_STREQ(to_string(node_op(node)), "MULT");
+    set_node_op(node, OP_DIV);
+    EXPECT_STREQ(to_string(node_op(node)), "DIV");
+    set_node_op(node, OP_ODD);
+    EXPECT_STREQ(to_string(node_op(node)), "ODD");
+    set_node_op(node, OP_EQ);
+    EXPECT_STREQ(to_string(node_op(node)), "EQ");
+    set_node_op(node, OP_NEQ);
+    EXPECT_STREQ(to_string(node_op(node)), "NEQ");
+    set_node_op(node, OP_LT);
+    EXPECT_STREQ(to_string(node_op(node)), "LT");
+    set_node_op(node, OP_LTE);
+    EXPECT_STREQ(to_string(node_op(node)), "LTE");
+    set_node_op(node, OP_GT);
+    EXPECT_STREQ(to_string(node_op(node)), "GT");
+    set_node_op(node, OP_GTE);
+    EXPECT_STREQ(to_string(node_op(node)), "GTE");
+    free_ast(node);
 }
 
 // Test complex AST construction and printing
@@ -147,26 +161,26 @@ TEST_F(ASTTest, ComplexASTConstruction) {
     Node* x_ident2 = new_ident("x");
     Node* number_1 = new_number(1);
     
-    condition->left = x_ident;
-    condition->right = number_5;
-    condition->op = OP_GT;
+    set_node_left(condition, x_ident);
+    set_node_right(condition, number_5);
+    set_node_op(condition, OP_GT);
     
-    binary_op->left = x_ident2;
-    binary_op->right = number_1;
-    binary_op->op = OP_PLUS;
+    set_node_left(binary_op, x_ident2);
+    set_node_right(binary_op, number_1);
+    set_node_op(binary_op, OP_PLUS);
     
-    assign->left = y_ident;
-    assign->right = binary_op;
+    set_node_left(assign, y_ident);
+    set_node_right(assign, binary_op);
     
-    if_node->left = condition;
-    if_node->right = assign;
+    set_node_left(if_node, condition);
+    set_node_right(if_node, assign);
     
     // Verify structure
     EXPECT_EQ(if_node->type, NODE_IF);
-    EXPECT_EQ(if_node->left->type, NODE_CONDITION);
-    EXPECT_EQ(if_node->right->type, NODE_ASSIGN);
-    EXPECT_EQ(condition->op, OP_GT);
-    EXPECT_EQ(binary_op->op, OP_PLUS);
+    EXPECT_EQ(node_left(if_node)->type, NODE_CONDITION);
+    EXPECT_EQ(node_right(if_node)->type, NODE_ASSIGN);
+    EXPECT_EQ(node_op(condition), OP_GT);
+    EXPECT_EQ(node_op(binary_op), OP_PLUS);
     
     // Verify output
     std::string output = capture_ast_output(if_node);
@@ -176,18 +190,7 @@ TEST_F(ASTTest, ComplexASTConstruction) {
     EXPECT_NE(output.find("Binary Operation: PLUS"), std::string::npos);
     
     // Cleanup
-    free(x_ident->name);
-    free(x_ident);
-    free(number_5);
-    free(condition);
-    free(y_ident->name);
-    free(y_ident);
-    free(x_ident2->name);
-    free(x_ident2);
-    free(number_1);
-    free(binary_op);
-    free(assign);
-    free(if_node);
+    free_ast(if_node);
 }
 
 // Test full program construction
@@ -196,28 +199,28 @@ TEST_F(ASTTest, FullProgramConstruction) {
     
     // Verify program structure
     EXPECT_EQ(program->type, NODE_PROGRAM);
-    EXPECT_EQ(program->left->type, NODE_BLOCK);
+    EXPECT_EQ(node_left(program)->type, NODE_BLOCK);
     
-    Node* block = program->left;
-    EXPECT_EQ(block->left->type, NODE_CONST_DECL);
-    EXPECT_EQ(block->right->type, NODE_VAR_DECL);
-    EXPECT_EQ(block->right->next->type, NODE_COMPOUND);
+    Node* block = node_left(program);
+    EXPECT_EQ(node_left(block)->type, NODE_CONST_DECL);
+    EXPECT_EQ(node_right(block)->type, NODE_VAR_DECL);
+    EXPECT_EQ(node_next(node_right(block))->type, NODE_COMPOUND);
     
     // Verify constant declaration
-    Node* const_decl = block->left;
-    EXPECT_STREQ(const_decl->left->name, "x");
-    EXPECT_EQ(const_decl->right->value, 42);
+    Node* const_decl = node_left(block);
+    EXPECT_STREQ(node_name(node_left(const_decl)), "x");
+    EXPECT_EQ(node_value(node_right(const_decl)), 42);
     
     // Verify variable declaration
-    Node* var_decl = block->right;
-    EXPECT_STREQ(var_decl->left->name, "y");
+    Node* var_decl = node_right(block);
+    EXPECT_STREQ(node_name(node_left(var_decl)), "y");
     
     // Verify compound statement
-    Node* compound = var_decl->next;
-    Node* assign = compound->left;
+    Node* compound = node_next(var_decl);
+    Node* assign = node_left(compound);
     EXPECT_EQ(assign->type, NODE_ASSIGN);
-    EXPECT_STREQ(assign->left->name, "y");
-    EXPECT_STREQ(assign->right->name, "x");
+    EXPECT_STREQ(node_name(node_left(assign)), "y");
+    EXPECT_STREQ(node_name(node_right(assign)), "x");
     
     // Verify AST printing
     std::string output = capture_ast_output(program);
@@ -229,40 +232,28 @@ TEST_F(ASTTest, FullProgramConstruction) {
     EXPECT_NE(output.find("Assignment"), std::string::npos);
     
     // Cleanup the entire tree
-    free(compound->left->left->name);  // y in assignment
-    free(compound->left->right->name); // x in assignment
-    free(compound->left);              // assignment node
-    free(compound);                    // compound node
-    free(var_decl->left->name);       // y in var declaration
-    free(var_decl->left);             // var ident node
-    free(var_decl);                   // var declaration node
-    free(const_decl->left->name);     // x in const declaration
-    free(const_decl->left);           // const ident node
-    free(const_decl->right);          // const value node
-    free(const_decl);                 // const declaration node
-    free(block);                      // block node
-    free(program);                    // program node
+    free_ast(program);
 }
 
 // Test node list operations
 TEST_F(ASTTest, NodeListOperations) {
     // Create a list of variable declarations
     Node* var1 = new_node(NODE_VAR_DECL);
-    var1->left = new_ident("x");
+    set_node_left(var1, new_ident("x"));
     Node* var2 = new_node(NODE_VAR_DECL);
-    var2->left = new_ident("y");
+    set_node_left(var2, new_ident("y"));
     Node* var3 = new_node(NODE_VAR_DECL);
-    var3->left = new_ident("z");
+    set_node_left(var3, new_ident("z"));
     
-    var1->next = var2;
-    var2->next = var3;
+    set_node_next(var1, var2);
+    set_node_next(var2, var3);
     
     // Test list traversal
     Node* current = var1;
     std::vector<std::string> names;
     while (current) {
-        names.push_back(current->left->name);
-        current = current->next;
+        names.push_back(node_name(node_left(current)));
+        current = node_next(current);
     }
     
     EXPECT_EQ(names.size(), 3);
@@ -271,15 +262,7 @@ TEST_F(ASTTest, NodeListOperations) {
     EXPECT_EQ(names[2], "z");
     
     // Cleanup
-    free(var3->left->name);
-    free(var3->left);
-    free(var3);
-    free(var2->left->name);
-    free(var2->left);
-    free(var2);
-    free(var1->left->name);
-    free(var1->left);
-    free(var1);
+    free_ast(var1);
 }
 
 // Test error handling for empty nodes
@@ -287,3 +270,192 @@ TEST_F(ASTTest, PrintEmptyNode) {
     std::string output = capture_ast_output(nullptr);
     EXPECT_TRUE(output.empty());
 }
+
+// Machine-readable output tests
+TEST_F(ASTTest, EmitJson) {
+    Node* program = create_sample_program();
+    std::string output = capture_emitted(program, AST_FORMAT_JSON);
+    EXPECT_EQ(output,
+        "{\"type\":\"program\",\"left\":[{\"type\":\"block\","
+        "\"left\":[{\"type\":\"const_decl\","
+        "\"left\":[{\"type\":\"ident\",\"name\":\"x\"}],"
+        "\"right\":[{\"type\":\"number\",\"value\":42}]}],"
+        "\"right\":[{\"type\":\"var_decl\","
+        "\"left\":[{\"type\":\"ident\",\"name\":\"y\"}]},"
+        "{\"type\":\"compound\",\"left\":[{\"type\":\"assign\","
+        "\"left\":[{\"type\":\"ident\",\"name\":\"y\"}],"
+        "\"right\":[{\"type\":\"ident\",\"name\":\"x\"}]}]}]}]}\n");
+    free_ast(program);
+}
+
+TEST_F(ASTTest, EmitSexpr) {
+    Node* cond = new_node(NODE_CONDITION);
+    set_node_op(cond, OP_GT);
+    set_node_left(cond, new_ident("x"));
+    set_node_right(cond, new_number(-5));
+    std::string output = capture_emitted(cond, AST_FORMAT_SEXPR);
+    EXPECT_EQ(output, "(condition GT (:left (ident \"x\")) (:right (number -5)))\n");
+    free_ast(cond);
+}
+
+TEST_F(ASTTest, EmitBinaryRoundTrip) {
+    Node* program = create_sample_program();
+    std::string bin = capture_emitted(program, AST_FORMAT_BINARY);
+    ASSERT_EQ(bin.compare(0, 6, AST_BINARY_MAGIC), 0);
+
+    Node* decoded = read_ast_binary(
+        reinterpret_cast<const unsigned char*>(bin.data()), bin.size());
+    ASSERT_NE(decoded, nullptr);
+    EXPECT_EQ(capture_ast_output(decoded), capture_ast_output(program));
+
+    // Truncated input is rejected
+    EXPECT_EQ(read_ast_binary(
+        reinterpret_cast<const unsigned char*>(bin.data()), bin.size() - 1), nullptr);
+
+    // So is a link the node has no room for: a number followed by another
+    std::string list = std::string(AST_BINARY_MAGIC) + char(AST_BINARY_VERSION) +
+                       std::string{ char(NODE_NUMBER), 4, 1, 0, 0, 0,
+                                    char(NODE_NUMBER), 0, 2, 0, 0, 0 };
+    EXPECT_EQ(read_ast_binary(
+        reinterpret_cast<const unsigned char*>(list.data()), list.size()), nullptr);
+
+    free_ast(decoded);
+    free_ast(program);
+}
+
+TEST_F(ASTTest, EmitLongList) {
+    // Lists are walked in place, so their length does not grow the stack
+    Node* head = nullptr;
+    for (int i = 0; i < 100000; i++) {
+        Node* decl = new_node(NODE_VAR_DECL);
+        set_node_left(decl, new_ident("v"));
+        set_node_next(decl, head);
+        head = decl;
+    }
+    Node* block = new_node(NODE_BLOCK);
+    set_node_right(block, head);
+
+    std::string output = capture_emitted(block, AST_FORMAT_SEXPR);
+    EXPECT_EQ(output.compare(0, 24, "(block (:right (var_decl"), 0);
+    EXPECT_EQ(output.substr(output.size() - 4), ")))\n");
+
+    free_ast(block);
+}
+
+TEST_F(ASTTest, FreeAstReleasesListsAndNames) {
+    // A list long enough that freeing it recursively along `next` would
+    // be a problem, hanging off a block with error and procedure nodes
+    Node* block = new_node(NODE_BLOCK);
+    NodeOffset* tail = node_right_link(block);
+    for (int i = 0; i < 100000; i++) {
+        Node* var = new_node(NODE_VAR_DECL);
+        set_node_left(var, new_ident("v"));
+        *tail = node_offset(var);
+        tail = node_next_link(var);
+    }
+    Node* error = new_node(NODE_ERROR);
+    set_node_right(error, new_node(NODE_BLOCK));
+    *tail = node_offset(error);
+
+    Node* proc = new_node(NODE_PROC);
+    set_node_left(proc, new_ident("p"));
+    set_node_right(proc, new_node(NODE_BLOCK));
+    set_node_next(error, proc);
+
+    // decl links are not owned
+    Node* call = new_node(NODE_CALL);
+    set_node_left(call, new_ident("p"));
+    set_node_decl(node_left(call), proc);
+    set_node_next(proc, call);
+
+    free_ast(block);  // leaks or double frees are reported by the sanitizers
+    free_ast(nullptr);
+}
+
+TEST_F(ASTTest, InternedNames) {
+    AstMemStats before;
+    get_ast_mem_stats(&before);
+
+    Node* a = new_ident("counter");
+    Node* b = new_ident("counter");
+    Node* c = new_ident("other");
+    EXPECT_EQ(node_name(a), node_name(b));  // one shared copy
+    EXPECT_NE(node_name(a), node_name(c));
+
+    AstMemStats during;
+    get_ast_mem_stats(&during);
+    EXPECT_EQ(during.nodes, before.nodes + 3);
+    EXPECT_EQ(during.names, before.names + 2);
+    EXPECT_EQ(during.name_refs, before.name_refs + 3);
+    EXPECT_EQ(during.nodes_by_type[NODE_IDENT], before.nodes_by_type[NODE_IDENT] + 3);
+
+    free_ast(a);
+    EXPECT_STREQ(node_name(b), "counter");
+    free_ast(b);
+    free_ast(c);
+
+    AstMemStats after;
+    get_ast_mem_stats(&after);
+    EXPECT_EQ(after.nodes, before.nodes);
+    EXPECT_EQ(after.names, before.names);
+    EXPECT_EQ(after.name_refs, before.name_refs);
+}
+
+TEST_F(ASTTest, SpansAreKeptInTheNode) {
+    bool previous = record_node_spans(true);
+    Node* assign = new_node(NODE_ASSIGN);
+    EXPECT_EQ(node_first_token(assign), -1);
+    set_node_span(assign, 3, 7);
+    EXPECT_EQ(node_first_token(assign), 3);
+    EXPECT_EQ(node_last_token(assign), 7);
+
+    // Conditions and operations get no span, and keep their operator
+    Node* cond = new_node(NODE_CONDITION);
+    set_node_op(cond, OP_GT);
+    set_node_span(cond, 1, 2);
+    EXPECT_EQ(node_first_token(cond), -1);
+    EXPECT_EQ(node_op(cond), OP_GT);
+
+    // A node built in the memory of a freed one does not inherit its span
+    free_ast(assign);
+    Node* reused = new_node(NODE_ASSIGN);
+    EXPECT_EQ(reused, assign);
+    EXPECT_EQ(node_first_token(reused), -1);
+    free_ast(reused);
+
+    record_node_spans(previous);
+    Node* plain = new_node(NODE_ASSIGN);
+    set_node_span(plain, 3, 7);
+    EXPECT_EQ(node_first_token(plain), -1);
+    free_ast(plain);
+    free_ast(cond);
+}
+
+TEST_F(ASTTest, NodePoolReleasesSlabs) {
+    AstMemStats stats;
+    get_ast_mem_stats(&stats);
+    ASSERT_EQ(stats.nodes, 0u);  // no tree is left over from other tests
+
+    Node* program = create_sample_program();
+    get_ast_mem_stats(&stats);
+    EXPECT_EQ(stats.nodes, 11u);
+    // Six statements and declarations, four identifiers and a number
+    EXPECT_EQ(stats.node_bytes, 6 * 24 + 4 * 20 + 8u);
+    EXPECT_EQ(stats.slabs, 1u);
+    EXPECT_EQ(stats.slab_bytes, (size_t)NODE_SLAB_BYTES);
+    Node* block = node_left(program);
+    EXPECT_EQ(node_at(node_offset(block)), block);
+
+    // Freed nodes are reused before another slab is taken
+    Node* number = new_number(1);
+    free_ast(number);
+    Node* reused = new_number(2);
+    EXPECT_EQ(reused, number);
+    free_ast(reused);
+
+    free_ast(program);
+    get_ast_mem_stats(&stats);
+    EXPECT_EQ(stats.nodes, 0u);
+    EXPECT_EQ(stats.slabs, 0u);
+    EXPECT_EQ(stats.slab_bytes, 0u);
+}
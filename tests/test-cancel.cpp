@@ -0,0 +1,244 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pl0.hpp"
+
+extern "C" {
+#include "driver.h"
+extern int yyparse(void);
+extern struct yy_buffer_state* yy_scan_string(const char*);
+extern void yy_delete_buffer(struct yy_buffer_state*);
+extern int yylex_destroy(void);
+extern int yylineno;
+extern int parse_error_count;
+extern Node* ast_root;
+}
+
+class CancelTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char tmpl[] = "/tmp/pl0-cancel-XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+        input = dir + "/input.pl0";
+        output = dir + "/output";
+    }
+
+    void TearDown() override {
+        yylex_destroy();  // as main() does: runs leave the scanner its buffer
+        free_cancel_token(analysis_cancel);
+        analysis_cancel = nullptr;
+        std::string command = "rm -rf " + dir;
+        ASSERT_EQ(system(command.c_str()), 0);
+    }
+
+    // A program of statements assignments, 100 to a procedure
+    static std::string long_program(int statements) {
+        std::string text = "VAR x;\n";
+        for (int p = 0; p < statements / 100; p++) {
+            text += "PROCEDURE p" + std::to_string(p) + ";\nBEGIN\n";
+            for (int i = 0; i < 100; i++) text += i ? ";\nx := x + 1" : "x := x + 1";
+            text += "\nEND;\n";
+        }
+        return text + "CALL p0.\n";
+    }
+
+    // Parse text with the parser given, polling an already cancelled token
+    static int parse_cancelled(ParseFunction parse, const std::string& text) {
+        analysis_cancel = create_cancel_token(0);
+        cancel_analysis(analysis_cancel);
+        struct yy_buffer_state* buffer = yy_scan_string(text.c_str());
+        yylineno = 1;
+        int result = parse();
+        yy_delete_buffer(buffer);
+        parse_error_count = 0;
+        free_cancel_token(analysis_cancel);
+        analysis_cancel = nullptr;
+        return result;
+    }
+
+    static Node* parse_program(const std::string& text) {
+        struct yy_buffer_state* buffer = yy_scan_string(text.c_str());
+        yylineno = 1;
+        EXPECT_EQ(yyparse(), 0);
+        yy_delete_buffer(buffer);
+        Node* root = ast_root;
+        ast_root = nullptr;
+        return root;
+    }
+
+    int run(std::initializer_list<const char*> options) {
+        std::vector<const char*> argv = { "pl0_parser" };
+        argv.insert(argv.end(), options);
+        argv.push_back("-o");
+        argv.push_back(output.c_str());
+        argv.push_back(input.c_str());
+        argv.push_back(nullptr);
+        return run_command((int)argv.size() - 1, const_cast<char**>(argv.data()));
+    }
+
+    std::string dir;
+    std::string input;
+    std::string output;
+};
+
+TEST_F(CancelTest, TokenRecordsTheFirstReason) {
+    EXPECT_FALSE(poll_cancel(nullptr));
+    EXPECT_FALSE(cancel_requested(nullptr));
+    EXPECT_EQ(cancel_reason(nullptr), CANCEL_NONE);
+
+    CancelToken* token = create_cancel_token(0);
+    ASSERT_NE(token, nullptr);
+    for (int i = 0; i < 4 * CANCEL_CLOCK_POLLS; i++) ASSERT_FALSE(poll_cancel(token));
+    cancel_analysis(token);
+    EXPECT_TRUE(poll_cancel(token));
+    EXPECT_EQ(cancel_reason(token), CANCEL_REQUESTED);
+    free_cancel_token(token);
+
+    token = create_cancel_token(1);
+    ASSERT_NE(token, nullptr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    // The clock is read once every CANCEL_CLOCK_POLLS polls
+    EXPECT_FALSE(cancel_requested(token));
+    bool polled = false;
+    for (int i = 0; i < CANCEL_CLOCK_POLLS && !polled; i++) polled = poll_cancel(token);
+    EXPECT_TRUE(polled);
+    EXPECT_TRUE(cancel_requested(token));
+    cancel_analysis(token);
+    EXPECT_EQ(cancel_reason(token), CANCEL_TIMEOUT);
+    free_cancel_token(token);
+}
+
+TEST_F(CancelTest, ParsersGiveUp) {
+    std::string text = long_program(1000);
+    ast_root = nullptr;
+    EXPECT_NE(parse_cancelled(yyparse, text), 0);
+    EXPECT_EQ(ast_root, nullptr);
+    EXPECT_NE(parse_cancelled(descent_parse, text), 0);
+    EXPECT_EQ(ast_root, nullptr);
+
+    // Without a token both parse it
+    Node* root = parse_program(text);
+    ASSERT_NE(root, nullptr);
+    free_ast(root);
+}
+
+TEST_F(CancelTest, LexingGivesUp) {
+    std::string text = long_program(1000);
+    CancelToken* token = create_cancel_token(0);
+    cancel_analysis(token);
+    TokenBuffer* tokens = borrow_token_buffer(text.data(), text.size());
+    ASSERT_NE(tokens, nullptr);
+    char message[64];
+    EXPECT_EQ(lex_tokens_quiet(tokens, token, message, sizeof(message)), -1);
+    EXPECT_EQ(tokens->lex_errors, -1);
+    EXPECT_LT(tokens->count, LEX_POLL_TOKENS);
+    free_token_buffer(tokens);
+
+    analysis_cancel = token;
+    tokens = borrow_token_buffer(text.data(), text.size());
+    EXPECT_EQ(lex_tokens(tokens), -1);
+    EXPECT_EQ(parse_tokens(tokens), 2);
+    free_token_buffer(tokens);
+    analysis_cancel = nullptr;
+
+    // Without a token all of it is lexed
+    tokens = borrow_token_buffer(text.data(), text.size());
+    EXPECT_EQ(lex_tokens_quiet(tokens, nullptr, message, sizeof(message)), 0);
+    EXPECT_GT(tokens->count, LEX_POLL_TOKENS);
+    free_token_buffer(tokens);
+    free_cancel_token(token);
+}
+
+TEST_F(CancelTest, PhasesGiveUp) {
+    Node* root = parse_program(long_program(1000));
+    ASSERT_NE(root, nullptr);
+    CancelToken* token = create_cancel_token(0);
+    cancel_analysis(token);
+
+    TypeContext* types = create_type_context();
+    types->cancel = token;
+    EXPECT_EQ(check_type(types, root), TYPE_ERROR);
+    EXPECT_STREQ(types->error_msg, "Cancelled");
+    free_type_context(types);
+
+    for (int threads : { 0, 2 }) {
+        SemanticContext* semantics = create_semantic_context();
+        semantics->cancel = token;
+        semantics->pool = threads ? create_task_pool(threads) : nullptr;
+        EXPECT_FALSE(analyze_semantics(semantics, root));
+        EXPECT_STREQ(semantics->error_msg, "Cancelled");
+        free_task_pool(semantics->pool);
+        free_semantic_context(semantics);
+    }
+
+    // The data-flow pass needs an analyzed tree
+    SemanticContext* semantics = create_semantic_context();
+    ASSERT_TRUE(analyze_semantics(semantics, root));
+    free_semantic_context(semantics);
+    DataflowContext* dataflow = create_dataflow_context();
+    dataflow->cancel = token;
+    EXPECT_FALSE(analyze_dataflow(dataflow, root));
+    EXPECT_STREQ(dataflow->error_msg, "Cancelled");
+    free_dataflow_context(dataflow);
+
+    free_cancel_token(token);
+    free_ast(root);
+}
+
+TEST_F(CancelTest, TimeoutStopsTheRun) {
+    std::ofstream(input) << long_program(200000);
+    EXPECT_EQ(run({ "--timeout=1" }), EXIT_CANCELLED);
+    EXPECT_EQ(run({ "--timeout=1", "--parser=descent" }), EXIT_CANCELLED);
+    EXPECT_EQ(run({ "--timeout=1", "--prelex", "--jobs=2" }), EXIT_CANCELLED);
+    EXPECT_EQ(run({ "--timeout=1", "--stream" }), EXIT_CANCELLED);
+    EXPECT_EQ(analysis_cancel, nullptr);
+
+    // A budget that is not used up changes nothing
+    std::ofstream(input) << "VAR x; BEGIN x := 1; WRITE x END.";
+    EXPECT_EQ(run({ "--timeout=60000" }), 0);
+    EXPECT_EQ(run({ "--timeout=60000", "--stream" }), 0);
+    std::ofstream(input) << "VAR x; y := 1.";
+    EXPECT_EQ(run({ "--timeout=60000" }), 1);
+
+    EXPECT_EQ(run({ "--timeout=" }), 1);
+    EXPECT_EQ(run({ "--timeout=-5" }), 1);
+    EXPECT_EQ(run({ "--timeout=99999999999999999999" }), 1);
+}
+
+TEST_F(CancelTest, BudgetStopsTheAPI) {
+    std::string text = long_program(1000);
+    {
+        pl0::Budget budget;
+        budget.cancel();
+        auto [program, diagnostics] = pl0::parse(text, &budget);
+        EXPECT_EQ(diagnostics.phase(), pl0::Phase::cancelled);
+        EXPECT_EQ(diagnostics.message(), "cancelled");
+        EXPECT_FALSE(program);
+    }
+    {
+        pl0::Budget budget(std::chrono::milliseconds(60000));
+        auto [program, diagnostics] = pl0::parse(text, &budget);
+        ASSERT_TRUE(diagnostics);
+        EXPECT_TRUE(program.check(&budget));
+        budget.cancel();
+        pl0::Diagnostics checked = program.check(&budget);
+        EXPECT_EQ(checked.phase(), pl0::Phase::cancelled);
+        EXPECT_EQ(checked.warning_count(), 0);
+        EXPECT_EQ(budget.reason(), CANCEL_REQUESTED);
+    }
+    {
+        pl0::Budget budget(std::chrono::milliseconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        auto [program, diagnostics] = pl0::parse(text, &budget);
+        EXPECT_EQ(diagnostics.phase(), pl0::Phase::cancelled);
+        EXPECT_EQ(diagnostics.message(), "time budget used up");
+    }
+    EXPECT_EQ(ast_root, nullptr);
+    EXPECT_EQ(parse_error_count, 0);
+}
@@ -0,0 +1,251 @@
+#include <gtest/gtest.h>
+#include <string>
+
+extern "C" {
+#include "ast.h"
+#include "semantic.h"
+#include "dataflow.h"
+extern int yyparse(void);
+extern struct yy_buffer_state* yy_scan_string(const char*);
+extern void yy_delete_buffer(struct yy_buffer_state*);
+extern int yylineno;
+extern Node* ast_root;
+}
+
+class DataflowTest : public ::testing::Test {
+protected:
+    void TearDown() override {
+        free_ast(ast_root);
+        ast_root = nullptr;
+    }
+
+    // Parse and analyze a program, returning its data-flow warnings
+    std::string warnings(const std::string& program) {
+        free_ast(ast_root);
+        struct yy_buffer_state* buffer = yy_scan_string(program.c_str());
+        yylineno = 1;
+        EXPECT_EQ(yyparse(), 0);
+        yy_delete_buffer(buffer);
+
+        SemanticContext* sem_ctx = create_semantic_context();
+        bool analyzed = analyze_semantics(sem_ctx, ast_root);
+        EXPECT_TRUE(analyzed) << sem_ctx->error_msg;
+        free_semantic_context(sem_ctx);
+        if (!analyzed) return "";
+
+        DataflowContext* ctx = create_dataflow_context();
+        ctx->overflow = overflow;
+        EXPECT_TRUE(analyze_dataflow(ctx, ast_root)) << ctx->error_msg;
+        char* text = nullptr;
+        size_t size = 0;
+        FILE* out = open_memstream(&text, &size);
+        print_dataflow_warnings(ctx, out);
+        fclose(out);
+        errors = ctx->error_count;
+        free_dataflow_context(ctx);
+
+        std::string result(text, size);
+        free(text);
+        return result;
+    }
+
+    int errors = 0;
+    OverflowMode overflow = OVERFLOW_WRAP;
+};
+
+TEST_F(DataflowTest, CleanProgram) {
+    EXPECT_EQ(warnings("VAR n, f;\n"
+                       "BEGIN\n"
+                       "  READ n; f := 1;\n"
+                       "  WHILE n > 1 DO BEGIN f := f * n; n := n - 1 END;\n"
+                       "  WRITE f\n"
+                       "END."), "");
+}
+
+TEST_F(DataflowTest, UseBeforeAssignment) {
+    EXPECT_EQ(warnings("VAR x, y;\n"
+                       "BEGIN\n"
+                       "  y := x + 1;\n"
+                       "  WRITE y;\n"
+                       "  WRITE x\n"
+                       "END."),
+              "Warning line 3: Variable 'x' may be used before it is assigned\n");
+}
+
+TEST_F(DataflowTest, AssignmentOnOnePathOnly) {
+    EXPECT_EQ(warnings("VAR c, x;\n"
+                       "BEGIN\n"
+                       "  READ c;\n"
+                       "  IF c > 0 THEN x := 1;\n"
+                       "  WRITE x\n"
+                       "END."),
+              "Warning line 5: Variable 'x' may be used before it is assigned\n");
+
+    EXPECT_EQ(warnings("VAR c, x;\n"
+                       "BEGIN\n"
+                       "  READ c;\n"
+                       "  WHILE c > 0 DO BEGIN WRITE x; x := c; c := c - 1 END\n"
+                       "END."),
+              "Warning line 4: Variable 'x' may be used before it is assigned\n");
+}
+
+TEST_F(DataflowTest, DeadStores) {
+    EXPECT_EQ(warnings("VAR x;\n"
+                       "BEGIN\n"
+                       "  x := 1;\n"
+                       "  x := 2;\n"
+                       "  WRITE x;\n"
+                       "  x := 3\n"
+                       "END."),
+              "Warning line 3: Value assigned to 'x' is never used\n"
+              "Warning line 6: Value assigned to 'x' is never used\n");
+}
+
+TEST_F(DataflowTest, StoresReadOnSomePathAreLive) {
+    EXPECT_EQ(warnings("VAR i, a;\n"
+                       "BEGIN\n"
+                       "  a := 5; i := 2;\n"
+                       "  WHILE i < a DO BEGIN\n"
+                       "    IF i = 3 THEN i := a;\n"
+                       "    i := i + 1\n"
+                       "  END\n"
+                       "END."), "");
+}
+
+TEST_F(DataflowTest, CallsUseProcedureSummaries) {
+    // init assigns x on every path; show reads y, which nobody assigned
+    EXPECT_EQ(warnings("VAR x, y;\n"
+                       "PROCEDURE init; x := 42;\n"
+                       "PROCEDURE show; WRITE x + y;\n"
+                       "BEGIN\n"
+                       "  CALL init;\n"
+                       "  CALL show\n"
+                       "END."),
+              "Warning line 6: Variable 'y' may be used before it is assigned "
+              "(read by procedure 'show')\n");
+}
+
+TEST_F(DataflowTest, NestedProcedureKeepsLocalsLive) {
+    EXPECT_EQ(warnings("VAR r;\n"
+                       "PROCEDURE outer;\n"
+                       "  VAR t;\n"
+                       "  PROCEDURE inner; r := t * 2;\n"
+                       "  BEGIN t := 21; CALL inner END;\n"
+                       "BEGIN CALL outer; WRITE r END."), "");
+}
+
+TEST_F(DataflowTest, RecursiveProcedures) {
+    // The summary of fib is used inside fib itself, so it takes more than
+    // one pass; r is not assigned on the path where both IFs are skipped
+    EXPECT_EQ(warnings("VAR n, r;\n"
+                       "PROCEDURE fib;\n"
+                       "  VAR a;\n"
+                       "  BEGIN\n"
+                       "    IF n < 2 THEN r := n;\n"
+                       "    IF n >= 2 THEN BEGIN\n"
+                       "      n := n - 1; CALL fib; a := r;\n"
+                       "      n := n - 1; CALL fib; r := a + r;\n"
+                       "      n := n + 2\n"
+                       "    END\n"
+                       "  END;\n"
+                       "BEGIN n := 10; CALL fib; WRITE r END."),
+              "Warning line 12: Variable 'r' may be used before it is assigned "
+              "(read by procedure 'fib')\n");
+}
+
+TEST_F(DataflowTest, ManyVariables) {
+    // More variables than fit in one chunk of the bit-vector sets
+    const int count = 2100;
+    std::string program = "VAR v0";
+    for (int i = 1; i < count; i++) program += ", v" + std::to_string(i);
+    program += ";\nBEGIN\n";
+    for (int i = 0; i < count; i++) {
+        if (i != 2050) program += "v" + std::to_string(i) + " := " + std::to_string(i) + ";\n";
+    }
+    for (int i = 0; i < count - 1; i++) program += "WRITE v" + std::to_string(i) + ";\n";
+    program += "v0 := 1\nEND.";
+
+    EXPECT_EQ(warnings(program),
+              "Warning line " + std::to_string(count + 1) +
+              ": Value assigned to 'v2099' is never used\n"
+              "Warning line " + std::to_string(count + 2 + 2050) +
+              ": Variable 'v2050' may be used before it is assigned\n"
+              "Warning line " + std::to_string(2 * count + 1) +
+              ": Value assigned to 'v0' is never used\n");
+}
+
+TEST_F(DataflowTest, EndlessLoops) {
+    EXPECT_EQ(warnings("VAR i, n;\n"
+                       "BEGIN\n"
+                       "  READ n; i := 0;\n"
+                       "  WHILE i < n DO n := n + 0;\n"
+                       "  WHILE i < 10 DO WRITE i\n"
+                       "END."),
+              "Loop Error line 5: The loop never ends once entered, "
+              "'i' in its condition is not assigned in the loop\n");
+    EXPECT_EQ(errors, 1);
+
+    EXPECT_EQ(warnings("CONST yes = 1;\n"
+                       "VAR i;\n"
+                       "BEGIN\n"
+                       "  i := 0;\n"
+                       "  WHILE yes = 1 DO i := i + 1;\n"
+                       "  WRITE i\n"
+                       "END."),
+              "Loop Error line 5: Condition is always true, the loop never ends\n"
+              "Warning line 6: Statement is never executed\n");
+    EXPECT_EQ(errors, 1);
+}
+
+TEST_F(DataflowTest, LoopConditionAssignedByCalledProcedure) {
+    // step assigns i only through the nested call to next
+    EXPECT_EQ(warnings("VAR i;\n"
+                       "PROCEDURE next; i := i + 1;\n"
+                       "PROCEDURE step; CALL next;\n"
+                       "BEGIN\n"
+                       "  i := 0;\n"
+                       "  WHILE i < 10 DO CALL step;\n"
+                       "  WHILE i > 0 DO READ i\n"
+                       "END."), "");
+    EXPECT_EQ(errors, 0);
+}
+
+TEST_F(DataflowTest, ConstantConditionsAndUnreachableCode) {
+    EXPECT_EQ(warnings("CONST debug = 0;\n"
+                       "VAR x;\n"
+                       "BEGIN\n"
+                       "  x := 1;\n"
+                       "  IF debug = 1 THEN WRITE 0;\n"
+                       "  IF 2 > 1 THEN WRITE x;\n"
+                       "  WHILE debug # 0 DO\n"
+                       "    WRITE x\n"
+                       "END."),
+              "Warning line 5: Statement is never executed\n"
+              "Warning line 6: Condition is always true\n"
+              "Warning line 8: Statement is never executed\n");
+    EXPECT_EQ(errors, 0);
+}
+
+TEST_F(DataflowTest, ConstantConditionsFollowTheOverflowMode) {
+    std::string program = "VAR x;\n"
+                          "BEGIN\n"
+                          "  x := 0;\n"
+                          "  WHILE 2147483647 + 1 < 0 DO x := x + 1;\n"
+                          "  IF 0 - 2147483647 - 2 > 0 THEN WRITE x\n"
+                          "END.";
+    EXPECT_EQ(warnings(program),
+              "Loop Error line 4: Condition is always true, the loop never ends\n"
+              "Warning line 5: Statement is never executed\n");
+    EXPECT_EQ(errors, 1);
+
+    overflow = OVERFLOW_SATURATE;
+    EXPECT_EQ(warnings(program),
+              "Warning line 4: Statement is never executed\n"
+              "Warning line 5: Statement is never executed\n");
+    EXPECT_EQ(errors, 0);
+
+    // The conditions stop the program when they run, so they are not constant
+    overflow = OVERFLOW_TRAP;
+    EXPECT_EQ(warnings(program), "");
+    EXPECT_EQ(errors, 0);
+}
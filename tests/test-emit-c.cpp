@@ -0,0 +1,184 @@
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <sys/wait.h>
+
+extern "C" {
+#include "ast.h"
+#include "driver.h"
+#include "emit_c.h"
+#include "interp.h"
+#include "semantic.h"
+extern int yyparse(void);
+extern struct yy_buffer_state* yy_scan_string(const char*);
+extern void yy_delete_buffer(struct yy_buffer_state*);
+extern int yylineno;
+extern Node* ast_root;
+}
+
+#ifndef PL0_EXAMPLES_DIR
+#define PL0_EXAMPLES_DIR "examples"
+#endif
+
+// A program run: what it wrote, its exit status and the runtime error
+struct ProgramRun {
+    std::string output;
+    int status;
+    std::string error;
+};
+
+// Programs translated with emit_c() and compiled with the system's cc
+// behave like the interpreter
+class EmitCTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        if (system("cc --version > /dev/null 2>&1") != 0) GTEST_SKIP() << "no C compiler";
+        char tmpl[] = "/tmp/pl0-emit-c-XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+    }
+
+    void TearDown() override {
+        free_ast(ast_root);
+        ast_root = nullptr;
+        if (dir.empty()) return;
+        std::string command = "rm -rf " + dir;
+        ASSERT_EQ(system(command.c_str()), 0);
+    }
+
+    // Parse and analyze a program into ast_root
+    bool analyze(const std::string& program) {
+        free_ast(ast_root);
+        ast_root = nullptr;
+        struct yy_buffer_state* scan_buffer = yy_scan_string(program.c_str());
+        yylineno = 1;
+        int parsed = yyparse();
+        yy_delete_buffer(scan_buffer);
+        if (parsed != 0) return false;
+        SemanticContext* sem_ctx = create_semantic_context();
+        bool analyzed = analyze_semantics(sem_ctx, ast_root);
+        free_semantic_context(sem_ctx);
+        return analyzed;
+    }
+
+    ProgramRun interpret(const std::string& input, OverflowMode overflow) {
+        char* buffer = nullptr;
+        size_t size = 0;
+        FILE* out = open_memstream(&buffer, &size);
+        std::string data = input + "\n";
+        FILE* in = fmemopen(&data[0], data.size(), "r");
+        InterpContext* ctx = create_interp_context(in, out);
+        ctx->overflow = overflow;
+        bool success = ::interpret(ctx, ast_root);
+        ProgramRun run = { "", 0, success ? "" : std::string("Runtime Error: ") + ctx->error_msg + "\n" };
+        run.status = ctx->status == EXEC_OK ? 0 : ctx->status == EXEC_DEPTH_LIMIT ? EXIT_DEPTH_LIMIT : 1;
+        free_interp_context(ctx);
+        fclose(in);
+        fclose(out);
+        run.output.assign(buffer, size);
+        free(buffer);
+        return run;
+    }
+
+    std::string read_file(const std::string& path) {
+        std::ifstream in(path);
+        std::stringstream text;
+        text << in.rdbuf();
+        return text.str();
+    }
+
+    ProgramRun compile_and_run(const std::string& input, OverflowMode overflow) {
+        std::string source = dir + "/program.c";
+        FILE* out = fopen(source.c_str(), "w");
+        EXPECT_TRUE(emit_c(out, ast_root, overflow));
+        fclose(out);
+        std::string compile = "cc -O2 -o " + dir + "/program " + source;
+        EXPECT_EQ(system(compile.c_str()), 0) << read_file(source);
+
+        std::ofstream(dir + "/input") << input;
+        std::string command = dir + "/program < " + dir + "/input > " + dir + "/output 2> " +
+                              dir + "/error";
+        int status = system(command.c_str());
+        return { read_file(dir + "/output"), WIFEXITED(status) ? WEXITSTATUS(status) : -1,
+                 read_file(dir + "/error") };
+    }
+
+    void expect_same(const std::string& program, const std::string& input = "",
+                     OverflowMode overflow = OVERFLOW_WRAP) {
+        ASSERT_TRUE(analyze(program));
+        ProgramRun expected = interpret(input, overflow);
+        ProgramRun native = compile_and_run(input, overflow);
+        EXPECT_EQ(native.output, expected.output) << program;
+        EXPECT_EQ(native.status, expected.status) << program;
+        EXPECT_EQ(native.error, expected.error) << program;
+    }
+
+    std::string dir;
+};
+
+TEST_F(EmitCTest, Examples) {
+    DIR* examples = opendir(PL0_EXAMPLES_DIR);
+    ASSERT_NE(examples, nullptr) << PL0_EXAMPLES_DIR;
+    std::vector<std::string> names;
+    while (struct dirent* entry = readdir(examples)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".pl0") == 0) names.push_back(name);
+    }
+    closedir(examples);
+    ASSERT_FALSE(names.empty());
+
+    int compiled = 0;
+    for (const std::string& name : names) {
+        std::string program = read_file(std::string(PL0_EXAMPLES_DIR) + "/" + name);
+        if (!analyze(program)) continue;  // the examples of errors
+        SCOPED_TRACE(name);
+        expect_same(program, "5 7 3\n");
+        compiled++;
+    }
+    EXPECT_GT(compiled, 0);
+}
+
+// Variables of enclosing procedures are reached through static links,
+// also from recursive activations
+TEST_F(EmitCTest, NestedProcedures) {
+    expect_same("VAR n, r;"
+                "PROCEDURE outer;"
+                "  VAR a;"
+                "  PROCEDURE inner;"
+                "    VAR b;"
+                "    PROCEDURE add; r := r + b;"
+                "  BEGIN b := a * 2; a := a - 1; CALL add; IF a > 0 THEN CALL inner END;"
+                "BEGIN a := n; CALL inner; WRITE a END;"
+                "BEGIN READ n; CALL outer; WRITE r; CALL outer; WRITE r END.",
+                "10\n");
+}
+
+TEST_F(EmitCTest, ArithmeticAndConditions) {
+    expect_same("CONST k = 7; VAR x, y;"
+                "BEGIN x := -k * 3 + 100 / 9; y := x - (-x); WRITE x; WRITE y; WRITE -7 / 2;"
+                "  IF ODD x THEN WRITE 1; IF ODD y THEN WRITE 2;"
+                "  IF x # y THEN WRITE 3; IF x <= y THEN WRITE 4; IF x >= y THEN WRITE 5;"
+                "  WHILE x < 0 DO x := x + 5; WRITE x END.");
+}
+
+TEST_F(EmitCTest, OverflowModes) {
+    const char* program = "VAR x, y; BEGIN x := 2147483647; WRITE x + 1; WRITE -x - 2;"
+                          "  y := -x - 1; WRITE y * 2; WRITE y / (-1); WRITE x * x END.";
+    expect_same(program, "", OVERFLOW_WRAP);
+    expect_same(program, "", OVERFLOW_SATURATE);
+    expect_same(program, "", OVERFLOW_TRAP);
+}
+
+TEST_F(EmitCTest, RuntimeErrors) {
+    const char* divide = "VAR x; BEGIN READ x; WRITE 1; WRITE 10 / x END.";
+    expect_same(divide, "0\n");
+    expect_same(divide, "abc\n");
+    expect_same(divide, "99999999999\n");
+    expect_same(divide, "");
+    expect_same(divide, "-2147483648\n");
+    expect_same("PROCEDURE p; CALL p; CALL p.");
+}
@@ -0,0 +1,298 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "ast.h"
+#include "ast_emit.h"
+#include "cst.h"
+#include "descent.h"
+#include "format.h"
+#include "parser.tab.h"
+extern Node* ast_root;
+extern int parse_error_count;
+}
+
+class FormatTest : public ::testing::Test {
+protected:
+    void TearDown() override {
+        free_ast(ast_root);
+        ast_root = nullptr;
+        free_token_buffer(tokens);
+    }
+
+    void parse(const std::string& source) {
+        free_ast(ast_root);
+        free_token_buffer(tokens);
+        tokens = create_token_buffer(source.data(), source.size());
+        ASSERT_NE(tokens, nullptr);
+        ASSERT_EQ(parse_tokens(tokens), 0);
+        ASSERT_EQ(parse_error_count, 0);
+    }
+
+    std::string format(const std::string& source) {
+        parse(source);
+        char* text = nullptr;
+        size_t size = 0;
+        FILE* out = open_memstream(&text, &size);
+        EXPECT_TRUE(format_program(tokens, ast_root, out));
+        fclose(out);
+        std::string result(text, size);
+        free(text);
+        return result;
+    }
+
+    std::string sexpr() {
+        char* text = nullptr;
+        size_t size = 0;
+        FILE* out = open_memstream(&text, &size);
+        EXPECT_TRUE(emit_ast(out, ast_root, AST_FORMAT_SEXPR));
+        fclose(out);
+        std::string result(text, size);
+        free(text);
+        return result;
+    }
+
+    std::string token_text(int index) {
+        return std::string(tokens->source + tokens->tokens[index].offset,
+                           token_length(tokens, index));
+    }
+
+    std::string trivia(size_t (*get)(const TokenBuffer*, int, size_t*), int index) {
+        size_t start;
+        size_t length = get(tokens, index, &start);
+        return std::string(tokens->source + start, length);
+    }
+
+    TokenBuffer* tokens = nullptr;
+};
+
+TEST_F(FormatTest, TokensAndTriviaCoverSource) {
+    std::string source = "  VAR x;  \n\n BEGIN\tx := 1  END .\n\n";
+    parse(source);
+    ASSERT_EQ(tokens->count, 10);  // 9 tokens and the end of input
+    EXPECT_EQ(token_kind(&tokens->tokens[0]), TOK_VAR);
+    EXPECT_EQ(token_kind(&tokens->tokens[9]), 0);
+    EXPECT_EQ(token_text(4), "x");
+    EXPECT_EQ(token_line(tokens, 4), 3);
+
+    EXPECT_EQ(trivia(token_leading_trivia, 0), "  ");
+    EXPECT_EQ(trivia(token_trailing_trivia, 2), "  \n");   // after ';'
+    EXPECT_EQ(trivia(token_leading_trivia, 3), "\n ");    // before BEGIN
+    EXPECT_EQ(trivia(token_trailing_trivia, 3), "\t");
+    EXPECT_EQ(trivia(token_trailing_trivia, 8), "\n");    // after '.'
+    EXPECT_EQ(trivia(token_leading_trivia, 9), "\n");
+
+    char* text = nullptr;
+    size_t size = 0;
+    FILE* out = open_memstream(&text, &size);
+    EXPECT_TRUE(write_tokens(tokens, 0, tokens->count - 1, out));
+    fclose(out);
+    EXPECT_EQ(std::string(text, size), source);
+    free(text);
+}
+
+TEST_F(FormatTest, NodesPointToTheirTokens) {
+    parse("VAR x;\nBEGIN\n  x := (x + 1) * 2;\n  WRITE x\nEND.");
+    Node* assign = node_left(find_block_statement(node_left(ast_root)));
+    ASSERT_EQ(assign->type, NODE_ASSIGN);
+    EXPECT_EQ(token_text(node_first_token(assign)), "x");
+    EXPECT_EQ(token_text(node_last_token(assign)), "2");
+    EXPECT_EQ(token_text(node_first_token(node_left(assign))), "x");
+    const Node* write = node_next(assign);
+    EXPECT_EQ(node_last_token(write) - node_first_token(write), 1);
+    // Expressions below the statement have no span of their own
+    EXPECT_EQ(node_first_token(node_right(assign)), -1);
+}
+
+TEST_F(FormatTest, RewriteWithoutReparsing) {
+    // Rename x to total by replacing the tokens of its identifier nodes
+    parse("VAR x, y;\nBEGIN x := y; WRITE x END.");
+    std::string result;
+    size_t copied = 0;
+    const Node* stmts = node_left(find_block_statement(node_left(ast_root)));
+    const Node* idents[] = { node_left(node_right(node_left(ast_root))), node_left(stmts),
+                             node_left(node_next(stmts)) };
+    for (const Node* ident : idents) {
+        int index = node_first_token(ident);
+        size_t offset = tokens->tokens[index].offset;
+        result.append(tokens->source + copied, offset - copied);
+        result += "total";
+        copied = offset + token_length(tokens, index);
+    }
+    result.append(tokens->source + copied, tokens->source_size - copied);
+    EXPECT_EQ(result, "VAR total, y;\nBEGIN total := y; WRITE total END.");
+}
+
+TEST_F(FormatTest, CompactTokenArray) {
+    EXPECT_LE(sizeof(Token), 12u);
+    parse("VAR x, y;\nBEGIN x := 42; y := x + y END.");
+    ASSERT_EQ(tokens->name_count, 2);  // x and y, however often they occur
+    const Token& number = tokens->tokens[8];
+    EXPECT_EQ(token_kind(&number), TOK_NUM);
+    EXPECT_EQ(number.value, 42);
+    const Token& ident = tokens->tokens[10];
+    EXPECT_EQ(token_kind(&ident), TOK_IDENT);
+    EXPECT_STREQ(tokens->names[ident.value], "y");
+    EXPECT_EQ(token_text(7), ":=");
+    EXPECT_EQ(token_line(tokens, 7), 2);
+}
+
+TEST_F(FormatTest, ReparseWithoutLexing) {
+    parse("CONST n = 3;\nVAR i;\nBEGIN i := 0; WHILE i < n DO i := i + 1 END.");
+    std::string tree = sexpr();
+    int count = tokens->count;
+    for (ParseFunction parse : {yyparse, descent_parse}) {
+        free_ast(ast_root);
+        ast_root = nullptr;
+        ASSERT_EQ(parse_tokens_with(tokens, parse), 0);
+        EXPECT_EQ(parse_error_count, 0);
+        EXPECT_EQ(tokens->count, count);
+        EXPECT_EQ(sexpr(), tree);
+    }
+}
+
+TEST_F(FormatTest, LexicalErrorsCountOnEveryParse) {
+    tokens = create_token_buffer("VAR x; BEGIN x := 1 $ END.", 26);
+    ASSERT_EQ(lex_tokens(tokens), 1);
+    for (int i = 0; i < 2; i++) {
+        free_ast(ast_root);
+        EXPECT_EQ(parse_tokens(tokens), 0);
+        EXPECT_EQ(parse_error_count, 1);
+    }
+}
+
+TEST_F(FormatTest, BorrowedSourceIsLexedWhereItIs) {
+    // Longer than the scanner's buffer, and followed by text that is not
+    // part of it
+    std::string text;
+    while (text.size() < 40000) text += "x := 12345 ;\n";
+    int statements = (int)text.size() / 13;
+    text += "y";
+    size_t size = text.size();
+    text += "z := 1";
+    tokens = borrow_token_buffer(text.data(), size);
+    ASSERT_NE(tokens, nullptr);
+    ASSERT_EQ(lex_tokens(tokens), 0);
+    ASSERT_EQ(tokens->count, 4 * statements + 2);
+    for (int i = 0; i < statements; i++) {
+        EXPECT_EQ(tokens->tokens[4 * i].offset, 13u * i);
+        EXPECT_EQ(token_text(4 * i + 2), "12345");
+        EXPECT_EQ(tokens->tokens[4 * i + 2].value, 12345);
+        EXPECT_EQ(tokens->tokens[4 * i + 3].offset, 13u * i + 11);
+    }
+    EXPECT_EQ(token_text(4 * statements), "y");
+    EXPECT_EQ(tokens->tokens[4 * statements + 1].offset, size);
+}
+
+TEST_F(FormatTest, CommentsAreSkippedWhenLexing) {
+    std::string source = "{ one\n two }x(* three\n * ) (* *)1{}(**)(x)(";
+    tokens = create_token_buffer(source.data(), source.size());
+    ASSERT_NE(tokens, nullptr);
+    ASSERT_EQ(lex_tokens(tokens), 0);
+    std::vector<std::string> texts = { "x", "1", "(", "x", ")", "(" };
+    std::vector<int> lines = { 2, 3, 3, 3, 3, 3 };
+    ASSERT_EQ(tokens->count, (int)texts.size() + 1);
+    for (size_t i = 0; i < texts.size(); i++) {
+        EXPECT_EQ(token_text((int)i), texts[i]) << i;
+        EXPECT_EQ(token_line(tokens, (int)i), lines[i]) << i;
+    }
+    EXPECT_EQ(tokens->tokens[texts.size()].offset, source.size());
+    free_token_buffer(tokens);
+
+    // "(*)" opens a comment without closing it
+    source = "x (*) y\n\n";
+    tokens = create_token_buffer(source.data(), source.size());
+    char message[64];
+    EXPECT_EQ(lex_tokens_quiet(tokens, nullptr, message, sizeof(message)), 1);
+    EXPECT_STREQ(message, "line 3: Unterminated comment");
+    ASSERT_EQ(tokens->count, 2);
+    EXPECT_EQ(token_text(0), "x");
+}
+
+TEST_F(FormatTest, IndentationAndSpacing) {
+    EXPECT_EQ(format("CONST  max=100;\n"
+                     "VAR x,y ;\n"
+                     "PROCEDURE p;\n"
+                     "  VAR z;\n"
+                     "    PROCEDURE q; z:=-(x+y)*2;\n"
+                     "  BEGIN\n"
+                     "CALL q;IF z>0 THEN\n"
+                     "  BEGIN\n"
+                     "          WRITE z\n"
+                     "    END\n"
+                     "  END;\n"
+                     "BEGIN\n"
+                     "  x := max;  WHILE x # 0 DO\n"
+                     "x:=x-1\n"
+                     "END ."),
+              "CONST max = 100;\n"
+              "VAR x, y;\n"
+              "PROCEDURE p;\n"
+              "VAR z;\n"
+              "   PROCEDURE q; z := -(x + y) * 2;\n"
+              "BEGIN\n"
+              "   CALL q; IF z > 0 THEN\n"
+              "   BEGIN\n"
+              "      WRITE z\n"
+              "   END\n"
+              "END;\n"
+              "BEGIN\n"
+              "   x := max; WHILE x # 0 DO\n"
+              "      x := x - 1\n"
+              "END.\n");
+}
+
+TEST_F(FormatTest, KeepsOneBlankLine) {
+    EXPECT_EQ(format("\n\nVAR x;\n\n\n\nBEGIN\n  x := 1;\n\n\n  WRITE x\nEND.\n\n\n"),
+              "VAR x;\n\nBEGIN\n   x := 1;\n\n   WRITE x\nEND.\n");
+}
+
+TEST_F(FormatTest, KeepsComments) {
+    EXPECT_EQ(format("{ header }\n"
+                     "VAR x;  (* counter *)\n"
+                     "BEGIN\n"
+                     "x:=1 {one};\n"
+                     "     { before write\n"
+                     "  spans lines }\n"
+                     "WRITE x\n"
+                     "END. { trailer }"),
+              "{ header }\n"
+              "VAR x; (* counter *)\n"
+              "BEGIN\n"
+              "   x := 1 {one};\n"
+              "   { before write\n"
+              "  spans lines }\n"
+              "   WRITE x\n"
+              "END. { trailer }\n");
+}
+
+TEST_F(FormatTest, CommentsStayInTrailingTrivia) {
+    parse("VAR x; { a\n b } (* c *)\nBEGIN x := 1 END.");
+    // VAR x ; | BEGIN
+    EXPECT_EQ(trivia(token_trailing_trivia, 2), " { a\n b } (* c *)\n");
+    EXPECT_EQ(trivia(token_leading_trivia, 3), "");
+    EXPECT_EQ(comment_length("(* x *) y", 9), 7u);
+    EXPECT_EQ(comment_length("(*)", 3), 3u);  // unterminated
+    EXPECT_EQ(comment_length("x", 1), 0u);
+}
+
+TEST_F(FormatTest, FormattedSourceIsUnchanged) {
+    std::string source = "VAR n, f;\n"
+                         "\n"
+                         "{ n! by recursion }\n"
+                         "PROCEDURE fact;\n"
+                         "BEGIN\n"
+                         "   IF n > 1 THEN\n"
+                         "   BEGIN\n"
+                         "      f := n * f;\n"
+                         "      n := n - 1;\n"
+                         "      CALL fact\n"
+                         "   END\n"
+                         "END;\n"
+                         "\n"
+                         "BEGIN\n"
+                         "   READ n; f := 1; CALL fact; WRITE f\n"
+                         "END.\n";
+    EXPECT_EQ(format(source), source);
+}
@@ -0,0 +1,350 @@
+#include <gtest/gtest.h>
+#include <string>
+
+extern "C" {
+#include "ast.h"
+#include "semantic.h"
+#include "interp.h"
+extern int yyparse(void);
+extern struct yy_buffer_state* yy_scan_string(const char*);
+extern void yy_delete_buffer(struct yy_buffer_state*);
+extern int yylineno;
+extern Node* ast_root;
+}
+
+class InterpreterTest : public ::testing::Test {
+protected:
+    // Parse, analyze and run a program, returning what it wrote
+    std::string run(const std::string& program, const std::string& input = "") {
+        free_ast(ast_root);
+        struct yy_buffer_state* scan_buffer = yy_scan_string(program.c_str());
+        yylineno = 1;
+        EXPECT_EQ(yyparse(), 0);
+        yy_delete_buffer(scan_buffer);
+
+        SemanticContext* sem_ctx = create_semantic_context();
+        bool analyzed = analyze_semantics(sem_ctx, ast_root);
+        EXPECT_TRUE(analyzed) << sem_ctx->error_msg;
+        free_semantic_context(sem_ctx);
+        if (!analyzed) return "";
+
+        char* buffer = nullptr;
+        size_t size = 0;
+        FILE* out = open_memstream(&buffer, &size);
+        std::string data = input + "\n";
+        FILE* in = fmemopen(&data[0], data.size(), "r");
+
+        InterpContext* ctx = create_interp_context(in, out);
+        if (profiling) ctx->profile = profile = create_profile(ast_root);
+        set_interp_limits(ctx, max_steps, max_depth);
+        ctx->overflow = overflow;
+        success = interpret(ctx, ast_root);
+        error = ctx->error_msg;
+        status = ctx->status;
+        steps = interp_steps(ctx);
+        peak_depth = ctx->peak_depth;
+        free_interp_context(ctx);
+
+        fclose(in);
+        fclose(out);
+        std::string result(buffer, size);
+        free(buffer);
+        return result;
+    }
+
+    void TearDown() override {
+        free_profile(profile);
+        free_ast(ast_root);
+        ast_root = nullptr;
+    }
+
+    bool profiling = false;
+    Profile* profile = nullptr;
+    unsigned long long max_steps = 0;
+    int max_depth = DEFAULT_MAX_DEPTH;
+    OverflowMode overflow = OVERFLOW_WRAP;
+    bool success = false;
+    std::string error;
+    ExecStatus status = EXEC_OK;
+    unsigned long long steps = 0;
+    int peak_depth = 0;
+};
+
+TEST_F(InterpreterTest, Arithmetic) {
+    EXPECT_EQ(run("VAR x; BEGIN x := 7; WRITE x * 6; WRITE -x + 2; WRITE 20 / 6; WRITE (1 + 2) * 3 END."),
+              "42\n-5\n3\n9\n");
+    EXPECT_TRUE(success);
+}
+
+TEST_F(InterpreterTest, ConstantsAndConditions) {
+    EXPECT_EQ(run("CONST ten = 10;"
+                  "VAR i;"
+                  "BEGIN"
+                  "  i := 0;"
+                  "  WHILE i < ten DO"
+                  "  BEGIN"
+                  "    IF ODD i THEN WRITE i;"
+                  "    i := i + 1"
+                  "  END;"
+                  "  IF i = ten THEN WRITE 100;"
+                  "  IF i # ten THEN WRITE 200 "
+                  "END."),
+              "1\n3\n5\n7\n9\n100\n");
+}
+
+TEST_F(InterpreterTest, RecursiveProcedure) {
+    EXPECT_EQ(run("VAR n, f;"
+                  "PROCEDURE fact;"
+                  "BEGIN"
+                  "  IF n > 1 THEN"
+                  "  BEGIN f := n * f; n := n - 1; CALL fact END "
+                  "END;"
+                  "BEGIN READ n; f := 1; CALL fact; WRITE f END.", "10\n"),
+              "3628800\n");
+    EXPECT_TRUE(success);
+}
+
+TEST_F(InterpreterTest, StaticLinks) {
+    // inner reaches a through two static links and b through one,
+    // while called from a recursive activation of outer
+    EXPECT_EQ(run("VAR a;"
+                  "PROCEDURE outer;"
+                  "  VAR b;"
+                  "  PROCEDURE inner;"
+                  "  BEGIN a := a + b END;"
+                  "  BEGIN"
+                  "    b := a;"
+                  "    IF a < 100 THEN CALL inner;"
+                  "    IF a < 100 THEN CALL outer "
+                  "  END;"
+                  "BEGIN a := 3; CALL outer; WRITE a END."),
+              "192\n");
+}
+
+TEST_F(InterpreterTest, ShadowedVariables) {
+    EXPECT_EQ(run("VAR x;"
+                  "PROCEDURE p;"
+                  "  VAR x;"
+                  "  BEGIN x := 2; WRITE x END;"
+                  "BEGIN x := 1; CALL p; WRITE x END."),
+              "2\n1\n");
+}
+
+TEST_F(InterpreterTest, ReadsInput) {
+    EXPECT_EQ(run("VAR x, y; BEGIN READ x; READ y; WRITE x - y END.", "  -12\n\t30 "),
+              "-42\n");
+    EXPECT_TRUE(success);
+}
+
+TEST_F(InterpreterTest, DivisionByZero) {
+    run("VAR x; BEGIN x := 0; WRITE 1 / x END.");
+    EXPECT_FALSE(success);
+    EXPECT_NE(error.find("Division by zero"), std::string::npos);
+}
+
+// Overflows in +, -, *, negation and /
+static const char* overflowing =
+    "VAR m;"
+    "BEGIN m := -2147483647 - 1;"
+    "  WRITE 2147483647 + 1; WRITE m - 1; WRITE m * 2; WRITE -m; WRITE m / (0 - 1)"
+    "END.";
+
+TEST_F(InterpreterTest, OverflowWraps) {
+    EXPECT_EQ(run(overflowing), "-2147483648\n2147483647\n0\n-2147483648\n-2147483648\n");
+    EXPECT_TRUE(success);
+}
+
+TEST_F(InterpreterTest, OverflowSaturates) {
+    overflow = OVERFLOW_SATURATE;
+    EXPECT_EQ(run(overflowing), "2147483647\n-2147483648\n-2147483648\n2147483647\n2147483647\n");
+    EXPECT_TRUE(success);
+}
+
+TEST_F(InterpreterTest, OverflowTraps) {
+    overflow = OVERFLOW_TRAP;
+    EXPECT_EQ(run("VAR x; BEGIN x := 65536; WRITE x; WRITE x * x END."), "65536\n");
+    EXPECT_FALSE(success);
+    EXPECT_EQ(status, EXEC_ERROR);
+    EXPECT_EQ(error, "Integer overflow in 65536 * 65536");
+
+    EXPECT_EQ(run("VAR m; BEGIN m := -2147483647 - 1; WRITE m / (0 - 1) END."), "");
+    EXPECT_EQ(error, "Integer overflow in -2147483648 / -1");
+    EXPECT_EQ(run("BEGIN WRITE 2147483646 + 1; WRITE 0 - 2147483647 - 1 END."),
+              "2147483647\n-2147483648\n");
+    EXPECT_TRUE(success);
+}
+
+TEST_F(InterpreterTest, EndOfInput) {
+    run("VAR x; READ x.");
+    EXPECT_FALSE(success);
+    EXPECT_NE(error.find("end of input"), std::string::npos);
+}
+
+TEST_F(InterpreterTest, InvalidInput) {
+    run("VAR x; READ x.", "12abc");
+    EXPECT_FALSE(success);
+    EXPECT_NE(error.find("expected an integer"), std::string::npos);
+}
+
+TEST_F(InterpreterTest, OutputLargerThanBuffer) {
+    std::string output = run("VAR i; BEGIN i := 0; WHILE i < 300000 DO BEGIN WRITE i; i := i + 1 END END.");
+    EXPECT_TRUE(success);
+    EXPECT_GT(output.size(), (size_t)BUFWRITER_SIZE);
+    EXPECT_EQ(output.compare(0, 6, "0\n1\n2\n"), 0);
+    EXPECT_EQ(output.substr(output.size() - 7), "299999\n");
+}
+
+TEST_F(InterpreterTest, InputLargerThanBuffer) {
+    std::string input;
+    for (int i = 1; i <= 200000; i++) input += std::to_string(i) + (i % 10 ? " " : "\n");
+    ASSERT_GT(input.size(), (size_t)BUFREADER_SIZE);
+
+    EXPECT_EQ(run("VAR n, x, sum;"
+                  "BEGIN"
+                  "  n := 0; sum := 0;"
+                  "  WHILE n < 200000 DO BEGIN READ x; sum := sum + x; n := n + 1 END;"
+                  "  WRITE sum "
+                  "END.", input),
+              "-1474736480\n");  // 20000100000 wrapped to 32 bits
+    EXPECT_TRUE(success);
+}
+
+TEST_F(InterpreterTest, InputOutOfRange) {
+    run("VAR x; READ x.", "2147483648");
+    EXPECT_FALSE(success);
+    EXPECT_NE(error.find("out of range"), std::string::npos);
+}
+
+TEST_F(InterpreterTest, OutputFlushedOnRuntimeError) {
+    EXPECT_EQ(run("VAR x; BEGIN WRITE 1; WRITE 2; WRITE 1 / x END."), "1\n2\n");
+    EXPECT_FALSE(success);
+}
+
+TEST_F(InterpreterTest, StepsCountLoopIterationsAndCalls) {
+    EXPECT_EQ(run("VAR i;"
+                  "PROCEDURE p; i := i + 1;"
+                  "BEGIN i := 0; WHILE i < 5 DO CALL p; WRITE i END."), "5\n");
+    EXPECT_EQ(status, EXEC_OK);
+    EXPECT_EQ(steps, 10u);
+    EXPECT_EQ(peak_depth, 1);
+}
+
+TEST_F(InterpreterTest, StepLimit) {
+    max_steps = 10;
+    EXPECT_EQ(run("VAR i; BEGIN i := 0; WHILE i >= 0 DO BEGIN WRITE i; i := i + 1 END END."),
+              "0\n1\n2\n3\n4\n5\n6\n7\n8\n9\n");
+    EXPECT_FALSE(success);
+    EXPECT_EQ(status, EXEC_STEP_LIMIT);
+    EXPECT_EQ(error, "Step limit of 10 loop iterations and calls exceeded");
+
+    // Exactly enough steps
+    EXPECT_EQ(run("VAR i; BEGIN i := 0; WHILE i < 10 DO i := i + 1; WRITE i END."), "10\n");
+    EXPECT_EQ(status, EXEC_OK);
+}
+
+TEST_F(InterpreterTest, DepthLimit) {
+    max_depth = 50;
+    std::string program = "VAR n;"
+                          "PROCEDURE down; IF n > 0 THEN BEGIN n := n - 1; CALL down END;"
+                          "BEGIN READ n; CALL down; WRITE n END.";
+    EXPECT_EQ(run(program, "49"), "0\n");
+    EXPECT_EQ(status, EXEC_OK);
+    EXPECT_EQ(peak_depth, 50);
+
+    EXPECT_EQ(run(program, "50"), "");
+    EXPECT_EQ(status, EXEC_DEPTH_LIMIT);
+    EXPECT_EQ(error, "Call depth limit of 50 exceeded calling 'down'");
+}
+
+TEST_F(InterpreterTest, UnboundedRecursionStopsAtDefaultDepth) {
+    EXPECT_EQ(run("PROCEDURE forever; CALL forever; CALL forever."), "");
+    EXPECT_EQ(status, EXEC_DEPTH_LIMIT);
+    EXPECT_EQ(peak_depth, DEFAULT_MAX_DEPTH);
+}
+
+TEST_F(InterpreterTest, NestedStatementsStopWhenOutOfStack) {
+    // Every call level nests several statements, each a frame of its own
+    std::string program = "VAR n;"
+                          "PROCEDURE down;"
+                          "  IF n > 0 THEN WHILE n > 0 DO IF n > 0 THEN"
+                          "    BEGIN BEGIN BEGIN n := n - 1; CALL down END END END;"
+                          "BEGIN READ n; CALL down; WRITE n END.";
+    max_depth = 1000000;
+    EXPECT_EQ(run(program, "200000"), "");
+    EXPECT_EQ(status, EXEC_DEPTH_LIMIT);
+    EXPECT_EQ(error.rfind("Out of stack at call depth ", 0), 0u) << error;
+    EXPECT_LT(peak_depth, 200000);
+
+    // With the default limit the calls either fit or stop at the limit
+    max_depth = DEFAULT_MAX_DEPTH;
+    for (const char* depth : { "8000", "20000" }) {
+        std::string output = run(program, depth);
+        EXPECT_TRUE(status == EXEC_OK || status == EXEC_DEPTH_LIMIT) << error;
+        EXPECT_EQ(output, status == EXEC_OK ? "0\n" : "");
+    }
+    EXPECT_EQ(run(program, "100"), "0\n");
+    EXPECT_EQ(status, EXEC_OK);
+}
+
+TEST_F(InterpreterTest, ProfileCountsCallsAndLines) {
+    profiling = true;
+    EXPECT_EQ(run("VAR i;\n"
+                  "PROCEDURE p;\n"
+                  "  PROCEDURE q;\n"
+                  "  BEGIN i := i + 1 END;\n"
+                  "  CALL q;\n"
+                  "BEGIN\n"
+                  "  i := 0;\n"
+                  "  WHILE i < 10 DO CALL p;\n"
+                  "  WRITE i\n"
+                  "END."),
+              "10\n");
+    ASSERT_NE(profile, nullptr);
+
+    ASSERT_EQ(profile->proc_count, 3);
+    EXPECT_STREQ(profile->procs[0].name, "main");
+    EXPECT_EQ(profile->procs[0].calls, 1u);
+    EXPECT_STREQ(profile->procs[1].name, "p");
+    EXPECT_EQ(profile->procs[1].calls, 10u);
+    EXPECT_STREQ(profile->procs[2].name, "p.q");
+    EXPECT_EQ(profile->procs[2].line, 3);
+    EXPECT_EQ(profile->procs[2].calls, 10u);
+
+    EXPECT_EQ(profile->line_counts[4], 10u);       // i := i + 1
+    EXPECT_EQ(profile->line_counts[8], 11u);       // WHILE and its CALL p
+    EXPECT_EQ(profile->line_iterations[8], 10u);
+    EXPECT_EQ(profile->statements, 1u + 11u + 10u + 10u + 1u);
+
+    // CALL q inside p, each call running one statement
+    ASSERT_EQ(profile->call_count, 2);
+    const CallProfile* call = profile->calls[0].caller == 1 ? &profile->calls[0] : &profile->calls[1];
+    EXPECT_EQ(call->caller, 1);
+    EXPECT_EQ(call->callee, 2);
+    EXPECT_EQ(call->line, 5);
+    EXPECT_EQ(call->count, 10u);
+    EXPECT_EQ(call->statements, 10u);
+}
+
+TEST_F(InterpreterTest, ProfileWritesCallgrind) {
+    profiling = true;
+    run("VAR x;\n"
+        "PROCEDURE p;\n"
+        "  x := x + 1;\n"
+        "BEGIN CALL p; CALL p END.");
+    ASSERT_NE(profile, nullptr);
+
+    char* buffer = nullptr;
+    size_t size = 0;
+    FILE* out = open_memstream(&buffer, &size);
+    EXPECT_TRUE(write_callgrind(out, profile, "test.pl0"));
+    fclose(out);
+    std::string text(buffer, size);
+    free(buffer);
+
+    EXPECT_NE(text.find("events: Statements Nanoseconds\n"), std::string::npos);
+    EXPECT_NE(text.find("fl=test.pl0\n"), std::string::npos);
+    EXPECT_NE(text.find("fn=main\n"), std::string::npos);
+    EXPECT_NE(text.find("fn=p\n"), std::string::npos);
+    EXPECT_NE(text.find("\n3 2\n"), std::string::npos);   // line 3 ran twice
+    EXPECT_NE(text.find("cfn=p\ncalls=1 2\n4 1 "), std::string::npos) << text;
+}
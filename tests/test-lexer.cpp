@@ -1,17 +1,32 @@
 #include <gtest/gtest.h>
+#include <cstdio>
 #include <cstring>
+#include <string>
+#include <vector>
 extern "C" {
+#include "ast.h"
 #include "parser.tab.h"
 }
 
 extern "C" int yylex(void);
 extern "C" char* yytext;
 extern "C" struct yy_buffer_state* yy_scan_string(const char*);
+extern "C" void yyrestart(FILE*);
+extern "C" int yylex_destroy(void);
+extern "C" int yylineno;
+extern "C" int parse_error_count;
+
+// Scan input with a fresh scanner, so that no earlier test's buffer is left
+// behind unreachable
+static void scan(const char* input) {
+    yylex_destroy();
+    yy_scan_string(input);
+}
 
 TEST(LexerTest, Keywords) {
     const char* input =
         "CONST VAR PROCEDURE READ WRITE BEGIN END IF THEN WHILE DO CALL ODD";
-    yy_scan_string(input);
+    scan(input);
 
     EXPECT_EQ(yylex(), TOK_CONST);
     EXPECT_EQ(yylex(), TOK_VAR);
@@ -30,7 +45,7 @@ TEST(LexerTest, Keywords) {
 
 TEST(LexerTest, OperatorsAndPunctuation) {
     const char* input = ":= = # < <= > >= + - * / ( ) , ; .";
-    yy_scan_string(input);
+    scan(input);
 
     EXPECT_EQ(yylex(), TOK_ASSIGN);
     EXPECT_EQ(yylex(), TOK_EQ);
@@ -52,17 +67,103 @@ TEST(LexerTest, OperatorsAndPunctuation) {
 
 TEST(LexerTest, NumbersAndIdentifiers) {
     const char* input = "123 square x";
-    yy_scan_string(input);
+    scan(input);
     EXPECT_EQ(yylex(), TOK_NUM);
     EXPECT_STREQ(yytext, "123");
     EXPECT_EQ(yylex(), TOK_IDENT);
     EXPECT_STREQ(yytext, "square");
+    EXPECT_STREQ(yylval.name, "square");
+    release_name(yylval.name);  // the token holds a reference
     EXPECT_EQ(yylex(), TOK_IDENT);
     EXPECT_STREQ(yytext, "x");
+    release_name(yylval.name);
+}
+
+TEST(LexerTest, NumberRange) {
+    const char* input = "2147483647 2147483648";
+    scan(input);
+    parse_error_count = 0;
+    EXPECT_EQ(yylex(), TOK_NUM);
+    EXPECT_EQ(yylval.value, 2147483647);
+    EXPECT_EQ(parse_error_count, 0);
+    EXPECT_EQ(yylex(), TOK_NUM);
+    EXPECT_EQ(parse_error_count, 1);
+    parse_error_count = 0;
 }
 
 TEST(LexerTest, WhiteSpace) {
     const char* input = " \t\n";
-    yy_scan_string(input);
+    scan(input);
     EXPECT_EQ(yylex(), 0);
 }
+
+TEST(LexerTest, Comments) {
+    const char* input = "{ one\n two } x (* three\n * ) (* *) 1 {}(**)";
+    scan(input);
+    yylineno = 1;
+    EXPECT_EQ(yylex(), TOK_IDENT);
+    EXPECT_STREQ(yytext, "x");
+    EXPECT_EQ(yylineno, 2);
+    release_name(yylval.name);
+    EXPECT_EQ(yylex(), TOK_NUM);
+    EXPECT_STREQ(yytext, "1");
+    EXPECT_EQ(yylineno, 3);
+    EXPECT_EQ(yylex(), 0);
+}
+
+TEST(LexerTest, UnterminatedComment) {
+    const char* input = "x (* not closed *";
+    scan(input);
+    parse_error_count = 0;
+    EXPECT_EQ(yylex(), TOK_IDENT);
+    release_name(yylval.name);
+    EXPECT_EQ(yylex(), 0);
+    EXPECT_EQ(parse_error_count, 1);
+    parse_error_count = 0;
+}
+
+// Lex text read through a stream, as the driver reads files: the scanner
+// refills its buffer a read at a time
+static std::vector<int> lex_stream(std::string text) {
+    FILE* in = fmemopen(&text[0], text.size(), "r");
+    yylex_destroy();  // a fresh buffer of YY_BUF_SIZE, not an earlier string's
+    yyrestart(in);
+    yylineno = 1;
+    std::vector<int> tokens;
+    for (int token; (token = yylex()) != 0;) {
+        tokens.push_back(token);
+        if (token == TOK_IDENT) release_name(yylval.name);
+    }
+    fclose(in);
+    return tokens;
+}
+
+TEST(LexerTest, CommentsAcrossBufferRefills) {
+    // Comments longer than the scanner's 16 KB buffer, closed with the
+    // "*" as the last character of one read and the ")" the first of the
+    // next, for the usual read sizes
+    std::vector<int> two_names = { TOK_IDENT, TOK_IDENT };
+    parse_error_count = 0;
+    for (size_t star : { 8191, 8192, 8193, 16383, 16384, 16385, 32767, 32768, 40000 }) {
+        std::string text = "x (*";
+        int lines = 1;
+        while (text.size() < star) {
+            char c = text.size() % 64 == 0 ? '\n' : text.size() % 5 == 0 ? '*' : 'a';
+            if (c == '\n') lines++;
+            text += c;
+        }
+        text += "*) y";
+        EXPECT_EQ(lex_stream(text), two_names) << star;
+        EXPECT_EQ(yylineno, lines) << star;
+    }
+
+    std::string braces = "x {" + std::string(40000, '*') + "\n} y";
+    EXPECT_EQ(lex_stream(braces), two_names);
+    EXPECT_EQ(yylineno, 2);
+    EXPECT_EQ(parse_error_count, 0);
+
+    EXPECT_EQ(lex_stream("x (*" + std::string(40000, '*')), std::vector<int>{ TOK_IDENT });
+    EXPECT_EQ(parse_error_count, 1);
+    parse_error_count = 0;
+    yylex_destroy();
+}
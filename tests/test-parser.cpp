@@ -1,78 +1,128 @@
 #include <gtest/gtest.h>
 #include <cstring>
 extern "C" {
+#include "ast.h"
+#include "ast_emit.h"
+#include "cst.h"
+#include "descent.h"
+#include "parallel_parse.h"
 #include "parser.tab.h"
 }
 
-extern "C" int yyparse(void);
 extern "C" struct yy_buffer_state* yy_scan_string(const char*);
+extern "C" void yy_delete_buffer(struct yy_buffer_state*);
+extern "C" Node* ast_root;
+extern "C" int parse_error_count;
 
-class ParserTest : public ::testing::Test {
+// Every test runs against both parsers
+class ParserTest : public ::testing::TestWithParam<ParserKind> {
    protected:
       void SetUp() override {
          // This method will be called before each test
       }
 
       void TearDown() override {
-         // This method will be called after each test
+         free_ast(ast_root);
+         ast_root = nullptr;
+      }
+
+      // Parse input, releasing the tree of the previous parse
+      int parse(const char* input) {
+         free_ast(ast_root);
+         struct yy_buffer_state* buffer = yy_scan_string(input);
+         int result = run_parser(GetParam());
+         yy_delete_buffer(buffer);
+         return result;
       }
 
       void test_parser(const char* input) {
-         yy_scan_string(input);
-         int result = yyparse();
+         int result = parse(input);
          ASSERT_EQ(result, 0);
+         ASSERT_EQ(parse_error_count, 0);
+      }
+
+      // Parse input that contains syntax errors the parser recovers from
+      int count_syntax_errors(const char* input) {
+         EXPECT_EQ(parse(input), 0);
+         return parse_error_count;
+      }
+
+      static int count_nodes(Node* node, NodeType type) {
+         int count = 0;
+         for (; node; node = node_next(node)) {
+            if (node->type == type) count++;
+            if (!node_has_children(node)) continue;
+            count += count_nodes(node_left(node), type);
+            count += count_nodes(node_right(node), type);
+         }
+         return count;
       }
 };
 
-TEST_F(ParserTest, EmptyProgram) {
+TEST_P(ParserTest, EmptyProgram) {
    test_parser(".");
 }
 
-TEST_F(ParserTest, Constants) {
+TEST_P(ParserTest, Constants) {
    test_parser("CONST a = 10, b = 12, c = 23;.");
 }
 
-TEST_F(ParserTest, Variables) {
+TEST_P(ParserTest, Variables) {
    test_parser("VAR x, y, z;.");
 }
 
-TEST_F(ParserTest, Procedures) {
+TEST_P(ParserTest, Procedures) {
    test_parser("PROCEDURE p; ;."); // a procedure can have an empty block
    test_parser("PROCEDURE p; ; PROCEDURE p; ;.");
 }
 
-TEST_F(ParserTest, Assignment) {
+TEST_P(ParserTest, Assignment) {
    test_parser("x := 3.");
    test_parser("x := abc.");
 }
 
-TEST_F(ParserTest, Call) {
+TEST_P(ParserTest, Call) {
    test_parser("CALL square.");
 }
 
-TEST_F(ParserTest, Read) {
+TEST_P(ParserTest, Read) {
    test_parser("READ x.");
 }
 
-TEST_F(ParserTest, WRITE) {
+TEST_P(ParserTest, WRITE) {
    test_parser("WRITE y.");
 }
 
-TEST_F(ParserTest, BeginEnd) {
+TEST_P(ParserTest, BeginEnd) {
    test_parser("BEGIN END.");
    test_parser("BEGIN x := 5 END.");
+   test_parser("BEGIN x := 5; END.");
+   test_parser("BEGIN ; ; x := 5 END.");
+}
+
+TEST_P(ParserTest, StatementListIsLinked) {
+   test_parser("BEGIN x := 1; ; y := 2; z := 3 END.");
+   Node* compound = node_right(node_left(ast_root));
+   ASSERT_EQ(compound->type, NODE_COMPOUND);
+   EXPECT_EQ(node_right(compound), nullptr);
+   int count = 0;
+   for (Node* stmt = node_left(compound); stmt; stmt = node_next(stmt)) {
+      EXPECT_EQ(stmt->type, NODE_ASSIGN);
+      count++;
+   }
+   EXPECT_EQ(count, 3);
 }
 
-TEST_F(ParserTest, IfThen) {
+TEST_P(ParserTest, IfThen) {
    test_parser("IF x = 0 THEN.");
    test_parser("IF x = 0 THEN x := 1.");
 }
 
-TEST_F(ParserTest, WhileDo) {
+TEST_P(ParserTest, WhileDo) {
    test_parser("WHILE x < 5 DO x := x + 1.");
 }
 
-TEST_F(ParserTest, Conditions) {
+TEST_P(ParserTest, Conditions) {
    test_parser("IF ODD 5 THEN x := 1.");
    test_parser("IF x = 5 THEN x := 0.");
    test_parser("IF x # 5 THEN x := 0.");
@@ -82,7 +132,7 @@ TEST_F(ParserTest, Conditions) {
    test_parser("IF x >= 5 THEN x := 0.");
 }
 
-TEST_F(ParserTest, Expressions) {
+TEST_P(ParserTest, Expressions) {
    test_parser(".");
    test_parser("x := +y.");
    test_parser("x := -7.");
@@ -94,7 +144,7 @@ TEST_F(ParserTest, Expressions) {
    test_parser("x := (-b - (b*b - 4*a*c)) / (2*a).");
 }
 
-TEST_F(ParserTest, ComplexProgram) {
+TEST_P(ParserTest, ComplexProgram) {
    const char* input = 
       R"(VAR x, y, z, q, r, n, f;
 
@@ -163,3 +213,301 @@ TEST_F(ParserTest, ComplexProgram) {
    test_parser(input);
 }
 
+
+// Error recovery tests
+TEST_P(ParserTest, RecoverInStatements) {
+   EXPECT_EQ(count_syntax_errors(
+      "VAR x;\n"
+      "BEGIN\n"
+      "  x := ;\n"
+      "  x := 1;\n"
+      "  IF x THEN x := 2;\n"
+      "  WRITE x\n"
+      "END."), 2);
+   ASSERT_NE(ast_root, nullptr);
+   EXPECT_EQ(count_nodes(ast_root, NODE_ERROR), 2);
+   EXPECT_EQ(count_nodes(ast_root, NODE_ASSIGN), 1);
+   EXPECT_EQ(count_nodes(ast_root, NODE_OUTPUT), 1);
+}
+
+TEST_P(ParserTest, RecoverInDeclarations) {
+   EXPECT_EQ(count_syntax_errors(
+      "CONST a = 1, b 2, c = 3;\n"
+      "VAR x, 5, y;\n"
+      "PROCEDURE 7; x := a;\n"
+      "PROCEDURE p; y := c;\n"
+      "CALL p."), 3);
+   EXPECT_EQ(count_nodes(ast_root, NODE_CONST_DECL), 2);
+   EXPECT_EQ(count_nodes(ast_root, NODE_VAR_DECL), 2);
+   EXPECT_EQ(count_nodes(ast_root, NODE_PROC), 1);
+   EXPECT_EQ(count_nodes(ast_root, NODE_ERROR), 3);
+}
+
+TEST_P(ParserTest, ErrorNodeRecordsLine) {
+   EXPECT_EQ(count_syntax_errors("VAR x;\nBEGIN\n  x := 1;\n  x 2\nEND."), 1);
+   Node* compound = node_next(node_right(node_left(ast_root)));
+   ASSERT_EQ(compound->type, NODE_COMPOUND);
+   Node* error = node_next(node_left(compound));
+   ASSERT_NE(error, nullptr);
+   EXPECT_EQ(error->type, NODE_ERROR);
+   EXPECT_GT(node_line(error), 0);
+}
+
+TEST_P(ParserTest, UnrecoverableError) {
+   EXPECT_NE(parse("BEGIN x := 1"), 0);
+   EXPECT_GT(parse_error_count, 0);
+   EXPECT_EQ(ast_root, nullptr);
+}
+
+// A service parses over and over; each parse must release everything,
+// including nodes and names dropped by error recovery (checked by the
+// leak sanitizer in a PL0_SANITIZE build)
+TEST_P(ParserTest, RepeatedParsesReleaseEverything) {
+   for (int i = 0; i < 1000; i++) {
+      test_parser("CONST c = 1; VAR x, y; PROCEDURE p; x := y + c; BEGIN CALL p; WRITE x END.");
+      EXPECT_EQ(count_syntax_errors("VAR a, 5, b; BEGIN a := ; b := a + 1; c d e END."), 3);
+      EXPECT_NE(parse("VAR x; BEGIN x := x +"), 0);
+   }
+}
+
+INSTANTIATE_TEST_SUITE_P(Parsers, ParserTest,
+                         ::testing::Values(PARSER_BISON, PARSER_DESCENT),
+                         [](const ::testing::TestParamInfo<ParserKind>& info) {
+                            return info.param == PARSER_BISON ? "Bison" : "Descent";
+                         });
+
+// The two parsers build the same tree, down to lines and token spans
+class ParserAgreementTest : public ::testing::Test {
+   protected:
+      void TearDown() override {
+         free_ast(ast_root);
+         ast_root = nullptr;
+      }
+
+      // The tree as an s-expression followed by the lines and tokens of
+      // its nodes in preorder
+      static void describe(const Node* node, std::string& out) {
+         for (; node; node = node_next(node)) {
+            out += std::to_string(node->type) + ":" + std::to_string(node_line(node)) + ":" +
+                   std::to_string(node_first_token(node)) + "-" +
+                   std::to_string(node_last_token(node)) + " ";
+            if (!node_has_children(node)) continue;
+            describe(node_left(node), out);
+            describe(node_right(node), out);
+         }
+      }
+
+      std::string parse_with(const std::string& source, int (*parse)(void),
+                             TaskPool* pool = nullptr, int errors = 0) {
+         free_ast(ast_root);
+         TokenBuffer* tokens = create_token_buffer(source.data(), source.size());
+         EXPECT_EQ(pool ? parse_tokens_parallel(tokens, parse, pool)
+                        : parse_tokens_with(tokens, parse), 0);
+         EXPECT_EQ(parse_error_count, errors);
+         if (!ast_root) {
+            free_token_buffer(tokens);
+            return "";
+         }
+
+         char* buffer = nullptr;
+         size_t size = 0;
+         FILE* out = open_memstream(&buffer, &size);
+         EXPECT_TRUE(emit_ast(out, ast_root, AST_FORMAT_SEXPR));
+         fclose(out);
+         std::string result(buffer, size);
+         free(buffer);
+         describe(ast_root, result);
+         free_token_buffer(tokens);
+         return result;
+      }
+
+      void expect_same_tree(const std::string& source) {
+         std::string bison = parse_with(source, yyparse);
+         EXPECT_FALSE(bison.empty());
+         EXPECT_EQ(parse_with(source, descent_parse), bison) << source;
+      }
+};
+
+TEST_F(ParserAgreementTest, SameTree) {
+   expect_same_tree(".");
+   expect_same_tree("PROCEDURE p; ;.");
+   expect_same_tree("CONST a = 1, b = 2; VAR x, y; x := -a * b + (b - (-a)) / 2 - (+y).");
+   expect_same_tree("BEGIN ; IF ODD x THEN ; WHILE x # 1 DO BEGIN x := x - 1; END END.");
+   expect_same_tree("x := a - b - c * d / e * f + g.");
+   expect_same_tree(
+      "VAR n, f;\n"
+      "PROCEDURE fact;\n"
+      "   PROCEDURE dec; n := n - 1;\n"
+      "BEGIN\n"
+      "   IF n > 1 THEN\n"
+      "   BEGIN\n"
+      "      f := n * f; CALL dec; CALL fact\n"
+      "   END\n"
+      "END;\n"
+      "BEGIN READ n; f := 1; CALL fact; WRITE f END.");
+}
+
+TEST_F(ParserAgreementTest, NestingLimit) {
+   std::string deep = "x := " + std::string(20000, '(') + "1" + std::string(20000, ')') + ".";
+   free_ast(ast_root);
+   TokenBuffer* tokens = create_token_buffer(deep.data(), deep.size());
+   EXPECT_EQ(parse_tokens_with(tokens, descent_parse), 2);
+   EXPECT_EQ(ast_root, nullptr);
+   free_token_buffer(tokens);
+}
+
+// Chunks of top-level procedures parsed on several threads give the tree
+// of a sequential parse
+class ParallelParseTest : public ParserAgreementTest {
+   protected:
+      void SetUp() override { pool = create_task_pool(4); }
+
+      void TearDown() override {
+         ParserAgreementTest::TearDown();
+         free_task_pool(pool);
+      }
+
+      // A program with enough procedures for several chunks
+      static std::string program(const std::string& declarations, const std::string& statement) {
+         std::string source = declarations;
+         for (int i = 0; i < 1000; i++) {
+            std::string n = std::to_string(i);
+            source += "PROCEDURE p" + n + ";\nVAR a, b;\n"
+                      "   PROCEDURE q" + n + "; a := a + 1;\n"
+                      "BEGIN\n"
+                      "   a := " + n + "; b := 0; { counting }\n"
+                      "   WHILE b < 10 DO BEGIN b := b + 1; a := a * b - (b / 2) END;\n"
+                      "   CALL q" + n + "\n"
+                      "END;\n";
+         }
+         return source + statement + ".\n";
+      }
+
+      TaskPool* pool = nullptr;
+};
+
+TEST_F(ParallelParseTest, SameTreeAsSequential) {
+   ASSERT_NE(pool, nullptr);
+   for (const std::string& source : { program("CONST n = 3;\nVAR x;\n", "BEGIN CALL p999; x := n END"),
+                                      program("", "") }) {
+      std::string sequential = parse_with(source, yyparse);
+      EXPECT_FALSE(sequential.empty());
+      EXPECT_EQ(parse_with(source, yyparse, pool), sequential);
+      EXPECT_EQ(parse_with(source, descent_parse, pool), sequential);
+   }
+}
+
+TEST_F(ParallelParseTest, SyntaxErrorsParseSequentially) {
+   std::string source = program("VAR x;\n", "x := 1");
+   source.replace(source.find("CALL q500"), 9, "CALL 500");
+   std::string sequential = parse_with(source, yyparse, nullptr, 1);
+   EXPECT_EQ(parse_with(source, yyparse, pool, 1), sequential);
+}
+
+TEST_F(ParallelParseTest, NameReferencesBalance) {
+   AstMemStats before;
+   get_ast_mem_stats(&before);
+   std::string source = program("VAR x;\n", "x := 1");
+   parse_with(source, descent_parse, pool);
+   source.replace(source.find("b := 0"), 6, "b = 0");
+   parse_with(source, descent_parse, pool, 1);
+   free_ast(ast_root);
+   ast_root = nullptr;
+   AstMemStats after;
+   get_ast_mem_stats(&after);
+   EXPECT_EQ(after.name_refs, before.name_refs);
+   EXPECT_EQ(after.names, before.names);
+   EXPECT_EQ(after.nodes, before.nodes);
+}
+
+// Hash-consing (share_expr()): identical expressions of a block share nodes
+class HashConsTest : public ParserTest {
+   protected:
+      void SetUp() override { share_expressions(true); }
+
+      void TearDown() override {
+         ParserTest::TearDown();
+         share_expressions(false);
+      }
+
+      // The statements of the compound statement of a block
+      static Node* statements(Node* block) {
+         Node* compound = find_block_statement(block);
+         EXPECT_NE(compound, nullptr);
+         EXPECT_EQ(compound->type, NODE_COMPOUND);
+         return node_left(compound);
+      }
+
+      static std::string emit_sexpr(Node* root) {
+         char* buffer = nullptr;
+         size_t size = 0;
+         FILE* out = open_memstream(&buffer, &size);
+         EXPECT_TRUE(emit_ast(out, root, AST_FORMAT_SEXPR));
+         fclose(out);
+         std::string result(buffer, size);
+         free(buffer);
+         return result;
+      }
+};
+
+TEST_P(HashConsTest, SharesIdenticalExpressions) {
+   test_parser("VAR x, y; BEGIN x := x + 1; y := x + 1; WRITE 2 * (x + 1); WRITE -x END.");
+   Node* assign_x = statements(node_left(ast_root));
+   Node* assign_y = node_next(assign_x);
+   Node* write_product = node_next(assign_y);
+   Node* write_negated = node_next(write_product);
+   EXPECT_EQ(node_right(assign_y), node_right(assign_x));
+   EXPECT_EQ(node_right(node_left(write_product)), node_right(assign_x));
+   EXPECT_EQ(node_right(node_left(write_negated)), node_left(node_right(assign_x)));
+   // One reference per use once the block's table is gone
+   EXPECT_EQ(node_right(assign_x)->refs, 3);
+   EXPECT_EQ(node_left(node_right(assign_x))->refs, 2);
+}
+
+TEST_P(HashConsTest, NotAcrossBlocks) {
+   test_parser("VAR x; PROCEDURE p; VAR x; x := x + 1; BEGIN x := x + 1; CALL p END.");
+   Node* proc = node_next(node_right(node_left(ast_root)));
+   ASSERT_EQ(proc->type, NODE_PROC);
+   Node* inner = find_block_statement(node_right(proc));
+   Node* outer = statements(node_left(ast_root));
+   EXPECT_NE(node_right(inner), node_right(outer));
+   EXPECT_NE(node_left(node_right(inner)), node_left(node_right(outer)));
+}
+
+TEST_P(HashConsTest, SameTreeAsUnshared) {
+   const char* source = "VAR a, b; BEGIN a := -b + (a + b) * (a + b) - b; "
+                        "WHILE a + b > 0 DO a := a - 1; b := (a + b) * (a + b) END.";
+   test_parser(source);
+   std::string shared = emit_sexpr(ast_root);
+   share_expressions(false);
+   test_parser(source);
+   EXPECT_EQ(emit_sexpr(ast_root), shared);
+}
+
+// Shared nodes and their names go with their last owner, also when error
+// recovery drops some of them
+TEST_P(HashConsTest, ReleasesEverything) {
+   free_ast(ast_root);
+   ast_root = nullptr;
+   AstMemStats before;
+   get_ast_mem_stats(&before);
+   for (int i = 0; i < 100; i++) {
+      test_parser("VAR x; PROCEDURE p; x := x * 2 + x * 2; BEGIN x := x * 2; CALL p END.");
+      EXPECT_EQ(count_syntax_errors("VAR a; BEGIN a := a + 1; a := a + ; b := a + 1 c END."), 2);
+      EXPECT_NE(parse("VAR x; BEGIN x := x + 1; x := x + 1 +"), 0);
+   }
+   free_ast(ast_root);
+   ast_root = nullptr;
+   share_expressions(false);
+   AstMemStats after;
+   get_ast_mem_stats(&after);
+   EXPECT_EQ(after.nodes, before.nodes);
+   EXPECT_EQ(after.name_refs, before.name_refs);
+   EXPECT_GT(after.shared_exprs, before.shared_exprs);
+}
+
+INSTANTIATE_TEST_SUITE_P(Parsers, HashConsTest,
+                         ::testing::Values(PARSER_BISON, PARSER_DESCENT),
+                         [](const ::testing::TestParamInfo<ParserKind>& info) {
+                            return info.param == PARSER_BISON ? "Bison" : "Descent";
+                         });
@@ -0,0 +1,259 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern "C" {
+#include "options.h"
+#include "driver.h"
+#include "server.h"
+int yylex_destroy(void);
+}
+
+class ServerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char tmpl[] = "/tmp/pl0-server-XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+        socket_path = dir + "/pl0.sock";
+    }
+
+    void TearDown() override {
+        stop_server();
+        yylex_destroy();  // as main() does: runs leave the scanner its buffer
+        std::string command = "rm -rf " + dir;
+        ASSERT_EQ(system(command.c_str()), 0);
+    }
+
+    std::string write_file(const std::string& name, const std::string& text) {
+        std::string path = dir + "/" + name;
+        std::ofstream(path) << text;
+        return path;
+    }
+
+    std::string read_file(const std::string& path) {
+        std::ifstream in(path);
+        std::stringstream text;
+        text << in.rdbuf();
+        return text.str();
+    }
+
+    // Parse a command line given as a list of arguments
+    int parse(std::vector<const char*> args, Options* opts) {
+        args.insert(args.begin(), "pl0_parser");
+        return parse_command_line((int)args.size(), const_cast<char**>(args.data()), opts);
+    }
+
+    void start_server() {
+        server = fork();
+        ASSERT_GE(server, 0);
+        if (server == 0) _exit(run_server(socket_path.c_str()));
+
+        // Wait until the server accepts connections
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socket_path.c_str());
+        for (int i = 0; i < 500; i++) {
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            bool up = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+            close(fd);
+            if (up) return;
+            usleep(10000);
+        }
+        FAIL() << "server did not start";
+    }
+
+    // Returns the server's exit status
+    int stop_server() {
+        if (server <= 0) return -1;
+        kill(server, SIGTERM);
+        int status = 0;
+        waitpid(server, &status, 0);
+        server = 0;
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+
+    // Run a command line through run_client with stdout going to a file
+    int run_client_to(const std::string& out_path, std::vector<const char*> args) {
+        args.insert(args.begin(), "pl0_parser");
+        fflush(stdout);
+        int saved = dup(STDOUT_FILENO);
+        int out = open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(out, STDOUT_FILENO);
+        close(out);
+        int status = run_client(socket_path.c_str(), (int)args.size(),
+                                const_cast<char**>(args.data()));
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        return status;
+    }
+
+    // Start run_client in a child with the streams given; returns its pid
+    pid_t spawn_client(int in, const std::string& out_path, const std::string& err_path,
+                       std::vector<const char*> args) {
+        args.insert(args.begin(), "pl0_parser");
+        args.push_back(nullptr);
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid == 0) {
+            int out = open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            int err = open(err_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            dup2(in, STDIN_FILENO);
+            dup2(out, STDOUT_FILENO);
+            dup2(err, STDERR_FILENO);
+            _exit(run_client(socket_path.c_str(), (int)args.size() - 1,
+                             const_cast<char**>(args.data())));
+        }
+        return pid;
+    }
+
+    static int wait_exit_status(pid_t pid) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+
+    static std::string fd_target(pid_t pid, int fd) {
+        std::string link = "/proc/" + std::to_string(pid) + "/fd/" + std::to_string(fd);
+        char target[256];
+        ssize_t n = readlink(link.c_str(), target, sizeof(target));
+        return n > 0 ? std::string(target, (size_t)n) : std::string();
+    }
+
+    // The server's worker process, or 0 while it has none
+    pid_t worker_pid() {
+        std::string id = std::to_string(server);
+        std::ifstream children("/proc/" + id + "/task/" + id + "/children");
+        pid_t pid = 0;
+        children >> pid;
+        return pid;
+    }
+
+    std::string dir;
+    std::string socket_path;
+    pid_t server = 0;
+};
+
+TEST_F(ServerTest, CommandLineStatus) {
+    Options opts;
+    EXPECT_EQ(parse({"--help"}, &opts), 0);
+    EXPECT_EQ(parse({"--no-such-option", "a.pl0"}, &opts), 1);
+    EXPECT_EQ(parse({}, &opts), 1);
+    EXPECT_EQ(parse({"--input-file", "in.txt", "a.pl0"}, &opts), 1);
+    EXPECT_EQ(parse({"--hash-cons", "--jobs=2", "a.pl0"}, &opts), 1);
+    EXPECT_EQ(parse({"--hash-cons", "--jobs=1", "--prelex", "a.pl0"}, &opts), -1);
+    EXPECT_TRUE(opts.hash_cons);
+
+    EXPECT_EQ(parse({"--input-file", "in.txt", "a.pl0", "--interpret"}, &opts), -1);
+    EXPECT_TRUE(opts.interpret);
+    EXPECT_STREQ(opts.program_input, "in.txt");
+    EXPECT_STREQ(opts.input_file, "a.pl0");
+
+    EXPECT_EQ(parse({"--max-steps=1000", "a.pl0"}, &opts), 1);
+    EXPECT_EQ(parse({"--interpret", "--max-steps=-1", "a.pl0"}, &opts), 1);
+    EXPECT_EQ(parse({"--interpret", "--max-depth=0x10", "a.pl0"}, &opts), 1);
+    EXPECT_EQ(parse({"--interpret", "--max-steps=1000", "--max-depth=64", "a.pl0"}, &opts), -1);
+    EXPECT_EQ(opts.max_steps, 1000u);
+    EXPECT_EQ(opts.max_depth, 64);
+    EXPECT_TRUE(opts.exec_stats);
+}
+
+TEST_F(ServerTest, ClientRunsLocallyWithoutServer) {
+    std::string program = write_file("sum.pl0", "VAR x; BEGIN READ x; WRITE x + 1 END.");
+    std::string input = write_file("in.txt", "41\n");
+    std::string out = dir + "/out.txt";
+
+    EXPECT_EQ(run_client_to(out, {"--interpret", "--input-file", input.c_str(),
+                                  program.c_str()}), 0);
+    EXPECT_EQ(read_file(out), "42\n");
+}
+
+TEST_F(ServerTest, RequestsRunOnServer) {
+    std::string program = write_file("sum.pl0", "VAR x; BEGIN READ x; WRITE x * 2 END.");
+    std::string broken = write_file("broken.pl0", "VAR x; BEGIN y := 1 END.");
+    std::string input = write_file("in.txt", "21\n");
+    std::string out = dir + "/out.txt";
+    start_server();
+
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(run_client_to(out, {"--interpret", "--input-file", input.c_str(),
+                                      program.c_str()}), 0);
+        EXPECT_EQ(read_file(out), "42\n");
+
+        // Failures come back as the exit status
+        EXPECT_EQ(run_client_to(out, {"--interpret", broken.c_str()}), 1);
+        EXPECT_EQ(run_client_to(out, {"--no-such-option"}), 1);
+    }
+
+    EXPECT_EQ(stop_server(), 0);
+    EXPECT_NE(access(socket_path.c_str(), F_OK), 0);
+}
+
+TEST_F(ServerTest, StaleSocketIsReported) {
+    // A socket file left behind by a server that is gone
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path.c_str());
+    ASSERT_EQ(bind(fd, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    close(fd);
+
+    std::string program = write_file("one.pl0", "BEGIN WRITE 1 END.");
+    std::string out = dir + "/out.txt";
+    std::string err = dir + "/err.txt";
+    pid_t client = spawn_client(STDIN_FILENO, out, err, {"--interpret", program.c_str()});
+    EXPECT_EQ(wait_exit_status(client), 0);
+    EXPECT_EQ(read_file(out), "1\n");
+    EXPECT_NE(read_file(err).find("No server is listening at " + socket_path),
+              std::string::npos);
+}
+
+TEST_F(ServerTest, CrashEndsOnlyTheRequest) {
+    std::string waiting = write_file("wait.pl0", "VAR x; BEGIN READ x; WRITE x END.");
+    std::string program = write_file("sum.pl0", "VAR x; BEGIN READ x; WRITE x * 2 END.");
+    std::string input = write_file("in.txt", "21\n");
+    std::string out = dir + "/out.txt";
+    std::string err = dir + "/err.txt";
+    start_server();
+
+    // The request blocks reading a pipe nobody writes to
+    int pipe_fds[2];
+    ASSERT_EQ(pipe(pipe_fds), 0);
+    pid_t client = spawn_client(pipe_fds[0], out, err, {"--interpret", waiting.c_str()});
+    close(pipe_fds[0]);
+
+    // Once the worker has taken over the client's stdin it runs the request
+    std::string pipe_id = fd_target(getpid(), pipe_fds[1]);
+    pid_t worker = 0;
+    for (int i = 0; i < 500 && !worker; i++) {
+        pid_t pid = worker_pid();
+        if (pid > 0 && fd_target(pid, STDIN_FILENO) == pipe_id) worker = pid;
+        else usleep(10000);
+    }
+    ASSERT_GT(worker, 0);
+    kill(worker, SIGKILL);
+
+    EXPECT_EQ(wait_exit_status(client), 128 + SIGKILL);
+    EXPECT_NE(read_file(err).find("terminated by signal 9"), std::string::npos);
+    close(pipe_fds[1]);
+
+    // The server is still there and runs the next request on a new worker
+    EXPECT_EQ(run_client_to(out, {"--interpret", "--input-file", input.c_str(),
+                                  program.c_str()}), 0);
+    EXPECT_EQ(read_file(out), "42\n");
+    EXPECT_NE(worker_pid(), worker);
+
+    EXPECT_EQ(stop_server(), 0);
+    EXPECT_NE(access(socket_path.c_str(), F_OK), 0);
+}
@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <vector>
+
+extern "C" {
+#include "task_pool.h"
+}
+
+static void increment(void* arg) {
+    static_cast<std::atomic<int>*>(arg)->fetch_add(1);
+}
+
+struct Fib {
+    TaskPool* pool;
+    int n;
+    long result;
+};
+
+// Fork/join Fibonacci: each task waits for the subtasks it submitted
+static void fib_task(void* arg) {
+    Fib* fib = static_cast<Fib*>(arg);
+    if (fib->n < 2) {
+        fib->result = fib->n;
+        return;
+    }
+    Fib a = { fib->pool, fib->n - 1, 0 };
+    Fib b = { fib->pool, fib->n - 2, 0 };
+    TaskGroup group = TASK_GROUP_INIT;
+    if (!submit_task(fib->pool, &group, fib_task, &a)) fib_task(&a);
+    fib_task(&b);
+    wait_task_group(fib->pool, &group);
+    fib->result = a.result + b.result;
+}
+
+TEST(TaskPoolTest, RunsAllTasks) {
+    TaskPool* pool = create_task_pool(4);
+    ASSERT_NE(pool, nullptr);
+    std::atomic<int> count(0);
+    TaskGroup group = TASK_GROUP_INIT;
+    for (int i = 0; i < 10000; i++) {
+        ASSERT_TRUE(submit_task(pool, &group, increment, &count));
+    }
+    wait_task_group(pool, &group);
+    EXPECT_EQ(count.load(), 10000);
+    free_task_pool(pool);
+}
+
+TEST(TaskPoolTest, NestedGroups) {
+    for (int threads : { 1, 2, 8 }) {
+        TaskPool* pool = create_task_pool(threads);
+        ASSERT_NE(pool, nullptr);
+        Fib fib = { pool, 20, 0 };
+        fib_task(&fib);
+        EXPECT_EQ(fib.result, 6765) << threads << " threads";
+        free_task_pool(pool);
+    }
+}
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+
+extern "C" {
+#include "driver.h"
+#include "trace.h"
+int yylex_destroy(void);
+}
+
+class TraceTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char tmpl[] = "/tmp/pl0-trace-XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+        trace_path = dir + "/trace.json";
+    }
+
+    void TearDown() override {
+        yylex_destroy();  // as main() does: runs leave the scanner its buffer
+        std::string command = "rm -rf " + dir;
+        ASSERT_EQ(system(command.c_str()), 0);
+    }
+
+    std::string read_file(const std::string& path) {
+        std::ifstream in(path);
+        std::stringstream text;
+        text << in.rdbuf();
+        return text.str();
+    }
+
+    static size_t count(const std::string& text, const std::string& what) {
+        size_t n = 0;
+        for (size_t at = text.find(what); at != std::string::npos; at = text.find(what, at + 1)) n++;
+        return n;
+    }
+
+    // The tids of the events in a trace
+    static std::set<std::string> thread_ids(const std::string& trace) {
+        std::set<std::string> tids;
+        const std::string key = "\"tid\":";
+        for (size_t at = trace.find(key); at != std::string::npos; at = trace.find(key, at + 1)) {
+            size_t start = at + key.size();
+            tids.insert(trace.substr(start, trace.find_first_not_of("0123456789", start) - start));
+        }
+        return tids;
+    }
+
+    std::string dir;
+    std::string trace_path;
+};
+
+TEST_F(TraceTest, RecordsNestedSpans) {
+    ASSERT_TRUE(start_trace());
+    trace_begin("outer", "a.pl0");
+    trace_begin("inner", nullptr);
+    trace_end();
+    trace_end();
+    ASSERT_TRUE(finish_trace(trace_path.c_str()));
+
+    std::string trace = read_file(trace_path);
+    EXPECT_EQ(trace.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0), 0u);
+    EXPECT_EQ(trace.substr(trace.size() - 4), "\n]}\n");
+    EXPECT_EQ(count(trace, "\"ph\":\"B\""), 2u);
+    EXPECT_EQ(count(trace, "\"ph\":\"E\""), 2u);
+    EXPECT_LT(trace.find("\"name\":\"outer\""), trace.find("\"name\":\"inner\""));
+    EXPECT_EQ(count(trace, "\"args\":{\"file\":\"a.pl0\"}"), 1u);
+    EXPECT_EQ(thread_ids(trace).size(), 1u);
+}
+
+TEST_F(TraceTest, ThreadsHaveTheirOwnIds) {
+    ASSERT_TRUE(start_trace());
+    trace_begin("main", nullptr);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([] {
+            for (int j = 0; j < 5000; j++) {
+                trace_begin("work", nullptr);
+                trace_end();
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    trace_end();
+    ASSERT_TRUE(finish_trace(trace_path.c_str()));
+
+    std::string trace = read_file(trace_path);
+    EXPECT_EQ(count(trace, "\"name\":\"work\""), 20000u);
+    EXPECT_EQ(count(trace, "\"ph\":\"E\""), 20001u);
+    EXPECT_EQ(thread_ids(trace).size(), 5u);
+}
+
+TEST_F(TraceTest, NothingRecordedWithoutATrace) {
+    trace_begin("before", nullptr);
+    trace_end();
+    ASSERT_TRUE(start_trace());
+    EXPECT_FALSE(start_trace());
+    ASSERT_TRUE(finish_trace(trace_path.c_str()));
+    trace_begin("after", nullptr);
+    trace_end();
+    EXPECT_EQ(read_file(trace_path), "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n]}\n");
+
+    // Threads record into a new buffer for each trace
+    ASSERT_TRUE(start_trace());
+    trace_begin("again", "quote\".pl0");
+    trace_end();
+    ASSERT_TRUE(finish_trace(trace_path.c_str()));
+    std::string trace = read_file(trace_path);
+    EXPECT_EQ(count(trace, "\"ph\":\"B\""), 1u);
+    EXPECT_NE(trace.find("\"file\":\"quote\\\".pl0\""), std::string::npos);
+}
+
+TEST_F(TraceTest, TracesThePipeline) {
+    std::string input = dir + "/input.pl0";
+    std::ofstream(input) << "VAR x; PROCEDURE p; VAR y; y := x; BEGIN x := 1; CALL p END.";
+    std::string trace_option = "--trace=" + trace_path;
+    std::string output = dir + "/output";
+    const char* argv[] = { "pl0_parser", trace_option.c_str(), "--prelex", "-o", output.c_str(),
+                           input.c_str(), nullptr };
+    ASSERT_EQ(run_command(6, const_cast<char**>(argv)), 0);
+
+    std::string trace = read_file(trace_path);
+    for (const char* phase : { "run_pipeline", "read input", "scan", "parse", "run_type_checking",
+                               "run_semantic_analysis", "run_dataflow_analysis", "cleanup" }) {
+        EXPECT_NE(trace.find(std::string("{\"name\":\"") + phase + "\""), std::string::npos)
+            << phase;
+    }
+    EXPECT_EQ(count(trace, "\"ph\":\"B\""), count(trace, "\"ph\":\"E\""));
+    EXPECT_EQ(count(trace, "\"args\":{\"file\":\"" + input + "\"}"), count(trace, "\"ph\":\"B\""));
+
+    // A failing run is traced up to the failure
+    std::ofstream(input) << "VAR x; y := 1.";
+    ASSERT_EQ(run_command(6, const_cast<char**>(argv)), 1);
+    trace = read_file(trace_path);
+    EXPECT_NE(trace.find("\"name\":\"run_semantic_analysis\""), std::string::npos);
+    EXPECT_EQ(trace.find("\"name\":\"run_dataflow_analysis\""), std::string::npos);
+    EXPECT_EQ(count(trace, "\"ph\":\"B\""), count(trace, "\"ph\":\"E\""));
+
+    const char* empty[] = { "pl0_parser", "--trace=", input.c_str(), nullptr };
+    EXPECT_EQ(run_command(3, const_cast<char**>(empty)), 1);
+}
@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+extern "C" {
+#include "ast.h"
+#include "cst.h"
+#include "semantic.h"
+#include "xref.h"
+extern Node* ast_root;
+extern int parse_error_count;
+}
+
+class XrefTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char tmpl[] = "/tmp/pl0-xref-XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+        index_path = dir + "/index";
+        builder = create_xref_builder();
+        ASSERT_NE(builder, nullptr);
+    }
+
+    void TearDown() override {
+        close_xref_index(index);
+        free_xref_builder(builder);
+        std::string command = "rm -rf " + dir;
+        ASSERT_EQ(system(command.c_str()), 0);
+    }
+
+    // Parse and analyze source and add it to the builder as path
+    void add(const std::string& path, const std::string& source, bool valid = true) {
+        TokenBuffer* tokens = create_token_buffer(source.data(), source.size());
+        ASSERT_NE(tokens, nullptr);
+        ASSERT_EQ(parse_tokens(tokens), 0);
+        ASSERT_EQ(parse_error_count, 0);
+        SemanticContext* ctx = create_semantic_context();
+        EXPECT_EQ(analyze_semantics(ctx, ast_root), valid);
+        int source_number = xref_add_source(builder, path.c_str(), 1, source.size());
+        EXPECT_GE(source_number, 0);
+        EXPECT_TRUE(xref_add_tree(builder, source_number, tokens, ast_root));
+        free_semantic_context(ctx);
+        free_ast(ast_root);
+        ast_root = nullptr;
+        free_token_buffer(tokens);
+    }
+
+    // Write the builder's index, start a new builder and open the index
+    void write_and_open() {
+        ASSERT_TRUE(write_xref_index(builder, index_path.c_str())) << builder->error_msg;
+        free_xref_builder(builder);
+        builder = create_xref_builder();
+        close_xref_index(index);
+        char error_msg[256];
+        index = open_xref_index(index_path.c_str(), error_msg, sizeof(error_msg));
+        ASSERT_NE(index, nullptr) << error_msg;
+    }
+
+    // The entries of name as "file:line:column role definition" lines
+    std::string query(const char* name) {
+        const XrefName* found = xref_find_name(index, name);
+        std::string result;
+        for (uint32_t i = 0; found && i < found->entry_count; i++) {
+            const XrefEntry& entry = index->entries[found->first_entry + i];
+            result += std::string(xref_string(index, index->files[entry.file].path)) + ":" +
+                      std::to_string(entry.line) + ":" + std::to_string(entry.column) + " " +
+                      xref_role_name((XrefRole)entry.role) + " " +
+                      std::to_string(entry.definition) + "\n";
+        }
+        return result;
+    }
+
+    std::string read_file(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream text;
+        text << in.rdbuf();
+        return text.str();
+    }
+
+    std::string dir;
+    std::string index_path;
+    XrefBuilder* builder = nullptr;
+    XrefIndex* index = nullptr;
+};
+
+TEST_F(XrefTest, RecordsDefinitionsAndUses) {
+    add("a.pl0", "CONST n = 3;\n"
+                 "VAR x;\n"
+                 "PROCEDURE p;\n"
+                 "  x := x + n;\n"
+                 "BEGIN\n"
+                 "  READ x;\n"
+                 "  CALL p;\n"
+                 "  WRITE x\n"
+                 "END.\n");
+    write_and_open();
+    EXPECT_EQ(index->header->file_count, 1u);
+    EXPECT_EQ(index->header->name_count, 3u);
+    EXPECT_EQ(query("x"), "a.pl0:2:5 define 17\n"
+                          "a.pl0:4:3 write 17\n"
+                          "a.pl0:4:8 read 17\n"
+                          "a.pl0:6:8 write 17\n"
+                          "a.pl0:8:9 read 17\n");
+    EXPECT_EQ(query("p"), "a.pl0:3:11 define 30\n"
+                          "a.pl0:7:8 call 30\n");
+    EXPECT_EQ(query("n"), "a.pl0:1:7 define 6\n"
+                          "a.pl0:4:12 read 6\n");
+    EXPECT_EQ(index->entries[xref_find_name(index, "p")->first_entry].kind, SYM_PROCEDURE);
+    EXPECT_EQ(xref_find_name(index, "y"), nullptr);
+}
+
+// Uses name the definition they resolve to, so a local variable and a
+// global one of the same name stay apart
+TEST_F(XrefTest, ShadowedNamesKeepTheirDefinitions) {
+    add("s.pl0", "VAR x; PROCEDURE p; VAR x; x := 1; BEGIN x := 2; CALL p END.");
+    write_and_open();
+    EXPECT_EQ(query("x"), "s.pl0:1:5 define 4\n"
+                          "s.pl0:1:25 define 24\n"
+                          "s.pl0:1:28 write 24\n"
+                          "s.pl0:1:42 write 4\n");
+}
+
+TEST_F(XrefTest, EntriesAreSortedByFile) {
+    add("b.pl0", "VAR x; x := 1.");
+    add("a.pl0", "VAR x; WRITE x.");
+    add("c.pl0", "CONST y = 1; WRITE y.");
+    write_and_open();
+    EXPECT_EQ(query("x"), "a.pl0:1:5 define 4\n"
+                          "a.pl0:1:14 read 4\n"
+                          "b.pl0:1:5 define 4\n"
+                          "b.pl0:1:8 write 4\n");
+    EXPECT_EQ(xref_find_file(index, "a.pl0"), 0);
+    EXPECT_EQ(xref_find_file(index, "c.pl0"), 2);
+    EXPECT_EQ(xref_find_file(index, "d.pl0"), -1);
+    EXPECT_EQ(index->files[1].entry_count, 2u);
+}
+
+// After a semantic error only what was resolved before it is indexed
+TEST_F(XrefTest, IndexesUpToASemanticError) {
+    add("e.pl0", "VAR x; BEGIN x := 1; y := 2; x := 3 END.", false);
+    write_and_open();
+    EXPECT_EQ(query("x"), "e.pl0:1:5 define 4\n"
+                          "e.pl0:1:14 write 4\n");
+    EXPECT_EQ(xref_find_name(index, "y"), nullptr);
+}
+
+// Reusing the entries of unchanged files gives the index parsing them
+// again would
+TEST_F(XrefTest, ReusedFilesMatchParsedOnes) {
+    const char* a = "VAR x; PROCEDURE p; x := x * 2; BEGIN READ x; CALL p END.";
+    const char* b = "CONST x = 7; VAR p; p := x.";
+    add("a.pl0", a);
+    add("b.pl0", b);
+    add("c.pl0", "VAR z; z := 1.");
+    write_and_open();
+    std::string original = read_file(index_path);
+
+    // Keep a and b, drop c
+    std::vector<int> sources(index->header->file_count, -1);
+    sources[xref_find_file(index, "b.pl0")] = xref_add_source(builder, "b.pl0", 1, strlen(b));
+    sources[xref_find_file(index, "a.pl0")] = xref_add_source(builder, "a.pl0", 1, strlen(a));
+    ASSERT_TRUE(xref_reuse(builder, index, sources.data()));
+    write_and_open();
+    std::string reused = read_file(index_path);
+    EXPECT_EQ(xref_find_name(index, "z"), nullptr);
+
+    add("a.pl0", a);
+    add("b.pl0", b);
+    write_and_open();
+    EXPECT_EQ(read_file(index_path), reused);
+    EXPECT_NE(reused, original);
+}
+
+TEST_F(XrefTest, RejectsOtherFiles) {
+    char error_msg[256];
+    std::ofstream(index_path) << "not an index";
+    EXPECT_EQ(open_xref_index(index_path.c_str(), error_msg, sizeof(error_msg)), nullptr);
+    EXPECT_NE(std::string(error_msg).find("not a PL/0 index"), std::string::npos);
+
+    // A truncated index
+    add("a.pl0", "VAR x; x := 1.");
+    write_and_open();
+    std::string data = read_file(index_path);
+    std::ofstream(index_path, std::ios::binary) << data.substr(0, data.size() - 1);
+    EXPECT_EQ(open_xref_index(index_path.c_str(), error_msg, sizeof(error_msg)), nullptr);
+
+    EXPECT_EQ(open_xref_index((dir + "/missing").c_str(), error_msg, sizeof(error_msg)), nullptr);
+    EXPECT_NE(std::string(error_msg).find("Cannot open"), std::string::npos);
+}
+
+TEST_F(XrefTest, EmptyIndex) {
+    write_and_open();
+    EXPECT_EQ(index->header->file_count, 0u);
+    EXPECT_EQ(xref_find_name(index, "x"), nullptr);
+    EXPECT_EQ(xref_find_file(index, "a.pl0"), -1);
+}